@@ -10,6 +10,7 @@
 #include "shared/piscsi_exceptions.h"
 #include "devices/primary_device.h"
 #include "abstract_controller.h"
+#include "buffer_pool.h"
 #include <ranges>
 
 using namespace scsi_defs;
@@ -29,7 +30,28 @@ void AbstractController::AllocateCmd(size_t size)
 void AbstractController::AllocateBuffer(size_t size)
 {
 	if (size > ctrl.buffer.size()) {
-		ctrl.buffer.resize(size);
+		vector<uint8_t> buffer = BufferPool::Acquire(size);
+		ranges::copy(ctrl.buffer, buffer.begin());
+		BufferPool::Release(std::move(ctrl.buffer));
+		ctrl.buffer = std::move(buffer);
+		buffer_capacity = ctrl.buffer.capacity();
+	}
+}
+
+void AbstractController::SetResidentBufferSize(size_t size)
+{
+	resident_buffer_size = size;
+
+	AllocateBuffer(size);
+}
+
+void AbstractController::ReleaseBuffer()
+{
+	// A buffer enlarged for a single command is returned to the pool
+	if (resident_buffer_size && ctrl.buffer.size() > resident_buffer_size) {
+		BufferPool::Release(std::move(ctrl.buffer));
+		ctrl.buffer = vector<uint8_t>(resident_buffer_size);
+		buffer_capacity = ctrl.buffer.capacity();
 	}
 }
 
@@ -61,7 +83,12 @@ void AbstractController::Reset()
 {
 	SetPhase(phase_t::busfree);
 
+	// The transfer buffer must survive a reset
+	vector<uint8_t> buffer = std::move(ctrl.buffer);
 	ctrl = {};
+	ctrl.buffer = std::move(buffer);
+	buffer_capacity = ctrl.buffer.capacity();
+	ReleaseBuffer();
 
 	SetByteTransfer(false);
 
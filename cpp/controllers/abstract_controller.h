@@ -15,6 +15,8 @@
 #include "hal/bus.h"
 #include "phase_handler.h"
 #include "devices/device_logger.h"
+#include "generated/piscsi_interface.pb.h"
+#include <atomic>
 #include <unordered_set>
 #include <unordered_map>
 #include <span>
@@ -23,6 +25,7 @@
 #include <functional>
 
 using namespace std;
+using namespace piscsi_interface;
 
 class PrimaryDevice;
 
@@ -50,6 +53,9 @@ public:
 	// Get requested LUN based on IDENTIFY message, with LUN from the CDB as fallback
 	virtual int GetEffectiveLun() const = 0;
 
+	// Statistics collected by the controller for a LUN
+	virtual vector<PbStatistics> GetStatistics(int) const { return vector<PbStatistics>(); }
+
 	void ScheduleShutdown(piscsi_shutdown_mode mode) { shutdown_mode = mode; }
 	piscsi_shutdown_mode GetShutdownMode() const { return shutdown_mode; }
 
@@ -67,6 +73,8 @@ public:
 	// TODO These should probably be extracted into a new TransferHandler class
 	void AllocateBuffer(size_t);
 	auto& GetBuffer() { return ctrl.buffer; }
+	// The buffer is only accessed by the bus thread, the size can also be read by other threads
+	size_t GetBufferSize() const { return buffer_capacity; }
 	auto GetStatus() const { return ctrl.status; }
 	void SetStatus(scsi_defs::status s) { ctrl.status = s; }
 	auto GetLength() const { return ctrl.length; }
@@ -95,6 +103,10 @@ protected:
 
 	void AllocateCmd(size_t);
 
+	// The buffer size required by all commands, larger buffers are released when a command has finished
+	void SetResidentBufferSize(size_t);
+	void ReleaseBuffer();
+
 	void SetCmdByte(int index, int value) { ctrl.cmd[index] = value; }
 
 	// TODO These should probably be extracted into a new TransferHandler class
@@ -103,7 +115,12 @@ protected:
 	void ResetOffset() { ctrl.offset = 0; }
 	void UpdateOffsetAndLength() { ctrl.offset += ctrl.length; ctrl.length = 0; }
 
+	bool IsTraceEnabled() const { return device_logger.IsTraceEnabled(); }
 	void LogTrace(const string& s) const { device_logger.Trace(s); }
+	void LogTrace(TraceLog::trace_event event, uint64_t value1, uint32_t value2 = 0, span<const uint8_t> data = {}) const
+	{
+		device_logger.Trace(event, value1, value2, data);
+	}
 	void LogDebug(const string& s) const { device_logger.Debug(s); }
 	void LogInfo(const string& s) const { device_logger.Info(s); }
 	void LogWarn(const string& s) const { device_logger.Warn(s); }
@@ -130,6 +147,11 @@ private:
 
 	ctrl_t ctrl = {};
 
+	size_t resident_buffer_size = 0;
+
+	// Updated whenever the buffer is replaced
+	atomic<size_t> buffer_capacity = 0;
+
 	BUS& bus;
 
 	DeviceLogger device_logger;
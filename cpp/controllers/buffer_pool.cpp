@@ -0,0 +1,114 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "buffer_pool.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <malloc.h>
+
+using namespace std;
+
+vector<uint8_t> BufferPool::Acquire(size_t size)
+{
+	if (size >= MIN_POOLED_SIZE) {
+		scoped_lock<mutex> lock(pool_mutex);
+
+		// The smallest buffer that is large enough
+		auto best = buffers.end();
+		for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+			if (it->buffer.capacity() >= size && (best == buffers.end() ||
+					it->buffer.capacity() < best->buffer.capacity())) {
+				best = it;
+			}
+		}
+
+		if (best != buffers.end()) {
+			vector<uint8_t> buffer = std::move(best->buffer);
+			pooled_bytes -= buffer.capacity();
+			buffers.erase(best);
+
+			buffer.resize(size);
+
+			return buffer;
+		}
+	}
+
+	return vector<uint8_t>(size);
+}
+
+void BufferPool::Release(vector<uint8_t>&& buffer)
+{
+	if (buffer.capacity() < MIN_POOLED_SIZE) {
+		return;
+	}
+
+	scoped_lock<mutex> lock(pool_mutex);
+
+	// The oldest buffers are freed first
+	while (!buffers.empty() && pooled_bytes + buffer.capacity() > MAX_POOLED_BYTES) {
+		pooled_bytes -= buffers.front().buffer.capacity();
+		buffers.erase(buffers.begin());
+	}
+
+	if (buffer.capacity() > MAX_POOLED_BYTES) {
+		return;
+	}
+
+	pooled_bytes += buffer.capacity();
+	buffers.push_back({ .buffer = std::move(buffer), .released = chrono::steady_clock::now() });
+
+	if (!trimmer.joinable()) {
+		trimmer = jthread([] (stop_token st) {
+			while (!st.stop_requested()) {
+				{
+					unique_lock<mutex> l(pool_mutex);
+					idle.wait_for(l, st, chrono::milliseconds(IDLE_TIMEOUT_MS), [] { return false; });
+				}
+
+				Trim();
+			}
+		});
+	}
+}
+
+size_t BufferPool::GetPooledByteCount()
+{
+	scoped_lock<mutex> lock(pool_mutex);
+
+	return pooled_bytes;
+}
+
+size_t BufferPool::GetPooledBufferCount()
+{
+	scoped_lock<mutex> lock(pool_mutex);
+
+	return buffers.size();
+}
+
+void BufferPool::Trim(int timeout_ms)
+{
+	scoped_lock<mutex> lock(pool_mutex);
+
+	const auto now = chrono::steady_clock::now();
+	const auto count = erase_if(buffers, [&] (const pooled_buffer& b) {
+		if (now - b.released < chrono::milliseconds(timeout_ms)) {
+			return false;
+		}
+
+		pooled_bytes -= b.buffer.capacity();
+		return true;
+	});
+
+	if (count) {
+		spdlog::trace("Freed " + to_string(count) + " idle transfer buffer(s)");
+
+		// Large freed blocks may otherwise remain part of the heap
+		malloc_trim(0);
+	}
+}
@@ -0,0 +1,64 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Pool for large transfer buffers, which are only required by some commands (e.g. SCSIBR file system access).
+// Released buffers are kept for being re-used by the next large command and are freed when they have not been
+// used for some time.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+using namespace std;
+
+class BufferPool
+{
+	// Smaller buffers are not worth being pooled
+	static const size_t MIN_POOLED_SIZE = 64 * 1024;
+
+	// The size of the largest transfer buffer (SCSIBR) and one more
+	static const size_t MAX_POOLED_BYTES = 32 * 1024 * 1024;
+
+	// How long a released buffer is kept
+	static const int IDLE_TIMEOUT_MS = 2000;
+
+	struct pooled_buffer {
+		vector<uint8_t> buffer;
+		chrono::steady_clock::time_point released;
+	};
+
+public:
+
+	// The buffer content is undefined
+	static vector<uint8_t> Acquire(size_t);
+	static void Release(vector<uint8_t>&&);
+
+	static size_t GetPooledByteCount();
+	static size_t GetPooledBufferCount();
+
+	// Frees the buffers idle for longer than the timeout, all if the timeout is 0
+	static void Trim(int = IDLE_TIMEOUT_MS);
+
+private:
+
+	static inline vector<pooled_buffer> buffers;
+
+	static inline size_t pooled_bytes;
+
+	static inline mutex pool_mutex;
+	static inline condition_variable_any idle;
+
+	// Only started when a buffer has been pooled
+	static inline jthread trimmer;
+};
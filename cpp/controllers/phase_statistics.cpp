@@ -0,0 +1,117 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "hal/bus.h"
+#include "phase_statistics.h"
+#include <bit>
+#include <sstream>
+#include <iomanip>
+
+void PhaseStatistics::EnterPhase(phase_t p, uint32_t timestamp)
+{
+	if (phase != phase_t::busfree) {
+		// A phase may be entered more than once during a command, e.g. MESSAGE IN
+		current.durations[static_cast<int>(phase)] += timestamp - phase_start;
+		current.phases[static_cast<int>(phase)] = true;
+	}
+
+	phase = p;
+	phase_start = timestamp;
+
+	if (phase == phase_t::busfree) {
+		AddCommand();
+	}
+}
+
+void PhaseStatistics::Reset()
+{
+	current = {};
+	phase = phase_t::busfree;
+}
+
+void PhaseStatistics::AddCommand()
+{
+	// Without a command (e.g. an aborted selection) there is no device to assign the timing to
+	if (current.lun != -1 && current.opcode != -1) {
+		scoped_lock<mutex> lock(statistics_locker);
+
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			const auto p = static_cast<phase_t>(i);
+
+			if (current.phases[i]) {
+				histograms[{ current.lun, current.opcode, p }][GetBucket(current.durations[i])]++;
+			}
+
+			if (current.byte_counts[i]) {
+				byte_counts[{ current.lun, p }] += current.byte_counts[i];
+			}
+		}
+	}
+
+	current = {};
+}
+
+vector<PbStatistics> PhaseStatistics::GetStatistics(int id, int lun) const
+{
+	vector<PbStatistics> statistics;
+
+	scoped_lock<mutex> lock(statistics_locker);
+
+	for (const auto& [key, h] : histograms) {
+		const auto& [l, opcode, p] = key;
+		if (l != lun) {
+			continue;
+		}
+
+		string command;
+		if (const auto& it = command_mapping.find(static_cast<scsi_command>(opcode)); it != command_mapping.end()) {
+			command = it->second.second;
+		}
+		else {
+			stringstream s;
+			s << "$" << setfill('0') << setw(2) << hex << opcode;
+			command = s.str();
+		}
+
+		PbStatistics s;
+		s.set_id(id);
+		s.set_unit(lun);
+		s.set_category(PbStatisticsCategory::CATEGORY_INFO);
+		s.set_key(string("latency_") + BUS::GetPhaseStrRaw(p) + "_" + command);
+		uint64_t count = 0;
+		for (const auto bucket : h) {
+			s.add_histogram(bucket);
+			count += bucket;
+		}
+		s.set_value(count);
+		statistics.push_back(s);
+	}
+
+	for (const auto& [key, count] : byte_counts) {
+		if (key.first != lun) {
+			continue;
+		}
+
+		PbStatistics s;
+		s.set_id(id);
+		s.set_unit(lun);
+		s.set_category(PbStatisticsCategory::CATEGORY_INFO);
+		s.set_key(string(BUS::GetPhaseStrRaw(key.second)) + "_byte_count");
+		s.set_value(count);
+		statistics.push_back(s);
+	}
+
+	return statistics;
+}
+
+int PhaseStatistics::GetBucket(uint32_t duration)
+{
+	// The number of significant bits of the duration in us determines the bucket
+	return min(max(static_cast<int>(bit_width(duration)) - protobuf_util::HISTOGRAM_MIN_BUCKET_BITS, 0), BUCKET_COUNT - 1);
+}
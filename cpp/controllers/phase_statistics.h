@@ -0,0 +1,78 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Per-phase latency histograms and byte counts of the SCSI commands processed by a controller.
+// The timing of the current command is collected without locking and is added to the
+// histograms when the bus becomes free, i.e. once per command.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "shared/scsi.h"
+#include "shared/protobuf_util.h"
+#include "generated/piscsi_interface.pb.h"
+#include <cstdint>
+#include <array>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+using namespace scsi_defs;
+using namespace piscsi_interface;
+
+class PhaseStatistics
+{
+	static const int PHASE_COUNT = static_cast<int>(phase_t::reserved) + 1;
+
+public:
+
+	// Bucket n counts durations of less than 2^(n + HISTOGRAM_MIN_BUCKET_BITS) us, the last bucket counts all longer durations
+	static constexpr int BUCKET_COUNT = 16;
+
+	using histogram = array<uint64_t, BUCKET_COUNT>;
+
+	PhaseStatistics() = default;
+	~PhaseStatistics() = default;
+
+	// These methods are called by the bus thread
+	void EnterPhase(phase_t, uint32_t);
+	void SetCommand(int lun, int opcode) { current.lun = lun; current.opcode = opcode; }
+	void AddBytes(phase_t phase, uint32_t count) { current.byte_counts[static_cast<int>(phase)] += count; }
+	void Reset();
+
+	vector<PbStatistics> GetStatistics(int, int) const;
+
+	static int GetBucket(uint32_t);
+
+private:
+
+	void AddCommand();
+
+	struct command_timing {
+		int lun = -1;
+		int opcode = -1;
+		array<uint32_t, PHASE_COUNT> durations = {};
+		array<bool, PHASE_COUNT> phases = {};
+		array<uint64_t, PHASE_COUNT> byte_counts = {};
+	};
+
+	command_timing current;
+
+	phase_t phase = phase_t::busfree;
+	uint32_t phase_start = 0;
+
+	// Histograms per LUN, opcode and phase
+	map<tuple<int, int, phase_t>, histogram> histograms;
+
+	// Byte counts per LUN and phase
+	map<pair<int, phase_t>, uint64_t> byte_counts;
+
+	mutable mutex statistics_locker;
+};
@@ -34,7 +34,7 @@ ScsiController::ScsiController(BUS& bus, int target_id) : AbstractController(bus
 {
 	// The initial buffer size will default to either the default buffer size OR
 	// the size of an Ethernet message, whichever is larger.
-	AllocateBuffer(std::max(DEFAULT_BUFFER_SIZE, ETH_FRAME_LEN + 16 + ETH_FCS_LEN));
+	SetResidentBufferSize(std::max(DEFAULT_BUFFER_SIZE, ETH_FRAME_LEN + 16 + ETH_FCS_LEN));
 }
 
 void ScsiController::Reset()
@@ -46,6 +46,8 @@ void ScsiController::Reset()
 	initiator_id = UNKNOWN_INITIATOR_ID;
 
 	scsi = {};
+
+	phase_statistics.Reset();
 }
 
 bool ScsiController::Process(int id)
@@ -80,7 +82,7 @@ void ScsiController::BusFree()
 {
 	if (!IsBusFree()) {
 		LogTrace("Bus Free phase");
-		SetPhase(phase_t::busfree);
+		EnterPhase(phase_t::busfree);
 
 		GetBus().SetREQ(false);
 		GetBus().SetMSG(false);
@@ -99,6 +101,8 @@ void ScsiController::BusFree()
 
 		SetByteTransfer(false);
 
+		ReleaseBuffer();
+
 		return;
 	}
 
@@ -108,11 +112,37 @@ void ScsiController::BusFree()
 	}
 }
 
+vector<PbStatistics> ScsiController::GetStatistics(int lun) const
+{
+	vector<PbStatistics> statistics = phase_statistics.GetStatistics(GetTargetId(), lun);
+
+	// The transfer buffer is shared by all LUNs
+	PbStatistics s;
+	s.set_id(GetTargetId());
+	s.set_unit(lun);
+	s.set_category(PbStatisticsCategory::CATEGORY_INFO);
+	s.set_key("transfer_buffer_byte_count");
+	s.set_value(GetBufferSize());
+	statistics.push_back(s);
+
+	return statistics;
+}
+
+void ScsiController::EnterPhase(phase_t phase)
+{
+	SetPhase(phase);
+
+	// The system timer is only available on a Pi
+	if (SysTimer::IsInitialized()) {
+		phase_statistics.EnterPhase(phase, SysTimer::GetTimerLow());
+	}
+}
+
 void ScsiController::Selection()
 {
 	if (!IsSelection()) {
 		LogTrace("Selection phase");
-		SetPhase(phase_t::selection);
+		EnterPhase(phase_t::selection);
 
 		// Raise BSY and respond
 		GetBus().SetBSY(true);
@@ -136,7 +166,7 @@ void ScsiController::Command()
 {
 	if (!IsCommand()) {
 		LogTrace("Command phase");
-		SetPhase(phase_t::command);
+		EnterPhase(phase_t::command);
 
 		GetBus().SetMSG(false);
 		GetBus().SetCD(true);
@@ -164,6 +194,8 @@ void ScsiController::Command()
 			return;
 		}
 
+		phase_statistics.AddBytes(phase_t::command, actual_count);
+
 		// Command data transfer
 		AllocateCmd(command_byte_count);
 		for (int i = 0; i < command_byte_count; i++) {
@@ -178,7 +210,7 @@ void ScsiController::Command()
 
 void ScsiController::Execute()
 {
-    if (spdlog::get_level() == spdlog::level::trace) {
+    if (IsTraceEnabled()) {
         stringstream s;
         s << "Controller is executing " << command_mapping.find(GetOpcode())->second.second << ", CDB $"
             << setfill('0') << hex;
@@ -193,6 +225,8 @@ void ScsiController::Execute()
 	SetBlocks(1);
 	execstart = SysTimer::GetTimerLow();
 
+	phase_statistics.SetCommand(GetEffectiveLun(), static_cast<int>(GetOpcode()));
+
 	// Discard pending sense data from the previous command if the current command is not REQUEST SENSE
 	if (GetOpcode() != scsi_command::eCmdRequestSense) {
 		SetStatus(status::good);
@@ -253,10 +287,8 @@ void ScsiController::Status()
 			SysTimer::SleepUsec(5);
 		}
 
-		stringstream s;
-		s << "Status phase, status is $" << setfill('0') << setw(2) << hex << static_cast<int>(GetStatus());
-		LogTrace(s.str());
-		SetPhase(phase_t::status);
+		LogTrace(TraceLog::trace_event::status, static_cast<int>(GetStatus()));
+		EnterPhase(phase_t::status);
 
 		// Signal line operated by the target
 		GetBus().SetMSG(false);
@@ -279,7 +311,7 @@ void ScsiController::MsgIn()
 {
 	if (!IsMsgIn()) {
 		LogTrace("Message In phase");
-		SetPhase(phase_t::msgin);
+		EnterPhase(phase_t::msgin);
 
 		GetBus().SetMSG(true);
 		GetBus().SetCD(true);
@@ -303,7 +335,7 @@ void ScsiController::MsgOut()
 		}
 
 		LogTrace("Message Out phase");
-		SetPhase(phase_t::msgout);
+		EnterPhase(phase_t::msgout);
 
 		GetBus().SetMSG(true);
 		GetBus().SetCD(true);
@@ -335,7 +367,7 @@ void ScsiController::DataIn()
 		}
 
 		LogTrace("Data In phase");
-		SetPhase(phase_t::datain);
+		EnterPhase(phase_t::datain);
 
 		GetBus().SetMSG(false);
 		GetBus().SetCD(false);
@@ -364,7 +396,7 @@ void ScsiController::DataOut()
 		}
 
 		LogTrace("Data Out phase");
-		SetPhase(phase_t::dataout);
+		EnterPhase(phase_t::dataout);
 
 		GetBus().SetMSG(false);
 		GetBus().SetCD(false);
@@ -433,7 +465,7 @@ void ScsiController::Send()
 	assert(GetBus().GetIO());
 
 	if (HasValidLength()) {
-		LogTrace("Sending data, offset: " + to_string(GetOffset()) + ", length: " + to_string(GetLength()));
+		LogTrace(TraceLog::trace_event::send, GetOffset(), GetLength());
 
 		// The delay should be taken from the respective LUN, but as there are no Daynaport drivers for
 		// LUNs other than 0 this work-around works.
@@ -445,6 +477,8 @@ void ScsiController::Send()
 			return;
 		}
 
+		phase_statistics.AddBytes(GetPhase(), GetLength());
+
 		UpdateOffsetAndLength();
 
 		return;
@@ -473,7 +507,9 @@ void ScsiController::Send()
 	}
 
 	// Move to next phase
-	LogTrace("All data transferred, moving to next phase: " + string(BUS::GetPhaseStrRaw(GetPhase())));
+	if (IsTraceEnabled()) {
+		LogTrace("All data transferred, moving to next phase: " + string(BUS::GetPhaseStrRaw(GetPhase())));
+	}
 	switch (GetPhase()) {
 		case phase_t::msgin:
 			// Completed sending response to extended message of IDENTIFY message
@@ -509,7 +545,7 @@ void ScsiController::Receive()
 	assert(!GetBus().GetIO());
 
 	if (HasValidLength()) {
-		LogTrace("Receiving data, transfer length: " + to_string(GetLength()) + " byte(s)");
+		LogTrace(TraceLog::trace_event::receive, GetLength());
 
 		// If not able to receive all, move to status phase
 		if (uint32_t len = GetBus().ReceiveHandShake(GetBuffer().data() + GetOffset(), GetLength()); len != GetLength()) {
@@ -518,6 +554,8 @@ void ScsiController::Receive()
 			Error(sense_key::aborted_command);
 			return;
 		}
+
+		phase_statistics.AddBytes(GetPhase(), GetLength());
 	}
 
 	if (IsByteTransfer()) {
@@ -534,7 +572,9 @@ void ScsiController::Receive()
 	bool result = true;
 
 	// Processing after receiving data (by phase)
-	LogTrace("Phase: " + string(BUS::GetPhaseStrRaw(GetPhase())));
+	if (IsTraceEnabled()) {
+		LogTrace("Phase: " + string(BUS::GetPhaseStrRaw(GetPhase())));
+	}
 	switch (GetPhase()) {
 		case phase_t::dataout:
 			if (!HasBlocks()) {
@@ -623,7 +663,9 @@ void ScsiController::ReceiveBytes()
 	bool result = true;
 
 	// Processing after receiving data (by phase)
-	LogTrace("Phase: " + string(BUS::GetPhaseStrRaw(GetPhase())));
+	if (IsTraceEnabled()) {
+		LogTrace("Phase: " + string(BUS::GetPhaseStrRaw(GetPhase())));
+	}
 	switch (GetPhase()) {
 		case phase_t::dataout:
 			result = XferOut(false);
@@ -702,8 +744,8 @@ void ScsiController::DataOutNonBlockOriented() const
 		case scsi_command::eCmdModeSelect10:
 			break;
 
+		case scsi_command::eCmdSetIfaceMode:
 		case scsi_command::eCmdSetMcastAddr:
-			// TODO: Eventually, we should store off the multicast address configuration data here...
 			break;
 
 		default:
@@ -725,9 +767,7 @@ bool ScsiController::XferIn(vector<uint8_t>& buf)
 {
 	assert(IsDataIn());
 
-	stringstream s;
-	s << "Command: $" << setfill('0') << setw(2) << hex << static_cast<int>(GetOpcode());
-	LogTrace(s.str());
+	LogTrace(TraceLog::trace_event::command, static_cast<int>(GetOpcode()));
 
 	const int lun = GetEffectiveLun();
 	if (!HasDeviceForLun(lun)) {
@@ -861,7 +901,19 @@ bool ScsiController::XferOutBlockOriented(bool cont)
 			break;
 		}
 
+		case scsi_command::eCmdSetIfaceMode:
+			if (auto daynaport = dynamic_pointer_cast<SCSIDaynaPort>(device); daynaport) {
+				daynaport->SetMacAddress(span(GetBuffer().data(), GetOffset()));
+			}
+
+			LogTrace("Done with DaynaPort Set MAC Address");
+			break;
+
 		case scsi_command::eCmdSetMcastAddr:
+			if (auto daynaport = dynamic_pointer_cast<SCSIDaynaPort>(device); daynaport) {
+				daynaport->SetMulticastAddresses(span(GetBuffer().data(), GetOffset()));
+			}
+
 			LogTrace("Done with DaynaPort Set Multicast Address");
 			break;
 
@@ -880,13 +932,10 @@ void ScsiController::ProcessCommand()
 {
 	const uint32_t len = GPIOBUS::GetCommandByteCount(GetBuffer()[0]);
 
-	stringstream s;
-	s << "CDB=$" << setfill('0') << setw(2) << hex;
 	for (uint32_t i = 0; i < len; i++) {
 		SetCmdByte(i, GetBuffer()[i]);
-		s << GetCmdByte(i);
 	}
-	LogTrace(s.str());
+	LogTrace(TraceLog::trace_event::cdb, 0, 0, span(GetBuffer().data(), len));
 
 	Execute();
 }
@@ -16,6 +16,7 @@
 
 #include "shared/scsi.h"
 #include "abstract_controller.h"
+#include "phase_statistics.h"
 #include <array>
 
 using namespace std;
@@ -64,6 +65,8 @@ public:
 
 	int GetInitiatorId() const override { return initiator_id; }
 
+	vector<PbStatistics> GetStatistics(int) const override;
+
 	// Phases
 	void BusFree() override;
 	void Selection() override;
@@ -85,6 +88,11 @@ private:
 	// The LUN from the IDENTIFY message
 	int identified_lun = -1;
 
+	// Per-phase latencies and byte counts
+	PhaseStatistics phase_statistics;
+
+	void EnterPhase(phase_t);
+
 	// Data transfer
 	void Send();
 	bool XferMsg(int);
@@ -19,12 +19,104 @@
 
 #include "cfilesystem.h"
 #include <sys/stat.h>
+#include <sys/inotify.h>
 #include <dirent.h>
 #include <iconv.h>
 #include <utime.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <array>
 
 #define ARRAY_SIZE(x) (sizeof(x)/(sizeof(x[0])))
 
+//---------------------------------------------------------------------------
+//
+//  Character tables for Human68k names
+//
+//---------------------------------------------------------------------------
+/// Shift-JIS first bytes, specifically 0x81~0x9F and 0xE0~0xEF
+static constexpr auto SJIS_LEAD = [] {
+	std::array<bool, 256> table = {};
+	for (int c = 0x80; c < 0x100; c++)
+		table[c] = c <= 0x9F || 0xE0 <= c;
+	return table;
+}();
+
+/// Characters for name comparisons: [0] folded to lower case, [1] case sensitive (WINDRV_OPT_ALPHABET).
+/// Slashes and backslashes are unified.
+static constexpr auto FOLD = [] {
+	std::array<std::array<uint8_t, 256>, 2> table = {};
+	for (int c = 0; c < 0x100; c++) {
+		const auto d = (uint8_t)(c == '\\' ? '/' : c);
+		table[0][c] = 'A' <= d && d <= 'Z' ? (uint8_t)(d + 'a' - 'A') : d;
+		table[1][c] = d;
+	}
+	return table;
+}();
+
+static inline bool isSjisLead(uint8_t c)
+{
+	return SJIS_LEAD[c];
+}
+
+static inline const std::array<uint8_t, 256>& GetFold()
+{
+	return FOLD[(CFileSys::GetFileOption() & WINDRV_OPT_ALPHABET) ? 1 : 0];
+}
+
+//---------------------------------------------------------------------------
+//
+//  Normalize a Human68k name for comparisons
+//
+//  The second bytes of Shift-JIS characters are not folded.
+//
+//---------------------------------------------------------------------------
+static uint8_t* FoldName(uint8_t* pWrite, const uint8_t* pFirst, const uint8_t* pLast)
+{
+	const auto& fold = GetFold();
+	for (const uint8_t* p = pFirst; p < pLast; p++) {
+		const uint8_t c = *p;
+		if (isSjisLead(c)) {
+			*pWrite++ = c;
+			if (++p == pLast)
+				break;
+			*pWrite++ = *p;
+		} else {
+			*pWrite++ = fold[c];
+		}
+	}
+
+	return pWrite;
+}
+
+//---------------------------------------------------------------------------
+//
+//  Compare normalized names
+//
+//  With wildcards '?' in the first name matches any character, including none.
+//  Returns 0 if the names match, like CHostPath::Compare().
+//
+//---------------------------------------------------------------------------
+static int CompareKey(const uint8_t* pFirst, const uint8_t* pLast, const uint8_t* pBufFirst, const uint8_t* pBufLast,
+	bool bWildcard)
+{
+	const size_t nLength = pLast - pFirst;
+	const size_t nBufLength = pBufLast - pBufFirst;
+
+	if (!bWildcard)
+		return nLength == nBufLength && !memcmp(pFirst, pBufFirst, nLength) ? 0 : 1;
+
+	if (nBufLength > nLength)
+		return 2;
+
+	for (size_t i = 0; i < nLength; i++) {
+		if (pFirst[i] != '?' && (i >= nBufLength || pFirst[i] != pBufFirst[i]))
+			return 1;
+	}
+
+	return 0;
+}
+
 //---------------------------------------------------------------------------
 //
 //  Kanji code conversion
@@ -208,6 +300,7 @@ CHostDrv::~CHostDrv()
 {
 	CHostPath* p;
 	while ((p = (CHostPath*)m_cRing.Next()) != &m_cRing) {
+		Unwatch(p);
 		delete p;
 		assert(m_nRing);
 		m_nRing--;
@@ -217,6 +310,9 @@ CHostDrv::~CHostDrv()
 	assert(m_cRing.Next() == &m_cRing);
 	assert(m_cRing.Prev() == &m_cRing);
 	assert(m_nRing == 0);
+
+	if (m_nNotify != -1)
+		close(m_nNotify);
 }
 
 //---------------------------------------------------------------------------
@@ -259,7 +355,7 @@ void CHostDrv::Init(const TCHAR* szBase, uint32_t nFlag)
 		} else {
 			pClear = nullptr;
 		}
-		if ((c <= (TCHAR)0x9F) || (TCHAR)0xE0 <= c) {	// To be precise: 0x81~0x9F 0xE0~0xEF
+		if (isSjisLead((uint8_t)c)) {
 			p++;
 			if (*p == '\0')
 				break;
@@ -269,6 +365,9 @@ void CHostDrv::Init(const TCHAR* szBase, uint32_t nFlag)
 	if (pClear)
 		*pClear = '\0';
 
+	// Host side changes are notified, without notification the cache may become outdated
+	m_nNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
 	// Status update
 	m_bEnable = true;
 }
@@ -510,6 +609,7 @@ void CHostDrv::DeleteCache(const uint8_t* szHumanPath)
 {
 	auto p = FindCache(szHumanPath);
 	if (p) {
+		Unwatch(p);
 		delete p;
 		assert(m_nRing);
 		m_nRing--;
@@ -635,9 +735,10 @@ CHostPath* CHostDrv::MakeCache(CHostFiles* pFiles)
 		pPath = FindCache(szHumanPath);
 		if (pPath == nullptr) {
 			// Check for max number of cache
-			if (m_nRing >= XM6_HOST_DIRENTRY_CACHE_MAX) {
+			if (m_nRing >= m_nCacheMax) {
 				// Destroy the oldest cache and reuse it
 				pPath = (CHostPath*)m_cRing.Prev();
+				Unwatch(pPath);
 				pPath->Clean();			// Release all files. Release update check handlers.
 			} else {
 				// Register new
@@ -648,6 +749,9 @@ CHostPath* CHostDrv::MakeCache(CHostFiles* pFiles)
 			pPath->SetHuman(szHumanPath);
 			pPath->SetHost(szHostPath);
 
+			// Watch before reading, so that no change gets lost
+			Watch(pPath);
+
 			// Update status
 			pPath->Refresh();
 		}
@@ -656,6 +760,10 @@ CHostPath* CHostDrv::MakeCache(CHostFiles* pFiles)
 		if (pPath->isRefresh()) {
 			Update();
 
+			// The directory might not have existed when the watch was added
+			if (pPath->GetWatch() == -1)
+				Watch(pPath);
+
 			// Update status
 			pPath->Refresh();
 		}
@@ -698,6 +806,97 @@ CHostPath* CHostDrv::MakeCache(CHostFiles* pFiles)
 	return pPath;
 }
 
+//---------------------------------------------------------------------------
+//
+/// Watch the host side directory of a path
+///
+/// Without a watch (no inotify or too many watches) the path is not updated on host side changes.
+//
+//---------------------------------------------------------------------------
+void CHostDrv::Watch(CHostPath* pPath)
+{
+	assert(pPath);
+	assert(pPath->GetWatch() == -1);
+
+	if (m_nNotify == -1)
+		return;
+
+	const int nWatch = inotify_add_watch(m_nNotify, S2U(pPath->GetHost()), IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+		IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+
+	if (nWatch == -1)
+		return;
+
+	// A directory reached by more than one path (symbolic links) has only one watch descriptor, which is shared
+	pPath->SetWatch(nWatch);
+	m_cWatch[nWatch].push_back(pPath);
+}
+
+//---------------------------------------------------------------------------
+//
+/// Stop watching the host side directory of a path
+///
+/// The watch is only removed when no other path shares it.
+//
+//---------------------------------------------------------------------------
+void CHostDrv::Unwatch(CHostPath* pPath)
+{
+	assert(pPath);
+
+	if (const int nWatch = pPath->GetWatch(); nWatch != -1) {
+		pPath->SetWatch(-1);
+
+		auto& paths = m_cWatch[nWatch];
+		std::erase(paths, pPath);
+		if (paths.empty()) {
+			inotify_rm_watch(m_nNotify, nWatch);
+			m_cWatch.erase(nWatch);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------
+//
+/// Mark the paths changed on the host side for being updated
+///
+/// Paths without changes are not read again.
+//
+//---------------------------------------------------------------------------
+void CHostDrv::ProcessEvents()
+{
+	if (m_nNotify == -1)
+		return;
+
+	alignas(inotify_event) uint8_t buf[4096];
+	ssize_t nSize;
+	while ((nSize = read(m_nNotify, buf, sizeof(buf))) > 0) {
+		for (const uint8_t* p = buf; p < buf + nSize;) {
+			const auto pEvent = (const inotify_event*)p;
+			p += sizeof(inotify_event) + pEvent->len;
+
+			// Events were lost, nothing is known about the state of the paths
+			if (pEvent->mask & IN_Q_OVERFLOW) {
+				CleanCache();
+				continue;
+			}
+
+			const auto& it = m_cWatch.find(pEvent->wd);
+			if (it == m_cWatch.end())
+				continue;
+
+			// All paths of the directory are affected
+			const std::vector<CHostPath*> paths = it->second;
+			for (auto pPath : paths) {
+				pPath->Release();
+
+				// The directory was deleted or moved, it is watched again when it is read the next time
+				if (pEvent->mask & (IN_IGNORED | IN_MOVE_SELF))
+					Unwatch(pPath);
+			}
+		}
+	}
+}
+
 //---------------------------------------------------------------------------
 //
 /// Find host side name (path name + file name (can be abbeviated) + attribute)
@@ -709,12 +908,19 @@ bool CHostDrv::Find(CHostFiles* pFiles)
 {
 	assert(pFiles);
 
+	// Apply the host side changes before using the cache
+	ProcessEvents();
+
 	// Get path name and build cache
 	const CHostPath* pPath = CopyCache(pFiles);
 	if (pPath == nullptr) {
 		pPath = MakeCache(pFiles);
 		if (pPath == nullptr) {
-			CleanCache();
+			// Only the paths not being watched may be outdated
+			for (auto p = (CHostPath*)m_cRing.Next(); p != &m_cRing; p = (CHostPath*)p->Next()) {
+				if (p->GetWatch() == -1)
+					p->Release();
+			}
 			return false;	// Error: Failed to build cache
 		}
 	}
@@ -802,6 +1008,7 @@ void CHostFilename::ConvertHuman(int nCount)
 		m_bCorrect = true;
 		m_pszHumanLast = m_szHuman + strlen((const char*)m_szHuman);
 		m_pszHumanExt = m_pszHumanLast;
+		SetKey();
 		return;
 	}
 
@@ -942,7 +1149,7 @@ void CHostFilename::ConvertHuman(int nCount)
 	if (pFirst < pExt) {
 		pCut++;		// 1 byte always uses the base name
 		uint8_t c = *pFirst;
-		if ((0x80 <= c && c <= 0x9F) || 0xE0 <= c) {	// Specifically 0x81~0x9F 0xE0~0xEF
+		if (isSjisLead(c)) {
 			pCut++;		// Base name. At least 2 bytes.
 			pStop++;	// File extension. Max 16 bytes.
 		}
@@ -972,7 +1179,7 @@ void CHostFilename::ConvertHuman(int nCount)
 	// If in the middle of a 2 byte char, shorten even further
 	for (p = pFirst; p < pCut; p++) {
 		uint8_t c = *p;
-		if ((0x80 <= c && c <= 0x9F) || 0xE0 <= c) {	// Specifically 0x81~0x9F 0xE0~0xEF
+		if (isSjisLead(c)) {
 			p++;
 			if (p >= pCut) {
 				pCut--;
@@ -991,6 +1198,7 @@ void CHostFilename::ConvertHuman(int nCount)
 	pWrite = CopyName(pWrite, pExt, pLast);		// Transfer the Human68k extension
 	m_pszHumanLast = pWrite;					// Store the end position
 	*pWrite = '\0';
+	SetKey();
 
 	// Confirm the conversion results
 	m_bCorrect = true;
@@ -1027,6 +1235,19 @@ void CHostFilename::CopyHuman(const uint8_t* szHuman)
 	m_bCorrect = true;
 	m_pszHumanLast = m_szHuman + strlen((const char*)m_szHuman);
 	m_pszHumanExt = SeparateExt(m_szHuman);
+	SetKey();
+}
+
+//---------------------------------------------------------------------------
+//
+/// Normalize the Human68k name for comparisons
+///
+/// Name matching compares the normalized names byte by byte, see CHostPath::Compare().
+//
+//---------------------------------------------------------------------------
+void CHostFilename::SetKey()
+{
+	*FoldName(m_szKey, m_szHuman, m_pszHumanLast) = '\0';
 }
 
 //---------------------------------------------------------------------------
@@ -1178,6 +1399,9 @@ void CHostPath::Clean()
 	while ((p = (ring_t*)m_cRing.Next()) != (ring_t*)&m_cRing) {
 		Free(p);
 	}
+
+	m_cIndex.clear();
+	m_nEntries = 0;
 }
 
 //---------------------------------------------------------------------------
@@ -1218,6 +1442,8 @@ int CHostPath::Compare(const uint8_t* pFirst, const uint8_t* pLast, const uint8_
 	assert(pBufFirst);
 	assert(pBufLast);
 
+	const auto& fold = GetFold();
+
 	// Compare chars
 	bool bSkip0 = false;
 	bool bSkip1 = false;
@@ -1228,46 +1454,13 @@ int CHostPath::Compare(const uint8_t* pFirst, const uint8_t* pLast, const uint8_
 		if (pBufFirst < pBufLast)
 			d = *pBufFirst++;
 
-		// Ajust char for comparison
-		if (!bSkip0) {
-			if (!bSkip1) {	// First byte for both c and d
-				if ((0x80 <= c && c <= 0x9F) || 0xE0 <= c) {	// Specifically 0x81~0x9F 0xE0~0xEF
-					bSkip0 = true;
-				}
-				if ((0x80 <= d && d <= 0x9F) || 0xE0 <= d) {	// Specifically 0x81~0x9F 0xE0~0xEF
-					bSkip1 = true;
-				}
-				if (c == d)
-					continue;	// Finishes the evaluation here with high probability
-				if ((CFileSys::GetFileOption() & WINDRV_OPT_ALPHABET) == 0) {
-					if ('A' <= c && c <= 'Z')
-						c += 'a' - 'A';	// To lower case
-					if ('A' <= d && d <= 'Z')
-						d += 'a' - 'A';	// To lower case
-				}
-				// Unify slashes and backslashes for comparison
-				if (c == '\\') {
-					c = '/';
-				}
-				if (d == '\\') {
-					d = '/';
-				}
-			} else {		// Only c is first byte
-				if ((0x80 <= c && c <= 0x9F) || 0xE0 <= c) {	// Specifically 0x81~0x9F 0xE0~0xEF
-					bSkip0 = true;
-				}
-				bSkip1 = false;
-			}
-		} else {
-			if (!bSkip1) {	// Only d is first byte
-				bSkip0 = false;
-				if ((0x80 <= d && d <= 0x9F) || 0xE0 <= d) {	// Specifically 0x81~0x9F 0xE0~0xEF
-					bSkip1 = true;
-				}
-			} else {		// Second byte for both c and d
-				bSkip0 = false;
-				bSkip1 = false;
-			}
+		// Only the first bytes of both c and d are adjusted for comparison
+		const bool bFirst = !bSkip0 && !bSkip1;
+		bSkip0 = !bSkip0 && isSjisLead(c);
+		bSkip1 = !bSkip1 && isSjisLead(d);
+		if (bFirst) {
+			c = fold[c];
+			d = fold[d];
 		}
 
 		// Compare
@@ -1283,6 +1476,61 @@ int CHostPath::Compare(const uint8_t* pFirst, const uint8_t* pLast, const uint8_
 	return 0;
 }
 
+//---------------------------------------------------------------------------
+//
+/// Normalize a Human68k name for the name index
+///
+/// Names that are identical for Compare() (without wildcards) result in the same key.
+//
+//---------------------------------------------------------------------------
+std::string CHostPath::GetIndexKey(const uint8_t* pFirst, const uint8_t* pLast)
+{
+	assert(pFirst);
+	assert(pLast);
+
+	std::string key(pLast - pFirst, '\0');
+	FoldName((uint8_t*)key.data(), pFirst, pLast);
+
+	return key;
+}
+
+//---------------------------------------------------------------------------
+//
+/// Check whether the normalized names of the entries can be used
+///
+/// They have to be created again when the file name option has changed.
+//
+//---------------------------------------------------------------------------
+bool CHostPath::isKeyValid() const
+{
+	return m_nIndexOption == CFileSys::GetFileOption();
+}
+
+//---------------------------------------------------------------------------
+//
+/// Check whether the name index can be used
+///
+/// Wildcards and a changed file name option require a search of all entries.
+//
+//---------------------------------------------------------------------------
+bool CHostPath::isIndexValid(const uint8_t* pFirst, const uint8_t* pLast) const
+{
+	return isKeyValid() && std::find(pFirst, pLast, '?') == pLast;
+}
+
+//---------------------------------------------------------------------------
+//
+/// Add the entry appended to the ring to the name index
+//
+//---------------------------------------------------------------------------
+void CHostPath::AddIndex(const ring_t* pRing)
+{
+	assert(pRing);
+
+	const uint8_t* pKey = pRing->f.GetKey();
+	m_cIndex[std::string((const char*)pKey, pRing->f.GetKeyLast() - pKey)].push_back({ m_nEntries++, pRing });
+}
+
 //---------------------------------------------------------------------------
 //
 /// Compare Human68k side name
@@ -1338,6 +1586,24 @@ const CHostFilename* CHostPath::FindFilename(const uint8_t* szHuman, uint32_t nH
 	size_t nLength = strlen((const char*)pFirst);
 	const uint8_t* pLast = pFirst + nLength;
 
+	// Only the entries with the same normalized name can match
+	if (isIndexValid(pFirst, pLast)) {
+		if (const auto& it = m_cIndex.find(GetIndexKey(pFirst, pLast)); it != m_cIndex.end()) {
+			for (const auto& i : it->second) {
+				if (i.pRing->f.CheckAttribute(nHumanAttribute))
+					return &i.pRing->f;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Normalize once for comparing with the normalized names of the entries
+	const bool bKey = isKeyValid();
+	uint8_t szKey[HUMAN68K_PATH_MAX];
+	if (bKey)
+		FoldName(szKey, pFirst, pLast);
+
 	// Find something that matches perfectly with either of the stored file names
 	const ring_t* p = (ring_t*)m_cRing.Next();
 	for (; p != (const ring_t*)&m_cRing; p = (ring_t*)p->r.Next()) {
@@ -1350,8 +1616,12 @@ const CHostFilename* CHostPath::FindFilename(const uint8_t* szHuman, uint32_t nH
 		if (size_t nBufLength = pBufLast - pBufFirst; nLength != nBufLength)
 			continue;
 		// File name check
-		if (Compare(pFirst, pLast, pBufFirst, pBufLast) == 0)
+		if (bKey) {
+			if (CompareKey(szKey, szKey + nLength, p->f.GetKey(), p->f.GetKeyLast(), true) == 0)
+				return &p->f;
+		} else if (Compare(pFirst, pLast, pBufFirst, pBufLast) == 0) {
 			return &p->f;
+		}
 	}
 
 	return nullptr;
@@ -1376,6 +1646,39 @@ const CHostFilename* CHostPath::FindFilenameWildcard(const uint8_t* szHuman, uin
 	const uint8_t* pLast = pFirst + strlen((const char*)pFirst);
 	const uint8_t* pExt = CHostFilename::SeparateExt(pFirst);
 
+	// Without wildcards only the entries with the same normalized name can match.
+	// The search count is the ring position of the next search.
+	if (isIndexValid(pFirst, pLast) && (pFind->count == 0 || pFind->id == m_nId)) {
+		if (const auto& it = m_cIndex.find(GetIndexKey(pFirst, pLast)); it != m_cIndex.end()) {
+			for (const auto& i : it->second) {
+				const ring_t* p = i.pRing;
+				if (i.position < pFind->count || p->f.CheckAttribute(nHumanAttribute) == 0)
+					continue;
+
+				// The base file name and the extension must also match separately
+				if (p->f.GetHumanExt() - p->f.GetHuman() != pExt - pFirst)
+					continue;
+
+				// Store the contents of the next candidate's directory entry
+				const auto pNext = (const ring_t*)p->r.Next();
+				pFind->count = i.position + 1;
+				pFind->id = m_nId;
+				pFind->pos = pNext;
+				if (pNext != (const ring_t*)&m_cRing)
+					memcpy(&pFind->entry, pNext->f.GetEntry(), sizeof(pFind->entry));
+				else
+					memset(&pFind->entry, 0, sizeof(pFind->entry));
+				return &p->f;
+			}
+		}
+
+		pFind->count = m_nEntries;
+		pFind->id = m_nId;
+		pFind->pos = (const ring_t*)&m_cRing;
+		memset(&pFind->entry, 0, sizeof(pFind->entry));
+		return nullptr;
+	}
+
 	// Move to the start position
 	auto p = (const ring_t*)m_cRing.Next();
 	if (pFind->count > 0) {
@@ -1407,6 +1710,18 @@ const CHostFilename* CHostPath::FindFilenameWildcard(const uint8_t* szHuman, uin
 		}
 	}
 
+	// Normalize once for comparing with the normalized names of the entries
+	const bool bKey = isKeyValid();
+	uint8_t szKey[HUMAN68K_PATH_MAX];
+	if (bKey)
+		FoldName(szKey, pFirst, pLast);
+	const uint8_t* pKeyExt = szKey + (pExt - pFirst);
+	const uint8_t* pKeyLast = szKey + (pLast - pFirst);
+	const bool bWildcard = std::find(pFirst, pExt, '?') != pExt;
+	const bool bWildcardExt = std::find(pExt, pLast, '?') != pLast;
+	// In the case of a '.???' extension, match the Human68k extension without period.
+	const bool bAnyExt = strcmp((const char*)pExt, ".???") == 0;
+
 	// Find files
 	for (; p != (const ring_t*)&m_cRing; p = (const ring_t*)p->r.Next()) {
 		pFind->count++;
@@ -1414,19 +1729,22 @@ const CHostFilename* CHostPath::FindFilenameWildcard(const uint8_t* szHuman, uin
 		if (p->f.CheckAttribute(nHumanAttribute) == 0)
 			continue;
 
-		// Split the base file name and Human68k file extension
-		const uint8_t* pBufFirst = p->f.GetHuman();
-		const uint8_t* pBufLast = p->f.GetHumanLast();
-		const uint8_t* pBufExt = p->f.GetHumanExt();
+		bool bMatch;
+		if (bKey) {
+			// Compare base file name and Human68k extension
+			bMatch = CompareKey(szKey, pKeyExt, p->f.GetKey(), p->f.GetKeyExt(), bWildcard) == 0 &&
+				(bAnyExt || CompareKey(pKeyExt, pKeyLast, p->f.GetKeyExt(), p->f.GetKeyLast(), bWildcardExt) == 0);
+		} else {
+			// Split the base file name and Human68k file extension
+			const uint8_t* pBufFirst = p->f.GetHuman();
+			const uint8_t* pBufLast = p->f.GetHumanLast();
+			const uint8_t* pBufExt = p->f.GetHumanExt();
 
-		// Compare base file name
-		if (Compare(pFirst, pExt, pBufFirst, pBufExt))
-			continue;
+			bMatch = Compare(pFirst, pExt, pBufFirst, pBufExt) == 0 &&
+				(bAnyExt || Compare(pExt, pLast, pBufExt, pBufLast) == 0);
+		}
 
-		// Compare Human68k extension
-		// In the case of a '.???' extension, match the Human68k extension without period.
-		if (strcmp((const char*)pExt, ".???") == 0 ||
-			Compare(pExt, pLast, pBufExt, pBufLast) == 0) {
+		if (bMatch) {
 			// Store the contents of the next candidate's directory entry
 			const auto pNext = (const ring_t*)p->r.Next();
 			pFind->id = m_nId;
@@ -1490,6 +1808,18 @@ void CHostPath::Refresh()
 	CRing cRingBackup;
 	m_cRing.InsertRing(&cRingBackup);
 
+	// Index the previous cache contents by host side name
+	std::unordered_map<std::string, ring_t*> cBackupIndex;
+	for (auto p = (ring_t*)cRingBackup.Next(); p != (ring_t*)&cRingBackup; p = (ring_t*)p->r.Next()) {
+		cBackupIndex[p->f.GetHost()] = p;
+	}
+
+	// The name index is re-created with the entries being added
+	m_cIndex.clear();
+	const bool bKey = isKeyValid();
+	m_nIndexOption = CFileSys::GetFileOption();
+	m_nEntries = 0;
+
 	// Register file name
 	bool bUpdate = false;
 	dirent **pd = nullptr;
@@ -1523,19 +1853,14 @@ void CHostPath::Refresh()
 		pFilename->SetHost(szFilename);
 
 		// If there is a relevant file name in the previous cache, prioritize that for the Human68k name
-		auto pCache = (ring_t*)cRingBackup.Next();
-		for (;;) {
-			if (pCache == (ring_t*)&cRingBackup) {
-				pCache = nullptr;			// No relevant entry
-				bUpdate = true;			// Confirm new entry
-				pFilename->ConvertHuman();
-				break;
-			}
-			if (strcmp(pFilename->GetHost(), pCache->f.GetHost()) == 0) {
-				pFilename->CopyHuman(pCache->f.GetHuman());	// Copy Human68k name
-				break;
-			}
-			pCache = (ring_t*)pCache->r.Next();
+		ring_t* pCache = nullptr;
+		if (const auto& it = cBackupIndex.find(pFilename->GetHost()); it != cBackupIndex.end()) {
+			pCache = it->second;
+			cBackupIndex.erase(it);
+			pFilename->CopyHuman(pCache->f.GetHuman());	// Copy Human68k name
+		} else {
+			bUpdate = true;			// Confirm new entry
+			pFilename->ConvertHuman();
 		}
 
 		// If there is a new entry, carry out file name duplication check.
@@ -1571,8 +1896,10 @@ void CHostPath::Refresh()
 		strcat(szPath, U2S(pe->d_name));
 
 		struct stat sb;
-		if (stat(S2U(szPath), &sb))
+		if (stat(S2U(szPath), &sb)) {
+			Free(pRing);
 			continue;
+		}
 
 		uint8_t nHumanAttribute = Human68k::AT_ARCHIVE;
 		if (S_ISDIR(sb.st_mode))
@@ -1600,6 +1927,8 @@ void CHostPath::Refresh()
 			if (pCache->f.isSameEntry(pFilename->GetEntry())) {
 				Free(pRing);			// Destroy entry that was created here
 				pRing = pCache;			// Use previous cache
+				if (!bKey)
+					pRing->f.SetKey();	// The file name option has changed
 			} else {
 				Free(pCache);			// Remove from the next search target
 				bUpdate = true;			// Flag for update if no match
@@ -1608,6 +1937,7 @@ void CHostPath::Refresh()
 
 		// Add to end of ring
 		pRing->r.InsertTail(&m_cRing);
+		AddIndex(pRing);
 	}
 
 	// Release directory entry
@@ -2018,7 +2348,7 @@ const uint8_t* CHostDrv::SeparateCopyFilename(const uint8_t* szHuman, uint8_t* s
 			return nullptr;		// Error: The first byte hits the end of the buffer
 		szBuffer[i++] = c;		// Read
 
-		if ((0x80 <= c && c <= 0x9F) || 0xE0 <= c) {	// Specifically 0x81~0x9F and 0xE0~0xEF
+		if (isSjisLead(c)) {
 			c = *p++;			// Read
 			if (c < 0x40)
 				return nullptr;	// Error: Invalid Shift-JIS 2nd byte
@@ -2047,6 +2377,9 @@ void CHostFiles::SetPath(const Human68k::namests_t* pNamests)
 	m_nHumanWildcard = 0;
 	m_nHumanAttribute = Human68k::AT_ARCHIVE;
 	m_findNext.Clear();
+	m_nCursor = 0;
+	m_findBatch.Clear();
+	m_nBatch = 0;
 }
 
 //---------------------------------------------------------------------------
@@ -2058,7 +2391,38 @@ bool CHostFiles::Find(uint32_t nUnit, const CHostEntry* pEntry)
 {
 	assert(pEntry);
 
-	return pEntry->Find(nUnit, this);
+	if (!pEntry->Find(nUnit, this))
+		return false;
+
+	if (m_nHumanWildcard == 1)
+		m_nCursor++;
+
+	return true;
+}
+
+//---------------------------------------------------------------------------
+//
+/// Continue a search at a cursor
+///
+/// The cursor of the current position starts a new batch. The cursor at the start of the
+/// previous batch repeats that batch, e.g. when its results were lost on the bus.
+//
+//---------------------------------------------------------------------------
+bool CHostFiles::Resume(uint32_t nCursor)
+{
+	if (nCursor == m_nCursor) {
+		m_findBatch = m_findNext;
+		m_nBatch = m_nCursor;
+		return true;
+	}
+
+	if (nCursor == m_nBatch) {
+		m_findNext = m_findBatch;
+		m_nCursor = m_nBatch;
+		return true;
+	}
+
+	return false;
 }
 
 //---------------------------------------------------------------------------
@@ -2135,15 +2499,6 @@ void CHostFiles::AddFilename()
 //
 //===========================================================================
 
-#ifdef _DEBUG
-CHostFilesManager::~CHostFilesManager()
-{
-	// Confirm that the entity does not exist (just in case)
-	assert(m_cRing.Next() == &m_cRing);
-	assert(m_cRing.Prev() == &m_cRing);
-}
-#endif	// _DEBUG
-
 //---------------------------------------------------------------------------
 //
 /// Initialization (when the driver is installed)
@@ -2151,16 +2506,8 @@ CHostFilesManager::~CHostFilesManager()
 //---------------------------------------------------------------------------
 void CHostFilesManager::Init()
 {
-
 	// Confirm that the entity does not exist (just in case)
-	assert(m_cRing.Next() == &m_cRing);
-	assert(m_cRing.Prev() == &m_cRing);
-
-	// Allocate memory
-	for (uint32_t i = 0; i < XM6_HOST_FILES_MAX; i++) {
-		auto p = new ring_t();
-		p->r.Insert(&m_cRing);
-	}
+	assert(m_cTable.GetCount() == 0);
 }
 
 //---------------------------------------------------------------------------
@@ -2170,56 +2517,33 @@ void CHostFilesManager::Init()
 //---------------------------------------------------------------------------
 void CHostFilesManager::Clean()
 {
-
 	// Release memory
-	CRing* p;
-	while ((p = m_cRing.Next()) != &m_cRing) {
-		delete (ring_t*)p;
-	}
+	m_cTable.Clean();
 }
 
 CHostFiles* CHostFilesManager::Alloc(uint32_t nKey)
 {
 	assert(nKey);
 
-	// Select from the end
-	auto p = (ring_t*)m_cRing.Prev();
-
-	// Move to the start of the ring
-	p->r.Insert(&m_cRing);
-
-	p->f.SetKey(nKey);
+	// Re-use the least recently used search, it has most likely been abandoned
+	if (m_cTable.GetCount() >= XM6_HOST_FILES_MAX)
+		m_cTable.Free(m_cTable.GetOldest());
 
-	return &p->f;
+	return m_cTable.Alloc(nKey);
 }
 
 CHostFiles* CHostFilesManager::Search(uint32_t nKey)
 {
 	// assert(nKey);	// The search key may become 0 due to DPB damage
 
-	// Find the relevant object
-	auto p = (ring_t*)m_cRing.Next();
-	for (; p != (ring_t*)&m_cRing; p = (ring_t*)p->r.Next()) {
-		if (p->f.isSameKey(nKey)) {
-			// Move to the start of the ring
-			p->r.Insert(&m_cRing);
-			return &p->f;
-		}
-	}
-
-	return nullptr;
+	return m_cTable.Search(nKey);
 }
 
 void CHostFilesManager::Free(CHostFiles* pFiles)
 {
 	assert(pFiles);
 
-	// Release
-	pFiles->SetKey(0);
-
-	// Move to the end of the ring
-	auto p = (ring_t*)((size_t)pFiles - offsetof(ring_t, f));
-	p->r.InsertTail(&m_cRing);
+	m_cTable.Free(pFiles);
 }
 
 //===========================================================================
@@ -2237,13 +2561,13 @@ bool CHostFcb::SetMode(uint32_t nHumanMode)
 {
 	switch (nHumanMode & Human68k::OP_MASK) {
 		case Human68k::OP_READ:
-			m_pszMode = "rb";
+			m_nMode = O_RDONLY;
 			break;
 		case Human68k::OP_WRITE:
-			m_pszMode = "wb";
+			m_nMode = O_WRONLY | O_CREAT | O_TRUNC;
 			break;
 		case Human68k::OP_FULL:
-			m_pszMode = "r+b";
+			m_nMode = O_RDWR;
 			break;
 		default:
 			return false;
@@ -2281,7 +2605,7 @@ bool CHostFcb::Create(uint32_t, bool bForce)
 {
 	assert((Human68k::AT_DIRECTORY | Human68k::AT_VOLUME) == 0);
 	assert(strlen(m_szFilename) > 0);
-	assert(m_pFile == nullptr);
+	assert(m_nFd == -1);
 
 	// Duplication check
 	if (!bForce) {
@@ -2290,9 +2614,11 @@ bool CHostFcb::Create(uint32_t, bool bForce)
 	}
 
 	// Create file
-	m_pFile = fopen(S2U(m_szFilename), "w+b");	/// @warning The ideal operation is to overwrite each attribute
+	m_nFd = open(S2U(m_szFilename), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);	/// @warning The ideal operation is to overwrite each attribute
+	m_nOffset = 0;
+	m_nReadEnd = 0;
 
-	return m_pFile != nullptr;
+	return m_nFd != -1;
 }
 
 //---------------------------------------------------------------------------
@@ -2312,10 +2638,55 @@ bool CHostFcb::Open()
 	}
 
 	// File open
-	if (m_pFile == nullptr)
-		m_pFile = fopen(S2U(m_szFilename), m_pszMode);
+	if (m_nFd == -1) {
+		m_nFd = open(S2U(m_szFilename), m_nMode | O_CLOEXEC, 0666);
+		m_nOffset = 0;
+		m_nReadEnd = 0;
+	}
+
+	return m_nFd != -1 || m_bFlag;
+}
+
+//---------------------------------------------------------------------------
+//
+/// Read from the host file at a position until the requested size or the end of the file
+//
+//---------------------------------------------------------------------------
+static ssize_t ReadFully(int nFd, uint8_t* pBuffer, size_t nSize, off_t nOffset)
+{
+	size_t nTotal = 0;
+	while (nTotal < nSize) {
+		const ssize_t n = pread(nFd, pBuffer + nTotal, nSize - nTotal, nOffset + nTotal);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+			return -1;
+		if (n == 0)
+			break;
+		nTotal += n;
+	}
 
-	return m_pFile != nullptr || m_bFlag;
+	return nTotal;
+}
+
+//---------------------------------------------------------------------------
+//
+/// Write to the host file at a position
+//
+//---------------------------------------------------------------------------
+static bool WriteFully(int nFd, const uint8_t* pBuffer, size_t nSize, off_t nOffset)
+{
+	size_t nTotal = 0;
+	while (nTotal < nSize) {
+		const ssize_t n = pwrite(nFd, pBuffer + nTotal, nSize - nTotal, nOffset + nTotal);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		nTotal += n;
+	}
+
+	return true;
 }
 
 //---------------------------------------------------------------------------
@@ -2323,19 +2694,62 @@ bool CHostFcb::Open()
 /// Read file
 ///
 /// Handle a 0 byte read as normal operation too.
+/// Small sequential reads are served from the read-ahead data, larger reads go
+/// directly into the transfer buffer.
 /// Return -1 if error is thrown.
 //
 //---------------------------------------------------------------------------
 uint32_t CHostFcb::Read(uint8_t* pBuffer, uint32_t nSize)
 {
 	assert(pBuffer);
-	assert(m_pFile);
+	assert(m_nFd != -1);
+
+	// The collected data must be read back
+	if (!Flush())
+		return (uint32_t)-1;
 
-	size_t nResult = fread(pBuffer, sizeof(uint8_t), nSize, m_pFile);
-	if (ferror(m_pFile))
-		nResult = (size_t)-1;
+	const bool bSequential = m_nOffset == m_nReadEnd;
+
+	// Use the read-ahead data first
+	uint32_t nResult = 0;
+	if (const off_t nEnd = m_nReadOffset + (off_t)m_cReadBuffer.size(); m_nOffset >= m_nReadOffset && m_nOffset < nEnd) {
+		nResult = (uint32_t)std::min((off_t)nSize, nEnd - m_nOffset);
+		memcpy(pBuffer, m_cReadBuffer.data() + (m_nOffset - m_nReadOffset), nResult);
+		m_nOffset += nResult;
+	}
 
-	return (uint32_t)nResult;
+	if (nResult < nSize) {
+		const uint32_t nRemaining = nSize - nResult;
+		if (bSequential && nRemaining < XM6_HOST_FCB_BUFFER_SIZE) {
+			m_cReadBuffer.resize(XM6_HOST_FCB_BUFFER_SIZE);
+			const ssize_t n = ReadFully(m_nFd, m_cReadBuffer.data(), m_cReadBuffer.size(), m_nOffset);
+			if (n == -1) {
+				m_cReadBuffer.clear();
+				return (uint32_t)-1;
+			}
+			m_cReadBuffer.resize(n);
+			m_nReadOffset = m_nOffset;
+
+			const auto nCopy = (uint32_t)std::min((ssize_t)nRemaining, n);
+			memcpy(pBuffer + nResult, m_cReadBuffer.data(), nCopy);
+			nResult += nCopy;
+			m_nOffset += nCopy;
+		} else {
+			const ssize_t n = ReadFully(m_nFd, pBuffer + nResult, nRemaining, m_nOffset);
+			if (n == -1)
+				return (uint32_t)-1;
+			nResult += (uint32_t)n;
+			m_nOffset += n;
+
+			// Let the host prefetch the next chunk of a sequential read
+			if (bSequential && n == (ssize_t)nRemaining)
+				posix_fadvise(m_nFd, m_nOffset, nRemaining, POSIX_FADV_WILLNEED);
+		}
+	}
+
+	m_nReadEnd = m_nOffset;
+
+	return nResult;
 }
 
 //---------------------------------------------------------------------------
@@ -2343,19 +2757,60 @@ uint32_t CHostFcb::Read(uint8_t* pBuffer, uint32_t nSize)
 /// Write file
 ///
 /// Handle a 0 byte read as normal operation too.
+/// Small sequential writes are collected, larger writes are done directly from the transfer buffer.
 /// Return -1 if error is thrown.
 //
 //---------------------------------------------------------------------------
 uint32_t CHostFcb::Write(const uint8_t* pBuffer, uint32_t nSize)
 {
 	assert(pBuffer);
-	assert(m_pFile);
+	assert(m_nFd != -1);
+
+	if ((m_nMode & O_ACCMODE) == O_RDONLY)
+		return (uint32_t)-1;
 
-	size_t nResult = fwrite(pBuffer, sizeof(uint8_t), nSize, m_pFile);
-	if (ferror(m_pFile))
-		nResult = (size_t)-1;
+	// The read-ahead data may become outdated
+	m_cReadBuffer.clear();
 
-	return (uint32_t)nResult;
+	if (nSize < XM6_HOST_FCB_BUFFER_SIZE) {
+		// Only data continuing the collected data can be added
+		if (!m_cWriteBuffer.empty() && (m_nWriteOffset + (off_t)m_cWriteBuffer.size() != m_nOffset ||
+			m_cWriteBuffer.size() + nSize > XM6_HOST_FCB_BUFFER_SIZE)) {
+			if (!Flush())
+				return (uint32_t)-1;
+		}
+
+		if (m_cWriteBuffer.empty()) {
+			m_cWriteBuffer.reserve(XM6_HOST_FCB_BUFFER_SIZE);
+			m_nWriteOffset = m_nOffset;
+		}
+		m_cWriteBuffer.insert(m_cWriteBuffer.end(), pBuffer, pBuffer + nSize);
+	} else {
+		if (!Flush() || !WriteFully(m_nFd, pBuffer, nSize, m_nOffset))
+			return (uint32_t)-1;
+	}
+
+	m_nOffset += nSize;
+
+	return nSize;
+}
+
+//---------------------------------------------------------------------------
+//
+/// Write the collected data
+///
+/// Return false if error is thrown.
+//
+//---------------------------------------------------------------------------
+bool CHostFcb::Flush()
+{
+	if (m_cWriteBuffer.empty())
+		return true;
+
+	const bool bResult = WriteFully(m_nFd, m_cWriteBuffer.data(), m_cWriteBuffer.size(), m_nWriteOffset);
+	m_cWriteBuffer.clear();
+
+	return bResult;
 }
 
 //---------------------------------------------------------------------------
@@ -2365,41 +2820,56 @@ uint32_t CHostFcb::Write(const uint8_t* pBuffer, uint32_t nSize)
 /// Return false if error is thrown.
 //
 //---------------------------------------------------------------------------
-bool CHostFcb::Truncate() const
+bool CHostFcb::Truncate()
 {
-	assert(m_pFile);
+	assert(m_nFd != -1);
+
+	if (!Flush())
+		return false;
 
-	return ftruncate(fileno(m_pFile), ftell(m_pFile)) == 0;
+	m_cReadBuffer.clear();
+
+	return ftruncate(m_nFd, m_nOffset) == 0;
 }
 
 //---------------------------------------------------------------------------
 //
 /// File seek
 ///
+/// Offsets from the beginning are unsigned, so that files up to 4 GiB can be accessed.
 /// Return -1 if error is thrown.
 //
 //---------------------------------------------------------------------------
-uint32_t CHostFcb::Seek(uint32_t nOffset, Human68k::seek_t nHumanSeek)
+uint32_t CHostFcb::Seek(int32_t nOffset, Human68k::seek_t nHumanSeek)
 {
-	assert(m_pFile);
+	assert(m_nFd != -1);
 
-	int nSeek;
+	off_t nPosition;
 	switch (nHumanSeek) {
 		case Human68k::seek_t::SK_BEGIN:
-			nSeek = SEEK_SET;
+			nPosition = (uint32_t)nOffset;
 			break;
 		case Human68k::seek_t::SK_CURRENT:
-			nSeek = SEEK_CUR;
+			nPosition = m_nOffset + nOffset;
 			break;
 			// case SK_END:
-		default:
-			nSeek = SEEK_END;
+		default: {
+			// The file size must include the collected data
+			struct stat sb;
+			if (!Flush() || fstat(m_nFd, &sb))
+				return (uint32_t)-1;
+			nPosition = sb.st_size + nOffset;
 			break;
+		}
 	}
-	if (fseek(m_pFile, nOffset, nSeek))
+
+	// -1 is reserved for errors
+	if (nPosition < 0 || nPosition >= (off_t)0xFFFFFFFF)
 		return (uint32_t)-1;
 
-	return (uint32_t)ftell(m_pFile);
+	m_nOffset = nPosition;
+
+	return (uint32_t)m_nOffset;
 }
 
 //---------------------------------------------------------------------------
@@ -2409,9 +2879,9 @@ uint32_t CHostFcb::Seek(uint32_t nOffset, Human68k::seek_t nHumanSeek)
 /// Return false if error is thrown.
 //
 //---------------------------------------------------------------------------
-bool CHostFcb::TimeStamp(uint32_t nHumanTime) const
+bool CHostFcb::TimeStamp(uint32_t nHumanTime)
 {
-	assert(m_pFile || m_bFlag);
+	assert(m_nFd != -1 || m_bFlag);
 
 	tm t = { };
 	t.tm_year = (nHumanTime >> 25) + 80;
@@ -2428,8 +2898,8 @@ bool CHostFcb::TimeStamp(uint32_t nHumanTime) const
 	ut.modtime = ti;
 
 	// This is for preventing the last updated time stamp to be overwritten upon closing.
-	// Flush and synchronize before updating the time stamp.
-	fflush(m_pFile);
+	// Write the collected data before updating the time stamp.
+	Flush();
 
 	return utime(S2U(m_szFilename), &ut) == 0 || m_bFlag;
 }
@@ -2445,10 +2915,15 @@ void CHostFcb::Close()
 {
 	// File close
 	// Always initialize because of the Close→Free (internally one more Close) flow.
-	if (m_pFile) {
-		fclose(m_pFile);
-		m_pFile = nullptr;
+	if (m_nFd != -1) {
+		Flush();
+		close(m_nFd);
+		m_nFd = -1;
 	}
+
+	// The buffers are only kept while the file is open
+	m_cReadBuffer = {};
+	m_cWriteBuffer = {};
 }
 
 //===========================================================================
@@ -2457,15 +2932,6 @@ void CHostFcb::Close()
 //
 //===========================================================================
 
-#ifdef _DEBUG
-CHostFcbManager::~CHostFcbManager()
-{
-	// Confirm that the entity does not exist (just in case)
-	assert(m_cRing.Next() == &m_cRing);
-	assert(m_cRing.Prev() == &m_cRing);
-}
-#endif	// _DEBUG
-
 //---------------------------------------------------------------------------
 //
 // Initialization (when the driver is installed)
@@ -2474,15 +2940,7 @@ CHostFcbManager::~CHostFcbManager()
 void CHostFcbManager::Init()
 {
 	// Confirm that the entity does not exist (just in case)
-	assert(m_cRing.Next() == &m_cRing);
-	assert(m_cRing.Prev() == &m_cRing);
-
-	// Memory allocation
-	for (uint32_t i = 0; i < XM6_HOST_FCB_MAX; i++) {
-		auto p = new ring_t;
-		assert(p);
-		p->r.Insert(&m_cRing);
-	}
+	assert(m_cTable.GetCount() == 0);
 }
 
 //---------------------------------------------------------------------------
@@ -2490,53 +2948,24 @@ void CHostFcbManager::Init()
 // Clean (at startup/reset)
 //
 //---------------------------------------------------------------------------
-void CHostFcbManager::Clean() const
+void CHostFcbManager::Clean()
 {
-	//  Fast task killer
-	CRing* p;
-	while ((p = m_cRing.Next()) != &m_cRing) {
-		delete (ring_t*)p;
-	}
+	// The files are closed when the objects are destroyed
+	m_cTable.Clean();
 }
 
 CHostFcb* CHostFcbManager::Alloc(uint32_t nKey)
 {
 	assert(nKey);
 
-	// Select from the end
-	auto p = (ring_t*)m_cRing.Prev();
-
-	// Error if in use (just in case)
-	if (!p->f.isSameKey(0)) {
-		assert(false);
-		return nullptr;
-	}
-
-	// Move to the top of the ring
-	p->r.Insert(&m_cRing);
-
-	//  Set key
-	p->f.SetKey(nKey);
-
-	return &p->f;
+	return m_cTable.Alloc(nKey);
 }
 
 CHostFcb* CHostFcbManager::Search(uint32_t nKey)
 {
 	assert(nKey);
 
-	// Search for applicable objects
-	auto p = (ring_t*)m_cRing.Next();
-	while (p != (ring_t*)&m_cRing) {
-		if (p->f.isSameKey(nKey)) {
-			 // Move to the top of the ring
-			p->r.Insert(&m_cRing);
-			return &p->f;
-		}
-		p = (ring_t*)p->r.Next();
-	}
-
-	return nullptr;
+	return m_cTable.Search(nKey);
 }
 
 void CHostFcbManager::Free(CHostFcb* pFcb)
@@ -2544,12 +2973,8 @@ void CHostFcbManager::Free(CHostFcb* pFcb)
 	assert(pFcb);
 
 	// Free
-	pFcb->SetKey(0);
 	pFcb->Close();
-
-	// Move to the end of the ring
-	auto p = (ring_t*)((size_t)pFcb - offsetof(ring_t, f));
-	p->r.InsertTail(&m_cRing);
+	m_cTable.Free(pFcb);
 }
 
 //===========================================================================
@@ -2623,6 +3048,7 @@ void CFileSys::Init()
 		// Create 1 unit file system
 		auto p = new CHostDrv;
 		if (p) {
+			p->SetCacheMax(m_nCacheMax);
 			m_cEntry.SetDrv(nUnit, p);
 			p->Init(m_szBase[n], m_nFlag[n]);
 
@@ -3062,6 +3488,65 @@ int CFileSys::NFiles(uint32_t nUnit, uint32_t nKey, Human68k::files_t* pFiles)
 	return 0;
 }
 
+//---------------------------------------------------------------------------
+//
+/// Search next files, several at once
+///
+/// Continues the search of $47 like repeated $48 calls, but stores up to nMax results.
+/// The cursor is the number of results returned so far, see CHostFiles::Resume().
+/// Returns the number of results, or FS_FILENOTFND when there are no more files.
+//
+//---------------------------------------------------------------------------
+int CFileSys::NFilesBatch(uint32_t nUnit, uint32_t nKey, uint32_t nCursor, const Human68k::files_t* pFiles,
+	Human68k::files_t* pResult, uint32_t nMax)
+{
+	assert(nKey);
+	assert(pFiles);
+	assert(pResult);
+
+	// Unit check
+	if (nUnit >= CHostEntry::DRIVE_MAX)
+		return FS_FATAL_INVALIDUNIT;
+	if (nUnit >= m_nUnits)
+		return FS_FATAL_MEDIAOFFLINE;
+
+	// Media check
+	if (m_cEntry.isMediaOffline(nUnit))
+		return FS_FATAL_MEDIAOFFLINE;
+
+	if (!nMax)
+		return FS_INVALIDPRM;
+
+	// Find buffer
+	CHostFiles* pHostFiles = m_cFiles.Search(nKey);
+	if (pHostFiles == nullptr)
+		return FS_INVALIDPTR;
+
+	if (!pHostFiles->Resume(nCursor))
+		return FS_INVALIDPRM;
+
+	uint32_t nCount = 0;
+	while (nCount < nMax && pHostFiles->Find(nUnit, &m_cEntry)) {
+		Human68k::files_t* p = &pResult[nCount++];
+		*p = *pFiles;
+		p->sector = nKey;
+		p->offset = 0;
+		p->attr = (uint8_t)pHostFiles->GetAttribute();
+		p->date = pHostFiles->GetDate();
+		p->time = pHostFiles->GetTime();
+		p->size = pHostFiles->GetSize();
+		strcpy((char*)p->full, (const char*)pHostFiles->GetHumanResult());
+	}
+
+	// Like with $48 the search ends with the first call not finding anything
+	if (!nCount) {
+		m_cFiles.Free(pHostFiles);
+		return FS_FILENOTFND;
+	}
+
+	return nCount;
+}
+
 //---------------------------------------------------------------------------
 //
 /// $49 - Create new file
@@ -3225,6 +3710,9 @@ int CFileSys::Close(uint32_t nUnit, uint32_t nKey, const Human68k::fcb_t* /* pFc
 	if (pHostFcb == nullptr)
 		return FS_INVALIDPRM;
 
+	// A write error of the collected data is reported on close
+	const bool bFlushed = pHostFcb->Flush();
+
 	// File close and release memory
 	m_cFcb.Free(pHostFcb);
 
@@ -3234,7 +3722,7 @@ int CFileSys::Close(uint32_t nUnit, uint32_t nKey, const Human68k::fcb_t* /* pFc
 
 	/// TODO: Match the FCB status on close with other devices
 
-	return 0;
+	return bFlushed ? 0 : FS_CANTWRITE;
 }
 
 //---------------------------------------------------------------------------
@@ -21,6 +21,10 @@
 #include <cstdio>
 #include <time.h>
 #include <unistd.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
 
 using TCHAR = char;
 
@@ -218,21 +222,25 @@ namespace Human68k {
 
 /// Number of FILES buffers
 /**
-Under normal circumstances it's enough with just a few buffers,
-but Human68k multitasking may lead to multiple threads working
-deeply in the system, which is why this value is set this high.
+Human68k does not report when a file search is abandoned before its end,
+so the least recently used search is re-used when this number is exceeded.
+Human68k multitasking may lead to many threads searching at the same time,
+which is why this value is set this high. The buffers are allocated on demand.
+The number of open files (FCB buffers) is only limited by the host.
 
-Default is 20 buffers.
+Default is 1024 buffers.
 */
-static const int XM6_HOST_FILES_MAX = 20;
+static const int XM6_HOST_FILES_MAX = 1024;
 
-/// Number of FCB buffers
+/// Size of the read-ahead and write buffers of an open file
 /**
-This decides how many files can be opened at the same time.
+Small sequential reads are served from a read-ahead buffer, and small sequential writes
+are collected before being written. Larger transfers are done directly between the
+host file and the transfer buffer. The buffers are only allocated when being used.
 
-Default is 100 files.
+Default is 64 KiB.
 */
-static const int XM6_HOST_FCB_MAX = 100;
+static const int XM6_HOST_FCB_BUFFER_SIZE = 64 * 1024;
 
 /// Max number of virtual clusters and sectors
 /**
@@ -247,12 +255,13 @@ static const int XM6_HOST_PSEUDO_CLUSTER_MAX = 10;
 /**
 Human68k carries out a large number of checks of directory entries when doing an operation
 inside a subdirectory. This specifies the number of caches used to speed up this operation.
-Cache is allocated per drive. The more you add the faster it gets, but use too many
-and the host OS gets under a heavy load, so be careful.
+Cache is allocated per drive. The least recently used directory is discarded first.
+Cached directories are watched with inotify, so that they are only read again when they have changed.
+Each cached directory requires an inotify watch.
 
-Default is 16.
+Default is 256. Can be changed with the SCSIBR "dir_cache" parameter.
 */
-static const int XM6_HOST_DIRENTRY_CACHE_MAX = 16;
+static const int XM6_HOST_DIRENTRY_CACHE_MAX = 256;
 
 /// Max number of entries that can be stored per directory
 /**
@@ -439,6 +448,12 @@ public:
 	const uint8_t* GetHumanLast() const
 	{ return m_pszHumanLast; }				///< Get Human68k file name
 	const uint8_t* GetHumanExt() const { return m_pszHumanExt; }///< Get Human68k file name
+	void SetKey();								///< Normalize the Human68k name for comparisons
+	const uint8_t* GetKey() const { return m_szKey; }		///< Get normalized Human68k file name
+	const uint8_t* GetKeyLast() const
+	{ return m_szKey + (m_pszHumanLast - m_szHuman); }		///< Get normalized Human68k file name
+	const uint8_t* GetKeyExt() const
+	{ return m_szKey + (m_pszHumanExt - m_szHuman); }		///< Get normalized Human68k file name
 	void SetEntryName();							///< Set Human68k directory entry
 	void SetEntryAttribute(uint8_t nHumanAttribute)
 	{ m_dirHuman.attr = nHumanAttribute; }			///< Set Human68k directory entry
@@ -468,6 +483,7 @@ private:
 	const uint8_t* m_pszHumanExt = nullptr;		///< Position of the extension of the Human68k internal name of the relevant entry
 	bool m_bCorrect = false;			///< TRUE if the relevant entry of the Human68k internal name is correct
 	uint8_t m_szHuman[24];			///< Human68k internal name of the relevant entry
+	uint8_t m_szKey[24];			///< Human68k internal name normalized for comparisons, with the same length
 	Human68k::dirent_t m_dirHuman;		///< All information for the Human68k relevant entry
 	TCHAR m_szHost[FILEPATH_MAX];		///< The host name of the relevant entry (variable length)
 };
@@ -533,6 +549,8 @@ public:
 	void Backup();								/// Backup the time stamp on the host side
 	void Restore() const;							/// Restore the time stamp on the host side
 	void Release();							///< Update
+	int GetWatch() const { return m_nWatch; }				///< Get inotify watch descriptor
+	void SetWatch(int nWatch) { m_nWatch = nWatch; }			///< Set inotify watch descriptor
 
 	// CHostEntry is an external API that we use
 	static void InitId() { g_nId = 0; }					///< Initialize the counter for the unique ID generation
@@ -542,10 +560,24 @@ private:
 	static void Free(ring_t* pRing);					///< Release memory for the file name
 	static int Compare(const uint8_t* pFirst, const uint8_t* pLast, const uint8_t* pBufFirst, const uint8_t* pBufLast);
 										///< Compare string (with support for wildcards)
+	static std::string GetIndexKey(const uint8_t* pFirst, const uint8_t* pLast);	///< Normalize a Human68k name like Compare() does
+	bool isKeyValid() const;						///< Check whether the normalized names of the entries can be used
+	bool isIndexValid(const uint8_t* pFirst, const uint8_t* pLast) const;	///< Check whether the name index can be used for a search
+	void AddIndex(const ring_t* pRing);					///< Add the last entry of the ring to the name index
+
+	/// Entry of the name index, in the order of the ring
+	struct index_t {
+		uint32_t position;						///< Position in the ring
+		const ring_t* pRing;
+	};
 
 	CRing m_cRing;								///< For CHostFilename linking
+	std::unordered_map<std::string, std::vector<index_t>> m_cIndex;		///< Entries by normalized Human68k name
+	uint32_t m_nIndexOption = 0;						///< File name option the index and the normalized names were created with
+	uint32_t m_nEntries = 0;						///< Number of entries in the ring
 	time_t m_tBackup = 0;					///< For time stamp restoration
 	bool m_bRefresh = true;						///< Refresh flag
+	int m_nWatch = -1;							///< inotify watch descriptor, -1 if not watched
 	uint32_t m_nId = 0;								///< Unique ID (When the value has changed, it means an update has been made)
 	uint8_t m_szHuman[HUMAN68K_PATH_MAX];					///< The internal Human68k name for the relevant entry
 	TCHAR m_szHost[FILEPATH_MAX];						///< The host side name for the relevant entry
@@ -582,6 +614,7 @@ public:
 	void Init();
 
 	void SetKey(uint32_t nKey) { m_nKey = nKey; }			///< Set search key
+	uint32_t GetKey() const { return m_nKey; }				///< Get search key
 	bool isSameKey(uint32_t nKey) const { return m_nKey == nKey; }	///< Compare search key
 	void SetPath(const Human68k::namests_t* pNamests);				///< Create path and file name internally
 	bool isRootPath() const { return m_szHumanPath[1] == '\0'; }			///< Check if root directory
@@ -590,6 +623,8 @@ public:
 	bool isPathOnly() const { return m_nHumanWildcard == 0xFF; }			///< Check if set to only path names
 	void SetAttribute(uint32_t nHumanAttribute) { m_nHumanAttribute = nHumanAttribute; }	///< Set search attribute
 	bool Find(uint32_t nUnit, const class CHostEntry* pEntry);				///< Find files on the Human68k side, generating data on the host side
+	uint32_t GetCursor() const { return m_nCursor; }				///< Get number of wildcard search results so far
+	bool Resume(uint32_t nCursor);							///< Continue a search at the cursor of the current or the previous batch
 	const CHostFilename* Find(const CHostPath* pPath);					///< Find file name
 	void SetEntry(const CHostFilename* pFilename);					///< Store search results on the Human68k side
 	void SetResult(const TCHAR* szPath);						///< Set names on the host side
@@ -613,6 +648,9 @@ private:
 	uint32_t m_nHumanWildcard = 0;				///< Human68k wildcard data
 	uint32_t m_nHumanAttribute = 0;			///< Human68k search attribute
 	CHostPath::find_t m_findNext = {};		///< Next search location data
+	uint32_t m_nCursor = 0;					///< Number of wildcard search results so far
+	CHostPath::find_t m_findBatch = {};		///< Search location data at the start of the previous batch
+	uint32_t m_nBatch = 0;					///< Cursor at the start of the previous batch
 	Human68k::dirent_t m_dirHuman = {};		///< Search results: Human68k file data
 	uint8_t m_szHumanFilename[24] = {};		///< Human68k file name
 	uint8_t m_szHumanResult[24] = {};			///< Search results: Human68k file name
@@ -620,6 +658,98 @@ private:
 	TCHAR m_szHostResult[FILEPATH_MAX] = {};	///< Search results: host's full path name
 };
 
+//===========================================================================
+//
+/// Handle table for file searches and FCBs
+///
+/// The objects are allocated in slabs, which are kept for re-use until Clean().
+/// They are found by their Human68k buffer address (key) with a hash map.
+//
+//===========================================================================
+template<class T>
+class CHostHandleTable {
+	static const size_t SLAB_SIZE = 16;					///< Number of objects allocated at once
+
+public:
+	void Clean()								///< Release all objects
+	{
+		m_cHandles.clear();
+		m_cFree.clear();
+		m_cSlabs.clear();
+	}
+
+	T* Alloc(uint32_t nKey)							///< Get an unused object for a key
+	{
+		assert(nKey);
+		assert(!m_cHandles.contains(nKey));
+
+		if (m_cFree.empty()) {
+			m_cSlabs.push_back(std::make_unique<T[]>(SLAB_SIZE));
+			for (size_t i = SLAB_SIZE; i > 0; i--) {
+				m_cFree.push_back(&m_cSlabs.back()[i - 1]);
+			}
+		}
+
+		T* p = m_cFree.back();
+		m_cFree.pop_back();
+
+		*p = T();
+		p->SetKey(nKey);
+		m_cHandles[nKey] = { p, ++m_nUsed };
+
+		return p;
+	}
+
+	T* Search(uint32_t nKey)						///< Find the object for a key
+	{
+		const auto& it = m_cHandles.find(nKey);
+		if (it == m_cHandles.end())
+			return nullptr;
+
+		it->second.nUsed = ++m_nUsed;
+
+		return it->second.p;
+	}
+
+	T* GetOldest() const							///< Find the least recently used object
+	{
+		T* p = nullptr;
+		uint64_t nUsed = UINT64_MAX;
+		for (const auto& [nKey, h] : m_cHandles) {
+			if (h.nUsed < nUsed) {
+				p = h.p;
+				nUsed = h.nUsed;
+			}
+		}
+
+		return p;
+	}
+
+	void Free(T* p)								///< Return an object for re-use
+	{
+		assert(p);
+
+		if (m_cHandles.erase(p->GetKey())) {
+			p->SetKey(0);
+			m_cFree.push_back(p);
+		}
+	}
+
+	size_t GetCount() const { return m_cHandles.size(); }		///< Number of objects in use
+
+private:
+	/// Object in use
+	struct handle_t {
+		T* p;
+		uint64_t nUsed;							///< For finding the least recently used object
+	};
+
+	std::vector<std::unique_ptr<T[]>> m_cSlabs;				///< Allocated objects
+	std::vector<T*> m_cFree;						///< Unused objects
+	std::unordered_map<uint32_t, handle_t> m_cHandles;			///< Objects in use by key
+	uint64_t m_nUsed = 0;							///< Usage counter
+};
+
 //===========================================================================
 //
 /// File search memory manager
@@ -627,23 +757,15 @@ private:
 //===========================================================================
 class CHostFilesManager {
 public:
-#ifdef _DEBUG
-	~CHostFilesManager();
-#endif	// _DEBUG
 	void  Init();						///< Initialization (when the driver is installed)
 	void  Clean();						///< Release (when starting up or resetting)
 
 	CHostFiles*  Alloc(uint32_t nKey);
 	CHostFiles*  Search(uint32_t nKey);
 	void  Free(CHostFiles* pFiles);
+	size_t  GetCount() const { return m_cTable.GetCount(); }	///< Number of searches in use
 private:
-	/// For memory management
-	struct ring_t {
-		CRing r;
-		CHostFiles f;
-	};
-
-	CRing m_cRing;						///< For attaching to CHostFiles
+	CHostHandleTable<CHostFiles> m_cTable;					///< For managing CHostFiles
 };
 
 //===========================================================================
@@ -661,6 +783,7 @@ public:
 	void Init();
 
 	void SetKey(uint32_t nKey) { m_nKey = nKey; }			///< Set search key
+	uint32_t GetKey() const { return m_nKey; }				///< Get search key
 	bool isSameKey(uint32_t nKey) const { return m_nKey == nKey; }	///< Compare search key
 	void SetUpdate() { m_bUpdate = true; }				///< Update
 	bool isUpdate() const { return m_bUpdate; }			///< Get update state
@@ -673,17 +796,24 @@ public:
 	bool Open();									///< Open file
 	uint32_t Read(uint8_t* pBuffer, uint32_t nSize);					///< Read file
 	uint32_t Write(const uint8_t* pBuffer, uint32_t nSize);					///< Write file
-	bool Truncate() const;								///< Truncate file
-	uint32_t Seek(uint32_t nOffset, Human68k::seek_t nHumanSeek);		///< Seek file
-	bool TimeStamp(uint32_t nHumanTime) const;						///< Set file time stamp
+	bool Flush();									///< Write the collected data
+	bool Truncate();								///< Truncate file
+	uint32_t Seek(int32_t nOffset, Human68k::seek_t nHumanSeek);		///< Seek file
+	bool TimeStamp(uint32_t nHumanTime);						///< Set file time stamp
 	void Close();									///< Close file
 
 private:
 	uint32_t m_nKey = 0;								///< Human68k FCB buffer address (0 if unused)
 	bool m_bUpdate = false;							///< Update flag
-	FILE* m_pFile = nullptr;						///< Host side file object
-	const char* m_pszMode = nullptr;				///< Host side file open mode
+	int m_nFd = -1;								///< Host side file descriptor
+	int m_nMode = 0;							///< Host side file open flags
 	bool m_bFlag = false;							///< Host side file open flag
+	off_t m_nOffset = 0;							///< File position
+	off_t m_nReadEnd = 0;							///< File position after the last read, for detecting sequential reads
+	std::vector<uint8_t> m_cReadBuffer;					///< Read-ahead data
+	off_t m_nReadOffset = 0;						///< File position of the read-ahead data
+	std::vector<uint8_t> m_cWriteBuffer;					///< Collected write data
+	off_t m_nWriteOffset = 0;						///< File position of the collected write data
 	uint8_t m_szHumanPath[HUMAN68K_PATH_MAX] = {};		///< Human68k path name
 	TCHAR m_szFilename[FILEPATH_MAX] = {};			///< Host side file name
 };
@@ -695,24 +825,16 @@ private:
 //===========================================================================
 class CHostFcbManager {
 public:
-	#ifdef _DEBUG
-	~CHostFcbManager();
-	#endif	// _DEBUG
 	void  Init();								///< Initialization (when the driver is installed)
-	void  Clean() const;						///< Release (when starting up or resetting)
+	void  Clean();								///< Release (when starting up or resetting)
 
 	CHostFcb*  Alloc(uint32_t nKey);
 	CHostFcb*  Search(uint32_t nKey);
 	void  Free(CHostFcb* p);
+	size_t  GetCount() const { return m_cTable.GetCount(); }	///< Number of open files
 
 private:
-	/// For memory management
-	struct ring_t {
-		CRing r;
-		CHostFcb f;
-	};
-
-	CRing m_cRing;								///< For attaching to CHostFcb
+	CHostHandleTable<CHostFcb> m_cTable;					///< For managing CHostFcb
 };
 
 //===========================================================================
@@ -731,6 +853,7 @@ public:
 	CHostDrv& operator=(const CHostDrv&) = default;
 
 	void Init(const TCHAR* szBase, uint32_t nFlag);				///< Initialization (device startup and load)
+	void SetCacheMax(uint32_t nCacheMax) { m_nCacheMax = nCacheMax; }	///< Set max number of cached paths
 
 	bool isWriteProtect() const { return m_bWriteProtect; }
 	bool isEnable() const { return m_bEnable; }		///< Is it accessible?
@@ -761,6 +884,11 @@ private:
 	static const uint8_t*  SeparateCopyFilename(const uint8_t* szHuman, uint8_t* szBuffer);
 										///< Split and copy the first element of the Human68k full path name
 
+	// Host side change notification
+	void Watch(CHostPath* pPath);						///< Watch the host side directory of a path
+	void Unwatch(CHostPath* pPath);						///< Stop watching the host side directory of a path
+	void ProcessEvents();							///< Mark the changed paths for being updated
+
 	/// For memory management
 	struct ring_t {
 		CRing r;
@@ -770,6 +898,9 @@ private:
 	bool m_bWriteProtect = false;						///< TRUE if write-protected
 	bool m_bEnable = false;							///< TRUE if media is usable
 	uint32_t m_nRing = 0;							///< Number of stored path names
+	uint32_t m_nCacheMax = XM6_HOST_DIRENTRY_CACHE_MAX;			///< Max number of stored path names
+	int m_nNotify = -1;							///< inotify file descriptor, -1 if not available
+	std::unordered_map<int, std::vector<CHostPath*>> m_cWatch;		///< Watched paths by watch descriptor
 	CRing m_cRing;							///< For attaching to CHostPath
 	Human68k::capacity_t m_capCache;				///< Sector data cache: if "sectors == 0" then not cached
 	bool m_bVolumeCache = false;						///< TRUE if the volume label has been read
@@ -879,6 +1010,8 @@ public:
 	int Files(uint32_t nUnit, uint32_t nKey, const Human68k::namests_t* pNamests, Human68k::files_t* pFiles);
 										///< $47 - Find file
 	int NFiles(uint32_t nUnit, uint32_t nKey, Human68k::files_t* pFiles);		///< $48 - Find next file
+	int NFilesBatch(uint32_t nUnit, uint32_t nKey, uint32_t nCursor, const Human68k::files_t* pFiles,
+		Human68k::files_t* pResult, uint32_t nMax);			///< Find next files, several at once
 	int Create(uint32_t nUnit, uint32_t nKey, const Human68k::namests_t* pNamests, Human68k::fcb_t* pFcb, uint32_t nHumanAttribute, bool bForce);
 										///< $49 - Create file
 	int Open(uint32_t nUnit, uint32_t nKey, const Human68k::namests_t* pNamests, Human68k::fcb_t* pFcb);
@@ -902,6 +1035,7 @@ public:
 	int Lock(uint32_t nUnit) const;							///< $58 - Lock
 
 	void SetOption(uint32_t nOption);						///< Set option
+	void SetCacheMax(uint32_t nCacheMax) { m_nCacheMax = nCacheMax; }	///< Set max number of cached paths per drive
 	uint32_t GetOption() const { return m_nOption; }		///< Get option
 	uint32_t GetDefault() const { return m_nOptionDefault; }	///< Get default options
 	static uint32_t GetFileOption() { return g_nOption; }			///< Get file name change option
@@ -917,6 +1051,8 @@ private:
 	uint32_t m_nOption = 0;							///< Current runtime flag
 	uint32_t m_nOptionDefault = 0;						///< Runtime flag at reset
 
+	uint32_t m_nCacheMax = XM6_HOST_DIRENTRY_CACHE_MAX;			///< Max number of cached paths per drive
+
 	uint32_t m_nDrives = 0;							///< Number of candidates for base path status restoration (scan every time if 0)
 
 	uint32_t m_nKernel = 0;							///< Counter for kernel check
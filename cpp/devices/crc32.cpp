@@ -0,0 +1,310 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "crc32.h"
+#include <array>
+#include <cstring>
+#include <cassert>
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#if defined(__arm__) && !defined(HWCAP2_CRC32)
+#define HWCAP2_CRC32 (1 << 4)
+#endif
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace crc32_util;
+
+namespace
+{
+	const uint32_t POLYNOMIAL = 0xedb88320;
+
+	// The PCLMULQDQ implementation processes blocks of 16 bytes and requires at least 64 bytes
+	const size_t PCLMUL_MIN_LENGTH = 64;
+
+	using crc32_tables = array<array<uint32_t, 256>, 8>;
+
+	const crc32_tables tables = [] {
+		crc32_tables t;
+
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+			for (int j = 0; j < 8; j++) {
+				crc = (crc >> 1) ^ (POLYNOMIAL & -(crc & 1));
+			}
+			t[0][i] = crc;
+		}
+
+		for (uint32_t i = 0; i < 256; i++) {
+			for (size_t n = 1; n < t.size(); n++) {
+				t[n][i] = (t[n - 1][i] >> 8) ^ t[0][t[n - 1][i] & 0xff];
+			}
+		}
+
+		return t;
+	}();
+
+	// The CRC functions below process the non-inverted CRC register
+
+	// The reference implementation, see https://stackoverflow.com/questions/21001659/crc32-algorithm-implementation-in-c-without-a-look-up-table-and-with-a-public-li
+	uint32_t Bitwise(uint32_t crc, span<const uint8_t> data)
+	{
+		for (const auto d : data) {
+			crc ^= d;
+			for (int i = 0; i < 8; i++) {
+				crc = (crc >> 1) ^ (POLYNOMIAL & -(crc & 1));
+			}
+		}
+
+		return crc;
+	}
+
+	uint32_t SlicingBy8(uint32_t crc, span<const uint8_t> data)
+	{
+		const uint8_t *p = data.data();
+		size_t length = data.size();
+
+		// Ethernet frames are little endian, which matches the byte order of all supported platforms
+		for (; length >= 8; length -= 8, p += 8) {
+			uint32_t low;
+			uint32_t high;
+			memcpy(&low, p, sizeof(low));
+			memcpy(&high, p + 4, sizeof(high));
+			low ^= crc;
+			crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff] ^ tables[5][(low >> 16) & 0xff]
+					^ tables[4][low >> 24] ^ tables[3][high & 0xff] ^ tables[2][(high >> 8) & 0xff]
+					^ tables[1][(high >> 16) & 0xff] ^ tables[0][high >> 24];
+		}
+
+		for (; length; length--, p++) {
+			crc = (crc >> 8) ^ tables[0][(crc ^ *p) & 0xff];
+		}
+
+		return crc;
+	}
+
+#if defined(__aarch64__)
+	__attribute__((target("+crc")))
+	uint32_t Arm(uint32_t crc, span<const uint8_t> data)
+	{
+		const uint8_t *p = data.data();
+		size_t length = data.size();
+
+		for (; length >= 8; length -= 8, p += 8) {
+			uint64_t d;
+			memcpy(&d, p, sizeof(d));
+			crc = __crc32d(crc, d);
+		}
+
+		for (; length >= 4; length -= 4, p += 4) {
+			uint32_t d;
+			memcpy(&d, p, sizeof(d));
+			crc = __crc32w(crc, d);
+		}
+
+		for (; length; length--, p++) {
+			crc = __crc32b(crc, *p);
+		}
+
+		return crc;
+	}
+#elif defined(__arm__)
+	// The 32-bit Raspberry Pi OS is built for ARMv6, but the Pi 3 and later support the ARMv8 CRC32 instructions.
+	// The builtins are used because arm_acle.h only declares the intrinsics when CRC32 is enabled for the whole file.
+	__attribute__((target("arch=armv8-a+crc")))
+	uint32_t Arm(uint32_t crc, span<const uint8_t> data)
+	{
+		const uint8_t *p = data.data();
+		size_t length = data.size();
+
+		for (; length >= 4; length -= 4, p += 4) {
+			uint32_t d;
+			memcpy(&d, p, sizeof(d));
+			crc = __builtin_arm_crc32w(crc, d);
+		}
+
+		for (; length; length--, p++) {
+			crc = __builtin_arm_crc32b(crc, *p);
+		}
+
+		return crc;
+	}
+#endif
+
+#if defined(__x86_64__)
+	// Folding with carry-less multiplication, see Intel's "Fast CRC Computation for Generic Polynomials
+	// Using PCLMULQDQ Instruction". The constants are those for the reflected IEEE 802.3 polynomial.
+	__attribute__((target("pclmul,sse4.1")))
+	uint32_t Pclmul(uint32_t crc, span<const uint8_t> data)
+	{
+		if (data.size() < PCLMUL_MIN_LENGTH) {
+			return SlicingBy8(crc, data);
+		}
+
+		alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+		alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+		alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+		alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+		const uint8_t *p = data.data();
+		size_t length = data.size();
+
+		auto load = [] (const uint8_t *b) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(b)); };
+
+		// Fold by 4 x 128 bits
+		__m128i x1 = _mm_xor_si128(load(p), _mm_cvtsi32_si128(static_cast<int>(crc)));
+		__m128i x2 = load(p + 16);
+		__m128i x3 = load(p + 32);
+		__m128i x4 = load(p + 48);
+		__m128i x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+		p += 64;
+		length -= 64;
+
+		while (length >= 64) {
+			const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			const __m128i x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+			const __m128i x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+			const __m128i x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+			x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x5), load(p));
+			x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, x0, 0x11), x6), load(p + 16));
+			x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, x0, 0x11), x7), load(p + 32));
+			x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, x0, 0x11), x8), load(p + 48));
+			p += 64;
+			length -= 64;
+		}
+
+		// Fold into 128 bits
+		x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+		for (const __m128i x : { x2, x3, x4 }) {
+			const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), x), x5);
+		}
+
+		while (length >= 16) {
+			const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x11), load(p)), x5);
+			p += 16;
+			length -= 16;
+		}
+
+		// Fold 128 bits into 64 bits
+		const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, x0, 0x10));
+		x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+		x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x00), _mm_srli_si128(x1, 4));
+
+		// Barrett reduction to 32 bits
+		x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+		__m128i x2r = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x10);
+		x2r = _mm_clmulepi64_si128(_mm_and_si128(x2r, mask), x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2r);
+
+		crc = static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+
+		// The remaining bytes, if any
+		return SlicingBy8(crc, span(p, length));
+	}
+#endif
+
+	crc32_implementation SelectImplementation()
+	{
+		for (const auto implementation : { crc32_implementation::arm, crc32_implementation::pclmul }) {
+			if (crc32_util::IsSupported(implementation)) {
+				return implementation;
+			}
+		}
+
+		return crc32_implementation::slicing_by_8;
+	}
+
+	const crc32_implementation implementation = SelectImplementation();
+}
+
+uint32_t crc32_util::Crc32(span<const uint8_t> data)
+{
+	return Crc32(data, implementation);
+}
+
+uint32_t crc32_util::Crc32(span<const uint8_t> data, crc32_implementation impl)
+{
+	assert(IsSupported(impl));
+
+	switch (impl) {
+#if defined(__aarch64__) || defined(__arm__)
+		case crc32_implementation::arm:
+			return ~Arm(0xffffffff, data);
+#endif
+
+#if defined(__x86_64__)
+		case crc32_implementation::pclmul:
+			return ~Pclmul(0xffffffff, data);
+#endif
+
+		case crc32_implementation::bitwise:
+			return ~Bitwise(0xffffffff, data);
+
+		default:
+			return ~SlicingBy8(0xffffffff, data);
+	}
+}
+
+crc32_util::crc32_implementation crc32_util::GetImplementation()
+{
+	return implementation;
+}
+
+bool crc32_util::IsSupported(crc32_implementation impl)
+{
+	switch (impl) {
+		case crc32_implementation::arm:
+#if defined(__aarch64__)
+			return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#elif defined(__arm__)
+			return getauxval(AT_HWCAP2) & HWCAP2_CRC32;
+#else
+			return false;
+#endif
+
+		case crc32_implementation::pclmul:
+#if defined(__x86_64__)
+			// This may be called during static initialization
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#else
+			return false;
+#endif
+
+		default:
+			return true;
+	}
+}
+
+string crc32_util::GetImplementationName(crc32_implementation impl)
+{
+	switch (impl) {
+		case crc32_implementation::bitwise:
+			return "bitwise";
+
+		case crc32_implementation::arm:
+			return "ARMv8 CRC32";
+
+		case crc32_implementation::pclmul:
+			return "PCLMULQDQ";
+
+		default:
+			return "slicing-by-8";
+	}
+}
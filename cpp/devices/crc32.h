@@ -0,0 +1,35 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// CRC32 (IEEE 802.3) of Ethernet frames. The implementation is selected at runtime:
+// ARMv8 CRC32 instructions, PCLMULQDQ folding on x86 or a slicing-by-8 table lookup.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+using namespace std;
+
+namespace crc32_util
+{
+	enum class crc32_implementation {
+		bitwise,
+		slicing_by_8,
+		arm,
+		pclmul
+	};
+
+	uint32_t Crc32(span<const uint8_t>);
+	uint32_t Crc32(span<const uint8_t>, crc32_implementation);
+	crc32_implementation GetImplementation();
+	bool IsSupported(crc32_implementation);
+	string GetImplementationName(crc32_implementation);
+}
@@ -12,17 +12,21 @@
 #include "shared/piscsi_util.h"
 #include "shared/network_util.h"
 #include <unistd.h>
-#include <poll.h>
 #include <arpa/inet.h>
 #include "ctapdriver.h"
+#include "crc32.h"
+#include "tap_backend.h"
 #include <spdlog/spdlog.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
 #include <sstream>
+#include <cstring>
+#include <chrono>
 
 #ifdef __linux__
 #include <linux/if_tun.h>
 #include <linux/sockios.h>
+#include <linux/filter.h>
 #endif
 
 using namespace std;
@@ -48,6 +52,35 @@ static string br_setif(int br_socket_fd, const string& bridgename, const string&
 #endif
 }
 
+#ifdef __linux__
+// Creates a classic BPF program that accepts frames with one of the given destination addresses
+static vector<sock_filter> create_filter_program(const vector<array<uint8_t, 6>>& addresses)
+{
+	vector<sock_filter> program;
+
+	const auto count = static_cast<int>(addresses.size());
+	for (int i = 0; i < count; i++) {
+		const auto& address = addresses[i];
+		const uint32_t upper = static_cast<uint32_t>(address[0]) << 24 | static_cast<uint32_t>(address[1]) << 16 |
+				static_cast<uint32_t>(address[2]) << 8 | address[3];
+		const uint32_t lower = static_cast<uint32_t>(address[4]) << 8 | address[5];
+
+		// Compare the first 4 and the last 2 bytes of the destination address, on a match jump to "accept"
+		program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0));
+		program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, upper, 0, 2));
+		program.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4));
+		program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, lower, static_cast<uint8_t>(4 * (count - i) - 3), 0));
+	}
+
+	// Reject
+	program.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+	// Accept
+	program.push_back(BPF_STMT(BPF_RET | BPF_K, 0xffffffff));
+
+	return program;
+}
+#endif
+
 string ip_link(int fd, const char* ifname, bool up) {
 #ifndef __linux__
 	return "Can't ip_link: Linux is required";
@@ -70,6 +103,14 @@ string ip_link(int fd, const char* ifname, bool up) {
 
 bool CTapDriver::Init(const param_map& const_params)
 {
+	if (backend != nullptr) {
+		spdlog::info("Using " + backend->GetName() + " packet backend");
+
+		StartReceiver();
+
+		return true;
+	}
+
 #ifndef __linux__
 	return false;
 #else
@@ -189,13 +230,28 @@ bool CTapDriver::Init(const param_map& const_params)
 	close(br_socket_fd);
 
 	spdlog::info("Tap device " + string(ifr.ifr_name) + " created");
+	spdlog::debug("Using " + crc32_util::GetImplementationName(crc32_util::GetImplementation())
+			+ " CRC32 implementation");
+
+	backend = make_unique<TapBackend>(m_hTAP);
+
+	StartReceiver();
 
 	return true;
 #endif
 }
 
-void CTapDriver::CleanUp() const
+CTapDriver::~CTapDriver()
+{
+	StopThreads();
+}
+
+void CTapDriver::CleanUp()
 {
+	StopThreads();
+
+	backend.reset();
+
 	if (m_hTAP != -1) {
 		if (const int br_socket_fd = socket(AF_LOCAL, SOCK_STREAM, 0); br_socket_fd < 0) {
 			LogErrno("Can't open bridge socket");
@@ -213,6 +269,21 @@ void CTapDriver::CleanUp() const
 	}
 }
 
+void CTapDriver::StopThreads()
+{
+	if (receiver.joinable()) {
+		receiver.request_stop();
+		receiver.join();
+	}
+
+	// The send thread sends the remaining queued frames before it terminates
+	if (sender.joinable()) {
+		sender.request_stop();
+		tx_available.release();
+		sender.join();
+	}
+}
+
 param_map CTapDriver::GetDefaultParams() const
 {
 	return {
@@ -313,9 +384,8 @@ string CTapDriver::IpLink(bool enable) const
 
 void CTapDriver::Flush() const
 {
-	while (HasPendingPackets()) {
-		array<uint8_t, ETH_FRAME_LEN> m_garbage_buffer;
-		(void)Receive(m_garbage_buffer.data());
+	if (rx_ring != nullptr) {
+		rx_tail.store(rx_head.load(memory_order_acquire), memory_order_release);
 	}
 }
 
@@ -328,44 +398,160 @@ void CTapDriver::GetMacAddr(uint8_t *mac) const
 
 bool CTapDriver::HasPendingPackets() const
 {
-	assert(m_hTAP != -1);
+	// Without the receive thread there is nothing to receive
+	return rx_ring != nullptr && rx_head.load(memory_order_acquire) != rx_tail.load(memory_order_relaxed);
+}
 
-	// Check if there is data that can be received
-	pollfd fds;
-	fds.fd = m_hTAP;
-	fds.events = POLLIN | POLLERR;
-	fds.revents = 0;
-	poll(&fds, 1, 0);
-	spdlog::trace(to_string(fds.revents) + " revents");
-	return fds.revents & POLLIN;
+void CTapDriver::SetFilter(const vector<array<uint8_t, 6>>& addresses)
+{
+	{
+		scoped_lock<mutex> lock(filter_mutex);
+
+		filter.clear();
+		for (const auto& address : addresses) {
+			filter.insert(GetAddressKey(address));
+		}
+	}
+
+	// The userspace filter remains active, it handles the frames that were received before the kernel filter
+	// was updated, and it is the fallback if the kernel filter cannot be used
+	if (AttachFilter(addresses)) {
+		spdlog::trace("Attached packet filter for " + to_string(addresses.size()) + " address(es) to TAP device");
+	}
+}
+
+bool CTapDriver::IsAccepted(span<const uint8_t> frame) const
+{
+	if (frame.size() < 6) {
+		return false;
+	}
+
+	scoped_lock<mutex> lock(filter_mutex);
+
+	return filter.empty() || filter.contains(GetAddressKey(frame));
+}
+
+bool CTapDriver::AttachFilter(const vector<array<uint8_t, 6>>& addresses) const
+{
+#ifndef __linux__
+	return false;
+#else
+	if (m_hTAP == -1) {
+		return false;
+	}
+
+	if (addresses.empty()) {
+		return !ioctl(m_hTAP, TUNDETACHFILTER, nullptr);
+	}
+
+	if (addresses.size() > MAX_FILTER_ADDRESS_COUNT) {
+		// Filter in userspace only, the jump offsets of the program would exceed 8 bits
+		ioctl(m_hTAP, TUNDETACHFILTER, nullptr);
+		return false;
+	}
+
+	// The kernel copies the program
+	auto program = create_filter_program(addresses);
+	const sock_fprog fprog = { .len = static_cast<unsigned short>(program.size()), .filter = program.data() };
+	if (ioctl(m_hTAP, TUNATTACHFILTER, &fprog)) {
+		spdlog::debug("Can't attach packet filter to TAP device: " + string(strerror(errno)));
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+uint64_t CTapDriver::GetAddressKey(span<const uint8_t> address)
+{
+	uint64_t key = 0;
+	for (int i = 0; i < 6; i++) {
+		key = (key << 8) | address[i];
+	}
+
+	return key;
 }
 
-// See https://stackoverflow.com/questions/21001659/crc32-algorithm-implementation-in-c-without-a-look-up-table-and-with-a-public-li
 uint32_t CTapDriver::Crc32(span<const uint8_t> data) {
-   uint32_t crc = 0xffffffff;
-   for (const auto d: data) {
-      crc ^= d;
-      for (int i = 0; i < 8; i++) {
-         const uint32_t mask = -(static_cast<int>(crc) & 1);
-         crc = (crc >> 1) ^ (0xEDB88320 & mask);
-      }
-   }
-   return ~crc;
+	return crc32_util::Crc32(data);
 }
 
 int CTapDriver::Receive(uint8_t *buf) const
 {
-	assert(m_hTAP != -1);
-
 	// Check if there is data that can be received
 	if (!HasPendingPackets()) {
 		return 0;
 	}
 
+	const uint32_t tail = rx_tail.load(memory_order_relaxed);
+	const rx_frame& frame = rx_ring[tail & (rx_ring_size - 1)];
+	memcpy(buf, frame.data.data(), frame.length);
+	rx_tail.store(tail + 1, memory_order_release);
+	return frame.length;
+}
+
+void CTapDriver::StartReceiver()
+{
+	rx_ring = make_unique<rx_frame[]>(rx_ring_size);
+
+	receiver = jthread([this] (const stop_token& st) { ReceiveFrames(st); });
+
+	tx_ring = make_unique<array<tx_frame, TX_RING_SIZE>>();
+
+	sender = jthread([this] (const stop_token& st) { SendFrames(st); });
+}
+
+void CTapDriver::ReceiveFrames(const stop_token& st)
+{
+	while (!st.stop_requested()) {
+		const uint32_t head = rx_head.load(memory_order_relaxed);
+		const uint32_t count = head - rx_tail.load(memory_order_acquire);
+		if (count == rx_ring_size) {
+			// The initiator does not fetch the frames fast enough
+			array<uint8_t, ETH_FRAME_LEN + ETH_FCS_LEN> garbage;
+			if (const int length = backend->Read(span(garbage.data(), ETH_FRAME_LEN), RX_POLL_TIMEOUT_MS); length > 0) {
+				++dropped_frame_count;
+			}
+			else if (length < 0) {
+				BackOff();
+			}
+			continue;
+		}
+
+		// Waits for a frame, but not longer than until it is time to check whether to terminate
+		rx_frame& frame = rx_ring[head & (rx_ring_size - 1)];
+		frame.length = ReadFrame(frame.data.data(), RX_POLL_TIMEOUT_MS);
+		if (frame.length < 0) {
+			BackOff();
+		}
+		else if (frame.length > 0) {
+			rx_head.store(head + 1, memory_order_release);
+
+			if (count + 1 > max_queued_frame_count) {
+				max_queued_frame_count = count + 1;
+			}
+		}
+	}
+}
+
+void CTapDriver::BackOff()
+{
+	// The error persists, e.g. when the interface was removed, i.e. reading again at once would only spin
+	spdlog::warn("Error occured while receiving a packet");
+
+	this_thread::sleep_for(chrono::milliseconds(RX_POLL_TIMEOUT_MS));
+}
+
+int CTapDriver::ReadFrame(uint8_t *buf, int timeout) const
+{
 	// Receive
-	auto dwReceived = static_cast<uint32_t>(read(m_hTAP, buf, ETH_FRAME_LEN));
+	auto dwReceived = static_cast<uint32_t>(backend->Read(span(buf, ETH_FRAME_LEN), timeout));
 	if (dwReceived == static_cast<uint32_t>(-1)) {
-		spdlog::warn("Error occured while receiving a packet");
+		return -1;
+	}
+
+	// Discard frames that are not for us before computing the CRC
+	if (dwReceived > 0 && !IsAccepted(span(buf, dwReceived))) {
 		return 0;
 	}
 
@@ -381,8 +567,10 @@ int CTapDriver::Receive(uint8_t *buf) const
 		buf[dwReceived + 2] = (uint8_t)((crc >> 16) & 0xFF);
 		buf[dwReceived + 3] = (uint8_t)((crc >> 24) & 0xFF);
 
-		spdlog::trace("CRC is " + to_string(crc) + " - " + to_string(buf[dwReceived+0]) + " " + to_string(buf[dwReceived+1]) +
-				" " + to_string(buf[dwReceived+2]) + " " + to_string(buf[dwReceived+3]));
+		if (spdlog::should_log(spdlog::level::trace)) {
+			spdlog::trace("CRC is " + to_string(crc) + " - " + to_string(buf[dwReceived+0]) + " " + to_string(buf[dwReceived+1]) +
+					" " + to_string(buf[dwReceived+2]) + " " + to_string(buf[dwReceived+3]));
+		}
 
 		// Add FCS size to the received message size
 		dwReceived += 4;
@@ -394,8 +582,89 @@ int CTapDriver::Receive(uint8_t *buf) const
 
 int CTapDriver::Send(const uint8_t *buf, int len) const
 {
-	assert(m_hTAP != -1);
+	if (tx_ring == nullptr || len < 0) {
+		return -1;
+	}
+
+	// The frames are only written by the send thread, i.e. oversized frames cannot be sent
+	if (len > TX_MAX_FRAME_LENGTH) {
+		++tx_dropped_frame_count;
+		spdlog::warn("Dropped oversized frame of " + to_string(len) + " byte(s)");
+		return -1;
+	}
 
-	// Start sending
-	return static_cast<int>(write(m_hTAP, buf, len));
+	const uint32_t head = tx_head.load(memory_order_relaxed);
+
+	// If the queue is full wait for the send thread for a limited time, then drop the frame.
+	// This limits how long a congested network can stall the bus.
+	uint32_t count = head - tx_tail.load(memory_order_acquire);
+	for (int waited = 0; count == TX_RING_SIZE; waited += TX_WAIT_INTERVAL_US) {
+		if (waited >= TX_MAX_WAIT_US) {
+			++tx_dropped_frame_count;
+			return 0;
+		}
+
+		this_thread::sleep_for(chrono::microseconds(TX_WAIT_INTERVAL_US));
+
+		count = head - tx_tail.load(memory_order_acquire);
+	}
+
+	tx_frame& frame = (*tx_ring)[head & (TX_RING_SIZE - 1)];
+	memcpy(frame.data.data(), buf, len);
+	frame.length = len;
+	frame.timestamp = GetTimestamp();
+	tx_head.store(head + 1, memory_order_release);
+
+	if (count + 1 > tx_max_queued_frame_count) {
+		tx_max_queued_frame_count = count + 1;
+	}
+
+	tx_available.release();
+
+	return len;
+}
+
+void CTapDriver::SendFrames(const stop_token& st)
+{
+	while (!st.stop_requested()) {
+		// Each queued frame releases the semaphore, i.e. there may be wake-ups without pending frames
+		tx_available.acquire();
+
+		WriteFrames();
+	}
+
+	WriteFrames();
+}
+
+void CTapDriver::WriteFrames()
+{
+	// Write all queued frames in one go. Each write() sends exactly one frame, combining
+	// frames with writev() is not possible because a TAP device treats each write as a single frame.
+	for (uint32_t tail = tx_tail.load(memory_order_relaxed); tail != tx_head.load(memory_order_acquire); tail++) {
+		const tx_frame& frame = (*tx_ring)[tail & (TX_RING_SIZE - 1)];
+
+		if (backend->Write(span(frame.data.data(), frame.length)) != frame.length) {
+			spdlog::warn("Error occured while sending a packet");
+		}
+
+		const uint64_t latency = GetTimestamp() - frame.timestamp;
+		tx_total_latency += latency;
+		++tx_frame_count;
+		if (latency > tx_max_latency) {
+			tx_max_latency = latency;
+		}
+
+		tx_tail.store(tail + 1, memory_order_release);
+	}
+}
+
+uint64_t CTapDriver::GetAverageSendLatency() const
+{
+	const uint64_t count = tx_frame_count;
+	return count ? tx_total_latency / count : 0;
+}
+
+uint64_t CTapDriver::GetTimestamp()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
 }
@@ -12,11 +12,18 @@
 #pragma once
 
 #include "devices/device.h"
+#include "packet_backend.h"
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 #include <array>
 #include <span>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <semaphore>
+#include <mutex>
 
 #ifndef ETH_FRAME_LEN
 static const int ETH_FRAME_LEN = 1514;
@@ -33,15 +40,39 @@ class CTapDriver
 
 	const inline static string DEFAULT_IP = "10.10.20.1/24"; //NOSONAR This hardcoded IP address is safe
 
+	// How long the receive thread waits for a frame before checking whether it has to terminate
+	static const int RX_POLL_TIMEOUT_MS = 100;
+
+	// The number of frames queued for the send thread, must be a power of 2
+	static const uint32_t TX_RING_SIZE = 64;
+
+	// How long Send() waits for a free queue entry when the queue is full before dropping the frame
+	static const int TX_MAX_WAIT_US = 10'000;
+	static const int TX_WAIT_INTERVAL_US = 100;
+
+	// The largest frame that can be sent, a VLAN-tagged Ethernet frame including the frame check sequence.
+	// The DaynaPort and SCSIBR drivers do not send larger frames, and the network would not accept them.
+	static const int TX_MAX_FRAME_LENGTH = ETH_FRAME_LEN + 4 + ETH_FCS_LEN;
+
+	// The maximum number of destination addresses a kernel packet filter can check
+	static const int MAX_FILTER_ADDRESS_COUNT = 64;
+
 public:
 
-	CTapDriver() = default;
-	~CTapDriver() = default;
-	CTapDriver(CTapDriver&) = default;
-	CTapDriver& operator=(const CTapDriver&) = default;
+	// The default number of frames buffered by the receive thread
+	static const uint32_t DEFAULT_RX_RING_SIZE = 64;
+
+	// The receive ring size must be a power of 2
+	explicit CTapDriver(uint32_t size = DEFAULT_RX_RING_SIZE) : rx_ring_size(size) {}
+	~CTapDriver();
+	CTapDriver(CTapDriver&) = delete;
+	CTapDriver& operator=(const CTapDriver&) = delete;
 
 	bool Init(const param_map&);
-	void CleanUp() const;
+	void CleanUp();
+
+	// Use a different backend than the TAP device, e.g. for testing. Must be called before Init().
+	void SetBackend(unique_ptr<PacketBackend> b) { backend = move(b); }
 
 	param_map GetDefaultParams() const;
 
@@ -52,21 +83,96 @@ public:
 	string IpLink(bool) const;	// Enable/Disable the piscsi0 interface
 	void Flush() const;			// Purge all of the packets that are waiting to be processed
 
+	// Receive ring statistics
+	uint64_t GetDroppedFrameCount() const { return dropped_frame_count; }
+	uint32_t GetQueuedFrameCount() const { return rx_head - rx_tail; }
+	uint32_t GetMaxQueuedFrameCount() const { return max_queued_frame_count; }
+
+	// Send queue statistics
+	uint64_t GetDroppedSendFrameCount() const { return tx_dropped_frame_count; }
+	uint32_t GetMaxQueuedSendFrameCount() const { return tx_max_queued_frame_count; }
+	uint64_t GetMaxSendLatency() const { return tx_max_latency; }
+	uint64_t GetAverageSendLatency() const;
+
+	// Only frames for these destination addresses are received, an empty list accepts all frames.
+	// If possible the filter is attached to the TAP device, so that the kernel discards the other frames.
+	void SetFilter(const vector<array<uint8_t, 6>>&);
+	bool IsAccepted(span<const uint8_t>) const;
+
 	static uint32_t Crc32(span<const uint8_t>);
 
 private:
 
+	void StartReceiver();
+	void StopThreads();
+	void ReceiveFrames(const stop_token&);
+	int ReadFrame(uint8_t *, int) const;
+	static void BackOff();
+	void SendFrames(const stop_token&);
+	void WriteFrames();
+
+	bool AttachFilter(const vector<array<uint8_t, 6>>&) const;
+
+	static uint64_t GetTimestamp();
+	static uint64_t GetAddressKey(span<const uint8_t>);
+
 	static string SetUpEth0(int, const string&);
 	static string SetUpNonEth0(int, int, const string&);
 	static pair<string, string> ExtractAddressAndMask(const string&);
 
-	array<byte, 6> m_MacAddr;	// MAC Address
+	array<byte, 6> m_MacAddr = {};	// MAC Address
 
 	int m_hTAP = -1;			// File handle
 
+	unique_ptr<PacketBackend> backend;
+
 	// Prioritized comma-separated list of interfaces to create the bridge for
 	vector<string> interfaces;
 
 	string inet;
+
+	// Frames received by the receive thread, including the CRC
+	struct rx_frame {
+		int length;
+		array<uint8_t, ETH_FRAME_LEN + ETH_FCS_LEN> data;
+	};
+	unique_ptr<rx_frame[]> rx_ring;
+	uint32_t rx_ring_size;
+
+	// The receive thread is the only producer, the bus thread is the only consumer
+	atomic<uint32_t> rx_head = 0;
+	mutable atomic<uint32_t> rx_tail = 0;
+
+	atomic<uint64_t> dropped_frame_count = 0;
+	atomic<uint32_t> max_queued_frame_count = 0;
+
+	jthread receiver;
+
+	// Frames queued for the send thread
+	struct tx_frame {
+		int length;
+		uint64_t timestamp;
+		array<uint8_t, TX_MAX_FRAME_LENGTH> data;
+	};
+	unique_ptr<array<tx_frame, TX_RING_SIZE>> tx_ring;
+
+	// The bus thread is the only producer, the send thread is the only consumer
+	mutable atomic<uint32_t> tx_head = 0;
+	atomic<uint32_t> tx_tail = 0;
+
+	// Released for each queued frame, the send thread sleeps while there are no frames
+	mutable counting_semaphore<> tx_available { 0 };
+
+	mutable atomic<uint64_t> tx_dropped_frame_count = 0;
+	mutable atomic<uint32_t> tx_max_queued_frame_count = 0;
+	atomic<uint64_t> tx_frame_count = 0;
+	atomic<uint64_t> tx_total_latency = 0;
+	atomic<uint64_t> tx_max_latency = 0;
+
+	jthread sender;
+
+	// The destination addresses accepted by the userspace filter, used by the receive thread
+	unordered_set<uint64_t> filter;
+	mutable mutex filter_mutex;
 };
 
@@ -39,18 +39,16 @@ void DeviceLogger::Error(const string& message) const
 
 void DeviceLogger::Log(level::level_enum level, const string& message) const
 {
-	if (!message.empty() &&
-			(log_device_id == -1 ||
-					(log_device_id == id && (log_device_lun == -1 || log_device_lun == lun)))) {
-		if (lun == -1) {
-			log(level, "(ID " + to_string(id) + ") - " + message);
-		}
-		else {
-			log(level, "(ID:LUN " + to_string(id) + ":" + to_string(lun) + ") - " + message);
-		}
+	if (!message.empty() && should_log(level) && IsLogDevice()) {
+		log(level, GetPrefix(id, lun) + message);
 	}
 }
 
+string DeviceLogger::GetPrefix(int id, int lun)
+{
+	return lun == -1 ? "(ID " + to_string(id) + ") - " : "(ID:LUN " + to_string(id) + ":" + to_string(lun) + ") - ";
+}
+
 void DeviceLogger::SetIdAndLun(int i, int l)
 {
 	id = i;
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "spdlog/spdlog.h"
+#include "trace_log.h"
 #include <string>
 
 using namespace std;
@@ -28,12 +29,28 @@ public:
 	void Warn(const string&) const;
 	void Error(const string&) const;
 
+	// Cheap check for the hot paths, so that no trace message is created if it would not be logged
+	bool IsTraceEnabled() const { return spdlog::should_log(spdlog::level::trace) && IsLogDevice(); }
+	bool IsDebugEnabled() const { return spdlog::should_log(spdlog::level::debug) && IsLogDevice(); }
+	void Trace(TraceLog::trace_event event, uint64_t value1, uint32_t value2 = 0, span<const uint8_t> data = {}) const
+	{
+		if (IsTraceEnabled()) {
+			TraceLog::Record(event, id, lun, value1, value2, data);
+		}
+	}
+
 	void SetIdAndLun(int, int);
 	static void SetLogIdAndLun(int, int);
 
+	static string GetPrefix(int, int);
+
 private:
 
 	void Log(spdlog::level::level_enum, const string&) const;
+	bool IsLogDevice() const
+	{
+		return log_device_id == -1 || (log_device_id == id && (log_device_lun == -1 || log_device_lun == lun));
+	}
 
 	int id = -1;
 	int lun = -1;
@@ -17,8 +17,6 @@
 #include "shared/piscsi_exceptions.h"
 #include "scsi_command_util.h"
 #include "disk.h"
-#include <sstream>
-#include <iomanip>
 
 using namespace scsi_defs;
 using namespace scsi_command_util;
@@ -663,9 +661,7 @@ tuple<bool, uint64_t, uint32_t> Disk::CheckAndGetStartAndCount(access_mode mode)
 		}
 	}
 
-	stringstream s;
-	s << "READ/WRITE/VERIFY/SEEK, start block: $" << setfill('0') << setw(8) << hex << start;
-	LogTrace(s.str() + ", blocks: " + to_string(count));
+	LogTrace(TraceLog::trace_event::block, start, count);
 
 	// Check capacity
 	if (uint64_t capacity = GetBlockCount(); !capacity || start > capacity || start + count > capacity) {
@@ -710,7 +706,8 @@ uint32_t Disk::GetConfiguredSectorSize() const
 
 bool Disk::SetConfiguredSectorSize(const DeviceFactory& device_factory, uint32_t configured_size)
 {
-	if (!device_factory.GetSectorSizes(GetType()).contains(configured_size)) {
+	// 0 means that the default sector size is used
+	if (configured_size && !device_factory.GetSectorSizes(GetType()).contains(configured_size)) {
 		return false;
 	}
 
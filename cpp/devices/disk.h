@@ -65,6 +65,7 @@ public:
 
 	uint32_t GetSectorSizeInBytes() const;
 	bool IsSectorSizeConfigurable() const { return !sector_sizes.empty(); }
+	uint32_t GetConfiguredSectorSize() const;
 	bool SetConfiguredSectorSize(const DeviceFactory&, uint32_t);
 	void FlushCache() override;
 
@@ -123,6 +124,5 @@ protected:
 	void SetSectorSizeInBytes(uint32_t);
 	uint32_t GetSectorSizeShiftCount() const { return size_shift_count; }
 	void SetSectorSizeShiftCount(uint32_t count) { size_shift_count = count; }
-	uint32_t GetConfiguredSectorSize() const;
 	static uint32_t CalculateShiftCount(uint32_t);
 };
@@ -0,0 +1,60 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "loopback_backend.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+pair<unique_ptr<LoopbackBackend>, unique_ptr<LoopbackBackend>> LoopbackBackend::CreatePair()
+{
+	auto a_to_b = make_shared<channel>();
+	auto b_to_a = make_shared<channel>();
+
+	// The constructor is private
+	return { unique_ptr<LoopbackBackend>(new LoopbackBackend(b_to_a, a_to_b)),
+		unique_ptr<LoopbackBackend>(new LoopbackBackend(a_to_b, b_to_a)) };
+}
+
+int LoopbackBackend::Read(span<uint8_t> buf, int timeout)
+{
+	unique_lock<mutex> lock(rx->frames_mutex);
+
+	if (!rx->frames_available.wait_for(lock, chrono::milliseconds(timeout), [this] { return !rx->frames.empty(); })) {
+		return 0;
+	}
+
+	const vector<uint8_t> frame = move(rx->frames.front());
+	rx->frames.pop_front();
+
+	const size_t size = min(buf.size(), frame.size());
+	memcpy(buf.data(), frame.data(), size);
+
+	return static_cast<int>(size);
+}
+
+int LoopbackBackend::Write(span<const uint8_t> buf)
+{
+	{
+		scoped_lock<mutex> lock(tx->frames_mutex);
+
+		if (tx->frames.size() >= MAX_QUEUED_FRAMES) {
+			// Dropped on the wire
+			return static_cast<int>(buf.size());
+		}
+
+		tx->frames.emplace_back(buf.begin(), buf.end());
+	}
+
+	tx->frames_available.notify_one();
+
+	return static_cast<int>(buf.size());
+}
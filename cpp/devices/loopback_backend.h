@@ -0,0 +1,49 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// A pair of in-process backends, the frames written to one of them are read from the other one
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "packet_backend.h"
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+class LoopbackBackend : public PacketBackend
+{
+	// Like a network interface queue, frames are dropped when the queue is full
+	static const size_t MAX_QUEUED_FRAMES = 4096;
+
+	struct channel {
+		mutex frames_mutex;
+		condition_variable frames_available;
+		deque<vector<uint8_t>> frames;
+	};
+
+public:
+
+	~LoopbackBackend() override = default;
+
+	static pair<unique_ptr<LoopbackBackend>, unique_ptr<LoopbackBackend>> CreatePair();
+
+	int Read(span<uint8_t>, int) override;
+	int Write(span<const uint8_t>) override;
+
+	string GetName() const override { return "loopback"; }
+
+private:
+
+	LoopbackBackend(shared_ptr<channel> r, shared_ptr<channel> t) : rx(r), tx(t) {}
+
+	shared_ptr<channel> rx;
+	shared_ptr<channel> tx;
+};
@@ -0,0 +1,35 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// The source and sink of the Ethernet frames of a CTapDriver. Frames do not include the CRC.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <span>
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+class PacketBackend
+{
+
+public:
+
+	PacketBackend() = default;
+	virtual ~PacketBackend() = default;
+
+	// Waits up to the timeout for a frame. Returns the frame size, 0 if there is no frame or -1 on error.
+	virtual int Read(span<uint8_t>, int) = 0;
+
+	// Returns the number of bytes written or -1 on error
+	virtual int Write(span<const uint8_t>) = 0;
+
+	virtual string GetName() const = 0;
+};
@@ -0,0 +1,279 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "packet_capture.h"
+#include <spdlog/spdlog.h>
+#include <filesystem>
+#include <chrono>
+#include <vector>
+#include <cstring>
+
+using namespace std;
+using namespace filesystem;
+
+namespace
+{
+	// pcapng block types
+	const uint32_t SECTION_HEADER_BLOCK = 0x0a0d0d0a;
+	const uint32_t INTERFACE_DESCRIPTION_BLOCK = 0x00000001;
+	const uint32_t ENHANCED_PACKET_BLOCK = 0x00000006;
+
+	const uint32_t BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+	const uint16_t LINKTYPE_ETHERNET = 1;
+
+	// pcapng option codes
+	const uint16_t OPT_ENDOFOPT = 0;
+	const uint16_t IF_NAME = 2;
+	const uint16_t EPB_FLAGS = 2;
+
+	void Append(vector<uint8_t>& buf, const void *data, size_t length)
+	{
+		const auto *d = static_cast<const uint8_t *>(data);
+		buf.insert(buf.end(), d, d + length);
+
+		// Blocks and options are padded to 32 bits
+		buf.resize((buf.size() + 3) & ~3);
+	}
+
+	template<typename T>
+	void Append(vector<uint8_t>& buf, T value)
+	{
+		const auto *d = reinterpret_cast<const uint8_t *>(&value);
+		buf.insert(buf.end(), d, d + sizeof(T));
+	}
+
+	void AppendOption(vector<uint8_t>& buf, uint16_t code, const void *data, uint16_t length)
+	{
+		Append(buf, code);
+		Append(buf, length);
+		Append(buf, data, length);
+	}
+}
+
+string PacketCapture::Start(const string& f, uint64_t size, int count)
+{
+	if (f.empty()) {
+		return "Missing capture file name";
+	}
+
+	if (size < MAX_FRAME_LENGTH * 2) {
+		return "Maximum capture file size must be at least " + to_string(MAX_FRAME_LENGTH * 2) + " bytes";
+	}
+
+	if (count < 1) {
+		return "Invalid capture file count " + to_string(count);
+	}
+
+	Stop();
+
+	filename = f;
+	max_file_size = size;
+	max_file_count = count;
+
+	if (!OpenFile()) {
+		return "Can't open capture file '" + filename + "'";
+	}
+
+	if (ring == nullptr) {
+		ring = make_unique<slot[]>(RING_SIZE);
+		for (uint32_t i = 0; i < RING_SIZE; i++) {
+			ring[i].sequence = i;
+		}
+	}
+
+	thread = jthread([] (stop_token st) {
+		while (!st.stop_requested()) {
+			Flush();
+
+			this_thread::sleep_for(chrono::milliseconds(POLL_INTERVAL_MS));
+		}
+
+		Flush();
+	});
+
+	running = true;
+
+	spdlog::info("Capturing network packets in '" + filename + "'");
+
+	return "";
+}
+
+void PacketCapture::Stop()
+{
+	running = false;
+
+	if (thread.joinable()) {
+		thread.request_stop();
+		thread.join();
+
+		file.close();
+
+		spdlog::info("Stopped capturing network packets");
+	}
+}
+
+string PacketCapture::GetRotatedFilename(const string& f, int index)
+{
+	return index ? f + "." + to_string(index) : f;
+}
+
+void PacketCapture::Record(int id, int lun, direction dir, span<const uint8_t> frame)
+{
+	// Multiple producers are possible, a slot is claimed by advancing the head
+	uint32_t pos = head.load(memory_order_relaxed);
+	while (true) {
+		slot& s = ring[pos & (RING_SIZE - 1)];
+		const auto diff = static_cast<int32_t>(s.sequence.load(memory_order_acquire) - pos);
+		if (!diff) {
+			if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+				capture_record& record = s.record;
+				record.timestamp = chrono::duration_cast<chrono::microseconds>(
+						chrono::system_clock::now().time_since_epoch()).count();
+				record.id = static_cast<int8_t>(id);
+				record.lun = static_cast<int8_t>(lun);
+				record.dir = dir;
+				record.original_length = static_cast<uint32_t>(frame.size());
+				record.length = static_cast<uint16_t>(min(frame.size(), record.data.size()));
+				memcpy(record.data.data(), frame.data(), record.length);
+				s.sequence.store(pos + 1, memory_order_release);
+				return;
+			}
+		}
+		else if (diff < 0) {
+			// The ring is full, the background thread cannot keep up
+			++dropped;
+			return;
+		}
+		else {
+			pos = head.load(memory_order_relaxed);
+		}
+	}
+}
+
+void PacketCapture::Flush()
+{
+	while (true) {
+		const uint32_t pos = tail.load(memory_order_relaxed);
+		slot& s = ring[pos & (RING_SIZE - 1)];
+		if (s.sequence.load(memory_order_acquire) != pos + 1) {
+			break;
+		}
+
+		Write(s.record);
+
+		s.sequence.store(pos + RING_SIZE, memory_order_release);
+		tail.store(pos + 1, memory_order_relaxed);
+	}
+
+	file.flush();
+}
+
+void PacketCapture::Write(const capture_record& record)
+{
+	// The largest possible interface description block and enhanced packet block
+	if (file_size + MAX_FRAME_LENGTH + 128 > max_file_size) {
+		Rotate();
+	}
+
+	if (!file.is_open()) {
+		return;
+	}
+
+	const int key = record.id * 256 + record.lun;
+	auto it = interfaces.find(key);
+	if (it == interfaces.end()) {
+		const auto interface_id = static_cast<uint32_t>(interfaces.size());
+		it = interfaces.emplace(key, interface_id).first;
+		WriteInterfaceDescriptionBlock("scsi" + to_string(record.id) + ":" + to_string(record.lun));
+	}
+
+	WriteEnhancedPacketBlock(it->second, record);
+}
+
+bool PacketCapture::OpenFile()
+{
+	interfaces.clear();
+	file_size = 0;
+
+	file.open(filename, ios::binary | ios::trunc);
+	if (file.fail()) {
+		spdlog::error("Can't open capture file '" + filename + "'");
+		return false;
+	}
+
+	WriteSectionHeaderBlock();
+
+	return true;
+}
+
+void PacketCapture::Rotate()
+{
+	file.close();
+
+	// The oldest file is overwritten
+	for (int i = max_file_count - 1; i > 0; i--) {
+		error_code error;
+		rename(path(GetRotatedFilename(filename, i - 1)), path(GetRotatedFilename(filename, i)), error);
+	}
+
+	OpenFile();
+}
+
+void PacketCapture::WriteSectionHeaderBlock()
+{
+	vector<uint8_t> body;
+	Append(body, BYTE_ORDER_MAGIC);
+	Append(body, static_cast<uint16_t>(1));
+	Append(body, static_cast<uint16_t>(0));
+	// The section length is not specified
+	Append(body, static_cast<int64_t>(-1));
+
+	WriteBlock(SECTION_HEADER_BLOCK, body);
+}
+
+void PacketCapture::WriteInterfaceDescriptionBlock(const string& name)
+{
+	vector<uint8_t> body;
+	Append(body, LINKTYPE_ETHERNET);
+	Append(body, static_cast<uint16_t>(0));
+	Append(body, MAX_FRAME_LENGTH);
+	AppendOption(body, IF_NAME, name.data(), static_cast<uint16_t>(name.size()));
+	AppendOption(body, OPT_ENDOFOPT, nullptr, 0);
+
+	WriteBlock(INTERFACE_DESCRIPTION_BLOCK, body);
+}
+
+void PacketCapture::WriteEnhancedPacketBlock(uint32_t interface_id, const capture_record& record)
+{
+	vector<uint8_t> body;
+	body.reserve(record.length + 64);
+	Append(body, interface_id);
+	Append(body, static_cast<uint32_t>(record.timestamp >> 32));
+	Append(body, static_cast<uint32_t>(record.timestamp));
+	Append(body, static_cast<uint32_t>(record.length));
+	Append(body, static_cast<uint32_t>(record.original_length));
+	Append(body, record.data.data(), record.length);
+	const auto flags = static_cast<uint32_t>(record.dir);
+	AppendOption(body, EPB_FLAGS, &flags, sizeof(flags));
+	AppendOption(body, OPT_ENDOFOPT, nullptr, 0);
+
+	WriteBlock(ENHANCED_PACKET_BLOCK, body);
+}
+
+void PacketCapture::WriteBlock(uint32_t type, span<const uint8_t> body)
+{
+	// Block type, block total length, body, block total length
+	const auto length = static_cast<uint32_t>(body.size() + 12);
+	file.write((const char *)&type, sizeof(type));
+	file.write((const char *)&length, sizeof(length));
+	file.write((const char *)body.data(), body.size());
+	file.write((const char *)&length, sizeof(length));
+
+	file_size += length;
+}
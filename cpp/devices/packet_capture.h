@@ -0,0 +1,117 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Captures the frames exchanged between the initiator and the network devices (DaynaPort, SCSIBR) in
+// pcapng files. The frames are copied into a lock-free ring and are written by a background thread.
+// When a file has reached its maximum size the files are rotated.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+
+using namespace std;
+
+class PacketCapture
+{
+	// Must be a power of 2
+	static const uint32_t RING_SIZE = 256;
+
+	// How often the background thread checks for new frames
+	static const int POLL_INTERVAL_MS = 10;
+
+	// Large enough for an Ethernet frame including the FCS, and for SCSIBR packets
+	static const uint32_t MAX_FRAME_LENGTH = 2048;
+
+public:
+
+	static const uint64_t DEFAULT_MAX_FILE_SIZE = 16 * 1024 * 1024;
+	static const int DEFAULT_MAX_FILE_COUNT = 4;
+
+	// The values of the direction bits of the pcapng epb_flags option
+	enum class direction : uint8_t {
+		inbound = 1,
+		outbound = 2
+	};
+
+	// Returns an error message or an empty string on success
+	static string Start(const string&, uint64_t = DEFAULT_MAX_FILE_SIZE, int = DEFAULT_MAX_FILE_COUNT);
+	static void Stop();
+	static bool IsRunning() { return running.load(memory_order_relaxed); }
+
+	// "inbound" are the frames the initiator receives, "outbound" are the frames the initiator sends
+	static void Capture(int id, int lun, direction dir, span<const uint8_t> frame) {
+		if (IsRunning()) {
+			Record(id, lun, dir, frame);
+		}
+	}
+
+	static uint64_t GetDropped() { return dropped; }
+
+	static string GetRotatedFilename(const string&, int);
+
+private:
+
+	struct capture_record {
+		uint64_t timestamp;
+		int8_t id;
+		int8_t lun;
+		direction dir;
+		// The length of the frame and the length of the captured data, which might have been truncated
+		uint32_t original_length;
+		uint16_t length;
+		array<uint8_t, MAX_FRAME_LENGTH> data;
+	};
+
+	struct slot {
+		atomic<uint32_t> sequence;
+		capture_record record;
+	};
+
+	static void Record(int, int, direction, span<const uint8_t>);
+	static void Flush();
+	static void Write(const capture_record&);
+	static bool OpenFile();
+	static void Rotate();
+
+	static void WriteSectionHeaderBlock();
+	static void WriteInterfaceDescriptionBlock(const string&);
+	static void WriteEnhancedPacketBlock(uint32_t, const capture_record&);
+	static void WriteBlock(uint32_t, span<const uint8_t>);
+
+	// Allocated when the capture is started for the first time, and never released because the bus thread
+	// may still be recording while the capture is stopped
+	static inline unique_ptr<slot[]> ring;
+
+	static inline atomic<uint32_t> head;
+	static inline atomic<uint32_t> tail;
+
+	static inline atomic<uint64_t> dropped;
+
+	static inline atomic<bool> running;
+
+	static inline jthread thread;
+
+	static inline string filename;
+	static inline uint64_t max_file_size;
+	static inline int max_file_count;
+
+	static inline ofstream file;
+	static inline uint64_t file_size;
+
+	// Maps ID and LUN to the pcapng interface ID, each device has its own interface
+	static inline unordered_map<int, uint32_t> interfaces;
+};
@@ -0,0 +1,111 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "pcap_backend.h"
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+bool PcapBackend::Open(const string& source_filename, const string& sink_filename)
+{
+	if (!source_filename.empty()) {
+		source.open(source_filename, ios::binary);
+
+		file_header header;
+		if (!source.read((char *)&header, sizeof(header))) {
+			spdlog::error("Can't read pcap file '" + source_filename + "'");
+			return false;
+		}
+
+		swapped = header.magic == __builtin_bswap32(MAGIC) || header.magic == __builtin_bswap32(MAGIC_NS);
+		if (!swapped && header.magic != MAGIC && header.magic != MAGIC_NS) {
+			spdlog::error("'" + source_filename + "' is not a pcap file");
+			return false;
+		}
+
+		if (Swap(header.network) != LINKTYPE_ETHERNET) {
+			spdlog::error("'" + source_filename + "' does not contain Ethernet frames");
+			return false;
+		}
+
+		// The snap length of the file may be larger than the largest frame the backends support
+		snap_length = header.snaplen ? min(Swap(header.snaplen), SNAP_LENGTH) : SNAP_LENGTH;
+
+		replay_done = false;
+	}
+
+	if (!sink_filename.empty()) {
+		sink.open(sink_filename, ios::binary | ios::trunc);
+
+		const file_header header = { .magic = MAGIC, .version_major = 2, .version_minor = 4, .thiszone = 0, .sigfigs = 0,
+				.snaplen = SNAP_LENGTH, .network = LINKTYPE_ETHERNET };
+		if (!sink.write((const char *)&header, sizeof(header))) {
+			spdlog::error("Can't write pcap file '" + sink_filename + "'");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int PcapBackend::Read(span<uint8_t> buf, int timeout)
+{
+	if (!replay_done) {
+		record_header header;
+		if (source.read((char *)&header, sizeof(header))) {
+			const uint32_t length = Swap(header.incl_len);
+			if (length > snap_length) {
+				spdlog::error("Invalid pcap record length of " + to_string(length) + " bytes, stopping replay");
+			}
+			else if (vector<char> frame(length); source.read(frame.data(), length)) {
+				replayed_frame_count++;
+
+				// Frames that are too long for the buffer are truncated
+				const size_t size = min(buf.size(), static_cast<size_t>(length));
+				memcpy(buf.data(), frame.data(), size);
+				return static_cast<int>(size);
+			}
+		}
+
+		replay_done = true;
+		spdlog::debug("Replayed " + to_string(replayed_frame_count) + " frame(s)");
+	}
+
+	// Like a network without traffic
+	this_thread::sleep_for(chrono::milliseconds(timeout));
+
+	return 0;
+}
+
+int PcapBackend::Write(span<const uint8_t> buf)
+{
+	if (!sink.is_open()) {
+		return static_cast<int>(buf.size());
+	}
+
+	const auto now = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+	const record_header header = { .ts_sec = static_cast<uint32_t>(now / 1'000'000),
+			.ts_usec = static_cast<uint32_t>(now % 1'000'000), .incl_len = static_cast<uint32_t>(buf.size()),
+			.orig_len = static_cast<uint32_t>(buf.size()) };
+	if (!sink.write((const char *)&header, sizeof(header)) || !sink.write((const char *)buf.data(), buf.size())) {
+		return -1;
+	}
+
+	return static_cast<int>(buf.size());
+}
+
+uint32_t PcapBackend::Swap(uint32_t value) const
+{
+	return swapped ? __builtin_bswap32(value) : value;
+}
@@ -0,0 +1,77 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Replays the frames of a pcap file and captures the sent frames in a pcap file.
+// The frames are replayed as fast as they are read, the original timing is not preserved.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "packet_backend.h"
+#include <atomic>
+#include <fstream>
+
+class PcapBackend : public PacketBackend
+{
+	static const uint32_t MAGIC = 0xa1b2c3d4;
+	static const uint32_t MAGIC_NS = 0xa1b23c4d;
+	static const uint32_t LINKTYPE_ETHERNET = 1;
+	static const uint32_t SNAP_LENGTH = 65535;
+
+	struct __attribute__((packed)) file_header {
+		uint32_t magic;
+		uint16_t version_major;
+		uint16_t version_minor;
+		int32_t thiszone;
+		uint32_t sigfigs;
+		uint32_t snaplen;
+		uint32_t network;
+	};
+
+	struct __attribute__((packed)) record_header {
+		uint32_t ts_sec;
+		uint32_t ts_usec;
+		uint32_t incl_len;
+		uint32_t orig_len;
+	};
+
+public:
+
+	PcapBackend() = default;
+	~PcapBackend() override = default;
+
+	// Either file name may be empty
+	bool Open(const string&, const string&);
+
+	int Read(span<uint8_t>, int) override;
+	int Write(span<const uint8_t>) override;
+
+	string GetName() const override { return "pcap"; }
+
+	uint64_t GetReplayedFrameCount() const { return replayed_frame_count; }
+	bool IsReplayDone() const { return replay_done; }
+
+private:
+
+	uint32_t Swap(uint32_t) const;
+
+	ifstream source;
+	ofstream sink;
+
+	// The byte order of the source file differs from the host byte order
+	bool swapped = false;
+
+	// Longer records are considered corrupt
+	uint32_t snap_length = SNAP_LENGTH;
+
+	// Incremented by the thread that replays the frames, but read by other threads
+	atomic<uint64_t> replayed_frame_count = 0;
+
+	// Not only checked by the thread that replays the frames
+	atomic<bool> replay_done = true;
+};
@@ -42,21 +42,29 @@ void PrimaryDevice::AddCommand(scsi_command cmd, const operation& execute)
 
 void PrimaryDevice::Dispatch(scsi_command cmd)
 {
-	stringstream s;
-	s << "$" << setfill('0') << setw(2) << hex << static_cast<int>(cmd);
-
 	if (const auto& it = commands.find(cmd); it != commands.end()) {
-		LogDebug("Device is executing " + command_mapping.find(cmd)->second.second + " (" + s.str() + ")");
+		if (IsDebugEnabled()) {
+			LogDebug("Device is executing " + command_mapping.find(cmd)->second.second + " (" + FormatOpcode(cmd) + ")");
+		}
 
 		it->second();
 	}
 	else {
-		LogTrace("Received unsupported command: " + s.str());
+		if (IsTraceEnabled()) {
+			LogTrace("Received unsupported command: " + FormatOpcode(cmd));
+		}
 
 		throw scsi_exception(sense_key::illegal_request, asc::invalid_command_operation_code);
 	}
 }
 
+string PrimaryDevice::FormatOpcode(scsi_command cmd)
+{
+	stringstream s;
+	s << "$" << setfill('0') << setw(2) << hex << static_cast<int>(cmd);
+	return s.str();
+}
+
 void PrimaryDevice::Reset()
 {
 	DiscardReservation();
@@ -321,3 +329,9 @@ void PrimaryDevice::DiscardReservation()
 {
 	reserving_initiator = NOT_RESERVED;
 }
+
+vector<PbStatistics> PrimaryDevice::GetStatistics() const
+{
+	// The controller collects the statistics common to all devices
+	return controller != nullptr ? controller->GetStatistics(GetLun()) : vector<PbStatistics>();
+}
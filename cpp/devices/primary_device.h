@@ -57,11 +57,8 @@ public:
 		// Devices with a cache have to override this method
 	}
 
-	virtual vector<PbStatistics> GetStatistics() const {
-		// Devices which provide statistics have to override this method
-
-		return vector<PbStatistics>();
-	}
+	// Devices which provide statistics have to override this method and add their own statistics
+	virtual vector<PbStatistics> GetStatistics() const;
 
 protected:
 
@@ -83,7 +80,13 @@ protected:
 
 	auto GetController() const { return controller; }
 
+	bool IsTraceEnabled() const { return device_logger.IsTraceEnabled(); }
+	bool IsDebugEnabled() const { return device_logger.IsDebugEnabled(); }
 	void LogTrace(const string& s) const { device_logger.Trace(s); }
+	void LogTrace(TraceLog::trace_event event, uint64_t value1, uint32_t value2 = 0) const
+	{
+		device_logger.Trace(event, value1, value2);
+	}
 	void LogDebug(const string& s) const { device_logger.Debug(s); }
 	void LogInfo(const string& s) const { device_logger.Info(s); }
 	void LogWarn(const string& s) const { device_logger.Warn(s); }
@@ -95,6 +98,8 @@ private:
 
 	void SetController(AbstractController *);
 
+	static string FormatOpcode(scsi_command);
+
 	void TestUnitReady() override;
 	void RequestSense() override;
 	void ReportLuns() override;
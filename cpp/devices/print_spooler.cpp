@@ -0,0 +1,211 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "print_spooler.h"
+#include <spdlog/spdlog.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <filesystem>
+
+using namespace std;
+using namespace filesystem;
+
+extern char **environ;
+
+PrintSpooler::~PrintSpooler()
+{
+	// Running commands are waited for, but jobs not yet started are discarded
+	for (auto& worker : workers) {
+		worker.request_stop();
+	}
+	workers.clear();
+
+	for (const auto& job : jobs) {
+		if (!job.filename.empty()) {
+			error_code error;
+			remove(path(job.filename), error);
+		}
+	}
+}
+
+bool PrintSpooler::Submit(const string& cmd, const string& filename, bool use_stdin)
+{
+	return Enqueue({ .job_id = 0, .cmd = cmd, .filename = filename, .data = {}, .use_stdin = use_stdin });
+}
+
+bool PrintSpooler::Submit(const string& cmd, vector<uint8_t>&& data)
+{
+	return Enqueue({ .job_id = 0, .cmd = cmd, .filename = "", .data = std::move(data), .use_stdin = true });
+}
+
+bool PrintSpooler::Enqueue(print_job&& job)
+{
+	scoped_lock<mutex> lock(jobs_mutex);
+
+	if (jobs.size() >= MAX_QUEUED_JOBS) {
+		return false;
+	}
+
+	if (workers.empty()) {
+		for (int i = 0; i < MAX_ACTIVE_JOBS; i++) {
+			workers.emplace_back([this] (stop_token st) { Work(st); });
+		}
+	}
+
+	job.job_id = next_job_id++;
+
+	spdlog::debug("Queueing print job " + to_string(job.job_id) + (job.filename.empty() ?
+			" with " + to_string(job.data.size()) + " byte(s)" : " for file '" + job.filename + "'"));
+
+	jobs.push_back(std::move(job));
+
+	jobs_available.notify_one();
+
+	return true;
+}
+
+uint64_t PrintSpooler::GetQueuedCount() const
+{
+	scoped_lock<mutex> lock(jobs_mutex);
+
+	return jobs.size();
+}
+
+void PrintSpooler::Drain()
+{
+	unique_lock<mutex> lock(jobs_mutex);
+
+	jobs_done.wait(lock, [this] { return jobs.empty() && !active_count; });
+}
+
+void PrintSpooler::Work(stop_token st)
+{
+	// A print command terminating early must not raise SIGPIPE while its data are being written
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	while (true) {
+		print_job job;
+
+		{
+			unique_lock<mutex> lock(jobs_mutex);
+
+			// The wait also succeeds with a stop request if there are jobs left, these are not started anymore
+			if (!jobs_available.wait(lock, st, [this] { return !jobs.empty(); }) || st.stop_requested()) {
+				return;
+			}
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+
+			++active_count;
+		}
+
+		spdlog::debug("Executing print command '" + job.cmd + "' for job " + to_string(job.job_id));
+
+		if (const int status = Execute(job.cmd, job.use_stdin ? job.filename : "", job.data); status) {
+			spdlog::error("Print job " + to_string(job.job_id) + " failed with status " + to_string(status) +
+					", the printing system might not be configured");
+
+			++failed_count;
+		}
+		else {
+			spdlog::debug("Print job " + to_string(job.job_id) + " completed");
+
+			++completed_count;
+		}
+
+		if (!job.filename.empty()) {
+			error_code error;
+			remove(path(job.filename), error);
+		}
+
+		{
+			scoped_lock<mutex> lock(jobs_mutex);
+
+			--active_count;
+		}
+
+		jobs_done.notify_all();
+	}
+}
+
+int PrintSpooler::Execute(const string& cmd, const string& filename, span<const uint8_t> data)
+{
+	// The command is run by the shell, like with system(), but posix_spawn does not duplicate the
+	// address space of the (large) piscsi process
+	const char *args[] = { "sh", "-c", cmd.c_str(), nullptr };
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+
+	int fds[2] = { -1, -1 };
+	if (!filename.empty()) {
+		posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, filename.c_str(), O_RDONLY, 0);
+	}
+	else if (!data.empty()) {
+		// Close-on-exec, so that commands of other jobs do not keep the pipe open
+		if (pipe2(fds, O_CLOEXEC) == -1) {
+			posix_spawn_file_actions_destroy(&actions);
+			return -1;
+		}
+		posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+	}
+
+	// The command gets the default signal handling, regardless of what piscsi or the worker thread use
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t signals;
+	sigemptyset(&signals);
+	posix_spawnattr_setsigmask(&attr, &signals);
+	sigaddset(&signals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &signals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	pid_t pid;
+	const int error = posix_spawn(&pid, "/bin/sh", &actions, &attr, const_cast<char * const *>(args), environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (fds[0] != -1) {
+		close(fds[0]);
+
+		if (!error) {
+			// Stops early if the command does not read all data
+			for (size_t offset = 0; offset < data.size();) {
+				const auto count = write(fds[1], data.data() + offset, data.size() - offset);
+				if (count == -1 && errno != EINTR) {
+					break;
+				}
+				offset += count > 0 ? count : 0;
+			}
+		}
+
+		close(fds[1]);
+	}
+
+	if (error) {
+		return -1;
+	}
+
+	int status;
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
@@ -0,0 +1,89 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Runs the print commands of SCSIPrinter in the background, so that a slow printing system
+// does not block the bus thread. The print files are removed when their job has finished.
+// The data to be printed are either passed as a file name or are piped to the standard input
+// of the print command, either from a file or from memory.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <vector>
+#include <span>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace std;
+
+class PrintSpooler
+{
+	// Number of print commands running at the same time
+	static const int MAX_ACTIVE_JOBS = 2;
+
+	// Further jobs are rejected until the printing system has caught up
+	static const size_t MAX_QUEUED_JOBS = 16;
+
+	struct print_job {
+		uint64_t job_id;
+		string cmd;
+		// Empty if the data are passed in memory
+		string filename;
+		vector<uint8_t> data;
+		bool use_stdin;
+	};
+
+public:
+
+	PrintSpooler() = default;
+	~PrintSpooler();
+
+	// Returns false if the queue is full, the file then remains owned by the caller.
+	// With use_stdin the file is the standard input of the command.
+	bool Submit(const string&, const string&, bool = false);
+	// The data are piped to the standard input of the command
+	bool Submit(const string&, vector<uint8_t>&&);
+
+	uint64_t GetQueuedCount() const;
+	uint64_t GetActiveCount() const { return active_count; }
+	uint64_t GetCompletedCount() const { return completed_count; }
+	uint64_t GetFailedCount() const { return failed_count; }
+
+	// Waits until all queued and active jobs have finished
+	void Drain();
+
+	// Returns the exit code of the shell, or -1 if the command could not be run.
+	// The standard input of the command is either the file (if not empty) or the data.
+	static int Execute(const string&, const string& = "", span<const uint8_t> = {});
+
+private:
+
+	bool Enqueue(print_job&&);
+
+	void Work(stop_token);
+
+	deque<print_job> jobs;
+
+	mutable mutex jobs_mutex;
+	condition_variable_any jobs_available;
+	condition_variable_any jobs_done;
+
+	// The workers are only created when there is something to print
+	vector<jthread> workers;
+
+	uint64_t next_job_id = 1;
+
+	atomic<uint64_t> active_count;
+	atomic<uint64_t> completed_count;
+	atomic<uint64_t> failed_count;
+};
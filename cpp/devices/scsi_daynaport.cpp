@@ -27,8 +27,10 @@
 #include "shared/piscsi_exceptions.h"
 #include "scsi_command_util.h"
 #include "scsi_daynaport.h"
+#include "packet_capture.h"
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 using namespace scsi_defs;
 using namespace scsi_command_util;
@@ -64,6 +66,8 @@ bool SCSIDaynaPort::Init(const param_map& params)
 		LogTrace("Tap interface created");
 	}
 
+	UpdateFilter();
+
 	Reset();
 	SetReady(true);
 	SetReset(false);
@@ -121,7 +125,6 @@ vector<uint8_t> SCSIDaynaPort::InquiryInternal() const
 //---------------------------------------------------------------------------
 int SCSIDaynaPort::Read(cdb_t cdb, vector<uint8_t>& buf, uint64_t)
 {
-	int rx_packet_size = 0;
 	const auto response = (scsi_resp_read_t*)buf.data();
 
 	const int requested_length = cdb[4];
@@ -134,106 +137,41 @@ int SCSIDaynaPort::Read(cdb_t cdb, vector<uint8_t>& buf, uint64_t)
 		return 0;
 	}
 
-	// Some of the packets we receive will not be for us. So, we'll keep pulling messages
-	// until the buffer is empty, or we've read X times. (X is just a made up number)
-	// TODO send_message_to_host is effctively always true
-	bool send_message_to_host;
-	int read_count = 0;
-	while (read_count < MAX_READ_RETRIES) {
-		read_count++;
-
-		// The first 2 bytes are reserved for the length of the packet
-		// The next 4 bytes are reserved for a flag field
-		//rx_packet_size = m_tap.Rx(response->data);
-		rx_packet_size = tap.Receive(&buf[DAYNAPORT_READ_HEADER_SZ]);
-
-		// If we didn't receive anything, return size of 0
-		if (rx_packet_size <= 0) {
-			LogTrace("No packet received");
-			response->length = 0;
-			response->flags = read_data_flags_t::e_no_more_data;
-			return DAYNAPORT_READ_HEADER_SZ;
-		}
-
-        byte_read_count += rx_packet_size;
-
-		LogTrace("Packet Size " + to_string(rx_packet_size) + ", read count: " + to_string(read_count));
-
-		// This is a very basic filter to prevent unnecessary packets from
-		// being sent to the SCSI initiator.
-		send_message_to_host = false;
-
-	// The following doesn't seem to work with unicast messages. Temporarily removing the filtering
-	// functionality.
-	///////	// Check if received packet destination MAC address matches the
-	///////	// DaynaPort MAC. For IP packets, the mac_address will be the first 6 bytes
-	///////	// of the data.
-	///////	if (memcmp(response->data, m_mac_addr, 6) == 0) {
-	///////		send_message_to_host = true;
-	///////	}
+	// The first 2 bytes are reserved for the length of the packet
+	// The next 4 bytes are reserved for a flag field
+	// Packets that are not for us have already been discarded by the TAP driver, see UpdateFilter()
+	const int rx_packet_size = tap.Receive(&buf[DAYNAPORT_READ_HEADER_SZ]);
+
+	// If we didn't receive anything, return size of 0
+	if (rx_packet_size <= 0) {
+		LogTrace("No packet received");
+		response->length = 0;
+		response->flags = read_data_flags_t::e_no_more_data;
+		return DAYNAPORT_READ_HEADER_SZ;
+	}
 
-	///////	// Check to see if this is a broadcast message
-	///////	if (memcmp(response->data, m_bcast_addr, 6) == 0) {
-	///////		send_message_to_host = true;
-	///////	}
+	byte_read_count += rx_packet_size;
 
-	///////	// Check to see if this is an AppleTalk Message
-	///////	if (memcmp(response->data, m_apple_talk_addr, 6) == 0) {
-	///////		send_message_to_host = true;
-	///////	}
-		send_message_to_host = true;
+	LogTrace("Packet Size " + to_string(rx_packet_size));
 
-		// TODO: We should check to see if this message is in the multicast
-		// configuration from SCSI command 0x0D
+	int size = rx_packet_size;
+	if (size < 64) {
+		// A frame must have at least 64 bytes (see https://github.com/PiSCSI/piscsi/issues/619)
+		// Note that this work-around breaks the checksum. As currently there are no known drivers
+		// that care for the checksum, and the Daynaport driver for the Atari expects frames of
+		// 64 bytes it was decided to accept the broken checksum. If a driver should pop up that
+		// breaks because of this, the work-around has to be re-evaluated.
+		size = 64;
+	}
+	SetInt16(buf, 0, size);
+	SetInt32(buf, 2, tap.HasPendingPackets() ? 0x10 : 0x00);
 
-		if (!send_message_to_host) {
-			stringstream s;
-			s << "Received a packet that's not for me:" << setfill('0') << setw(2) << hex;
-			for (int i = 0 ; i < 6; i++) {
-				s << " $" << static_cast<int>(response->data[i]);
-			}
-			LogDebug(s.str());
-
-			// If there are pending packets to be processed, we'll tell the host that the read
-			// length was 0.
-			if (!tap.HasPendingPackets()) {
-				response->length = 0;
-				response->flags = read_data_flags_t::e_no_more_data;
-				return DAYNAPORT_READ_HEADER_SZ;
-			}
-		}
-		else {
-			// TODO: Need to do some sort of size checking. The buffer can easily overflow, probably.
-
-			// response->length = rx_packet_size;
-			// if(m_tap.PendingPackets()){
-			// 	response->flags = e_more_data_available;
-			// } else {
-			// 	response->flags = e_no_more_data;
-			// }
-			int size = rx_packet_size;
-			if (size < 64) {
-				// A frame must have at least 64 bytes (see https://github.com/PiSCSI/piscsi/issues/619)
-				// Note that this work-around breaks the checksum. As currently there are no known drivers
-				// that care for the checksum, and the Daynaport driver for the Atari expects frames of
-				// 64 bytes it was decided to accept the broken checksum. If a driver should pop up that
-				// breaks because of this, the work-around has to be re-evaluated.
-				size = 64;
-			}
-			SetInt16(buf, 0, size);
-			SetInt32(buf, 2, tap.HasPendingPackets() ? 0x10 : 0x00);
-
-			// Return the packet size + 2 for the length + 4 for the flag field
-			// The CRC was already appended by the ctapdriver
-			return size + DAYNAPORT_READ_HEADER_SZ;
-		}
-		// If we got to this point, there are still messages in the queue, so
-		// we should loop back and get the next one.
-	} // end while
+	PacketCapture::Capture(GetId(), GetLun(), PacketCapture::direction::inbound,
+			span(buf.data() + DAYNAPORT_READ_HEADER_SZ, size));
 
-	response->length = 0;
-	response->flags = read_data_flags_t::e_no_more_data;
-	return DAYNAPORT_READ_HEADER_SZ;
+	// Return the packet size + 2 for the length + 4 for the flag field
+	// The CRC was already appended by the ctapdriver
+	return size + DAYNAPORT_READ_HEADER_SZ;
 }
 
 //---------------------------------------------------------------------------
@@ -259,13 +197,20 @@ bool SCSIDaynaPort::Write(cdb_t cdb, span<const uint8_t> buf)
 	if (const int data_format = cdb[5]; data_format == 0x00) {
 		const int data_length = GetInt16(cdb, 3);
 		tap.Send(buf.data(), data_length);
+		PacketCapture::Capture(GetId(), GetLun(), PacketCapture::direction::outbound, buf.subspan(0, data_length));
 		byte_write_count += data_length;
 		LogTrace("Transmitted " + to_string(data_length) + " byte(s) (00 format)");
 	}
 	else if (data_format == 0x80) {
-		// The data length is specified in the first 2 bytes of the payload
+		// The data length is specified in the first 2 bytes of the payload and must fit into the transferred data,
+		// which is 8 bytes longer than specified by the CDB
 		const int data_length = buf[1] + ((static_cast<int>(buf[0]) & 0xff) << 8);
+		if (data_length + 4 > min(GetInt16(cdb, 3) + 8, static_cast<int>(buf.size()))) {
+			LogWarn("Packet length " + to_string(data_length) + " exceeds the transferred data (80 format)");
+			return false;
+		}
 		tap.Send(&(buf.data()[4]), data_length);
+		PacketCapture::Capture(GetId(), GetLun(), PacketCapture::direction::outbound, buf.subspan(4, data_length));
 		byte_write_count += data_length;
 		LogTrace("Transmitted " + to_string(data_length) + "byte(s) (80 format)");
 	}
@@ -337,9 +282,6 @@ void SCSIDaynaPort::Read6()
 
 void SCSIDaynaPort::Write6() const
 {
-	// Ensure a sufficient buffer size (because it is not transfer for each block)
-	GetController()->AllocateBuffer(DAYNAPORT_BUFFER_SIZE);
-
 	const int data_format = GetController()->GetCmdByte(5);
 
 	if (data_format == 0x00) {
@@ -354,6 +296,9 @@ void SCSIDaynaPort::Write6() const
 		LogWarn(s.str());
 	}
 
+	// Ensure a sufficient buffer size (because it is not transfer for each block)
+	GetController()->AllocateBuffer(GetController()->GetLength());
+
 	stringstream s;
 	s << "Length: " << GetController()->GetLength() << ", format: $" << setfill('0') << setw(2) << hex << data_format;
 	LogTrace(s.str());
@@ -444,6 +389,58 @@ void SCSIDaynaPort::SetMcastAddr() const
 	EnterDataOutPhase();
 }
 
+void SCSIDaynaPort::SetMulticastAddresses(span<const uint8_t> buf)
+{
+	multicast_addresses.clear();
+
+	// The list consists of 6 byte addresses
+	for (size_t i = 0; i + 6 <= buf.size(); i += 6) {
+		array<uint8_t, 6> address;
+		ranges::copy(buf.subspan(i, 6), address.begin());
+		multicast_addresses.push_back(address);
+	}
+
+	LogTrace("Received " + to_string(multicast_addresses.size()) + " multicast address(es)");
+
+	UpdateFilter();
+}
+
+void SCSIDaynaPort::SetMacAddress(span<const uint8_t> buf)
+{
+	if (buf.size() < m_scsi_link_stats.mac_address.size()) {
+		LogWarn("Received incomplete MAC address");
+		return;
+	}
+
+	ranges::transform(buf.first(m_scsi_link_stats.mac_address.size()), m_scsi_link_stats.mac_address.begin(),
+			[] (uint8_t b) { return static_cast<byte>(b); });
+
+	stringstream s;
+	s << "Received MAC address " << setfill('0') << hex;
+	for (size_t i = 0; i < m_scsi_link_stats.mac_address.size(); i++) {
+		s << (i ? ":" : "") << setw(2) << static_cast<int>(m_scsi_link_stats.mac_address[i]);
+	}
+	LogTrace(s.str());
+
+	UpdateFilter();
+}
+
+void SCSIDaynaPort::UpdateFilter()
+{
+	// Our address, the broadcast address, the AppleTalk broadcast address and the multicast addresses
+	// configured by the initiator
+	vector<array<uint8_t, 6>> addresses;
+	array<uint8_t, 6> mac_address;
+	ranges::transform(m_scsi_link_stats.mac_address, mac_address.begin(),
+			[] (byte b) { return static_cast<uint8_t>(b); });
+	addresses.push_back(mac_address);
+	addresses.push_back(BROADCAST_ADDRESS);
+	addresses.push_back(APPLETALK_BROADCAST_ADDRESS);
+	addresses.insert(addresses.end(), multicast_addresses.begin(), multicast_addresses.end());
+
+	tap.SetFilter(addresses);
+}
+
 //---------------------------------------------------------------------------
 //
 //	Enable or Disable the interface
@@ -456,7 +453,7 @@ void SCSIDaynaPort::SetMcastAddr() const
 //            seconds
 //
 //---------------------------------------------------------------------------
-void SCSIDaynaPort::EnableInterface() const
+void SCSIDaynaPort::EnableInterface()
 {
 	if (GetController()->GetCmdByte(5) & 0x80) {
 		if (const string error = tap.IpLink(true); !error.empty()) {
@@ -476,6 +473,12 @@ void SCSIDaynaPort::EnableInterface() const
 			throw scsi_exception(sense_key::aborted_command);
 		}
 
+		// Disabling the interface resets the MAC address to the built-in value
+		if (m_scsi_link_stats.mac_address != BUILT_IN_MAC_ADDRESS) {
+			m_scsi_link_stats.mac_address = BUILT_IN_MAC_ADDRESS;
+			UpdateFilter();
+		}
+
 		LogInfo("The DaynaPort interface has been DISABLED");
 	}
 
@@ -500,5 +503,34 @@ vector<PbStatistics> SCSIDaynaPort::GetStatistics() const
 	s.set_value(byte_write_count);
 	statistics.push_back(s);
 
+	s.set_key(RX_FRAME_QUEUE_COUNT);
+	s.set_value(tap.GetQueuedFrameCount());
+	statistics.push_back(s);
+
+	s.set_key(RX_FRAME_QUEUE_MAX_COUNT);
+	s.set_value(tap.GetMaxQueuedFrameCount());
+	statistics.push_back(s);
+
+	s.set_key(TX_FRAME_QUEUE_MAX_COUNT);
+	s.set_value(tap.GetMaxQueuedSendFrameCount());
+	statistics.push_back(s);
+
+	s.set_key(TX_LATENCY_MAX_US);
+	s.set_value(tap.GetMaxSendLatency());
+	statistics.push_back(s);
+
+	s.set_key(TX_LATENCY_AVERAGE_US);
+	s.set_value(tap.GetAverageSendLatency());
+	statistics.push_back(s);
+
+	s.set_category(PbStatisticsCategory::CATEGORY_WARNING);
+	s.set_key(RX_FRAME_DROP_COUNT);
+	s.set_value(tap.GetDroppedFrameCount());
+	statistics.push_back(s);
+
+	s.set_key(TX_FRAME_DROP_COUNT);
+	s.set_value(tap.GetDroppedSendFrameCount());
+	statistics.push_back(s);
+
 	return statistics;
 }
@@ -49,6 +49,13 @@ class SCSIDaynaPort : public PrimaryDevice
 
 	inline static const string BYTE_READ_COUNT = "byte_read_count";
 	inline static const string BYTE_WRITE_COUNT = "byte_write_count";
+	inline static const string RX_FRAME_DROP_COUNT = "rx_frame_drop_count";
+	inline static const string RX_FRAME_QUEUE_COUNT = "rx_frame_queue_count";
+	inline static const string RX_FRAME_QUEUE_MAX_COUNT = "rx_frame_queue_max_count";
+	inline static const string TX_FRAME_DROP_COUNT = "tx_frame_drop_count";
+	inline static const string TX_FRAME_QUEUE_MAX_COUNT = "tx_frame_queue_max_count";
+	inline static const string TX_LATENCY_MAX_US = "tx_latency_max_us";
+	inline static const string TX_LATENCY_AVERAGE_US = "tx_latency_average_us";
 
 public:
 
@@ -60,6 +67,9 @@ public:
 
 	param_map GetDefaultParams() const override { return tap.GetDefaultParams(); }
 
+	// Use a different packet backend than the TAP device, e.g. for testing. Must be called before Init().
+	void SetBackend(unique_ptr<PacketBackend> backend) { tap.SetBackend(move(backend)); }
+
 	// Commands
 	vector<uint8_t> InquiryInternal() const override;
 	int Read(cdb_t, vector<uint8_t>&, uint64_t);
@@ -73,11 +83,15 @@ public:
 	void RetrieveStatistics() const;
 	void SetInterfaceMode() const;
 	void SetMcastAddr() const;
-	void EnableInterface() const;
+	void EnableInterface();
 
-	vector<PbStatistics> GetStatistics() const override;
+	// Called with the data of SET MCAST ADDR
+	void SetMulticastAddresses(span<const uint8_t>);
 
-	static const int DAYNAPORT_BUFFER_SIZE = 0x1000000;
+	// Called with the data of SET INTERFACE MODE/SET MAC ADDRESS
+	void SetMacAddress(span<const uint8_t>);
+
+	vector<PbStatistics> GetStatistics() const override;
 
 	static const int CMD_SCSILINK_STATS        = 0x09;
 	static const int CMD_SCSILINK_ENABLE       = 0x0E;
@@ -85,12 +99,6 @@ public:
 	static const int CMD_SCSILINK_SETMAC       = 0x40;
 	static const int CMD_SCSILINK_SETMODE      = 0x80;
 
-	// When we're reading the Linux tap device, most of the messages will not be for us, so we
-	// need to filter through those. However, we don't want to keep re-reading the packets
-	// indefinitely. So, we'll pick a large-ish number that will cause the emulated DaynaPort
-	// to respond with "no data" after MAX_READ_RETRIES tries.
-	static const int MAX_READ_RETRIES               = 50;
-
 	// The READ response has a header which consists of:
 	//   2 bytes - payload size
 	//   4 bytes - status flags
@@ -98,6 +106,14 @@ public:
 
 private:
 
+	void UpdateFilter();
+
+	static constexpr array<uint8_t, 6> BROADCAST_ADDRESS = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	static constexpr array<uint8_t, 6> APPLETALK_BROADCAST_ADDRESS = { 0x09, 0x00, 0x07, 0xff, 0xff, 0xff };
+
+	// TODO Remove this hard-coded MAC address, see https://github.com/PiSCSI/piscsi/issues/598
+	static constexpr array<byte, 6> BUILT_IN_MAC_ADDRESS = { byte{0x00}, byte{0x80}, byte{0x19}, byte{0x10}, byte{0x98}, byte{0xe3} };
+
 	enum class read_data_flags_t : uint32_t {
 		e_no_more_data = 0x00000000,
 		e_more_data_available = 0x00000001,
@@ -119,8 +135,7 @@ private:
 	};
 
 	scsi_resp_link_stats_t m_scsi_link_stats = {
-		// TODO Remove this hard-coded MAC address, see https://github.com/PiSCSI/piscsi/issues/598
-		.mac_address = { byte{0x00}, byte{0x80}, byte{0x19}, byte{0x10}, byte{0x98}, byte{0xe3} },
+		.mac_address = BUILT_IN_MAC_ADDRESS,
 		.frame_alignment_errors = 0,
 		.crc_errors = 0,
 		.frames_lost = 0,
@@ -128,5 +143,7 @@ private:
 
 	CTapDriver tap;
 
+	vector<array<uint8_t, 6>> multicast_addresses;
+
 	bool tap_enabled = false;
 };
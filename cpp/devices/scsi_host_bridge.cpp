@@ -17,13 +17,18 @@
 //---------------------------------------------------------------------------
 
 #include "shared/piscsi_exceptions.h"
+#include "shared/piscsi_util.h"
+#include "controllers/buffer_pool.h"
 #include "scsi_command_util.h"
 #include "scsi_host_bridge.h"
+#include "packet_capture.h"
 #include <arpa/inet.h>
+#include <climits>
 
 using namespace std;
 using namespace scsi_defs;
 using namespace scsi_command_util;
+using namespace piscsi_util;
 
 SCSIBR::SCSIBR(int lun) : PrimaryDevice(SCBR, lun)
 {
@@ -34,6 +39,14 @@ bool SCSIBR::Init(const param_map& params)
 {
 	PrimaryDevice::Init(params);
 
+	if (int cache_max; GetAsUnsignedInt(GetParam("dir_cache"), cache_max) && cache_max > 0) {
+		fs.SetCacheMax(cache_max);
+	}
+	else {
+		LogError("Invalid directory cache size '" + GetParam("dir_cache") + "'");
+		return false;
+	}
+
 	// Create host file system
 	fs.Reset();
 
@@ -52,6 +65,7 @@ bool SCSIBR::Init(const param_map& params)
 	if (tap_enabled) {
 		tap.GetMacAddr(mac_addr.data());
 		mac_addr[5]++;
+		tap.SetFilter({ mac_addr, bcast_addr });
 	}
 
 	// Packet reception flag OFF
@@ -141,21 +155,12 @@ int SCSIBR::GetMessage10(cdb_t cdb, vector<uint8_t>& buf)
 					GetPacketBuf(buf, 2);
 					return packet_len + 2;
 
-				case 3:	{
-					// Simultaneous acquisition of multiple packets (size + buffer simultaneously)
-					// Currently the maximum number of packets is 10
-					// Isn't it too fast if I increase more?
-					int total_len = 0;
-					for (int i = 0; i < 10; i++) {
-						ReceivePacket();
-						SetInt16(buf, total_len, packet_len);
-						total_len += 2;
-						if (packet_len == 0)
-							break;
-						GetPacketBuf(buf, 0);
-						total_len += packet_len;
-					}
-					return total_len;
+				case 3:		// Simultaneous acquisition of multiple packets (size + buffer simultaneously)
+					return GetPackets(buf, MAX_PACKET_COUNT, static_cast<int>(buf.size()));
+
+				case 4:	{	// Packet bundle, as many packets as fit into the allocation length
+					const int allocation_length = GetInt24(cdb, 6);
+					return GetPackets(buf, INT_MAX, allocation_length ? allocation_length : static_cast<int>(buf.size()));
 				}
 
 				default:
@@ -249,8 +254,9 @@ bool SCSIBR::ReadWrite(cdb_t cdb, vector<uint8_t>& buf)
 
 void SCSIBR::GetMessage10()
 {
-	// Ensure a sufficient buffer size (because it is not a transfer for each block)
-	GetController()->AllocateBuffer(0x1000000);
+	// Ensure a sufficient buffer size (because it is not a transfer for each block).
+	// The file system data returned may exceed the allocation length.
+	GetController()->AllocateBuffer(max<uint32_t>(GetInt24(GetController()->GetCmd(), 6), fsoptlen));
 
 	GetController()->SetLength(GetMessage10(GetController()->GetCmd(), GetController()->GetBuffer()));
 	if (GetController()->GetLength() <= 0) {
@@ -279,7 +285,7 @@ void SCSIBR::SendMessage10() const
 	}
 
 	// Ensure a sufficient buffer size (because it is not a transfer for each block)
-	GetController()->AllocateBuffer(0x1000000);
+	GetController()->AllocateBuffer(GetController()->GetLength());
 
 	// Set next block
 	GetController()->SetBlocks(1);
@@ -297,6 +303,9 @@ int SCSIBR::GetMacAddr(vector<uint8_t>& mac) const
 void SCSIBR::SetMacAddr(span<const uint8_t> mac)
 {
 	memcpy(mac_addr.data(), mac.data(), mac_addr.size());
+
+	// Only receive packets for the new address
+	tap.SetFilter({ mac_addr, bcast_addr });
 }
 
 void SCSIBR::ReceivePacket()
@@ -309,11 +318,7 @@ void SCSIBR::ReceivePacket()
 	// Receive packet
 	packet_len = tap.Receive(packet_buf.data());
 
-	// Check if received packet
-	if (memcmp(packet_buf.data(), mac_addr.data(), mac_addr.size()) != 0
-				&& memcmp(packet_buf.data(), bcast_addr.data(), bcast_addr.size()) != 0) {
-		packet_len = 0;
-	}
+	// Packets that are not for us have already been discarded by the TAP driver, see SetMacAddr()
 
 	// Discard if it exceeds the buffer size
 	if (packet_len > 2048) {
@@ -337,13 +342,58 @@ void SCSIBR::GetPacketBuf(vector<uint8_t>& buf, int index)
 	// Copy
 	memcpy(buf.data() + index, packet_buf.data(), len);
 
+	PacketCapture::Capture(GetId(), GetLun(), PacketCapture::direction::inbound, span(packet_buf.data(), len));
+
 	// Received
 	packet_enable = false;
 }
 
+//---------------------------------------------------------------------------
+//
+//	Get several packets, each one preceded by its size. A size of 0 terminates the list
+//	unless the maximum number of packets was returned. A packet that does not fit is
+//	returned by the next call.
+//
+//---------------------------------------------------------------------------
+int SCSIBR::GetPackets(vector<uint8_t>& buf, int max_count, int max_length)
+{
+	int total_len = 0;
+	int count = 0;
+	for (; count < max_count; count++) {
+		ReceivePacket();
+
+		if (!packet_len) {
+			break;
+		}
+
+		// There must be space left for the terminating size
+		if (total_len + 2 + packet_len + 2 > max_length) {
+			// Discard a packet that can never be returned
+			if (!total_len) {
+				LogWarn("Discarding packet of " + to_string(packet_len) + " bytes, allocation length is too small");
+				packet_enable = false;
+			}
+			break;
+		}
+
+		SetInt16(buf, total_len, packet_len);
+		GetPacketBuf(buf, total_len + 2);
+		total_len += 2 + packet_len;
+	}
+
+	if (count == max_count) {
+		return total_len;
+	}
+
+	SetInt16(buf, total_len, 0);
+	return total_len + 2;
+}
+
 void SCSIBR::SendPacket(span<const uint8_t> buf, int len) const
 {
 	tap.Send(buf.data(), len);
+
+	PacketCapture::Capture(GetId(), GetLun(), PacketCapture::direction::outbound, buf.subspan(0, len));
 }
 
 //---------------------------------------------------------------------------
@@ -690,7 +740,9 @@ void SCSIBR::FS_Read(vector<uint8_t>& buf)
 	pFcb->date = ntohs(pFcb->date);
 	pFcb->size = ntohl(pFcb->size);
 
-	fsresult = fs.Read(nKey, pFcb, fsopt.data(), nSize);
+	AllocateFsOpt(nSize);
+
+	fsresult = fs.Read(nKey, pFcb, fsopt.data(), static_cast<uint32_t>(fsopt.size()));
 
 	pFcb->fileptr = htonl(pFcb->fileptr);
 	pFcb->mode = htons(pFcb->mode);
@@ -704,7 +756,11 @@ void SCSIBR::FS_Read(vector<uint8_t>& buf)
 
 	fsoutlen = i;
 
-	fsoptlen = fsresult;
+	// Negative results are error codes
+	fsoptlen = static_cast<int32_t>(fsresult) > 0 ? fsresult : 0;
+	if (!fsoptlen) {
+		ReleaseFsOpt();
+	}
 }
 
 //---------------------------------------------------------------------------
@@ -730,7 +786,8 @@ void SCSIBR::FS_Write(vector<uint8_t>& buf)
 	pFcb->date = ntohs(pFcb->date);
 	pFcb->size = ntohl(pFcb->size);
 
-	fsresult = fs.Write(nKey, pFcb, fsopt.data(), nSize);
+	fsresult = fs.Write(nKey, pFcb, fsopt.data(), min(nSize, static_cast<uint32_t>(fsopt.size())));
+	ReleaseFsOpt();
 
 	pFcb->fileptr = htonl(pFcb->fileptr);
 	pFcb->mode = htons(pFcb->mode);
@@ -1014,6 +1071,62 @@ void SCSIBR::FS_Lock(vector<uint8_t>& buf)
 	fsresult = fs.Lock(nUnit);
 }
 
+//---------------------------------------------------------------------------
+//
+//  $59 - Find next files (extension)
+//
+//  Returns as many results of $48 as fit into the requested size with one
+//  transfer of the option data. The result code is the number of results.
+//
+//---------------------------------------------------------------------------
+void SCSIBR::FS_NFilesBatch(vector<uint8_t>& buf)
+{
+	auto dp = (uint32_t*)buf.data();
+	const uint32_t nUnit = ntohl(*dp);
+	int i = sizeof(uint32_t);
+
+	dp = (uint32_t*)&(buf.data()[i]);
+	const uint32_t nKey = ntohl(*dp);
+	i += sizeof(uint32_t);
+
+	dp = (uint32_t*)&(buf.data()[i]);
+	const uint32_t nCursor = ntohl(*dp);
+	i += sizeof(uint32_t);
+
+	auto files = (Human68k::files_t*)&(buf.data()[i]);
+	i += sizeof(Human68k::files_t);
+
+	dp = (uint32_t*)&(buf.data()[i]);
+	const uint32_t nSize = ntohl(*dp);
+
+	files->sector = ntohl(files->sector);
+	files->offset = ntohs(files->offset);
+	files->time = ntohs(files->time);
+	files->date = ntohs(files->date);
+	files->size = ntohl(files->size);
+
+	AllocateFsOpt(nSize);
+
+	auto results = (Human68k::files_t*)fsopt.data();
+	fsresult = fs.NFilesBatch(nUnit, nKey, nCursor, files, results,
+			static_cast<uint32_t>(fsopt.size() / sizeof(Human68k::files_t)));
+
+	// Negative results are error codes
+	const int count = static_cast<int32_t>(fsresult) > 0 ? fsresult : 0;
+	for (int n = 0; n < count; n++) {
+		results[n].sector = htonl(results[n].sector);
+		results[n].offset = htons(results[n].offset);
+		results[n].time = htons(results[n].time);
+		results[n].date = htons(results[n].date);
+		results[n].size = htonl(results[n].size);
+	}
+
+	fsoptlen = count * sizeof(Human68k::files_t);
+	if (!fsoptlen) {
+		ReleaseFsOpt();
+	}
+}
+
 //---------------------------------------------------------------------------
 //
 //	Read Filesystem (result code)
@@ -1042,10 +1155,15 @@ int SCSIBR::ReadFsOut(vector<uint8_t>& buf) const
 //	Read file system (return option data)
 //
 //---------------------------------------------------------------------------
-int SCSIBR::ReadFsOpt(vector<uint8_t>& buf) const
+int SCSIBR::ReadFsOpt(vector<uint8_t>& buf)
 {
-	copy_n(fsopt.begin(), fsoptlen, buf.begin());
-	return fsoptlen;
+	const int length = fsoptlen;
+	copy_n(fsopt.begin(), length, buf.begin());
+
+	fsoptlen = 0;
+	ReleaseFsOpt();
+
+	return length;
 }
 
 //---------------------------------------------------------------------------
@@ -1136,6 +1254,9 @@ void SCSIBR::WriteFs(int func, vector<uint8_t>& buf)
 		case 0x18:
 			FS_Lock(buf);		// $58 - exclusive control
 			break;
+		case 0x19:
+			FS_NFilesBatch(buf);	// $59 - find next files (extension)
+			break;
 		default:
 			break;
 	}
@@ -1148,5 +1269,52 @@ void SCSIBR::WriteFs(int func, vector<uint8_t>& buf)
 //---------------------------------------------------------------------------
 void SCSIBR::WriteFsOpt(const vector<uint8_t>& buf, int num)
 {
-	copy_n(buf.begin(), num, fsopt.begin());
+	AllocateFsOpt(num);
+
+	copy_n(buf.begin(), fsopt.size(), fsopt.begin());
+}
+
+void SCSIBR::AllocateFsOpt(uint32_t size)
+{
+	size = min(size, MAX_FSOPT_SIZE);
+	if (size > fsopt.size()) {
+		BufferPool::Release(std::move(fsopt));
+		fsopt = BufferPool::Acquire(size);
+	}
+	else {
+		fsopt.resize(size);
+	}
+
+	fsopt_capacity = fsopt.capacity();
+}
+
+void SCSIBR::ReleaseFsOpt()
+{
+	BufferPool::Release(std::move(fsopt));
+	fsopt = {};
+
+	fsopt_capacity = 0;
+}
+
+param_map SCSIBR::GetDefaultParams() const
+{
+	param_map params = tap.GetDefaultParams();
+	params["dir_cache"] = to_string(XM6_HOST_DIRENTRY_CACHE_MAX);
+
+	return params;
+}
+
+vector<PbStatistics> SCSIBR::GetStatistics() const
+{
+	vector<PbStatistics> statistics = PrimaryDevice::GetStatistics();
+
+	PbStatistics s;
+	s.set_id(GetId());
+	s.set_unit(GetLun());
+	s.set_category(PbStatisticsCategory::CATEGORY_INFO);
+	s.set_key(FS_BUFFER_BYTE_COUNT);
+	s.set_value(fsopt_capacity);
+	statistics.push_back(s);
+
+	return statistics;
 }
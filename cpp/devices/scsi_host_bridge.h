@@ -20,9 +20,11 @@
 #include "primary_device.h"
 #include "ctapdriver.h"
 #include "cfilesystem.h"
+#include <atomic>
 #include <string>
 #include <span>
 #include <array>
+#include <vector>
 
 using namespace std;
 
@@ -30,6 +32,17 @@ class SCSIBR : public PrimaryDevice
 {
 	static constexpr const array<uint8_t, 6> bcast_addr = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 
+	// The X68000 fetches several packets per command, buffer more of them than the default
+	static const uint32_t RX_RING_SIZE = 256;
+
+	// The number of packets returned by the legacy multi-packet function
+	static const int MAX_PACKET_COUNT = 10;
+
+	// The largest file system read or write
+	static const uint32_t MAX_FSOPT_SIZE = 0x1000000;
+
+	inline static const string FS_BUFFER_BYTE_COUNT = "fs_buffer_byte_count";
+
 public:
 
 	explicit SCSIBR(int);
@@ -38,7 +51,10 @@ public:
 	bool Init(const param_map&) override;
 	void CleanUp() override;
 
-	param_map GetDefaultParams() const override { return tap.GetDefaultParams(); }
+	param_map GetDefaultParams() const override;
+
+	// Use a different packet backend than the TAP device, e.g. for testing. Must be called before Init().
+	void SetBackend(unique_ptr<PacketBackend> backend) { tap.SetBackend(move(backend)); }
 
 	// Commands
 	vector<uint8_t> InquiryInternal() const override;
@@ -48,15 +64,18 @@ public:
 	void GetMessage10();
 	void SendMessage10() const;
 
+	vector<PbStatistics> GetStatistics() const override;
+
 private:
 
 	int GetMacAddr(vector<uint8_t>&) const;		// Get MAC address
 	void SetMacAddr(span<const uint8_t>);		// Set MAC address
 	void ReceivePacket();						// Receive a packet
 	void GetPacketBuf(vector<uint8_t>&, int);	// Get a packet
+	int GetPackets(vector<uint8_t>&, int, int);	// Get several packets
 	void SendPacket(span<const uint8_t>, int) const;	// Send a packet
 
-	CTapDriver tap;								// TAP driver
+	CTapDriver tap { RX_RING_SIZE };			// TAP driver
 	bool tap_enabled = false;					// TAP valid flag
 	array<uint8_t, 6> mac_addr = {};			// MAC Address
 	int packet_len = 0;							// Receive packet size
@@ -65,7 +84,7 @@ private:
 
 	int ReadFsResult(vector<uint8_t>&) const;		// Read filesystem (result code)
 	int ReadFsOut(vector<uint8_t>&) const;			// Read filesystem (return data)
-	int ReadFsOpt(vector<uint8_t>&) const;			// Read file system (optional data)
+	int ReadFsOpt(vector<uint8_t>&);			// Read file system (optional data)
 	void WriteFs(int, vector<uint8_t>&);			// File system write (execute)
 	void WriteFsOpt(const vector<uint8_t>&, int);	// File system write (optional data)
 
@@ -95,11 +114,18 @@ private:
 	void FS_Flush(vector<uint8_t>&);					// $56 - flush cache
 	void FS_CheckMedia(vector<uint8_t>&);				// $57 - check media
 	void FS_Lock(vector<uint8_t>&);					// $58 - get exclusive control
+	void FS_NFilesBatch(vector<uint8_t>&);				// $59 - find next files (extension)
+
+	void AllocateFsOpt(uint32_t);
+	void ReleaseFsOpt();
 
 	CFileSys fs;								// File system accessor
 	uint32_t fsresult = 0;						// File system access result code
 	array<uint8_t, 0x800> fsout;					// File system access result buffer
 	uint32_t fsoutlen = 0;						// File system access result buffer size
-	array<uint8_t, 0x1000000> fsopt;				// File system access buffer
+	vector<uint8_t> fsopt;						// File system access buffer, only allocated while in use
 	uint32_t fsoptlen = 0;						// File system access buffer size
+
+	// The buffer size for the statistics, which are not read by the thread that allocates the buffer
+	atomic<size_t> fsopt_capacity = 0;
 };
@@ -16,6 +16,8 @@
 // transfer size per PRINT command is currently limited to 4096 bytes.
 // 2. The client triggers printing with SYNCHRONIZE BUFFER. Each SYNCHRONIZE BUFFER results in
 // the print command for this printer (see below) to be called for the data not yet printed.
+// The print command is run in the background, i.e. SYNCHRONIZE BUFFER does not wait for the
+// printing system. The status of the print jobs is reported by the device statistics.
 //
 // It is recommended to reserve the printer device before printing and to release it afterwards.
 // The command to be used for printing can be set with the "cmd" property when attaching the device.
@@ -28,8 +30,14 @@
 //
 // With STOP PRINT printing can be cancelled before SYNCHRONIZE BUFFER was sent.
 //
+// The data received are collected in memory. Only when the "buffer" size has been exceeded they are
+// written to the print file, in large blocks. With "pipe" set to "true" the data are piped to the
+// standard input of the print command, which then does not require %f. Jobs not larger than "buffer"
+// are then printed without writing a file.
+//
 
 #include "shared/piscsi_exceptions.h"
+#include "shared/piscsi_util.h"
 #include "scsi_command_util.h"
 #include "scsi_printer.h"
 #include <filesystem>
@@ -38,6 +46,7 @@ using namespace std;
 using namespace filesystem;
 using namespace scsi_defs;
 using namespace scsi_command_util;
+using namespace piscsi_util;
 
 SCSIPrinter::SCSIPrinter(int lun) : PrimaryDevice(SCLP, lun)
 {
@@ -59,11 +68,21 @@ bool SCSIPrinter::Init(const param_map& params)
 	AddCommand(scsi_command::eCmdRelease6, [this] { ReleaseUnit(); });
 	AddCommand(scsi_command::eCmdSendDiagnostic, [this] { SendDiagnostic(); });
 
-	if (GetParam("cmd").find("%f") == string::npos) {
+	use_stdin = GetParam("pipe") == "true";
+
+	if (!use_stdin && GetParam("cmd").find("%f") == string::npos) {
 		LogTrace("Missing filename specifier %f");
 		return false;
 	}
 
+	if (int threshold; GetAsUnsignedInt(GetParam("buffer"), threshold)) {
+		spill_threshold = threshold;
+	}
+	else {
+		LogTrace("Invalid spool buffer size '" + GetParam("buffer") + "'");
+		return false;
+	}
+
 	error_code error;
 	file_template = temp_directory_path(error); //NOSONAR Publicly writable directory is fine here
 	file_template += PRINTER_FILE_PATTERN;
@@ -77,20 +96,26 @@ void SCSIPrinter::CleanUp()
 {
 	PrimaryDevice::CleanUp();
 
-	if (out.is_open()) {
-		out.close();
+	if (fd != -1) {
+		close(fd);
+		fd = -1;
 
 		error_code error;
 		remove(path(filename), error);
 
 		filename = "";
 	}
+
+	spool_buffer.clear();
+	job_byte_count = 0;
 }
 
 param_map SCSIPrinter::GetDefaultParams() const
 {
 	return {
-		{ "cmd", "lp -oraw %f" }
+		{ "cmd", "lp -oraw %f" },
+		{ "buffer", to_string(DEFAULT_SPILL_THRESHOLD) },
+		{ "pipe", "false" }
 	};
 }
 
@@ -128,7 +153,7 @@ void SCSIPrinter::Print()
 
 void SCSIPrinter::SynchronizeBuffer()
 {
-	if (!out.is_open()) {
+	if (!job_byte_count) {
 		LogWarn("Nothing to print");
 
 		++print_warning_count;
@@ -136,27 +161,55 @@ void SCSIPrinter::SynchronizeBuffer()
 		throw scsi_exception(sense_key::aborted_command);
 	}
 
+	const auto duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - job_start).count();
+	LogDebug("Received " + to_string(job_byte_count) + " byte(s) to be printed in " + to_string(duration) + " us (" +
+			to_string(duration ? job_byte_count * 1'000'000 / duration / 1024 : 0) + " KiB/s)");
+
 	string cmd = GetParam("cmd");
-	const size_t file_position = cmd.find("%f");
-	assert(file_position != string::npos);
-	cmd.replace(file_position, 2, filename);
 
-	error_code error;
-	LogTrace("Printing file '" + filename + "' with " + to_string(file_size(path(filename), error)) + " byte(s)");
+	bool submitted;
+	if (use_stdin && fd == -1 && cmd.find("%f") == string::npos) {
+		// The data never hit the disk
+		LogTrace("Piping " + to_string(spool_buffer.size()) + " byte(s) to the print command");
 
-	LogDebug("Executing print command '" + cmd + "'");
+		submitted = spooler.Submit(cmd, std::move(spool_buffer));
+	}
+	else {
+		if (!Spill(true)) {
+			CleanUp();
 
-	if (system(cmd.c_str())) {
-		LogError("Printing file '" + filename + "' failed, the printing system might not be configured");
+			throw scsi_exception(sense_key::aborted_command);
+		}
 
-		++print_error_count;
+		close(fd);
+		fd = -1;
+
+		if (const size_t file_position = cmd.find("%f"); file_position != string::npos) {
+			cmd.replace(file_position, 2, filename);
+		}
 
-		CleanUp();
+		LogTrace("Printing file '" + filename + "' with " + to_string(job_byte_count) + " byte(s)");
 
-		throw scsi_exception(sense_key::aborted_command);
+		submitted = spooler.Submit(cmd, filename, use_stdin);
+		if (!submitted) {
+			error_code error;
+			remove(path(filename), error);
+		}
+
+		// The file is owned by the spooler now
+		filename = "";
 	}
 
-	CleanUp();
+	spool_buffer = {};
+	job_byte_count = 0;
+
+	if (!submitted) {
+		LogWarn("Print queue is full, can't print");
+
+		++print_warning_count;
+
+		throw scsi_exception(sense_key::aborted_command);
+	}
 
 	EnterStatusPhase();
 }
@@ -165,43 +218,66 @@ bool SCSIPrinter::WriteByteSequence(span<const uint8_t> buf)
 {
 	byte_receive_count += buf.size();
 
-	if (!out.is_open()) {
+	if (!job_byte_count) {
+		job_start = chrono::steady_clock::now();
+
+		// The buffer never grows beyond the threshold and the size of one PRINT command
+		spool_buffer.reserve(min(spill_threshold, DEFAULT_SPILL_THRESHOLD) + buf.size());
+	}
+	job_byte_count += buf.size();
+
+	LogTrace("Buffering " + to_string(buf.size()) + " byte(s) to be printed");
+
+	spool_buffer.insert(spool_buffer.end(), buf.begin(), buf.end());
+
+	return spool_buffer.size() < spill_threshold || Spill(false);
+}
+
+bool SCSIPrinter::Spill(bool all)
+{
+	if (fd == -1) {
 		vector<char> f(file_template.begin(), file_template.end());
 		f.push_back(0);
 
 		// There is no C++ API that generates a file with a unique name
-		const int fd = mkstemp(f.data());
+		fd = mkstemp(f.data());
 		if (fd == -1) {
-			LogError("Can't create printer output file for pattern '" + filename + "': " + strerror(errno));
+			LogError("Can't create printer output file for pattern '" + file_template + "': " + strerror(errno));
 
 			++print_error_count;
 
 			return false;
 		}
-		close(fd);
 
 		filename = f.data();
 
-		out.open(filename, ios::binary);
-		if (out.fail()) {
-			++print_error_count;
-
-			throw scsi_exception(sense_key::aborted_command);
-		}
-
 		LogTrace("Created printer output file '" + filename + "'");
 	}
 
-	LogTrace("Appending " + to_string(buf.size()) + " byte(s) to printer output file ''" + filename + "'");
+	// Except for the end of the job only complete blocks are written, the remainder stays buffered
+	const size_t length = all ? spool_buffer.size() : spool_buffer.size() & ~(SPILL_ALIGNMENT - 1);
 
-	out.write((const char *)buf.data(), buf.size());
+	LogTrace("Writing " + to_string(length) + " byte(s) to printer output file '" + filename + "'");
 
-	const bool status = out.fail();
-	if (!status) {
-		++print_error_count;
+	for (size_t offset = 0; offset < length;) {
+		const auto count = write(fd, spool_buffer.data() + offset, length - offset);
+		if (count == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			LogError("Can't write printer output file '" + filename + "': " + strerror(errno));
+
+			++print_error_count;
+
+			return false;
+		}
+		offset += count;
 	}
 
-	return !status;
+	spool_buffer.erase(spool_buffer.begin(), spool_buffer.begin() + length);
+
+	return true;
 }
 
 vector<PbStatistics> SCSIPrinter::GetStatistics() const
@@ -215,7 +291,15 @@ vector<PbStatistics> SCSIPrinter::GetStatistics() const
 	s.set_category(PbStatisticsCategory::CATEGORY_INFO);
 
 	s.set_key(FILE_PRINT_COUNT);
-	s.set_value(file_print_count);
+	s.set_value(spooler.GetCompletedCount());
+	statistics.push_back(s);
+
+	s.set_key(PRINT_JOB_QUEUE_COUNT);
+	s.set_value(spooler.GetQueuedCount());
+	statistics.push_back(s);
+
+	s.set_key(PRINT_JOB_ACTIVE_COUNT);
+	s.set_value(spooler.GetActiveCount());
 	statistics.push_back(s);
 
 	s.set_key(BYTE_RECEIVE_COUNT);
@@ -228,6 +312,10 @@ vector<PbStatistics> SCSIPrinter::GetStatistics() const
 	s.set_value(print_error_count);
 	statistics.push_back(s);
 
+	s.set_key(PRINT_JOB_ERROR_COUNT);
+	s.set_value(spooler.GetFailedCount());
+	statistics.push_back(s);
+
 	s.set_category(PbStatisticsCategory::CATEGORY_WARNING);
 
 	s.set_key(PRINT_WARNING_COUNT);
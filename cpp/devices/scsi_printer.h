@@ -12,7 +12,9 @@
 
 #include "interfaces/scsi_printer_commands.h"
 #include "primary_device.h"
-#include <fstream>
+#include "print_spooler.h"
+#include <chrono>
+#include <vector>
 #include <string>
 #include <unordered_map>
 #include <span>
@@ -21,19 +23,26 @@ using namespace std;
 
 class SCSIPrinter : public PrimaryDevice, private ScsiPrinterCommands
 {
-	uint64_t file_print_count = 0;
 	uint64_t byte_receive_count = 0;
 	uint64_t print_error_count = 0;
 	uint64_t print_warning_count = 0;
 
 	static const int NOT_RESERVED = -2;
 
+	// Print data are written to the print file in multiples of this size
+	static const size_t SPILL_ALIGNMENT = 4096;
+
+	static const size_t DEFAULT_SPILL_THRESHOLD = 1024 * 1024;
+
 	static constexpr const char *PRINTER_FILE_PATTERN = "/piscsi_sclp-XXXXXX";
 
 	inline static const string FILE_PRINT_COUNT = "file_print_count";
 	inline static const string BYTE_RECEIVE_COUNT = "byte_receive_count";
 	inline static const string PRINT_ERROR_COUNT = "print_error_count";
 	inline static const string PRINT_WARNING_COUNT = "print_warning_count";
+	inline static const string PRINT_JOB_QUEUE_COUNT = "print_job_queue_count";
+	inline static const string PRINT_JOB_ACTIVE_COUNT = "print_job_active_count";
+	inline static const string PRINT_JOB_ERROR_COUNT = "print_job_error_count";
 
 public:
 
@@ -49,6 +58,9 @@ public:
 
 	bool WriteByteSequence(span<const uint8_t>) override;
 
+	// Waits for the print jobs to finish
+	void DrainPrintQueue() { spooler.Drain(); }
+
 	vector<PbStatistics> GetStatistics() const override;
 
 private:
@@ -59,10 +71,22 @@ private:
 	void SendDiagnostic() override { PrimaryDevice::SendDiagnostic(); }
 	void Print() override;
 	void SynchronizeBuffer();
+	bool Spill(bool);
 
 	string file_template;
 
 	string filename;
 
-	ofstream out;
+	// The print file, only created when the data do not fit into the spool buffer
+	int fd = -1;
+
+	vector<uint8_t> spool_buffer;
+	size_t spill_threshold = DEFAULT_SPILL_THRESHOLD;
+
+	bool use_stdin = false;
+
+	uint64_t job_byte_count = 0;
+	chrono::steady_clock::time_point job_start;
+
+	PrintSpooler spooler;
 };
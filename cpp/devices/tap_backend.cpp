@@ -0,0 +1,35 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "tap_backend.h"
+#include <unistd.h>
+#include <poll.h>
+#include <cerrno>
+
+using namespace std;
+
+int TapBackend::Read(span<uint8_t> buf, int timeout)
+{
+	pollfd fds = { .fd = fd, .events = POLLIN, .revents = 0 };
+	if (const int result = poll(&fds, 1, timeout); result <= 0) {
+		return result < 0 && errno != EINTR ? -1 : 0;
+	}
+
+	// An error condition without data would be reported again by each poll
+	if (!(fds.revents & POLLIN)) {
+		return fds.revents & (POLLERR | POLLHUP | POLLNVAL) ? -1 : 0;
+	}
+
+	return static_cast<int>(read(fd, buf.data(), buf.size()));
+}
+
+int TapBackend::Write(span<const uint8_t> buf)
+{
+	return static_cast<int>(write(fd, buf.data(), buf.size()));
+}
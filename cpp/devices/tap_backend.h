@@ -0,0 +1,33 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Sends and receives the frames of a TAP device, which is set up by CTapDriver
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "packet_backend.h"
+
+class TapBackend : public PacketBackend
+{
+
+public:
+
+	// The file descriptor remains owned by the caller
+	explicit TapBackend(int fd) : fd(fd) {}
+	~TapBackend() override = default;
+
+	int Read(span<uint8_t>, int) override;
+	int Write(span<const uint8_t>) override;
+
+	string GetName() const override { return "TAP"; }
+
+private:
+
+	int fd;
+};
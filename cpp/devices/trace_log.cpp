@@ -0,0 +1,168 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "device_logger.h"
+#include "trace_log.h"
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <cassert>
+
+using namespace std;
+
+void TraceLog::Start()
+{
+	if (IsRunning()) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < RING_SIZE; i++) {
+		ring[i].sequence = i;
+	}
+	head = 0;
+	tail = 0;
+	dropped = 0;
+	reported_dropped = 0;
+
+	thread = jthread([] (stop_token st) {
+		while (!st.stop_requested()) {
+			if (consuming) {
+				Flush();
+			}
+
+			this_thread::sleep_for(chrono::milliseconds(POLL_INTERVAL_MS));
+		}
+
+		Flush();
+	});
+}
+
+void TraceLog::Stop()
+{
+	if (IsRunning()) {
+		thread.request_stop();
+		thread.join();
+	}
+}
+
+void TraceLog::Record(trace_event event, int id, int lun, uint64_t value1, uint32_t value2,
+		span<const uint8_t> data)
+{
+	trace_record record = {
+			.value1 = value1,
+			.timestamp = static_cast<uint32_t>(chrono::duration_cast<chrono::microseconds>(
+					chrono::steady_clock::now().time_since_epoch()).count()),
+			.value2 = value2,
+			.id = static_cast<int8_t>(id),
+			.lun = static_cast<int8_t>(lun),
+			.event = event,
+			.length = static_cast<uint8_t>(min(data.size(), record.data.size())),
+			.data = {}
+	};
+	copy_n(data.begin(), record.length, record.data.begin());
+
+	if (!IsRunning()) {
+		spdlog::trace(Format(record));
+		return;
+	}
+
+	// Multiple producers are possible, a slot is claimed by advancing the head
+	uint32_t pos = head.load(memory_order_relaxed);
+	while (true) {
+		slot& s = ring[pos & (RING_SIZE - 1)];
+		const auto diff = static_cast<int32_t>(s.sequence.load(memory_order_acquire) - pos);
+		if (!diff) {
+			if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+				s.record = record;
+				s.sequence.store(pos + 1, memory_order_release);
+				return;
+			}
+		}
+		else if (diff < 0) {
+			// The ring is full, the background thread cannot keep up
+			++dropped;
+			return;
+		}
+		else {
+			pos = head.load(memory_order_relaxed);
+		}
+	}
+}
+
+bool TraceLog::Pop(trace_record& record)
+{
+	const uint32_t pos = tail.load(memory_order_relaxed);
+	slot& s = ring[pos & (RING_SIZE - 1)];
+	if (s.sequence.load(memory_order_acquire) != pos + 1) {
+		return false;
+	}
+
+	record = s.record;
+	s.sequence.store(pos + RING_SIZE, memory_order_release);
+	tail.store(pos + 1, memory_order_relaxed);
+
+	return true;
+}
+
+void TraceLog::Flush()
+{
+	trace_record record;
+	while (Pop(record)) {
+		spdlog::trace(Format(record));
+	}
+
+	// Otherwise gaps in the trace would go unnoticed
+	if (const uint64_t d = dropped; d != reported_dropped) {
+		spdlog::warn("Trace log buffer overflow, " + to_string(d - reported_dropped) + " trace record(s) dropped");
+		reported_dropped = d;
+	}
+}
+
+string TraceLog::Format(const trace_record& record)
+{
+	stringstream s;
+	s << DeviceLogger::GetPrefix(record.id, record.lun) << '[' << record.timestamp << " us] ";
+
+	switch (record.event) {
+		case trace_event::command:
+			s << "Command: $" << setfill('0') << setw(2) << hex << record.value1;
+			break;
+
+		case trace_event::cdb:
+			s << "CDB=$" << setfill('0') << hex;
+			for (int i = 0; i < record.length; i++) {
+				s << setw(2) << static_cast<int>(record.data[i]);
+			}
+			break;
+
+		case trace_event::send:
+			s << "Sending data, offset: " << record.value1 << ", length: " << record.value2;
+			break;
+
+		case trace_event::receive:
+			s << "Receiving data, transfer length: " << record.value1 << " byte(s)";
+			break;
+
+		case trace_event::status:
+			s << "Status phase, status is $" << setfill('0') << setw(2) << hex << record.value1;
+			break;
+
+		case trace_event::block:
+			s << "READ/WRITE/VERIFY/SEEK, start block: $" << setfill('0') << setw(8) << hex << record.value1
+					<< ", blocks: " << dec << record.value2;
+			break;
+
+		default:
+			assert(false);
+			break;
+	}
+
+	return s.str();
+}
@@ -0,0 +1,94 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Binary trace log for the hot paths of the bus thread. Fixed-size records are written
+// into a lock-free ring and are formatted and logged by a background thread.
+// As long as the background thread is not running records are logged immediately.
+// Records that do not fit into the ring anymore are dropped and counted.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <string>
+
+using namespace std;
+
+class TraceLog
+{
+	// Must be a power of 2
+	static const uint32_t RING_SIZE = 4096;
+
+	// How often the background thread checks for new records
+	static const int POLL_INTERVAL_MS = 10;
+
+public:
+
+	enum class trace_event : uint8_t {
+		command,
+		cdb,
+		send,
+		receive,
+		status,
+		block
+	};
+
+	struct trace_record {
+		uint64_t value1;
+		uint32_t timestamp;
+		uint32_t value2;
+		int8_t id;
+		int8_t lun;
+		trace_event event;
+		uint8_t length;
+		array<uint8_t, 16> data;
+	};
+
+	static void Start();
+	static void Stop();
+	static bool IsRunning() { return thread.joinable(); }
+
+	static void Record(trace_event, int, int, uint64_t, uint32_t, span<const uint8_t> = {});
+
+	static uint64_t GetDropped() { return dropped; }
+
+	static string Format(const trace_record&);
+
+protected:
+
+	// Lets the tests fill the ring, the records are only consumed when stopping
+	static void SetConsuming(bool b) { consuming = b; }
+
+private:
+
+	static bool Pop(trace_record&);
+	static void Flush();
+
+	struct slot {
+		atomic<uint32_t> sequence;
+		trace_record record;
+	};
+
+	static inline array<slot, RING_SIZE> ring;
+
+	static inline atomic<uint32_t> head;
+	static inline atomic<uint32_t> tail;
+
+	static inline atomic<uint64_t> dropped;
+
+	static inline atomic<bool> consuming = true;
+
+	// Only accessed by the background thread
+	static inline uint64_t reported_dropped;
+
+	static inline jthread thread;
+};
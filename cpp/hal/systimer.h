@@ -46,6 +46,7 @@ class SysTimer
 {
   public:
     static void Init();
+    static bool IsInitialized() { return initialized; }
     // Get system timer low byte
     static uint32_t GetTimerLow();
     // Get system timer high byte
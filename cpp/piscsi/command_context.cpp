@@ -35,11 +35,12 @@ bool CommandContext::ReadCommand()
 	return false;
 }
 
-void CommandContext::WriteResult(const PbResult& result) const
+// The optional fields are pre-serialized PbResult fields, which are appended to the serialized result
+void CommandContext::WriteResult(const PbResult& result, string_view fields) const
 {
 	// The descriptor is -1 when devices are not attached via the remote interface but by the piscsi tool
 	if (fd != -1) {
-		SerializeMessage(fd, result);
+		SerializeMessage(fd, result, fields);
 	}
 }
 
@@ -50,6 +51,17 @@ bool CommandContext::WriteSuccessResult(PbResult& result) const
 	return true;
 }
 
+// The data are a pre-serialized message, which is spliced into the result as the field with the given number
+bool CommandContext::WriteSuccessResult(PbResult& result, int field_number, string_view data) const
+{
+	string fields;
+	AppendSerializedField(fields, field_number, data);
+
+	result.set_status(true);
+	WriteResult(result, fields);
+	return true;
+}
+
 bool CommandContext::ReturnLocalizedError(LocalizationKey key, const string& arg1, const string& arg2,
 		const string& arg3) const
 {
@@ -23,13 +23,17 @@ public:
 
 	CommandContext(const PbCommand& cmd, string_view f, string_view l) : command(cmd), default_folder(f), locale(l) {}
 	explicit CommandContext(int f) : fd(f) {}
+	// Context for a command of a batch, sharing the settings and the descriptor of the batch context
+	CommandContext(const CommandContext& context, const PbCommand& cmd) : command(cmd),
+			default_folder(context.default_folder), locale(context.locale), fd(context.fd) {}
 	~CommandContext() = default;
 
 	string GetDefaultFolder() const { return default_folder; }
 	void SetDefaultFolder(string_view f) { default_folder = f; }
 	bool ReadCommand();
-	void WriteResult(const PbResult&) const;
+	void WriteResult(const PbResult&, string_view = "") const;
 	bool WriteSuccessResult(PbResult&) const;
+	bool WriteSuccessResult(PbResult&, int, string_view) const;
 	const PbCommand& GetCommand() const { return command; }
 
 	bool ReturnLocalizedError(LocalizationKey, const string& = "", const string& = "", const string& = "") const;
@@ -238,6 +238,13 @@ Localizer::Localizer()
 	Add(LocalizationKey::ERROR_OPERATION_DENIED_READY, "fr", "Opération %1 refusée, %2 n'est pas prêt");
 	Add(LocalizationKey::ERROR_OPERATION_DENIED_READY, "es", "%1 operación denegada, %2 no está listo");
 	Add(LocalizationKey::ERROR_OPERATION_DENIED_READY, "zh", "%1 操作被拒绝,%2 还没有准备好");
+
+	Add(LocalizationKey::ERROR_BATCH_OPERATION, "en", "%1 operation is not supported in a batch");
+	Add(LocalizationKey::ERROR_BATCH_OPERATION, "de", "%1-Operation wird in einem Batch nicht unterstützt");
+	Add(LocalizationKey::ERROR_BATCH_OPERATION, "sv", "Operationen %1 stöds inte i en batch");
+	Add(LocalizationKey::ERROR_BATCH_OPERATION, "fr", "Opération %1 non supportée dans un lot");
+	Add(LocalizationKey::ERROR_BATCH_OPERATION, "es", "Operación %1 no soportada en un lote");
+	Add(LocalizationKey::ERROR_BATCH_OPERATION, "zh", "批处理中不支持 %1 操作");
 }
 
 void Localizer::Add(LocalizationKey key, const string& locale, string_view value)
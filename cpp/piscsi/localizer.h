@@ -51,7 +51,8 @@ enum class LocalizationKey {
 	ERROR_OPERATION_DENIED_STOPPABLE,
 	ERROR_OPERATION_DENIED_REMOVABLE,
 	ERROR_OPERATION_DENIED_PROTECTABLE,
-	ERROR_OPERATION_DENIED_READY
+	ERROR_OPERATION_DENIED_READY,
+	ERROR_BATCH_OPERATION
 };
 
 class Localizer
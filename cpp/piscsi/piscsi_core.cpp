@@ -17,6 +17,8 @@
 #include "shared/piscsi_version.h"
 #include "controllers/scsi_controller.h"
 #include "devices/device_logger.h"
+#include "devices/trace_log.h"
+#include "devices/packet_capture.h"
 #include "devices/device_factory.h"
 #include "devices/storage_device.h"
 #include "hal/gpiobus_factory.h"
@@ -74,6 +76,9 @@ bool Piscsi::InitBus()
 
 	executor = make_unique<PiscsiExecutor>(*bus, controller_manager);
 
+	// Trace messages of the bus thread are formatted and logged in the background
+	TraceLog::Start();
+
 	return true;
 }
 
@@ -85,6 +90,10 @@ void Piscsi::CleanUp()
 
 	executor->DetachAll();
 
+	TraceLog::Stop();
+
+	PacketCapture::Stop();
+
 	// TODO Check why there are rare cases where bus is NULL on a remote interface shutdown
 	// even though it is never set to NULL anywhere
 	assert(bus);
@@ -271,6 +280,33 @@ PbDeviceType Piscsi::ParseDeviceType(const string& value)
 	throw parser_exception("Illegal device type '" + value + "'");
 }
 
+string Piscsi::SetPacketCapture(const PbCommand& command) const
+{
+	const string file = GetParam(command, "file");
+	if (file.empty()) {
+		PacketCapture::Stop();
+		return "";
+	}
+
+	// The capture files are created in the image folder and are rotated, the fixed extension ensures that
+	// no image file can be overwritten or renamed
+	if (path(file).is_absolute() || file.find("..") != string::npos || path(file).extension() != ".pcapng") {
+		return "Invalid capture file name '" + file + "', the name must be relative and end with '.pcapng'";
+	}
+
+	int max_size = PacketCapture::DEFAULT_MAX_FILE_SIZE;
+	if (const string size = GetParam(command, "max_size"); !size.empty() && !GetAsUnsignedInt(size, max_size)) {
+		return "Invalid maximum capture file size '" + size + "'";
+	}
+
+	int max_files = PacketCapture::DEFAULT_MAX_FILE_COUNT;
+	if (const string count = GetParam(command, "max_files"); !count.empty() && !GetAsUnsignedInt(count, max_files)) {
+		return "Invalid capture file count '" + count + "'";
+	}
+
+	return PacketCapture::Start(piscsi_image.GetDefaultFolder() + "/" + file, max_size, max_files);
+}
+
 bool Piscsi::SetLogLevel(const string& log_level) const
 {
 	int id = -1;
@@ -330,7 +366,9 @@ bool Piscsi::ExecuteCommand(const CommandContext& context)
 
 	spdlog::trace("Received " + PbOperation_Name(operation) + " command");
 
-	PbResult result;
+	// Build the result on an arena in order to avoid many small heap allocations
+	google::protobuf::Arena arena;
+	auto& result = *google::protobuf::Arena::CreateMessage<PbResult>(&arena);
 
 	switch(operation) {
 		case LOG_LEVEL:
@@ -342,6 +380,15 @@ bool Piscsi::ExecuteCommand(const CommandContext& context)
 			}
 			break;
 
+		case PACKET_CAPTURE:
+			if (const string error = SetPacketCapture(command); !error.empty()) {
+				context.ReturnErrorStatus(error);
+			}
+			else {
+				context.ReturnSuccessStatus();
+			}
+			break;
+
 		case DEFAULT_FOLDER:
 			if (const string error = piscsi_image.SetDefaultFolder(GetParam(command, "folder")); !error.empty()) {
 				context.ReturnErrorStatus(error);
@@ -361,14 +408,14 @@ bool Piscsi::ExecuteCommand(const CommandContext& context)
 			return context.WriteSuccessResult(result);
 
 		case SERVER_INFO:
-			response.GetServerInfo(*result.mutable_server_info(), command, controller_manager.GetAllDevices(),
-					executor->GetReservedIds(), piscsi_image.GetDefaultFolder(), piscsi_image.GetDepth());
-			context.WriteSuccessResult(result);
+			context.WriteSuccessResult(result, PbResult::kServerInfoFieldNumber,
+					response.GetServerInfo(command, controller_manager.GetAllDevices(), executor->GetReservedIds(),
+							piscsi_image.GetDefaultFolder(), piscsi_image.GetDepth()));
 			break;
 
 		case VERSION_INFO:
-			response.GetVersionInfo(*result.mutable_version_info());
-			return context.WriteSuccessResult(result);
+			return context.WriteSuccessResult(result, PbResult::kVersionInfoFieldNumber,
+					response.GetStaticInfo(operation, piscsi_image.GetDepth()));
 
 		case LOG_LEVEL_INFO:
 			response.GetLogLevelInfo(*result.mutable_log_level_info());
@@ -383,18 +430,12 @@ bool Piscsi::ExecuteCommand(const CommandContext& context)
 			if (string filename = GetParam(command, "file"); filename.empty()) {
 				context.ReturnLocalizedError( LocalizationKey::ERROR_MISSING_FILENAME);
 			}
+			else if (response.GetImageFile(*result.mutable_image_file_info(), piscsi_image.GetDefaultFolder(),
+					filename)) {
+				context.WriteSuccessResult(result);
+			}
 			else {
-				auto image_file = make_unique<PbImageFile>();
-				const bool status = response.GetImageFile(*image_file.get(), piscsi_image.GetDefaultFolder(),
-						filename);
-				if (status) {
-					result.set_allocated_image_file_info(image_file.get());
-					result.set_status(true);
-					context.WriteResult(result);
-				}
-				else {
-					context.ReturnLocalizedError(LocalizationKey::ERROR_IMAGE_FILE_INFO);
-				}
+				context.ReturnLocalizedError(LocalizationKey::ERROR_IMAGE_FILE_INFO);
 			}
 			break;
 
@@ -403,8 +444,8 @@ bool Piscsi::ExecuteCommand(const CommandContext& context)
 			return context.WriteSuccessResult(result);
 
 		case MAPPING_INFO:
-			response.GetMappingInfo(*result.mutable_mapping_info());
-			return context.WriteSuccessResult(result);
+			return context.WriteSuccessResult(result, PbResult::kMappingInfoFieldNumber,
+					response.GetStaticInfo(operation, piscsi_image.GetDepth()));
 
 		case STATISTICS_INFO:
 			response.GetStatisticsInfo(*result.mutable_statistics_info(), controller_manager.GetAllDevices());
@@ -412,8 +453,8 @@ bool Piscsi::ExecuteCommand(const CommandContext& context)
 			break;
 
 		case OPERATION_INFO:
-			response.GetOperationInfo(*result.mutable_operation_info(), piscsi_image.GetDepth());
-			return context.WriteSuccessResult(result);
+			return context.WriteSuccessResult(result, PbResult::kOperationInfoFieldNumber,
+					response.GetStaticInfo(operation, piscsi_image.GetDepth()));
 
 		case RESERVED_IDS_INFO:
 			response.GetReservedIds(*result.mutable_reserved_ids_info(), executor->GetReservedIds());
@@ -464,8 +505,8 @@ bool Piscsi::ExecuteWithLock(const CommandContext& context)
 
 bool Piscsi::HandleDeviceListChange(const CommandContext& context, PbOperation operation) const
 {
-	// ATTACH and DETACH return the resulting device list
-	if (operation == ATTACH || operation == DETACH) {
+	// ATTACH, DETACH and BATCH return the resulting device list
+	if (operation == ATTACH || operation == DETACH || operation == BATCH) {
 		// A command with an empty device list is required here in order to return data for all devices
 		PbCommand command;
 		PbResult result;
@@ -56,6 +56,7 @@ private:
 	bool HandleDeviceListChange(const CommandContext&, PbOperation) const;
 
 	bool SetLogLevel(const string&) const;
+	string SetPacketCapture(const PbCommand&) const;
 
 	const shared_ptr<spdlog::logger> logger = spdlog::stdout_color_mt("piscsi stdout logger");
 
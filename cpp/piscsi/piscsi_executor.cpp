@@ -17,6 +17,10 @@
 #include "piscsi_executor.h"
 #include <spdlog/spdlog.h>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <ranges>
 
 using namespace spdlog;
 using namespace protobuf_util;
@@ -103,11 +107,20 @@ bool PiscsiExecutor::ProcessCmd(const CommandContext& context)
 			return context.ReturnSuccessStatus();
 		}
 
+		case BATCH:
+			// The resulting device list is the only result of a batch, it is returned by the caller
+			return ProcessBatch(context);
+
 		default:
 			// This is a device-specific command handled below
 			break;
 	}
 
+	// Attaching several devices (typically at startup) opens the image files in parallel
+	if (command.operation() == ATTACH && command.devices_size() > 1) {
+		return ProcessAttachCmd(context) && context.ReturnSuccessStatus();
+	}
+
 	// Remember the list of reserved files during the dry run
 	const auto& reserved_files = StorageDevice::GetReservedFiles();
 	const bool isDryRunError = ranges::find_if_not(command.devices(), [&] (const auto& device)
@@ -130,6 +143,385 @@ bool PiscsiExecutor::ProcessCmd(const CommandContext& context)
 	return context.ReturnSuccessStatus();
 }
 
+bool PiscsiExecutor::ProcessAttachCmd(const CommandContext& context)
+{
+	const PbCommand& command = context.GetCommand();
+
+	const auto start = chrono::steady_clock::now();
+
+	// Create and validate all devices without opening any image file, this is cheap
+	vector<shared_ptr<PrimaryDevice>> devices;
+	set<id_set> ids;
+	unordered_map<string, id_set> filenames;
+	for (const auto& pb_device : command.devices()) {
+		spdlog::info("Validating: " + PrintCommand(command, pb_device));
+
+		if (!ValidateIdAndLun(context, pb_device.id(), pb_device.unit())) {
+			return false;
+		}
+
+		if (!ids.insert({ pb_device.id(), pb_device.unit() }).second
+				|| controller_manager.HasDeviceForIdAndLun(pb_device.id(), pb_device.unit())) {
+			return context.ReturnLocalizedError(LocalizationKey::ERROR_DUPLICATE_ID, to_string(pb_device.id()),
+					to_string(pb_device.unit()));
+		}
+
+		auto device = PrepareAttach(context, pb_device);
+		if (device == nullptr) {
+			return false;
+		}
+
+		// Image files are only reserved when attaching, i.e. the same file might be used twice in this command
+		if (const auto storage_device = dynamic_pointer_cast<StorageDevice>(device); storage_device != nullptr
+				&& !storage_device->GetFilename().empty()) {
+			if (const auto& [it, inserted] = filenames.try_emplace(storage_device->GetFilename(),
+					id_set(pb_device.id(), pb_device.unit())); !inserted) {
+				return context.ReturnLocalizedError(LocalizationKey::ERROR_IMAGE_IN_USE, it->first,
+						to_string(it->second.first) + ":" + to_string(it->second.second));
+			}
+		}
+
+		devices.push_back(device);
+	}
+
+	const auto prepared = chrono::steady_clock::now();
+
+	// Opening the image files is what takes time (file checks, caches), the devices do not share any state
+	vector<string> errors(devices.size());
+	atomic<size_t> next = 0;
+	auto open = [&] {
+		for (size_t i = next++; i < devices.size(); i = next++) {
+			if (const auto storage_device = dynamic_pointer_cast<StorageDevice>(devices[i]); storage_device != nullptr
+					&& !storage_device->GetFilename().empty()) {
+				try {
+					storage_device->Open();
+				}
+				catch(const io_exception&) {
+					errors[i] = storage_device->GetFilename();
+				}
+				// Any other exception would terminate piscsi when leaving the worker thread
+				catch(const exception& e) {
+					spdlog::error("Can't open '" + storage_device->GetFilename() + "': " + e.what());
+					errors[i] = storage_device->GetFilename();
+				}
+			}
+		}
+	};
+	{
+		const size_t count = min(devices.size(), static_cast<size_t>(max(1U, min(thread::hardware_concurrency(),
+				MAX_OPEN_THREADS))));
+		vector<jthread> threads;
+		for (size_t i = 1; i < count; i++) {
+			threads.emplace_back(open);
+		}
+		open();
+	}
+
+	const auto opened = chrono::steady_clock::now();
+
+	// Report the first error in command order, so that the result does not depend on the thread timing
+	if (const auto& error = ranges::find_if_not(errors, &string::empty); error != errors.end()) {
+		return context.ReturnLocalizedError(LocalizationKey::ERROR_FILE_OPEN, *error);
+	}
+
+	if (const string error = EnsureLun0(command); !error.empty()) {
+		return context.ReturnErrorStatus(error);
+	}
+
+	for (size_t i = 0; i < devices.size(); i++) {
+		const auto& pb_device = command.devices(static_cast<int>(i));
+
+		spdlog::info("Executing: " + PrintCommand(command, pb_device));
+
+		SetProtection(pb_device, *devices[i]);
+
+		if (!CompleteAttach(context, pb_device, devices[i])) {
+			// Either all or none of the devices are attached
+			for (size_t j = i; j > 0; j--) {
+				RevertAttach(command.devices(static_cast<int>(j - 1)).id(), command.devices(static_cast<int>(j - 1)).unit());
+			}
+
+			return false;
+		}
+	}
+
+	const auto attached = chrono::steady_clock::now();
+
+	spdlog::debug("Attached " + to_string(devices.size()) + " device(s): prepare "
+			+ to_string(chrono::duration_cast<chrono::milliseconds>(prepared - start).count()) + " ms, open "
+			+ to_string(chrono::duration_cast<chrono::milliseconds>(opened - prepared).count()) + " ms, attach "
+			+ to_string(chrono::duration_cast<chrono::milliseconds>(attached - opened).count()) + " ms");
+
+	return true;
+}
+
+bool PiscsiExecutor::ProcessBatch(const CommandContext& context)
+{
+	const PbCommand& batch = context.GetCommand();
+
+	for (const auto& command : batch.commands()) {
+		if (!IsBatchOperation(command.operation())) {
+			return context.ReturnLocalizedError(LocalizationKey::ERROR_BATCH_OPERATION,
+					PbOperation_Name(command.operation()));
+		}
+	}
+
+	// The device configuration resulting from the commands validated so far, so that a command can refer
+	// to a device attached, detached or ejected by a previous command of the same batch
+	map<id_set, batch_device> batch_devices;
+	for (const auto& device : controller_manager.GetAllDevices()) {
+		const auto storage_device = dynamic_pointer_cast<StorageDevice>(device);
+		batch_devices[{ device->GetId(), device->GetLun() }] =
+				{ device, storage_device != nullptr ? storage_device->GetFilename() : "" };
+	}
+
+	// Validate all commands before executing any of them, remembering the list of reserved files during the dry run
+	const auto& reserved_files = StorageDevice::GetReservedFiles();
+	const bool isDryRunError = ranges::find_if_not(batch.commands(), [&] (const auto& command) {
+		const CommandContext command_context(context, command);
+		return ranges::find_if_not(command.devices(), [&] (const auto& device)
+				{ return ValidateBatchCmd(command_context, device, batch_devices); }) == command.devices().end();
+	}) != batch.commands().end();
+	StorageDevice::SetReservedFiles(reserved_files);
+
+	if (isDryRunError) {
+		return false;
+	}
+
+	unordered_map<int32_t, int32_t> luns;
+	for (const auto& [id, lun] : views::keys(batch_devices)) {
+		luns[id] |= 1 << lun;
+	}
+	if (const string error = CheckLun0(luns); !error.empty()) {
+		return context.ReturnErrorStatus(error);
+	}
+
+	vector<function<void()>> undo_list;
+	const bool isError = ranges::find_if_not(batch.commands(), [&] (const auto& command) {
+		const CommandContext command_context(context, command);
+		return ranges::find_if_not(command.devices(), [&] (const auto& pb_device) {
+			auto undo = GetUndo(command.operation(), pb_device);
+			if (!ProcessDeviceCmd(command_context, pb_device, false)) {
+				return false;
+			}
+			undo_list.push_back(undo);
+			return true;
+		}) == command.devices().end();
+	}) != batch.commands().end();
+
+	if (isError) {
+		for (const auto& undo : views::reverse(undo_list)) {
+			undo();
+		}
+
+		spdlog::warn("Undid " + to_string(undo_list.size()) + " device command(s) of the failed batch");
+
+		return false;
+	}
+
+	spdlog::info("Executed batch with " + to_string(batch.commands_size()) + " command(s)");
+
+	return true;
+}
+
+bool PiscsiExecutor::ValidateBatchCmd(const CommandContext& context, const PbDeviceDefinition& pb_device,
+		map<id_set, batch_device>& batch_devices) const
+{
+	spdlog::info("Validating: " + PrintCommand(context.GetCommand(), pb_device));
+
+	const int id = pb_device.id();
+	const int lun = pb_device.unit();
+
+	if (!ValidateIdAndLun(context, id, lun)) {
+		return false;
+	}
+
+	const PbOperation operation = context.GetCommand().operation();
+
+	if (operation == ATTACH) {
+		if (batch_devices.contains({ id, lun })) {
+			return context.ReturnLocalizedError(LocalizationKey::ERROR_DUPLICATE_ID, to_string(id), to_string(lun));
+		}
+
+		auto device = PrepareAttach(context, pb_device);
+		if (device == nullptr) {
+			return false;
+		}
+
+		string filename;
+		if (const auto storage_device = dynamic_pointer_cast<StorageDevice>(device); storage_device != nullptr) {
+			filename = storage_device->GetFilename();
+			if (!filename.empty() && !OpenImageFile(context, *storage_device)) {
+				return false;
+			}
+		}
+
+		SetProtection(pb_device, *device);
+
+		UpdateReservedFile(filename, { id, lun });
+
+		batch_devices[{ id, lun }] = { device, filename };
+
+		return true;
+	}
+
+	const auto& it = batch_devices.find({ id, lun });
+	if (it == batch_devices.end()) {
+		if (ranges::none_of(views::keys(batch_devices), [id] (const auto& d) { return d.first == id; })) {
+			return context.ReturnLocalizedError(LocalizationKey::ERROR_NON_EXISTING_DEVICE, to_string(id));
+		}
+
+		return context.ReturnLocalizedError(LocalizationKey::ERROR_NON_EXISTING_UNIT, to_string(id), to_string(lun));
+	}
+
+	auto& [device, filename] = it->second;
+
+	if (!ValidateOperationAgainstDevice(context, *device, operation)) {
+		return false;
+	}
+
+	switch (operation) {
+		case DETACH:
+			// LUN 0 can only be detached if there is no other LUN anymore
+			if (!lun && ranges::count_if(views::keys(batch_devices), [id] (const auto& d) { return d.first == id; }) > 1) {
+				return context.ReturnLocalizedError(LocalizationKey::ERROR_LUN0);
+			}
+
+			UpdateReservedFile(filename, { -1, -1 });
+			batch_devices.erase(it);
+			return true;
+
+		case EJECT:
+			UpdateReservedFile(filename, { -1, -1 });
+			filename.clear();
+			return true;
+
+		case INSERT: {
+			// The medium might have been ejected by a previous command of the batch
+			if (!ValidateInsert(context, pb_device, *device, filename.empty())) {
+				return false;
+			}
+
+			// Resolve the filename like ResolveImageFile() does, without modifying the device
+			string f = GetParam(pb_device, "file");
+			if (!StorageDevice::FileExists(f)) {
+				f = context.GetDefaultFolder() + "/" + f;
+			}
+			if (!CheckForReservedFile(context, f)) {
+				return false;
+			}
+
+			UpdateReservedFile(f, { id, lun });
+			filename = f;
+			return true;
+		}
+
+		case PROTECT:
+		case UNPROTECT:
+			if (device->SupportsFile() && filename.empty()) {
+				return context.ReturnLocalizedError(LocalizationKey::ERROR_OPERATION_DENIED_READY,
+						PbOperation_Name(operation), device->GetTypeString());
+			}
+			return true;
+
+		default:
+			return true;
+	}
+}
+
+function<void()> PiscsiExecutor::GetUndo(PbOperation operation, const PbDeviceDefinition& pb_device)
+{
+	const int id = pb_device.id();
+	const int lun = pb_device.unit();
+
+	// The device state before the command is executed, which is restored when undoing the command
+	const auto device = controller_manager.GetDeviceForIdAndLun(id, lun);
+
+	switch (operation) {
+		case ATTACH:
+			return [this, id, lun] { RevertAttach(id, lun); };
+
+		case DETACH: {
+			// The detached device cannot be added to a controller again, an equivalent device is attached instead
+			PbDeviceDefinition pb_attach;
+			pb_attach.set_id(id);
+			pb_attach.set_unit(lun);
+			pb_attach.set_type(device->GetType());
+			pb_attach.set_vendor(device->GetVendor());
+			pb_attach.set_product(device->GetProduct());
+			pb_attach.set_revision(device->GetRevision());
+			pb_attach.set_protected_(device->IsProtected());
+			auto params = device->GetParams();
+			if (const auto storage_device = dynamic_pointer_cast<StorageDevice>(device); storage_device != nullptr) {
+				// The medium might have been changed since the device was attached
+				params["file"] = storage_device->GetFilename();
+			}
+			pb_attach.mutable_params()->insert(params.begin(), params.end());
+			if (const auto disk = dynamic_pointer_cast<Disk>(device); disk != nullptr) {
+				pb_attach.set_block_size(disk->GetConfiguredSectorSize());
+			}
+
+			return [this, pb_attach] {
+				if (!Attach(CommandContext(-1), pb_attach, false)) {
+					spdlog::error("Can't attach device " + to_string(pb_attach.id()) + ":"
+							+ to_string(pb_attach.unit()) + " again");
+				}
+			};
+		}
+
+		case START:
+		case STOP:
+			return [device, stopped = device->IsStopped()] {
+				if (stopped) {
+					device->Stop();
+				}
+				else {
+					device->Start();
+				}
+			};
+
+		case INSERT: {
+			const auto disk = dynamic_pointer_cast<Disk>(device);
+			return [this, device, disk, is_protected = device->IsProtected(),
+					sector_size = disk != nullptr ? disk->GetConfiguredSectorSize() : 0] {
+				device->Eject(true);
+				device->SetProtected(is_protected);
+				if (disk != nullptr) {
+					disk->SetConfiguredSectorSize(device_factory, sector_size);
+				}
+			};
+		}
+
+		case EJECT: {
+			const auto storage_device = dynamic_pointer_cast<StorageDevice>(device);
+			if (storage_device == nullptr || storage_device->GetFilename().empty()) {
+				return [] { /* There is no medium to be inserted again */ };
+			}
+
+			// The configured sector size is not changed by ejecting
+			PbDeviceDefinition pb_insert;
+			pb_insert.set_id(id);
+			pb_insert.set_unit(lun);
+			pb_insert.set_protected_(device->IsProtected());
+			(*pb_insert.mutable_params())["file"] = storage_device->GetFilename();
+
+			return [this, device, pb_insert] {
+				if (!Insert(CommandContext(-1), pb_insert, device, false)) {
+					spdlog::error("Can't insert '" + GetParam(pb_insert, "file") + "' into " + device->GetIdentifier()
+							+ " again");
+				}
+			};
+		}
+
+		case PROTECT:
+		case UNPROTECT:
+			return [device, is_protected = device->IsProtected()] { device->SetProtected(is_protected); };
+
+		default:
+			return [] { /* Nothing to be undone */ };
+	}
+}
+
 bool PiscsiExecutor::Start(PrimaryDevice& device, bool dryRun) const
 {
 	if (!dryRun) {
@@ -190,65 +582,87 @@ bool PiscsiExecutor::Unprotect(PrimaryDevice& device, bool dryRun) const
 }
 
 bool PiscsiExecutor::Attach(const CommandContext& context, const PbDeviceDefinition& pb_device, bool dryRun)
+{
+	if (controller_manager.HasDeviceForIdAndLun(pb_device.id(), pb_device.unit())) {
+		return context.ReturnLocalizedError(LocalizationKey::ERROR_DUPLICATE_ID, to_string(pb_device.id()),
+				to_string(pb_device.unit()));
+	}
+
+	auto device = PrepareAttach(context, pb_device);
+	if (device == nullptr) {
+		return false;
+	}
+
+	if (const auto storage_device = dynamic_pointer_cast<StorageDevice>(device);
+			storage_device != nullptr && !storage_device->GetFilename().empty()
+			&& !OpenImageFile(context, *storage_device)) {
+		return false;
+	}
+
+	SetProtection(pb_device, *device);
+
+	// Stop the dry run here, before actually attaching
+	if (dryRun) {
+		return true;
+	}
+
+	return CompleteAttach(context, pb_device, device);
+}
+
+shared_ptr<PrimaryDevice> PiscsiExecutor::PrepareAttach(const CommandContext& context,
+		const PbDeviceDefinition& pb_device) const
 {
 	const int id = pb_device.id();
 	const int lun = pb_device.unit();
 	const PbDeviceType type = pb_device.type();
 
 	if (lun >= ControllerManager::GetScsiLunMax()) {
-		return context.ReturnLocalizedError(LocalizationKey::ERROR_INVALID_LUN, to_string(lun),
+		context.ReturnLocalizedError(LocalizationKey::ERROR_INVALID_LUN, to_string(lun),
 				to_string(ControllerManager::GetScsiLunMax()));
-	}
-
-	if (controller_manager.HasDeviceForIdAndLun(id, lun)) {
-		return context.ReturnLocalizedError(LocalizationKey::ERROR_DUPLICATE_ID, to_string(id), to_string(lun));
+		return nullptr;
 	}
 
 	if (reserved_ids.contains(id)) {
-		return context.ReturnLocalizedError(LocalizationKey::ERROR_RESERVED_ID, to_string(id));
+		context.ReturnLocalizedError(LocalizationKey::ERROR_RESERVED_ID, to_string(id));
+		return nullptr;
 	}
 
 	const string filename = GetParam(pb_device, "file");
 
 	auto device = CreateDevice(context, type, lun, filename);
 	if (device == nullptr) {
-		return false;
+		return nullptr;
 	}
 
 	// If no filename was provided the medium is considered not inserted
 	device->SetRemoved(device->SupportsFile() ? filename.empty() : false);
 
 	if (!SetProductData(context, pb_device, *device)) {
-		return false;
+		return nullptr;
 	}
 
 	if (!SetSectorSize(context, device, pb_device.block_size())) {
-		return false;
+		return nullptr;
 	}
 
-	const auto storage_device = dynamic_pointer_cast<StorageDevice>(device);
 	if (device->SupportsFile()) {
 		// Only with removable media drives, CD and MO the medium (=file) may be inserted later
 		if (!device->IsRemovable() && filename.empty()) {
-			return context.ReturnLocalizedError(LocalizationKey::ERROR_MISSING_FILENAME, PbDeviceType_Name(type));
+			context.ReturnLocalizedError(LocalizationKey::ERROR_MISSING_FILENAME, PbDeviceType_Name(type));
+			return nullptr;
 		}
 
-		if (!ValidateImageFile(context, *storage_device, filename)) {
-			return false;
+		if (!ResolveImageFile(context, *dynamic_pointer_cast<StorageDevice>(device), filename)) {
+			return nullptr;
 		}
 	}
 
-	// Only non read-only devices support protect/unprotect
-	// This operation must not be executed before Open() because Open() overrides some settings.
-	if (device->IsProtectable() && !device->IsReadOnly()) {
-		device->SetProtected(pb_device.protected_());
-	}
-
-	// Stop the dry run here, before actually attaching
-	if (dryRun) {
-		return true;
-	}
+	return device;
+}
 
+bool PiscsiExecutor::CompleteAttach(const CommandContext& context, const PbDeviceDefinition& pb_device,
+		const shared_ptr<PrimaryDevice>& device)
+{
 	param_map params = { pb_device.params().begin(), pb_device.params().end() };
 	if (!device->SupportsFile()) {
 		// Clients like scsictl might have sent both "file" and "interfaces"
@@ -259,11 +673,12 @@ bool PiscsiExecutor::Attach(const CommandContext& context, const PbDeviceDefinit
 		return context.ReturnLocalizedError(LocalizationKey::ERROR_INITIALIZATION, device->GetIdentifier());
 	}
 
-	if (!controller_manager.AttachToController(bus, id, device)) {
+	if (!controller_manager.AttachToController(bus, pb_device.id(), device)) {
 		return context.ReturnLocalizedError(LocalizationKey::ERROR_SCSI_CONTROLLER);
 	}
 
-	if (storage_device != nullptr && !storage_device->IsRemoved()) {
+	if (const auto storage_device = dynamic_pointer_cast<StorageDevice>(device);
+			storage_device != nullptr && !storage_device->IsRemoved()) {
 		storage_device->ReserveFile();
 	}
 
@@ -280,31 +695,29 @@ bool PiscsiExecutor::Attach(const CommandContext& context, const PbDeviceDefinit
 	return true;
 }
 
+void PiscsiExecutor::SetProtection(const PbDeviceDefinition& pb_device, PrimaryDevice& device)
+{
+	// Only non read-only devices support protect/unprotect
+	// This operation must not be executed before Open() because Open() overrides some settings.
+	if (device.IsProtectable() && !device.IsReadOnly()) {
+		device.SetProtected(pb_device.protected_());
+	}
+}
+
 bool PiscsiExecutor::Insert(const CommandContext& context, const PbDeviceDefinition& pb_device,
 		const shared_ptr<PrimaryDevice>& device, bool dryRun) const
 {
-	if (!device->SupportsFile()) {
+	if (!ValidateInsert(context, pb_device, *device, device->IsRemoved())) {
 		return false;
 	}
 
-	if (!device->IsRemoved()) {
-		return context.ReturnLocalizedError(LocalizationKey::ERROR_EJECT_REQUIRED);
-	}
-
-	if (!pb_device.vendor().empty() || !pb_device.product().empty() || !pb_device.revision().empty()) {
-		return context.ReturnLocalizedError(LocalizationKey::ERROR_DEVICE_NAME_UPDATE);
-	}
-
-	const string filename = GetParam(pb_device, "file");
-	if (filename.empty()) {
-		return context.ReturnLocalizedError(LocalizationKey::ERROR_MISSING_FILENAME);
-	}
-
 	// Stop the dry run here, before modifying the device
 	if (dryRun) {
 		return true;
 	}
 
+	const string filename = GetParam(pb_device, "file");
+
 	spdlog::info("Insert " + string(pb_device.protected_() ? "protected " : "") + "file '" + filename +
 			"' requested into " + device->GetIdentifier());
 
@@ -324,6 +737,28 @@ bool PiscsiExecutor::Insert(const CommandContext& context, const PbDeviceDefinit
 	return true;
 }
 
+bool PiscsiExecutor::ValidateInsert(const CommandContext& context, const PbDeviceDefinition& pb_device,
+		const PrimaryDevice& device, bool removed)
+{
+	if (!device.SupportsFile()) {
+		return false;
+	}
+
+	if (!removed) {
+		return context.ReturnLocalizedError(LocalizationKey::ERROR_EJECT_REQUIRED);
+	}
+
+	if (!pb_device.vendor().empty() || !pb_device.product().empty() || !pb_device.revision().empty()) {
+		return context.ReturnLocalizedError(LocalizationKey::ERROR_DEVICE_NAME_UPDATE);
+	}
+
+	if (GetParam(pb_device, "file").empty()) {
+		return context.ReturnLocalizedError(LocalizationKey::ERROR_MISSING_FILENAME);
+	}
+
+	return true;
+}
+
 bool PiscsiExecutor::Detach(const CommandContext& context, PrimaryDevice& device, bool dryRun)
 {
 	auto controller = controller_manager.FindController(device.GetId());
@@ -355,6 +790,20 @@ bool PiscsiExecutor::Detach(const CommandContext& context, PrimaryDevice& device
 	return true;
 }
 
+void PiscsiExecutor::RevertAttach(int id, int lun)
+{
+	// Unlike Detach() there is no LUN 0 check, the devices are detached in reverse order of attaching
+	if (const auto controller = controller_manager.FindController(id); controller != nullptr) {
+		if (const auto device = controller_manager.GetDeviceForIdAndLun(id, lun); device != nullptr) {
+			controller->RemoveDevice(*device);
+			if (!controller->GetLunCount()) {
+				controller_manager.DeleteController(*controller);
+			}
+			spdlog::info("Detached " + device->GetIdentifier() + " again");
+		}
+	}
+}
+
 void PiscsiExecutor::DetachAll()
 {
 	controller_manager.DeleteAllControllers();
@@ -400,6 +849,16 @@ bool PiscsiExecutor::ValidateImageFile(const CommandContext& context, StorageDev
 		return true;
 	}
 
+	return ResolveImageFile(context, storage_device, filename) && OpenImageFile(context, storage_device);
+}
+
+bool PiscsiExecutor::ResolveImageFile(const CommandContext& context, StorageDevice& storage_device,
+		const string& filename) const
+{
+	if (filename.empty()) {
+		return true;
+	}
+
 	if (!CheckForReservedFile(context, filename)) {
 		return false;
 	}
@@ -417,6 +876,11 @@ bool PiscsiExecutor::ValidateImageFile(const CommandContext& context, StorageDev
 		storage_device.SetFilename(effective_filename);
 	}
 
+	return true;
+}
+
+bool PiscsiExecutor::OpenImageFile(const CommandContext& context, StorageDevice& storage_device)
+{
 	try {
 		storage_device.Open();
 	}
@@ -437,6 +901,40 @@ bool PiscsiExecutor::CheckForReservedFile(const CommandContext& context, const s
 	return true;
 }
 
+void PiscsiExecutor::UpdateReservedFile(const string& filename, const id_set& ids)
+{
+	if (filename.empty()) {
+		return;
+	}
+
+	auto reserved_files = StorageDevice::GetReservedFiles();
+	if (ids.first == -1) {
+		reserved_files.erase(filename);
+	}
+	else {
+		reserved_files[filename] = ids;
+	}
+	StorageDevice::SetReservedFiles(reserved_files);
+}
+
+bool PiscsiExecutor::IsBatchOperation(PbOperation operation)
+{
+	switch (operation) {
+		case ATTACH:
+		case DETACH:
+		case START:
+		case STOP:
+		case INSERT:
+		case EJECT:
+		case PROTECT:
+		case UNPROTECT:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
 string PiscsiExecutor::PrintCommand(const PbCommand& command, const PbDeviceDefinition& pb_device) const
 {
 	const map<string, string, less<>> params = { command.params().begin(), command.params().end() };
@@ -492,6 +990,11 @@ string PiscsiExecutor::EnsureLun0(const PbCommand& command) const
 		luns[device->GetId()] |= 1 << device->GetLun();
 	}
 
+	return CheckLun0(luns);
+}
+
+string PiscsiExecutor::CheckLun0(const unordered_map<int32_t, int32_t>& luns)
+{
 	const auto& it = ranges::find_if_not(luns, [] (const auto& l) { return l.second & 0x01; } );
 	return it == luns.end() ? "" : "LUN 0 is missing for device ID " + to_string((*it).first);
 }
@@ -12,6 +12,8 @@
 #include "hal/bus.h"
 #include "controllers/controller_manager.h"
 #include <unordered_set>
+#include <functional>
+#include <map>
 
 class DeviceFactory;
 class PrimaryDevice;
@@ -20,6 +22,17 @@ class CommandContext;
 
 class PiscsiExecutor
 {
+	// The maximum number of threads for opening image files in parallel
+	static const unsigned int MAX_OPEN_THREADS = 8;
+
+	// The simulated state of a device while validating a batch
+	struct batch_device
+	{
+		shared_ptr<PrimaryDevice> device;
+		// Empty if there is no medium
+		string filename;
+	};
+
 public:
 
 	PiscsiExecutor(BUS& bus, ControllerManager& controller_manager) : bus(bus), controller_manager(controller_manager) {}
@@ -31,6 +44,8 @@ public:
 
 	bool ProcessDeviceCmd(const CommandContext&, const PbDeviceDefinition&, bool);
 	bool ProcessCmd(const CommandContext&);
+	bool ProcessAttachCmd(const CommandContext&);
+	bool ProcessBatch(const CommandContext&);
 	bool Start(PrimaryDevice&, bool) const;
 	bool Stop(PrimaryDevice&, bool) const;
 	bool Eject(PrimaryDevice&, bool) const;
@@ -42,6 +57,7 @@ public:
 	void DetachAll();
 	string SetReservedIds(string_view);
 	bool ValidateImageFile(const CommandContext&, StorageDevice&, const string&) const;
+	bool ResolveImageFile(const CommandContext&, StorageDevice&, const string&) const;
 	string PrintCommand(const PbCommand&, const PbDeviceDefinition&) const;
 	string EnsureLun0(const PbCommand&) const;
 	bool VerifyExistingIdAndLun(const CommandContext&, int, int) const;
@@ -54,7 +70,19 @@ public:
 
 private:
 
+	shared_ptr<PrimaryDevice> PrepareAttach(const CommandContext&, const PbDeviceDefinition&) const;
+	bool ValidateBatchCmd(const CommandContext&, const PbDeviceDefinition&, map<id_set, batch_device>&) const;
+	function<void()> GetUndo(PbOperation, const PbDeviceDefinition&);
+	bool CompleteAttach(const CommandContext&, const PbDeviceDefinition&, const shared_ptr<PrimaryDevice>&);
+	void RevertAttach(int, int);
+
+	static bool ValidateInsert(const CommandContext&, const PbDeviceDefinition&, const PrimaryDevice&, bool);
+	static bool OpenImageFile(const CommandContext&, StorageDevice&);
+	static void SetProtection(const PbDeviceDefinition&, PrimaryDevice&);
 	static bool CheckForReservedFile(const CommandContext&, const string&);
+	static void UpdateReservedFile(const string&, const id_set&);
+	static bool IsBatchOperation(PbOperation);
+	static string CheckLun0(const unordered_map<int32_t, int32_t>&);
 
 	BUS& bus;
 
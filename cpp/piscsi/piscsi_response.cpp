@@ -8,6 +8,7 @@
 //---------------------------------------------------------------------------
 
 #include "controllers/controller_manager.h"
+#include "controllers/buffer_pool.h"
 #include "shared/protobuf_util.h"
 #include "shared/network_util.h"
 #include "shared/piscsi_util.h"
@@ -227,32 +228,47 @@ void PiscsiResponse::GetDevicesInfo(const unordered_set<shared_ptr<PrimaryDevice
 	result.set_status(true);
 }
 
-void PiscsiResponse::GetServerInfo(PbServerInfo& server_info, const PbCommand& command,
-		const unordered_set<shared_ptr<PrimaryDevice>>& devices, const unordered_set<int>& reserved_ids,
-		const string& default_folder, int scan_depth) const
+// Returns the serialized server information. Only the data that may change are built, the remaining data are
+// spliced in from the cache.
+string PiscsiResponse::GetServerInfo(const PbCommand& command, const unordered_set<shared_ptr<PrimaryDevice>>& devices,
+		const unordered_set<int>& reserved_ids, const string& default_folder, int scan_depth) const
 {
-	const vector<string> command_operations = Split(GetParam(command, "operations"), ',');
-	set<string, less<>> operations;
-	for (const string& operation : command_operations) {
-		string op;
-		ranges::transform(operation, back_inserter(op), ::toupper);
-		operations.insert(op);
-	}
+	const set<string, less<>> operations = GetRequestedOperations(command);
 
-	if (!operations.empty()) {
-		spdlog::trace("Requested operation(s): " + Join(operations, ","));
+	// The arena avoids a lot of small heap allocations for a large number of image files or devices
+	google::protobuf::Arena arena;
+	auto server_info = google::protobuf::Arena::CreateMessage<PbServerInfo>(&arena);
+	GetDynamicServerInfo(*server_info, operations, command, devices, reserved_ids, default_folder, scan_depth);
+
+	// The default parameters of the network devices depend on the network interfaces currently available
+	if (HasOperation(operations, PbOperation::DEVICE_TYPES_INFO)) {
+		GetDeviceTypesInfo(*server_info->mutable_device_types_info());
 	}
 
+	string data = server_info->SerializeAsString();
+
 	if (HasOperation(operations, PbOperation::VERSION_INFO)) {
-		GetVersionInfo(*server_info.mutable_version_info());
+		AppendSerializedField(data, PbServerInfo::kVersionInfoFieldNumber, GetStaticInfo(VERSION_INFO, scan_depth));
 	}
 
-	if (HasOperation(operations, PbOperation::LOG_LEVEL_INFO)) {
-		GetLogLevelInfo(*server_info.mutable_log_level_info());
+	if (HasOperation(operations, PbOperation::MAPPING_INFO)) {
+		AppendSerializedField(data, PbServerInfo::kMappingInfoFieldNumber, GetStaticInfo(MAPPING_INFO, scan_depth));
 	}
 
-	if (HasOperation(operations, PbOperation::DEVICE_TYPES_INFO)) {
-		GetDeviceTypesInfo(*server_info.mutable_device_types_info());
+	if (HasOperation(operations, PbOperation::OPERATION_INFO)) {
+		AppendSerializedField(data, PbServerInfo::kOperationInfoFieldNumber,
+				GetStaticInfo(OPERATION_INFO, scan_depth));
+	}
+
+	return data;
+}
+
+void PiscsiResponse::GetDynamicServerInfo(PbServerInfo& server_info, const set<string, less<>>& operations,
+		const PbCommand& command, const unordered_set<shared_ptr<PrimaryDevice>>& devices,
+		const unordered_set<int>& reserved_ids, const string& default_folder, int scan_depth) const
+{
+	if (HasOperation(operations, PbOperation::LOG_LEVEL_INFO)) {
+		GetLogLevelInfo(*server_info.mutable_log_level_info());
 	}
 
 	if (HasOperation(operations, PbOperation::DEFAULT_IMAGE_FILES_INFO)) {
@@ -264,10 +280,6 @@ void PiscsiResponse::GetServerInfo(PbServerInfo& server_info, const PbCommand& c
 		GetNetworkInterfacesInfo(*server_info.mutable_network_interfaces_info());
 	}
 
-	if (HasOperation(operations, PbOperation::MAPPING_INFO)) {
-		GetMappingInfo(*server_info.mutable_mapping_info());
-	}
-
 	if (HasOperation(operations, PbOperation::STATISTICS_INFO)) {
 		GetStatisticsInfo(*server_info.mutable_statistics_info(), devices);
 	}
@@ -279,10 +291,50 @@ void PiscsiResponse::GetServerInfo(PbServerInfo& server_info, const PbCommand& c
 	if (HasOperation(operations, PbOperation::RESERVED_IDS_INFO)) {
 		GetReservedIds(*server_info.mutable_reserved_ids_info(), reserved_ids);
 	}
+}
 
-	if (HasOperation(operations, PbOperation::OPERATION_INFO)) {
-		GetOperationInfo(*server_info.mutable_operation_info(), scan_depth);
+// Returns the serialized data for VERSION_INFO, MAPPING_INFO or OPERATION_INFO, which are only built once.
+// DEVICE_TYPES_INFO is not cached because the default parameters depend on the available network interfaces.
+const string& PiscsiResponse::GetStaticInfo(PbOperation operation, int scan_depth) const
+{
+	// Only the operation meta data depend on the scan depth
+	const pair<PbOperation, int> key = { operation, operation == OPERATION_INFO ? scan_depth : 0 };
+
+	scoped_lock<mutex> lock(static_info_locker);
+
+	if (const auto& it = static_info.find(key); it != static_info.end()) {
+		return it->second;
 	}
+
+	string data;
+	switch (operation) {
+		case VERSION_INFO: {
+			PbVersionInfo version_info;
+			GetVersionInfo(version_info);
+			data = version_info.SerializeAsString();
+			break;
+		}
+
+		case MAPPING_INFO: {
+			PbMappingInfo mapping_info;
+			GetMappingInfo(mapping_info);
+			data = mapping_info.SerializeAsString();
+			break;
+		}
+
+		case OPERATION_INFO: {
+			PbOperationInfo operation_info;
+			GetOperationInfo(operation_info, scan_depth);
+			data = operation_info.SerializeAsString();
+			break;
+		}
+
+		default:
+			assert(false);
+			break;
+	}
+
+	return static_info.emplace(key, data).first->second;
 }
 
 void PiscsiResponse::GetVersionInfo(PbVersionInfo& version_info) const
@@ -328,6 +380,14 @@ void PiscsiResponse::GetStatisticsInfo(PbStatisticsInfo& statistics_info,
 			s->set_value(statistics.value());
 		}
 	}
+
+	// The transfer buffers kept for re-use are not device-specific
+	auto s = statistics_info.add_statistics();
+	s->set_id(-1);
+	s->set_unit(-1);
+	s->set_category(PbStatisticsCategory::CATEGORY_INFO);
+	s->set_key("buffer_pool_byte_count");
+	s->set_value(BufferPool::GetPooledByteCount());
 }
 
 void PiscsiResponse::GetOperationInfo(PbOperationInfo& operation_info, int depth) const
@@ -336,7 +396,10 @@ void PiscsiResponse::GetOperationInfo(PbOperationInfo& operation_info, int depth
 	AddOperationParameter(*operation, "name", "Image file name in case of a mass storage device");
 	AddOperationParameter(*operation, "interface", "Comma-separated prioritized network interface list");
 	AddOperationParameter(*operation, "inet", "IP address and netmask of the network bridge");
+	AddOperationParameter(*operation, "dir_cache", "Number of host directories cached by the bridge file system");
 	AddOperationParameter(*operation, "cmd", "Print command for the printer device");
+	AddOperationParameter(*operation, "buffer", "Print data buffered in memory for the printer device");
+	AddOperationParameter(*operation, "pipe", "Pipe print data to the print command for the printer device");
 
 	CreateOperation(operation_info, DETACH, "Detach device, device-specific parameters are required");
 
@@ -431,6 +494,13 @@ void PiscsiResponse::GetOperationInfo(PbOperationInfo& operation_info, int depth
 	AddOperationParameter(*operation, "token", "Authentication token to be checked", "", true);
 
 	CreateOperation(operation_info, OPERATION_INFO, "Get operation meta data");
+
+	CreateOperation(operation_info, BATCH, "Execute a batch of device-specific commands");
+
+	operation = CreateOperation(operation_info, PACKET_CAPTURE, "Start or stop capturing network packets");
+	AddOperationParameter(*operation, "file", "Capture file name, capturing is stopped if empty", "", false);
+	AddOperationParameter(*operation, "max_size", "Maximum capture file size in bytes", "16777216", false);
+	AddOperationParameter(*operation, "max_files", "Number of capture files kept", "4", false);
 }
 
 // This method returns a raw pointer because protobuf does not have support for smart pointers
@@ -530,6 +600,22 @@ bool PiscsiResponse::FilterMatches(const string& input, string_view pattern_lowe
 	return true;
 }
 
+set<string, less<>> PiscsiResponse::GetRequestedOperations(const PbCommand& command)
+{
+	set<string, less<>> operations;
+	for (const string& operation : Split(GetParam(command, "operations"), ',')) {
+		string op;
+		ranges::transform(operation, back_inserter(op), ::toupper);
+		operations.insert(op);
+	}
+
+	if (!operations.empty()) {
+		spdlog::trace("Requested operation(s): " + Join(operations, ","));
+	}
+
+	return operations;
+}
+
 bool PiscsiResponse::HasOperation(const set<string, less<>>& operations, PbOperation operation)
 {
 	return operations.empty() || operations.contains(PbOperation_Name(operation));
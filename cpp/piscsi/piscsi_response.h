@@ -16,6 +16,8 @@
 #include <string>
 #include <span>
 #include <set>
+#include <map>
+#include <mutex>
 
 using namespace std;
 using namespace filesystem;
@@ -35,8 +37,9 @@ public:
 	void GetDevicesInfo(const unordered_set<shared_ptr<PrimaryDevice>>&, PbResult&, const PbCommand&, const string&) const;
 	void GetDeviceTypesInfo(PbDeviceTypesInfo&) const;
 	void GetVersionInfo(PbVersionInfo&) const;
-	void GetServerInfo(PbServerInfo&, const PbCommand&, const unordered_set<shared_ptr<PrimaryDevice>>&,
+	string GetServerInfo(const PbCommand&, const unordered_set<shared_ptr<PrimaryDevice>>&,
 			const unordered_set<int>&, const string&, int) const;
+	const string& GetStaticInfo(PbOperation, int) const;
 	void GetNetworkInterfacesInfo(PbNetworkInterfacesInfo&) const;
 	void GetMappingInfo(PbMappingInfo&) const;
 	void GetLogLevelInfo(PbLogLevelInfo&) const;
@@ -50,11 +53,18 @@ private:
 	// TODO Try to get rid of this field by having the device instead of the factory providing the device data
 	const DeviceFactory device_factory;
 
+	// Serialized data that do not change for the process lifetime, the key is the operation and the scan depth
+	mutable map<pair<PbOperation, int>, string, less<>> static_info;
+
+	mutable mutex static_info_locker;
+
 	void GetDeviceProperties(const Device&, PbDeviceProperties&) const;
 	void GetDevice(const Device&, PbDevice&, const string&) const;
 	void GetDeviceTypeProperties(PbDeviceTypesInfo&, PbDeviceType) const;
 	void GetAvailableImages(PbImageFilesInfo&, const string&, const string&, const string&, int) const;
 	void GetAvailableImages(PbServerInfo&, const string&, const string&, const string&, int) const;
+	void GetDynamicServerInfo(PbServerInfo&, const set<string, less<>>&, const PbCommand&,
+			const unordered_set<shared_ptr<PrimaryDevice>>&, const unordered_set<int>&, const string&, int) const;
 	PbOperationMetaData *CreateOperation(PbOperationInfo&, const PbOperation&, const string&) const;
 	void AddOperationParameter(PbOperationMetaData&, const string&, const string&,
 			const string& = "", bool = false, const vector<string>& = EMPTY_VECTOR) const;
@@ -64,5 +74,7 @@ private:
 
 	static bool FilterMatches(const string&, string_view);
 
+	static set<string, less<>> GetRequestedOperations(const PbCommand&);
+
 	static bool HasOperation(const set<string, less<>>&, PbOperation);
 };
@@ -34,7 +34,7 @@ void ScsiCtl::Banner(const vector<char *>& args) const
 				<< "\nUsage: " << args[0] << " -i ID[:LUN] [-c CMD] [-C FILE] [-t TYPE] [-b BLOCK_SIZE] [-n NAME] [-f FILE|PARAM] "
 				<< "[-F IMAGE_FOLDER] [-L LOG_LEVEL] [-h HOST] [-p PORT] [-r RESERVED_IDS] "
 				<< "[-C FILENAME:FILESIZE] [-d FILENAME] [-w FILENAME] [-R CURRENT_NAME:NEW_NAME] "
-				<<	"[-x CURRENT_NAME:NEW_NAME] [-z LOCALE] "
+				<<	"[-x CURRENT_NAME:NEW_NAME] [-z LOCALE] [-k[CAPTURE_FILE]] "
 				<< "[-e] [-E FILENAME] [-D] [-I] [-l] [-m] [o] [-O] [-P] [-s] [-S] [-v] [-V] [-y] [-X]\n"
 				<< " where  ID[:LUN] ID := {0-" << (ControllerManager::GetScsiIdMax() - 1) << "},"
 				<< " LUN := {0-" << (ControllerManager::GetScsiLunMax() - 1) << "}, default is 0\n"
@@ -48,7 +48,10 @@ void ScsiCtl::Banner(const vector<char *>& args) const
 				<< "        PORT := piscsi port to connect to, default is 6868\n"
 				<< "        RESERVED_IDS := comma-separated list of IDs to reserve\n"
 				<< "        LOG_LEVEL := log level {trace|debug|info|warn|err|off}, default is 'info'\n"
+				<< "        CAPTURE_FILE := network packet capture file (*.pcapng), relative to the image folder, or\n"
+				<< "                        file=NAME:max_size=BYTES:max_files=COUNT, capturing stops if omitted\n"
 				<< " If CMD is 'attach' or 'insert' the FILE parameter is required.\n"
+				<< " Several -i options with their CMD, TYPE etc. are executed as a single batch.\n"
 				<< "Usage: " << args[0] << " -l\n"
 				<< "       Print device list.\n" << flush;
 
@@ -56,6 +59,25 @@ void ScsiCtl::Banner(const vector<char *>& args) const
 	}
 }
 
+// Moves the device of the command parsed so far into a new command of the batch
+string ScsiCtl::AddBatchCommand(PbCommand& batch, PbCommand& command)
+{
+	auto& device = *command.mutable_devices(0);
+
+	if (command.operation() == NO_OPERATION) {
+		return "Missing command for device " + to_string(device.id()) + COMPONENT_SEPARATOR + to_string(device.unit());
+	}
+
+	auto batch_command = batch.add_commands();
+	batch_command->set_operation(command.operation());
+	batch_command->add_devices()->Swap(&device);
+
+	device.set_id(-1);
+	command.set_operation(NO_OPERATION);
+
+	return "";
+}
+
 int ScsiCtl::run(const vector<char *>& args) const
 {
 	GOOGLE_PROTOBUF_VERIFY_VERSION;
@@ -76,15 +98,27 @@ int ScsiCtl::run(const vector<char *>& args) const
 	string filename;
 	string token;
 	bool list = false;
+	PbCommand batch;
 
 	string locale = GetLocale();
 
 	opterr = 1;
 	int opt;
 	while ((opt = getopt(static_cast<int>(args.size()), args.data(),
-			"e::lmos::vDINOSTVXa:b:c:d:f:h:i:n:p:r:t:x:z:C:E:F:L:P::R:")) != -1) {
+			"e::k::lmos::vDINOSTVXa:b:c:d:f:h:i:n:p:r:t:x:z:C:E:F:L:P::R:")) != -1) {
 		switch (opt) {
 			case 'i':
+				// Each additional device results in a batch with a device-specific command per device
+				if (device->id() != -1) {
+					ParseParameters(*device, param);
+					param.clear();
+
+					if (const string error = AddBatchCommand(batch, command); !error.empty()) {
+						cerr << "Error: " << error << endl;
+						exit(EXIT_FAILURE);
+					}
+				}
+
 				if (const string error = SetIdAndLun(*device, optarg); !error.empty()) {
 					cerr << "Error: " << error << endl;
 					exit(EXIT_FAILURE);
@@ -151,6 +185,19 @@ int ScsiCtl::run(const vector<char *>& args) const
 				command.set_operation(RESERVED_IDS_INFO);
 				break;
 
+			case 'k':
+				command.set_operation(PACKET_CAPTURE);
+				if (optarg) {
+					if (const string params = optarg; params.find('=') == string::npos) {
+						SetParam(command, "file", params);
+					}
+					else if (const string error = SetFromGenericParams(command, params); !error.empty()) {
+						cerr << "Error: " << error << endl;
+						exit(EXIT_FAILURE);
+					}
+				}
+				break;
+
 			case 'L':
 				command.set_operation(LOG_LEVEL);
 				log_level = optarg;
@@ -260,6 +307,19 @@ int ScsiCtl::run(const vector<char *>& args) const
 		exit(EXIT_FAILURE);
 	}
 
+	ParseParameters(*device, param);
+
+	if (batch.commands_size()) {
+		if (const string error = AddBatchCommand(batch, command); !error.empty()) {
+			cerr << "Error: " << error << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		command.clear_devices();
+		command.set_operation(BATCH);
+		command.mutable_commands()->Swap(batch.mutable_commands());
+	}
+
 	SetParam(command, "token", token);
 	SetParam(command, "locale", locale);
 
@@ -275,8 +335,6 @@ int ScsiCtl::run(const vector<char *>& args) const
 			status = scsictl_commands.CommandDevicesInfo();
 		}
 		else {
-			ParseParameters(*device, param);
-
 			status = scsictl_commands.Execute(log_level, default_folder, reserved_ids, image_params, filename);
 		}
 	}
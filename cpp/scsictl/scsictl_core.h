@@ -28,4 +28,6 @@ class ScsiCtl
 private:
 
 	void Banner(const vector<char *>&) const;
+
+	static string AddBatchCommand(PbCommand&, PbCommand&);
 };
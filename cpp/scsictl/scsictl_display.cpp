@@ -257,7 +257,11 @@ string ScsictlDisplay::DisplayStatisticsInfo(const PbStatisticsInfo& statistics_
 			prev_category = statistics.category();
 		}
 
-		s << "    " << statistics.id() << ":" << statistics.unit() << "  " << statistics.key() << ": " << statistics.value() << '\n';
+		s << "    " << statistics.id() << ":" << statistics.unit() << "  " << statistics.key() << ": " << statistics.value();
+		if (statistics.histogram_size()) {
+			s << DisplayHistogram(statistics);
+		}
+		s << '\n';
 	}
 
 	return s.str();
@@ -303,6 +307,41 @@ string ScsictlDisplay::DisplayOperationInfo(const PbOperationInfo& operation_inf
 	return s.str();
 }
 
+string ScsictlDisplay::DisplayHistogram(const PbStatistics& statistics) const
+{
+	ostringstream s;
+
+	uint64_t total = 0;
+	for (const auto count : statistics.histogram()) {
+		total += count;
+	}
+	if (!total) {
+		return "";
+	}
+
+	// The percentiles are rounded up to the upper bound of the respective bucket
+	string separator = " (";
+	for (const int percentile : { 50, 90, 99 }) {
+		uint64_t count = 0;
+		for (int bucket = 0; bucket < statistics.histogram_size(); bucket++) {
+			count += statistics.histogram(bucket);
+			if (count * 100 >= total * percentile) {
+				s << separator << "p" << percentile
+						<< (bucket == statistics.histogram_size() - 1 ? " >= " : " < ")
+						<< (1ULL << (bucket + HISTOGRAM_MIN_BUCKET_BITS - (bucket == statistics.histogram_size() - 1 ? 1 : 0)))
+						<< " us";
+				separator = ", ";
+				break;
+			}
+		}
+	}
+	if (separator == ", ") {
+		s << ")";
+	}
+
+	return s.str();
+}
+
 string ScsictlDisplay::DisplayParams(const PbDevice& pb_device) const
 {
 	ostringstream s;
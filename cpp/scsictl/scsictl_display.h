@@ -43,4 +43,5 @@ private:
 	string DisplayBlockSizes(const PbDeviceProperties&) const;
 	string DisplayParameters(const PbOperationMetaData&) const;
 	string DisplayPermittedValues(const PbOperationParameter&) const;
+	string DisplayHistogram(const PbStatistics&) const;
 };
@@ -0,0 +1,71 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "scsimon/sm_capture.h"
+#include <sys/mman.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+// The usual size of huge pages on ARM and x86 with 4 KiB pages
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+CaptureBuffer::CaptureBuffer(size_t c, bool use_huge_pages) : capacity(c)
+{
+    const size_t size = max<size_t>(capacity, 1) * sizeof(capture_record_t);
+
+    // Explicit huge pages have to be reserved by the administrator (vm.nr_hugepages)
+    if (use_huge_pages) {
+        mapped_size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        if (void *p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0); p != MAP_FAILED) {
+            records = static_cast<capture_record_t *>(p);
+            huge_pages = true;
+            return;
+        }
+    }
+
+    mapped_size = size;
+    void *p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        throw bad_alloc();
+    }
+    records = static_cast<capture_record_t *>(p);
+
+    // Otherwise transparent huge pages are used if available
+    if (use_huge_pages) {
+        madvise(p, mapped_size, MADV_HUGEPAGE);
+    }
+
+    // There must be no page faults while capturing
+    memset(p, 0, mapped_size);
+}
+
+CaptureBuffer::~CaptureBuffer()
+{
+    munmap(records, mapped_size);
+}
+
+bool CaptureBuffer::AppendAt(uint32_t data, uint64_t timestamp)
+{
+    uint64_t delta = timestamp > last_timestamp ? timestamp - last_timestamp : 0;
+
+    // The signals did not change during the gap
+    while (delta > UINT32_MAX && count) {
+        if (!Append(records[count - 1].data, UINT32_MAX)) {
+            return false;
+        }
+        delta -= UINT32_MAX;
+    }
+
+    return Append(data, static_cast<uint32_t>(min<uint64_t>(delta, UINT32_MAX)));
+}
@@ -0,0 +1,150 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Preallocated buffer for the captured bus signal changes. Each change is a packed record with the
+// raw GPIO word and the time since the previous change in counter ticks, so that capturing does not allocate
+// memory. The reports read the records through a view, which provides them as data samples with timestamps
+// in nanoseconds.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "hal/data_sample_raspberry.h"
+#include <cstdint>
+#include <climits>
+#include <span>
+
+using namespace std;
+
+struct capture_record_t {
+    uint32_t data;
+    // Time since the previous record, in counter ticks
+    uint32_t delta;
+};
+static_assert(sizeof(capture_record_t) == 8);
+
+// Passes a change to the recorder. After a long phase without changes the time since the previous record does not
+// fit into a record, records with the previous data are inserted. Returns false if the recorder has stopped.
+template<typename S>
+bool RecordChange(S& record, uint32_t previous_data, uint32_t data, uint64_t delta)
+{
+    for (; delta > UINT32_MAX; delta -= UINT32_MAX) {
+        if (!record(previous_data, UINT32_MAX)) {
+            return false;
+        }
+    }
+
+    return record(data, static_cast<uint32_t>(delta));
+}
+
+class CaptureBuffer
+{
+  public:
+
+    // With huge pages the buffer causes fewer TLB misses while capturing, falls back to normal pages
+    explicit CaptureBuffer(size_t, bool = false);
+    ~CaptureBuffer();
+    CaptureBuffer(const CaptureBuffer&) = delete;
+    CaptureBuffer& operator=(const CaptureBuffer&) = delete;
+
+    // Returns false if the buffer is full
+    bool Append(uint32_t data, uint32_t delta)
+    {
+        if (count == capacity) {
+            return false;
+        }
+
+        records[count++] = { .data = data, .delta = delta };
+        last_timestamp += delta;
+
+        return true;
+    }
+
+    // For samples with absolute timestamps (e.g. imported ones), gaps too long for a record are split
+    bool AppendAt(uint32_t, uint64_t);
+
+    // Counter ticks per second
+    void SetFrequency(uint64_t f) { frequency = f; }
+    uint64_t GetFrequency() const { return frequency; }
+
+    size_t GetCount() const { return count; }
+    size_t GetCapacity() const { return capacity; }
+    bool UsesHugePages() const { return huge_pages; }
+
+    span<const capture_record_t> GetRecords() const { return { records, count }; }
+
+  private:
+
+    capture_record_t *records = nullptr;
+
+    size_t capacity;
+
+    size_t count = 0;
+
+    size_t mapped_size = 0;
+
+    bool huge_pages = false;
+
+    uint64_t last_timestamp = 0;
+
+    // The timestamps are nanoseconds by default
+    uint64_t frequency = 1'000'000'000;
+};
+
+// The records as data samples with absolute timestamps, without copying them
+class CaptureView
+{
+  public:
+
+    class iterator
+    {
+      public:
+
+        iterator(const capture_record_t *r, double n) : record(r), ns_per_tick(n) {}
+
+        DataSample_Raspberry operator*() const
+        {
+            // Rounded, so that the nanoseconds are exact where the frequency allows it
+            const auto ticks = static_cast<double>(previous + record->delta);
+            return DataSample_Raspberry(record->data, static_cast<uint64_t>(ticks * ns_per_tick + 0.5));
+        }
+
+        iterator& operator++()
+        {
+            previous += record->delta;
+            ++record;
+            return *this;
+        }
+
+        bool operator!=(const iterator& other) const { return record != other.record; }
+
+      private:
+
+        const capture_record_t *record;
+
+        // Timestamp of the previous record
+        uint64_t previous = 0;
+
+        double ns_per_tick;
+    };
+
+    explicit CaptureView(span<const capture_record_t> r, uint64_t frequency = 1'000'000'000)
+        : records(r), ns_per_tick(1'000'000'000.0 / static_cast<double>(frequency)) {}
+    explicit CaptureView(const CaptureBuffer& buffer) : CaptureView(buffer.GetRecords(), buffer.GetFrequency()) {}
+
+    iterator begin() const { return iterator(records.data(), ns_per_tick); }
+    iterator end() const { return iterator(records.data() + records.size(), ns_per_tick); }
+
+    size_t size() const { return records.size(); }
+
+  private:
+
+    span<const capture_record_t> records;
+
+    double ns_per_tick;
+};
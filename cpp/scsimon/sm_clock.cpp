@@ -0,0 +1,71 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "scsimon/sm_clock.h"
+#include <sys/auxv.h>
+
+using namespace std;
+
+// The kernel only provides the event stream of the ARM generic timer if there is one
+#if defined(__arm__) && !defined(HWCAP_EVTSTRM)
+#define HWCAP_EVTSTRM (1 << 21)
+#endif
+
+void SampleClock::Init()
+{
+#if defined(__aarch64__)
+    counter = counter_t::generic_timer;
+#elif defined(__arm__)
+    if (getauxval(AT_HWCAP) & HWCAP_EVTSTRM) {
+        counter = counter_t::generic_timer;
+    }
+    else if (SysTimer::IsInitialized()) {
+        counter = counter_t::system_timer;
+    }
+    else {
+        counter = counter_t::monotonic_clock;
+    }
+#else
+    counter = counter_t::monotonic_clock;
+#endif
+}
+
+uint64_t SampleClock::GetFrequency()
+{
+#if defined(__aarch64__)
+    uint64_t frequency;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    return frequency;
+#else
+#if defined(__arm__)
+    if (counter == counter_t::generic_timer) {
+        uint32_t frequency;
+        asm volatile("mrc p15, 0, %0, c14, c0, 0" : "=r"(frequency));
+        return frequency;
+    }
+
+    if (counter == counter_t::system_timer) {
+        return 1'000'000;
+    }
+#endif
+    return 1'000'000'000;
+#endif
+}
+
+string SampleClock::GetName()
+{
+    switch (counter) {
+    case counter_t::generic_timer:
+        return "ARM generic timer";
+    case counter_t::system_timer:
+        return "BCM system timer";
+    default:
+        return "monotonic clock";
+    }
+}
@@ -0,0 +1,75 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Free-running counter for timestamping the samples. On the Pi 2 and later this is the ARM generic timer,
+// which can be read without a system call and has a resolution of 18.5 ns (Pi 4) or 52 ns (Pi 2/3).
+// The 32-bit Raspberry Pi OS is built for ARMv6, therefore whether there is a generic timer is detected at
+// runtime. The Pi Zero/1 use the memory-mapped BCM system timer, which only has a resolution of 1 us.
+// Other platforms (e.g. the virtual bus on x86) use the monotonic clock.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "hal/systimer.h"
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+using namespace std;
+
+class SampleClock
+{
+    enum class counter_t { generic_timer, system_timer, monotonic_clock };
+
+  public:
+
+    // Selects the counter. On a Raspberry Pi the bus, and with it the system timer, must have been initialized.
+    static void Init();
+
+    static uint64_t Read()
+    {
+#if defined(__aarch64__)
+        uint64_t ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+        return ticks;
+#else
+#if defined(__arm__)
+        if (counter == counter_t::generic_timer) {
+            uint64_t ticks;
+            asm volatile("mrrc p15, 1, %Q0, %R0, c14" : "=r"(ticks));
+            return ticks;
+        }
+
+        if (counter == counter_t::system_timer) {
+            // The 32 bit counter wraps after about 71 minutes
+            const uint32_t low = SysTimer::GetTimerLow();
+            if (low < system_timer_low) {
+                system_timer_high++;
+            }
+            system_timer_low = low;
+            return (static_cast<uint64_t>(system_timer_high) << 32) | low;
+        }
+#endif
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+#endif
+    }
+
+    // Ticks per second
+    static uint64_t GetFrequency();
+
+    static string GetName();
+
+  private:
+
+    static inline counter_t counter = counter_t::monotonic_clock;
+
+    static inline uint32_t system_timer_low = 0;
+    static inline uint32_t system_timer_high = 0;
+};
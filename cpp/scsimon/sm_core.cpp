@@ -11,12 +11,15 @@
 
 #include "scsimon/sm_core.h"
 #include "hal/gpiobus.h"
+#include "hal/gpiobus_raspberry.h"
 #include "hal/gpiobus_factory.h"
 #include "scsimon/sm_reports.h"
+#include "scsimon/sm_clock.h"
 #include "hal/log.h"
 #include "shared/piscsi_version.h"
 #include "shared/piscsi_util.h"
-#include <climits>
+#include <spdlog/fmt/fmt.h>
+#include <cmath>
 #include <csignal>
 #include <getopt.h>
 #include <iostream>
@@ -35,20 +38,60 @@ void ScsiMon::ParseArguments(const vector<char *> &args)
 {
     int opt;
 
-    while ((opt = getopt(static_cast<int>(args.size()), args.data(), "-Hhb:i:")) != -1) {
+    // Prints the usage and terminates if an option value is not a valid number
+    const auto& get_number = [this, &args] (const string& description) {
+        int value;
+        if (!GetAsUnsignedInt(optarg, value)) {
+            spdlog::error("Invalid " + description + ": '" + optarg + "'");
+            PrintHelpText(args);
+            exit(EXIT_FAILURE);
+        }
+        return value;
+    };
+
+    while ((opt = getopt(static_cast<int>(args.size()), args.data(), "-HhA:B:b:i:Lk:r:sT:t:")) != -1) {
         switch (opt) {
         // The three options below are kind of a compound option with two letters
         case 'h':
         case 'H':
             print_help = true;
             break;
+        case 'A':
+        case 'B':
+            (opt == 'A' ? trigger_after : trigger_before) =
+                    get_number("number of changes " + string(opt == 'A' ? "after" : "before") + " the trigger");
+            break;
         case 'b':
-            buff_size = atoi(optarg);
+            buff_size = get_number("buffer size");
             break;
         case 'i':
             input_file_name = optarg;
             import_data     = true;
             break;
+        case 'k':
+            keep_seconds = get_number("number of seconds to keep");
+            stream_data = true;
+            break;
+        case 'L':
+            huge_pages = true;
+            break;
+        case 'r':
+            rotate_mib = get_number("capture file size");
+            stream_data = true;
+            break;
+        case 's':
+            stream_data = true;
+            break;
+        case 'T':
+            if (const string error = triggers.emplace_back().Parse(optarg); !error.empty()) {
+                spdlog::error(error);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't':
+            rotate_seconds = get_number("capture file duration");
+            stream_data = true;
+            break;
         case 1:
             file_base_name = optarg;
             break;
@@ -76,10 +119,20 @@ void ScsiMon::ParseArguments(const vector<char *> &args)
 
 void ScsiMon::PrintHelpText(const vector<char *> &args) const
 {
-    spdlog::info(string(args[0]) + " -i [input file json] -b [buffer size] [output file]");
-    spdlog::info("       -i [input file json] - scsimon will parse the json file instead of capturing new data");
+    spdlog::info(string(args[0]) + " -i [input file] -b [buffer size] -L -s -r [MiB] -t [seconds] -k [seconds]");
+    spdlog::info("       -T [condition] -B [changes] -A [changes] [output file]");
+    spdlog::info("       -i [input file]      - scsimon will parse the json or capture (.scm) file instead of capturing new data");
     spdlog::info("                              If -i option is not specified, scsimon will read the gpio pins");
 	spdlog::info("       -b [buffer size]     - Override the default buffer size of " + to_string(buff_size));
+	spdlog::info("       -L                   - Use huge pages for the data buffer");
+	spdlog::info("       -s                   - Stream the data to capture (.scm) files instead of keeping it in memory");
+	spdlog::info("       -r [MiB]             - Start a new capture file when the current one has this size (implies -s)");
+	spdlog::info("       -t [seconds]         - Start a new capture file after this time (implies -s)");
+	spdlog::info("       -k [seconds]         - Only keep the capture files with data of this last time (implies -s)");
+	spdlog::info("       -T [condition]       - Only capture the changes around a trigger condition, can be repeated:");
+	spdlog::info("                              id:[target ID], opcode:[CDB opcode], rst, phases:[phase],[phase],...");
+	spdlog::info("       -B [changes]         - The number of changes before the trigger, default is " + to_string(trigger_before));
+	spdlog::info("       -A [changes]         - The number of changes from the trigger on, default is until the buffer is full");
 	spdlog::info("       [output file]        - Base name of the output files. The file extension (ex: .json)");
 	spdlog::info("                              will be appended to this file name");
 }
@@ -93,7 +146,16 @@ void ScsiMon::Banner() const
 		spdlog::info("    Connection type: " + CONNECT_DESC);
     }
     spdlog::info("    Data buffer size: " + to_string(buff_size));
+    for (const auto& trigger : triggers) {
+        spdlog::info("    Trigger condition: " + trigger.GetDescription());
+    }
     spdlog::info(" ");
+    if (stream_data && !import_data) {
+        spdlog::info("Streaming to capture files:");
+        spdlog::info("   " + file_base_name + (rotate_mib || rotate_seconds || keep_seconds ? "-NNNNNN" : "") +
+                ".scm - Compressed raw data, use -i to generate the reports");
+        return;
+    }
 	spdlog::info("Generating output files:");
 	spdlog::info("   " + vcd_file_name + " - Value Change Dump file that can be opened with GTKWave");
 	spdlog::info("   " + json_file_name + " - JSON file with raw data");
@@ -130,14 +192,24 @@ void ScsiMon::Cleanup() const
     	spdlog::info("Stopping data collection ...");
     }
     spdlog::info(" ");
-    spdlog::info("Generating " + vcd_file_name + "...");
-    scsimon_generate_value_change_dump(vcd_file_name, data_buffer);
-    spdlog::info("Generating " + json_file_name + "...");
-    scsimon_generate_json(json_file_name, data_buffer);
-    spdlog::info("Generating " + html_file_name + "...");
-    scsimon_generate_html(html_file_name, data_buffer);
-
-    bus->Cleanup();
+    if (stream != nullptr) {
+        for (const auto& filename : stream->GetFilenames()) {
+            spdlog::info("Wrote " + filename);
+        }
+    }
+    else {
+        spdlog::info("Generating " + vcd_file_name + "...");
+        const CaptureView view(*data_buffer);
+        scsimon_generate_value_change_dump(vcd_file_name, view);
+        spdlog::info("Generating " + json_file_name + "...");
+        scsimon_generate_json(json_file_name, view);
+        spdlog::info("Generating " + html_file_name + "...");
+        scsimon_generate_html(html_file_name, view);
+    }
+
+    if (bus != nullptr) {
+        bus->Cleanup();
+    }
 }
 
 void ScsiMon::Reset() const
@@ -145,6 +217,115 @@ void ScsiMon::Reset() const
     bus->Reset();
 }
 
+template<typename T, typename S>
+uint64_t ScsiMon::Capture(const T& acquire, S&& record)
+{
+    uint64_t loop_count = 0;
+    sample_intervals_t i;
+    const uint64_t gap_ticks = SampleClock::GetFrequency() * GAP_NS / 1'000'000'000;
+
+    // The first sample is always recorded
+    uint32_t prev_data = acquire();
+    const uint64_t start_time = SampleClock::Read();
+    uint64_t prev_time = start_time;
+    uint64_t change_time = start_time;
+    bool capturing = record(prev_data, 0);
+
+    while (capturing && running.load(memory_order_relaxed)) {
+        const uint32_t data = acquire();
+        const uint64_t now = SampleClock::Read();
+        loop_count++;
+
+        // Only integer arithmetic in the loop. The gaps are not included in the deviation, which keeps the sum small.
+        const uint64_t interval = now - prev_time;
+        prev_time = now;
+        i.min = min(i.min, interval);
+        i.max = max(i.max, interval);
+        if (interval > gap_ticks) {
+            i.gaps++;
+            i.gap_total += interval;
+        }
+        else {
+            i.sum_of_squares += interval * interval;
+        }
+
+        if (data != prev_data) {
+            capturing = RecordChange(record, prev_data, data, now - change_time);
+            prev_data = data;
+            change_time = now;
+        }
+    }
+
+    // Collect one last sample, otherwise it looks like the end of the data was cut off
+    RecordChange(record, prev_data, acquire(), SampleClock::Read() - change_time);
+
+    i.total = prev_time - start_time;
+    intervals = i;
+
+    return loop_count;
+}
+
+template<typename S>
+uint64_t ScsiMon::Capture(S&& record)
+{
+    if (auto raspberry = dynamic_cast<GPIOBUS_Raspberry *>(bus.get()); raspberry != nullptr) {
+        return Capture([raspberry] { return raspberry->GPIOBUS_Raspberry::Acquire(); }, record);
+    }
+
+    return Capture([this] { return bus->Acquire(); }, record);
+}
+
+template<typename S>
+uint64_t ScsiMon::Record(S& recorder)
+{
+    if (triggers.empty()) {
+        return Capture(recorder);
+    }
+
+    TriggerRecorder<S> trigger_recorder(triggers, trigger_before, trigger_after, recorder);
+    const uint64_t loop_count = Capture(trigger_recorder);
+    trigger_recorder.Finish();
+
+    if (const int trigger = trigger_recorder.GetTrigger(); trigger >= 0) {
+        spdlog::info("Triggered by condition '" + triggers[trigger].GetDescription() + "'");
+    }
+    else {
+        spdlog::warn("No trigger condition was met, only the most recent changes are included");
+    }
+
+    return loop_count;
+}
+
+void ScsiMon::ReportJitter(uint64_t loop_count) const
+{
+    if (!loop_count) {
+        return;
+    }
+
+    const double ns_per_tick = 1'000'000'000.0 / static_cast<double>(SampleClock::GetFrequency());
+    const double mean = static_cast<double>(intervals.total) / static_cast<double>(loop_count);
+
+    // The deviation of the intervals without the gaps
+    double deviation = 0;
+    if (const uint64_t count = loop_count - intervals.gaps; count) {
+        const double regular_mean = static_cast<double>(intervals.total - intervals.gap_total) /
+                static_cast<double>(count);
+        deviation = sqrt(max(0.0, static_cast<double>(intervals.sum_of_squares) / static_cast<double>(count) -
+                regular_mean * regular_mean));
+    }
+
+    spdlog::info(fmt::format("Read the SCSI bus {0} times, time between two reads: average {1:.1f} ns, "
+            "minimum {2:.1f} ns, maximum {3:.1f} ns, standard deviation without gaps {4:.1f} ns", loop_count,
+            mean * ns_per_tick, static_cast<double>(intervals.min) * ns_per_tick,
+            static_cast<double>(intervals.max) * ns_per_tick, deviation * ns_per_tick));
+
+    if (intervals.gaps) {
+        spdlog::warn(fmt::format("{0} times the bus was not read for more than {1} ns ({2:.1f} us in total), "
+                "signal changes may have been missed", intervals.gaps, GAP_NS,
+                static_cast<double>(intervals.gap_total) * ns_per_tick / 1000));
+    }
+}
+
 int ScsiMon::run(const vector<char *> &args)
 {
 #ifdef DEBUG
@@ -158,8 +339,6 @@ int ScsiMon::run(const vector<char *> &args)
 
     ParseArguments(args);
 
-    shared_ptr<DataSample> prev_sample = nullptr;
-    shared_ptr<DataSample> this_sample = nullptr;
     timeval start_time;
     timeval stop_time;
     uint64_t loop_count = 0;
@@ -173,12 +352,23 @@ int ScsiMon::run(const vector<char *> &args)
 
     Banner();
 
-    data_buffer.reserve(buff_size);
+    if (!stream_data || import_data) {
+        // At least the first and the last sample
+        data_buffer = make_unique<CaptureBuffer>(max<uint32_t>(buff_size, 2), huge_pages);
+        if (!triggers.empty() && trigger_before > data_buffer->GetCapacity() - 2) {
+            trigger_before = static_cast<uint32_t>(data_buffer->GetCapacity() - 2);
+            spdlog::warn("The number of changes before the trigger is limited to " + to_string(trigger_before));
+        }
+        if (huge_pages && !data_buffer->UsesHugePages()) {
+            spdlog::warn("No huge pages are reserved (vm.nr_hugepages), using transparent huge pages if available");
+        }
+    }
 
     if (import_data) {
-        data_idx = scsimon_read_json(input_file_name, data_buffer);
-        if (data_idx > 0) {
-            spdlog::debug("Read " + to_string(data_idx) + " samples from '" + input_file_name + "'");
+        if (const uint32_t count = input_file_name.ends_with(".scm") ?
+                CaptureStream::Read(input_file_name, *data_buffer) :
+                scsimon_read_json(input_file_name, *data_buffer); count > 0) {
+            spdlog::debug("Read " + to_string(count) + " samples from '" + input_file_name + "'");
             Cleanup();
         }
         exit(0);
@@ -195,9 +385,28 @@ int ScsiMon::run(const vector<char *> &args)
         goto init_exit;
     }
 
+    // The counter depends on the hardware the bus has been initialized for
+    SampleClock::Init();
+    spdlog::debug(fmt::format("Timestamps are taken from the {0} with {1} ticks per second", SampleClock::GetName(),
+            SampleClock::GetFrequency()));
+    if (stream_data) {
+        // The buffer size is the size of the ring between the sampling and the writer thread
+        stream = make_unique<CaptureStream>(file_base_name, buff_size, SampleClock::GetFrequency(),
+                rotate_mib * 1024 * 1024, rotate_seconds, keep_seconds);
+    }
+    else {
+        data_buffer->SetFrequency(SampleClock::GetFrequency());
+    }
+
     // Reset
     Reset();
 
+    // The writer thread must not use the core of the sampling loop
+    if (stream != nullptr && !stream->Start(2)) {
+        ret = EIO;
+        goto init_exit;
+    }
+
 #ifdef __linux__
     // Set the affinity to a specific processor core
     FixCpu(3);
@@ -215,46 +424,48 @@ int ScsiMon::run(const vector<char *> &args)
     (void)gettimeofday(&start_time, nullptr);
 
     // Main Loop
-    while (running) {
-        loop_count++;
-        if (loop_count > LLONG_MAX - 1) {
-        	spdlog::info("Maximum amount of time has elapsed. SCSIMON is terminating.");
-            running = false;
-        }
-
-        if (data_idx >= (buff_size - 2)) {
-        	spdlog::info("Internal data buffer is full. SCSIMON is terminating.");
-            running = false;
-        }
-
-        this_sample = bus->GetSample(loop_count);
-        if ((prev_sample == nullptr) || (this_sample->GetRawCapture() != prev_sample->GetRawCapture())) {
-            data_buffer.push_back(this_sample);
-            data_idx++;
-            prev_sample = this_sample;
-        }
-
-        continue;
+    if (stream != nullptr) {
+        auto to_stream = [&s = *stream] (uint32_t data, uint32_t delta) { return s.Push(data, delta); };
+        loop_count = Record(to_stream);
     }
-
-    // Collect one last sample, otherwise it looks like the end of the data was cut off
-    if (data_idx < buff_size) {
-        data_buffer.push_back(bus->GetSample(loop_count));
-        data_idx++;
+    else {
+        // One record is left for the last sample
+        auto to_buffer = [this, max_count = data_buffer->GetCapacity() - 1] (uint32_t data, uint32_t delta) {
+            data_buffer->Append(data, delta);
+            if (data_buffer->GetCount() != max_count) {
+                return true;
+            }
+
+            spdlog::info("Internal data buffer is full. SCSIMON is terminating.");
+            return false;
+        };
+        loop_count = Record(to_buffer);
     }
 
     (void)gettimeofday(&stop_time, nullptr);
 
+    if (stream != nullptr) {
+        stream->Stop();
+    }
+
     timersub(&stop_time, &start_time, &time_diff);
 
     elapsed_us = ((time_diff.tv_sec * 1000000) + time_diff.tv_usec);
     spdlog::info("Elapsed time: " + to_string(elapsed_us) + " microseconds (" + to_string(elapsed_us / 1000000) +
                    " seconds");
-	spdlog::info("Collected " + to_string(data_idx) + " changes");
-
-    ns_per_loop = (double)(elapsed_us * 1000) / (double)loop_count;
-    spdlog::info("Read the SCSI bus " + to_string(loop_count) + " times with an average of " +
-                   to_string(ns_per_loop) + " ns for each read");
+	if (stream != nullptr) {
+		spdlog::info("Collected " + to_string(stream->GetRecordCount()) + " changes, wrote " +
+				to_string(stream->GetByteCount()) + " bytes");
+		if (stream->GetStallCount()) {
+			spdlog::warn("The writer could not keep up, sampling was stalled for " +
+					to_string(stream->GetStallCount()) + " loop iterations");
+		}
+	}
+	else {
+		spdlog::info("Collected " + to_string(data_buffer->GetCount()) + " changes");
+	}
+
+    ReportJitter(loop_count);
 
     Cleanup();
 
@@ -10,7 +10,9 @@
 #pragma once
 
 #include "hal/bus.h"
-#include "hal/data_sample.h"
+#include "scsimon/sm_capture.h"
+#include "scsimon/sm_stream.h"
+#include "scsimon/sm_trigger.h"
 #include <memory>
 #include <vector>
 #include <atomic>
@@ -20,14 +22,26 @@ using namespace std;
 // TODO Make static fields/methods non-static
 class ScsiMon
 {
+    // Longer intervals between two samples are reported as gaps, during which signal changes may have been missed
+    static const uint64_t GAP_NS = 1000;
+
+    // The measured times between two consecutive samples, in counter ticks
+    struct sample_intervals_t {
+        uint64_t min = UINT64_MAX;
+        uint64_t max = 0;
+        uint64_t total = 0;
+        // Of the intervals that are not gaps
+        uint64_t sum_of_squares = 0;
+        uint64_t gaps = 0;
+        uint64_t gap_total = 0;
+    };
+
   public:
     ScsiMon()  = default;
     ~ScsiMon() = default;
 
     int run(const vector<char *> &);
 
-    inline static double ns_per_loop;
-
   private:
     void ParseArguments(const vector<char *> &);
     void PrintHelpText(const vector<char *> &) const;
@@ -35,6 +49,18 @@ class ScsiMon
     bool Init();
     void Cleanup() const;
     void Reset() const;
+    void ReportJitter(uint64_t) const;
+
+    // The bus signals are read with the function object, which avoids virtual calls where possible
+    // The changes are passed to the function object, capturing stops when it returns false
+    template<typename T, typename S>
+    uint64_t Capture(const T&, S&&);
+    template<typename S>
+    uint64_t Capture(S&&);
+
+    // Only the changes around a trigger are passed to the recorder if there are trigger conditions
+    template<typename S>
+    uint64_t Record(S&);
 
     static void KillHandler(int);
 
@@ -44,9 +70,23 @@ class ScsiMon
 
     uint32_t buff_size = 1000000;
 
-    vector<shared_ptr<DataSample>> data_buffer;
+    unique_ptr<CaptureBuffer> data_buffer;
+
+    sample_intervals_t intervals;
+
+    bool huge_pages = false;
+
+    // The changes are written to capture files instead of being kept in memory
+    bool stream_data = false;
+    unique_ptr<CaptureStream> stream;
+    uint64_t rotate_mib = 0;
+    int rotate_seconds = 0;
+    int keep_seconds = 0;
 
-    uint32_t data_idx = 0;
+    // Any of the conditions starts the capture window
+    vector<Trigger> triggers;
+    uint32_t trigger_before = 1000;
+    uint32_t trigger_after = 0;
 
     bool print_help = false;
 
@@ -97,9 +97,8 @@ for (i = 0; i < coll.length; i++) {
 )";
 
 
-static void print_html_data(ofstream& html_fp, const vector<shared_ptr<DataSample>> &data_capture_array)
+static void print_html_data(ofstream& html_fp, const CaptureView &data_capture_array)
 {
-    shared_ptr<DataSample> data;
     bool prev_data_valid = false;
     bool curr_data_valid;
     uint32_t selected_id = 0;
@@ -111,11 +110,11 @@ static void print_html_data(ofstream& html_fp, const vector<shared_ptr<DataSampl
 
     html_fp << "<table>" << endl;
 
-    for (auto data: data_capture_array) {
-        curr_data_valid = data->GetACK() && data->GetREQ();
-        phase_t phase = data->GetPhase();
-        if (phase == phase_t::selection && !data->GetBSY()) {
-            selected_id = data->GetDAT();
+    for (const auto& data: data_capture_array) {
+        curr_data_valid = data.GetACK() && data.GetREQ();
+        phase_t phase = data.GetPhase();
+        if (phase == phase_t::selection && !data.GetBSY()) {
+            selected_id = data.GetDAT();
         }
         if (prev_phase != phase) {
             if (close_row) {
@@ -137,8 +136,9 @@ static void print_html_data(ofstream& html_fp, const vector<shared_ptr<DataSampl
             }
             html_fp << "<tr>";
             close_row = true; // Close the row the next time around
-            html_fp << "<td>" << (double)data->GetTimestamp() / 100000 << "</td>";
-            html_fp << "<td>" << data->GetPhaseStr() << "</td>";
+            // Microseconds
+            html_fp << "<td>" << (double)data.GetTimestamp() / 1000 << "</td>";
+            html_fp << "<td>" << data.GetPhaseStr() << "</td>";
             html_fp << "<td>" << std::hex << selected_id << "</td>";
             html_fp << "<td>";
         }
@@ -151,7 +151,7 @@ static void print_html_data(ofstream& html_fp, const vector<shared_ptr<DataSampl
                 html_fp << std::hex << data_space_count << ": ";
             }
 
-            html_fp << fmt::format("{0:02X}", data->GetDAT());
+            html_fp << fmt::format("{0:02X}", data.GetDAT());
 
             data_space_count++;
             if ((data_space_count % 4) == 0) {
@@ -171,7 +171,7 @@ static void print_html_data(ofstream& html_fp, const vector<shared_ptr<DataSampl
     }
 }
 
-void scsimon_generate_html(const string &filename, const vector<shared_ptr<DataSample>> &data_capture_array)
+void scsimon_generate_html(const string &filename, const CaptureView &data_capture_array)
 {
 	spdlog::info("Creating HTML report file (" + filename + ")");
 
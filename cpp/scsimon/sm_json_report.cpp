@@ -9,7 +9,6 @@
 //
 //---------------------------------------------------------------------------
 
-#include "hal/data_sample_raspberry.h"
 #include "hal/log.h"
 #include "sm_reports.h"
 #include "string.h"
@@ -18,10 +17,13 @@
 
 using namespace std;
 
-const string timestamp_label = "\"timestamp\":\"0x";
-const string data_label      = "\"data\":\"0x";
+// The timestamps are in nanoseconds. Older versions of scsimon wrote the number of loop iterations with a
+// different label, because these cannot be converted the files are rejected.
+const string timestamp_label        = "\"timestamp_ns\":\"0x";
+const string legacy_timestamp_label = "\"timestamp\":\"0x";
+const string data_label             = "\"data\":\"0x";
 
-uint32_t scsimon_read_json(const string &json_filename, vector<shared_ptr<DataSample>> &data_capture_array)
+uint32_t scsimon_read_json(const string &json_filename, CaptureBuffer &data_capture_array)
 {
     std::ifstream json_file(json_filename);
     uint32_t sample_count = 0;
@@ -36,8 +38,14 @@ uint32_t scsimon_read_json(const string &json_filename, vector<shared_ptr<DataSa
         char *ptr;
 
         size_t timestamp_pos = str_buf.find(timestamp_label);
-        if (timestamp_pos == string::npos)
+        if (timestamp_pos == string::npos) {
+            if (str_buf.find(legacy_timestamp_label) != string::npos) {
+                spdlog::error("'" + json_filename + "' was created by an older version of scsimon, its timestamps "
+                        "are loop counts and not nanoseconds");
+                return 0;
+            }
             continue;
+        }
         timestamp      = str_buf.substr(timestamp_pos + timestamp_label.length(), 16);
         timestamp_uint = strtoull(timestamp.c_str(), &ptr, 16);
 
@@ -48,7 +56,10 @@ uint32_t scsimon_read_json(const string &json_filename, vector<shared_ptr<DataSa
         data_uint = static_cast<uint32_t>(strtoul(data.c_str(), &ptr, 16));
 
         // For reading in JSON files, we'll just assume raspberry pi data types
-        data_capture_array.push_back(make_unique<DataSample_Raspberry>(data_uint, timestamp_uint));
+        if (!data_capture_array.AppendAt(data_uint, timestamp_uint)) {
+            spdlog::warn("Internal data buffer is full. Some data may not be included.");
+            break;
+        }
 
         sample_count++;
         if (sample_count == UINT32_MAX) {
@@ -67,7 +78,7 @@ uint32_t scsimon_read_json(const string &json_filename, vector<shared_ptr<DataSa
 //	Generate JSON Output File
 //
 //---------------------------------------------------------------------------
-void scsimon_generate_json(const string &filename, const vector<shared_ptr<DataSample>> &data_capture_array)
+void scsimon_generate_json(const string &filename, const CaptureView &data_capture_array)
 {
     spdlog::trace("Creating JSON file (" + filename + ")");
     ofstream json_ofstream;
@@ -77,9 +88,9 @@ void scsimon_generate_json(const string &filename, const vector<shared_ptr<DataS
 
     size_t i             = 0;
     size_t capture_count = data_capture_array.size();
-    for (auto data : data_capture_array) {
-        json_ofstream << fmt::format("{{\"id\": \"{0:d}\", \"timestamp\":\"{1:#016x}\", \"data\":\"{2:#08x}\"}}", i,
-                                     data->GetTimestamp(), data->GetRawCapture());
+    for (const auto& data : data_capture_array) {
+        json_ofstream << fmt::format("{{\"id\": \"{0:d}\", \"timestamp_ns\":\"{1:#016x}\", \"data\":\"{2:#08x}\"}}", i,
+                                     data.GetTimestamp(), data.GetRawCapture());
 
         if (i != (capture_count - 1)) {
             json_ofstream << ",";
@@ -9,11 +9,11 @@
 //
 //---------------------------------------------------------------------------
 
-#include "hal/data_sample.h"
-#include <memory>
+#include "scsimon/sm_capture.h"
+#include <string>
 
-uint32_t scsimon_read_json(const string &json_filename, vector<shared_ptr<DataSample>> &data_capture_array);
+uint32_t scsimon_read_json(const string &json_filename, CaptureBuffer &data_capture_array);
 
-void scsimon_generate_html(const string &filename, const vector<shared_ptr<DataSample>> &data_capture_array);
-void scsimon_generate_json(const string &filename, const vector<shared_ptr<DataSample>> &data_capture_array);
-void scsimon_generate_value_change_dump(const string &filename, const vector<shared_ptr<DataSample>> &data_capture_array);
+void scsimon_generate_html(const string &filename, const CaptureView &data_capture_array);
+void scsimon_generate_json(const string &filename, const CaptureView &data_capture_array);
+void scsimon_generate_value_change_dump(const string &filename, const CaptureView &data_capture_array);
@@ -0,0 +1,442 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "scsimon/sm_stream.h"
+#include "shared/piscsi_util.h"
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+static const char FILE_MAGIC[8] = { 'S', 'C', 'S', 'I', 'M', 'O', 'N', 0 };
+static const uint32_t DATA_MAGIC = 0x41544144; // "DATA"
+static const uint32_t INDEX_MAGIC = 0x58444e49; // "INDX"
+static const uint32_t TRAILER_MAGIC = 0x4c494154; // "TAIL"
+
+// Magic, payload size, uncompressed payload size, record count, timestamp
+static const size_t BLOCK_HEADER_SIZE = 24;
+static const size_t FILE_HEADER_SIZE = 16;
+
+static void Put32(vector<uint8_t>& buf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        buf.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+static void Put64(vector<uint8_t>& buf, uint64_t value)
+{
+    Put32(buf, static_cast<uint32_t>(value));
+    Put32(buf, static_cast<uint32_t>(value >> 32));
+}
+
+static void PutVarint(vector<uint8_t>& buf, uint32_t value)
+{
+    while (value >= 0x80) {
+        buf.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buf.push_back(static_cast<uint8_t>(value));
+}
+
+static uint32_t Get32(const uint8_t *buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24);
+}
+
+static uint64_t Get64(const uint8_t *buf)
+{
+    return Get32(buf) | (static_cast<uint64_t>(Get32(buf + 4)) << 32);
+}
+
+static bool GetVarint(const uint8_t *& p, const uint8_t *end, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        const uint8_t b = *p++;
+        value |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+RecordRing::RecordRing(size_t capacity) : records(bit_ceil(max<size_t>(capacity, 2))), mask(records.size() - 1)
+{
+}
+
+size_t RecordRing::Pop(capture_record_t *buf, size_t max_count)
+{
+    const size_t t = tail.load(memory_order_relaxed);
+    const size_t count = min(head.load(memory_order_acquire) - t, max_count);
+
+    // The available records may wrap around the end of the ring
+    const size_t start = t & mask;
+    const size_t first = min(count, records.size() - start);
+    memcpy(buf, &records[start], first * sizeof(capture_record_t));
+    memcpy(buf + first, records.data(), (count - first) * sizeof(capture_record_t));
+
+    tail.store(t + count, memory_order_release);
+
+    return count;
+}
+
+CaptureStream::CaptureStream(const string& name, size_t ring_size, uint64_t f, uint64_t bytes, int seconds, int keep)
+    : ring(ring_size), base_name(name), frequency(f), rotate_bytes(bytes), rotate_seconds(seconds), keep_seconds(keep)
+{
+    // Without a rotation limit the files are rotated often enough to only keep little more than required
+    if (keep_seconds && !rotate_bytes && !rotate_seconds) {
+        rotate_seconds = max(keep_seconds / 4, 1);
+    }
+
+    raw.reserve(MAX_BLOCK_SIZE);
+}
+
+bool CaptureStream::Start(int cpu)
+{
+    failed = false;
+    writer_cpu = cpu;
+
+    if (!OpenFile()) {
+        return false;
+    }
+
+    writer = jthread([this] (stop_token st) { Write(st); });
+
+    return true;
+}
+
+void CaptureStream::Stop()
+{
+    if (writer.joinable()) {
+        writer.request_stop();
+        writer.join();
+    }
+}
+
+void CaptureStream::Write(stop_token st)
+{
+    piscsi_util::FixCpu(writer_cpu);
+
+    vector<capture_record_t> batch(BLOCK_RECORDS);
+    auto last_flush = chrono::steady_clock::now();
+
+    while (!failed) {
+        // All records pushed before stopping have to be written
+        const bool stopping = st.stop_requested();
+
+        const size_t count = ring.Pop(batch.data(), batch.size());
+        for (size_t i = 0; i < count; i++) {
+            const capture_record_t& record = batch[i];
+            timestamp += record.delta;
+            PutVarint(raw, record.delta);
+            PutVarint(raw, record.data ^ previous_data);
+            previous_data = record.data;
+
+            if (++block_count == BLOCK_RECORDS && !WriteBlock()) {
+                break;
+            }
+        }
+        record_count += count;
+        if (failed) {
+            break;
+        }
+
+        const auto now = chrono::steady_clock::now();
+        if (block_count && now - last_flush >= chrono::milliseconds(FLUSH_INTERVAL_MS)) {
+            WriteBlock();
+            file.flush();
+            last_flush = now;
+        }
+
+        if ((rotate_bytes && file_offset >= rotate_bytes) ||
+                (rotate_seconds && now - file_opened >= chrono::seconds(rotate_seconds))) {
+            if (!WriteBlock() || !CloseFile() || !OpenFile()) {
+                break;
+            }
+            RemoveExpiredFiles();
+        }
+
+        if (!count) {
+            if (stopping) {
+                break;
+            }
+
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+    if (!failed) {
+        WriteBlock();
+        CloseFile();
+    }
+}
+
+bool CaptureStream::OpenFile()
+{
+    if (rotate_bytes || rotate_seconds) {
+        ostringstream s;
+        s << base_name << '-' << setw(6) << setfill('0') << file_number++ << ".scm";
+        filename = s.str();
+    }
+    else {
+        filename = base_name + ".scm";
+    }
+
+    file.open(filename, ios::binary | ios::trunc);
+    if (file.fail()) {
+        spdlog::error("Can't create capture file '" + filename + "': " + strerror(errno));
+        failed = true;
+        return false;
+    }
+
+    file_opened = chrono::steady_clock::now();
+    file_offset = 0;
+    filenames.push_back(filename);
+
+    vector<uint8_t> header(FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC));
+    Put32(header, FILE_VERSION);
+    Put32(header, static_cast<uint32_t>(frequency));
+
+    return WriteBytes(header);
+}
+
+bool CaptureStream::CloseFile()
+{
+    if (!WriteIndex()) {
+        return false;
+    }
+
+    vector<uint8_t> trailer;
+    Put32(trailer, TRAILER_MAGIC);
+    Put32(trailer, 0);
+    Put64(trailer, previous_index);
+    if (!WriteBytes(trailer)) {
+        return false;
+    }
+
+    file.close();
+    previous_index = 0;
+
+    closed_files.push_back({ .filename = filename, .closed = chrono::steady_clock::now() });
+
+    return true;
+}
+
+bool CaptureStream::WriteBlock()
+{
+    if (!block_count) {
+        return true;
+    }
+
+    uLongf size = compressBound(static_cast<uLong>(raw.size()));
+    compressed.resize(size);
+    const bool is_compressed = compress2(compressed.data(), &size, raw.data(), static_cast<uLong>(raw.size()),
+            Z_BEST_SPEED) == Z_OK && size < raw.size();
+    const vector<uint8_t>& payload = is_compressed ? compressed : raw;
+    if (!is_compressed) {
+        size = static_cast<uLongf>(raw.size());
+    }
+
+    index.push_back({ .offset = file_offset, .timestamp = block_timestamp, .count = block_count });
+
+    vector<uint8_t> header;
+    Put32(header, DATA_MAGIC);
+    Put32(header, static_cast<uint32_t>(size));
+    Put32(header, static_cast<uint32_t>(raw.size()));
+    Put32(header, block_count);
+    Put64(header, block_timestamp);
+    if (!WriteBytes(header)) {
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char *>(payload.data()), size);
+    if (file.fail()) {
+        spdlog::error("Can't write to capture file '" + filename + "': " + strerror(errno));
+        failed = true;
+        return false;
+    }
+    file_offset += size;
+    byte_count += size;
+
+    // Each block can be decoded on its own
+    raw.clear();
+    block_count = 0;
+    previous_data = 0;
+    block_timestamp = timestamp;
+
+    return index.size() < INDEX_INTERVAL || WriteIndex();
+}
+
+bool CaptureStream::WriteIndex()
+{
+    if (index.empty()) {
+        return true;
+    }
+
+    vector<uint8_t> block;
+    Put32(block, INDEX_MAGIC);
+    const auto size = static_cast<uint32_t>(8 + index.size() * 24);
+    Put32(block, size);
+    Put32(block, size);
+    Put32(block, static_cast<uint32_t>(index.size()));
+    Put64(block, index.front().timestamp);
+    Put64(block, previous_index);
+    for (const auto& entry : index) {
+        Put64(block, entry.offset);
+        Put64(block, entry.timestamp);
+        Put32(block, entry.count);
+        Put32(block, 0);
+    }
+
+    const uint64_t offset = file_offset;
+    if (!WriteBytes(block)) {
+        return false;
+    }
+
+    previous_index = offset;
+    index.clear();
+
+    return true;
+}
+
+bool CaptureStream::WriteBytes(const vector<uint8_t>& bytes)
+{
+    file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    if (file.fail()) {
+        spdlog::error("Can't write to capture file '" + filename + "': " + strerror(errno));
+        failed = true;
+        return false;
+    }
+
+    file_offset += bytes.size();
+    byte_count += bytes.size();
+
+    return true;
+}
+
+void CaptureStream::RemoveExpiredFiles()
+{
+    if (!keep_seconds) {
+        return;
+    }
+
+    // A file only contains samples older than the time it was closed
+    const auto expired = chrono::steady_clock::now() - chrono::seconds(keep_seconds);
+    while (!closed_files.empty() && closed_files.front().closed < expired) {
+        error_code error;
+        if (!filesystem::remove(closed_files.front().filename, error) && error) {
+            spdlog::warn("Can't remove capture file '" + closed_files.front().filename + "': " + error.message());
+        }
+        erase(filenames, closed_files.front().filename);
+        closed_files.pop_front();
+    }
+}
+
+uint32_t CaptureStream::Read(const string& name, CaptureBuffer& buffer)
+{
+    ifstream in(name, ios::binary);
+    vector<uint8_t> header(FILE_HEADER_SIZE);
+    in.read(reinterpret_cast<char *>(header.data()), header.size());
+    if (in.fail() || memcmp(header.data(), FILE_MAGIC, sizeof(FILE_MAGIC))) {
+        spdlog::error("'" + name + "' is not a scsimon capture file");
+        return 0;
+    }
+    // Version 1 files contain loop counts instead of timestamps
+    if (Get32(header.data() + sizeof(FILE_MAGIC)) != FILE_VERSION) {
+        spdlog::error("'" + name + "' was created by a different version of scsimon");
+        return 0;
+    }
+    const uint32_t frequency = Get32(header.data() + sizeof(FILE_MAGIC) + 4);
+    if (!frequency) {
+        spdlog::error("Capture file '" + name + "' is corrupt");
+        return 0;
+    }
+    buffer.SetFrequency(frequency);
+
+    uint32_t sample_count = 0;
+    vector<uint8_t> payload;
+    vector<uint8_t> decompressed;
+    while (true) {
+        in.read(reinterpret_cast<char *>(header.data()), 8);
+        if (in.fail() || Get32(header.data()) == TRAILER_MAGIC) {
+            break;
+        }
+
+        header.resize(BLOCK_HEADER_SIZE);
+        in.read(reinterpret_cast<char *>(header.data()) + 8, BLOCK_HEADER_SIZE - 8);
+        if (in.fail()) {
+            spdlog::warn("Capture file '" + name + "' is truncated");
+            break;
+        }
+
+        const uint32_t magic = Get32(header.data());
+        const uint32_t size = Get32(header.data() + 4);
+        const uint32_t raw_size = Get32(header.data() + 8);
+        const uint32_t count = Get32(header.data() + 12);
+        uint64_t timestamp = Get64(header.data() + 16);
+
+        // Do not trust the sizes of a damaged file
+        if (size > MAX_BLOCK_SIZE || raw_size > MAX_BLOCK_SIZE) {
+            spdlog::error("Capture file '" + name + "' is corrupt");
+            break;
+        }
+
+        payload.resize(size);
+        in.read(reinterpret_cast<char *>(payload.data()), size);
+        if (in.fail()) {
+            spdlog::warn("Capture file '" + name + "' is truncated");
+            break;
+        }
+
+        if (magic != DATA_MAGIC) {
+            continue;
+        }
+
+        if (size != raw_size) {
+            decompressed.resize(raw_size);
+            uLongf length = raw_size;
+            if (uncompress(decompressed.data(), &length, payload.data(), size) != Z_OK || length != raw_size) {
+                spdlog::error("Capture file '" + name + "' is corrupt");
+                break;
+            }
+            payload.swap(decompressed);
+        }
+
+        const uint8_t *p = payload.data();
+        const uint8_t *end = p + raw_size;
+        uint32_t data = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t delta;
+            uint32_t change;
+            if (!GetVarint(p, end, delta) || !GetVarint(p, end, change)) {
+                spdlog::error("Capture file '" + name + "' is corrupt");
+                return sample_count;
+            }
+
+            timestamp += delta;
+            data ^= change;
+            if (!buffer.AppendAt(data, timestamp)) {
+                spdlog::warn("Internal data buffer is full. Some data may not be included.");
+                return sample_count;
+            }
+
+            sample_count++;
+        }
+    }
+
+    return sample_count;
+}
@@ -0,0 +1,190 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Streaming capture to disk. The sampling thread pushes the change records into a lock-free ring,
+// a writer thread on another core encodes them in compressed blocks and appends them to capture files.
+//
+// Capture file format, all numbers little endian:
+//   File header:  "SCSIMON\0", uint32_t version, uint32_t ticks per second of the timestamps
+//   Blocks:       block_header, payload
+//                 DATA: records (varint delta, varint data XOR previous data), compressed with zlib
+//                       unless size == raw_size, timestamp is the time of the record before the block
+//                 INDX: uint64_t offset of the previous index block (0 if none), then for each data block
+//                       since the previous index uint64_t offset, uint64_t timestamp, uint32_t count, uint32_t 0
+//   Trailer:      "TAIL", uint32_t 0, uint64_t offset of the last index block
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "scsimon/sm_capture.h"
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Single producer/single consumer ring, the producer is the sampling loop
+class RecordRing
+{
+  public:
+
+    // The capacity is rounded up to a power of 2
+    explicit RecordRing(size_t);
+    ~RecordRing() = default;
+
+    bool Push(const capture_record_t& record)
+    {
+        const size_t h = head.load(memory_order_relaxed);
+        if (h - cached_tail == records.size()) {
+            cached_tail = tail.load(memory_order_acquire);
+            if (h - cached_tail == records.size()) {
+                return false;
+            }
+        }
+
+        records[h & mask] = record;
+        head.store(h + 1, memory_order_release);
+
+        return true;
+    }
+
+    // Returns the number of records copied
+    size_t Pop(capture_record_t *, size_t);
+
+  private:
+
+    vector<capture_record_t> records;
+
+    size_t mask;
+
+    // Producer and consumer indices are on separate cache lines
+    alignas(64) atomic<size_t> head = 0;
+    size_t cached_tail = 0;
+
+    alignas(64) atomic<size_t> tail = 0;
+};
+
+class CaptureStream
+{
+    static const uint32_t FILE_VERSION = 2;
+
+    // Records per data block
+    static const size_t BLOCK_RECORDS = 65536;
+
+    // A record is encoded in at most 10 bytes, index blocks are much smaller
+    static const size_t MAX_BLOCK_SIZE = BLOCK_RECORDS * 10;
+
+    // A partial block is written after this time, so that not much is lost when scsimon is killed
+    static const int FLUSH_INTERVAL_MS = 1000;
+
+    // Data blocks per index block
+    static const size_t INDEX_INTERVAL = 64;
+
+    struct index_entry_t {
+        uint64_t offset;
+        uint64_t timestamp;
+        uint32_t count;
+    };
+
+    struct closed_file_t {
+        string filename;
+        chrono::steady_clock::time_point closed;
+    };
+
+  public:
+
+    // Without rotation all records are written to a single file
+    CaptureStream(const string&, size_t, uint64_t, uint64_t, int, int);
+    ~CaptureStream() = default;
+
+    // The writer thread is pinned to the CPU core
+    bool Start(int);
+    void Stop();
+
+    // Waits while the ring is full, returns false if the writer has failed
+    bool Push(uint32_t data, uint32_t delta)
+    {
+        while (!ring.Push({ .data = data, .delta = delta })) {
+            if (failed.load(memory_order_relaxed)) {
+                return false;
+            }
+            stall_count++;
+        }
+
+        return true;
+    }
+
+    // The number of loop iterations the sampling thread had to wait for the writer, samples may have been missed
+    uint64_t GetStallCount() const { return stall_count; }
+    uint64_t GetRecordCount() const { return record_count; }
+    uint64_t GetByteCount() const { return byte_count; }
+    const vector<string>& GetFilenames() const { return filenames; }
+
+    // Reads the records of a capture file, returns the number of records
+    static uint32_t Read(const string&, CaptureBuffer&);
+
+  private:
+
+    void Write(stop_token);
+    bool OpenFile();
+    bool CloseFile();
+    bool WriteBlock();
+    bool WriteIndex();
+    bool WriteBytes(const vector<uint8_t>&);
+    void RemoveExpiredFiles();
+
+    RecordRing ring;
+
+    string base_name;
+
+    // Ticks per second of the record timestamps
+    uint64_t frequency;
+
+    // No rotation if 0
+    uint64_t rotate_bytes;
+    int rotate_seconds;
+
+    // All files are kept if 0
+    int keep_seconds;
+
+    jthread writer;
+
+    int writer_cpu = -1;
+
+    atomic<bool> failed;
+
+    uint64_t stall_count = 0;
+
+    // Only accessed by the writer thread until it has been stopped
+    ofstream file;
+    string filename;
+    int file_number = 0;
+    uint64_t file_offset = 0;
+    chrono::steady_clock::time_point file_opened;
+
+    vector<uint8_t> raw;
+    vector<uint8_t> compressed;
+    uint32_t block_count = 0;
+    uint32_t previous_data = 0;
+    uint64_t block_timestamp = 0;
+    uint64_t timestamp = 0;
+
+    vector<index_entry_t> index;
+    uint64_t previous_index = 0;
+
+    deque<closed_file_t> closed_files;
+    vector<string> filenames;
+
+    uint64_t record_count = 0;
+    uint64_t byte_count = 0;
+};
@@ -0,0 +1,124 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "scsimon/sm_trigger.h"
+#include "hal/bus.h"
+#include "shared/piscsi_util.h"
+#include <sstream>
+
+using namespace std;
+using namespace piscsi_util;
+
+// A target is selected when SEL is asserted, BSY has been released and its ID is on the data bus
+static const uint32_t SELECTION_MASK = (1 << PIN_SEL) | (1 << PIN_BSY);
+static const uint32_t SELECTION_VALUE = 1 << PIN_SEL;
+
+// The signals that define the phase
+static const uint32_t PHASE_MASK = (1 << PIN_SEL) | (1 << PIN_BSY) | (1 << PIN_MSG) | (1 << PIN_CD) | (1 << PIN_IO);
+static const uint32_t COMMAND_VALUE = (1 << PIN_BSY) | (1 << PIN_CD);
+
+// The target asserts REQ when it has set the phase, the data on the bus are valid when ACK is also asserted
+static const uint32_t REQ_VALUE = 1 << PIN_REQ;
+static const uint32_t HANDSHAKE_VALUE = (1 << PIN_REQ) | (1 << PIN_ACK);
+
+string Trigger::Parse(const string& condition)
+{
+    description = condition;
+
+    const auto& components = Split(condition, ':', 2);
+    if (components.empty()) {
+        return "Missing trigger condition";
+    }
+    const string& type = components[0];
+    const string argument = components.size() > 1 ? components[1] : "";
+
+    if (type == "rst" && argument.empty()) {
+        AddStep(1 << PIN_RST, 1 << PIN_RST);
+        return "";
+    }
+
+    if (type == "id") {
+        if (int id; GetAsUnsignedInt(argument, id) && id < 8) {
+            const uint32_t data = GetDataBits(static_cast<uint8_t>(1 << id));
+            AddStep(SELECTION_MASK | data, SELECTION_VALUE | data);
+            return "";
+        }
+
+        return "Invalid target ID '" + argument + "' (0-7)";
+    }
+
+    if (type == "opcode") {
+        size_t end = 0;
+        int opcode = -1;
+        try {
+            opcode = stoi(argument, &end, 0);
+        }
+        catch (const logic_error&) { // NOSONAR Not needed
+            // Reported below
+        }
+        if (argument.empty() || end != argument.size() || opcode < 0 || opcode > 255) {
+            return "Invalid opcode '" + argument + "' (0-255)";
+        }
+
+        // The opcode is the first byte transferred in the COMMAND phase, i.e. the previous byte was transferred
+        // in a different phase
+        gate_mask = HANDSHAKE_VALUE;
+        gate_value = HANDSHAKE_VALUE;
+        AddStep(PHASE_MASK, COMMAND_VALUE, true);
+        AddStep(PHASE_MASK | GetDataBits(0xff), COMMAND_VALUE | GetDataBits(static_cast<uint8_t>(opcode)));
+        return "";
+    }
+
+    if (type == "phases") {
+        gate_mask = REQ_VALUE;
+        gate_value = REQ_VALUE;
+
+        stringstream s(argument);
+        string name;
+        while (getline(s, name, ',')) {
+            int mci = 0;
+            while (mci < 8 && (BUS::GetPhase(mci) == phase_t::reserved || name != BUS::GetPhaseStrRaw(BUS::GetPhase(mci)))) {
+                mci++;
+            }
+            if (mci == 8) {
+                return "Invalid phase '" + name + "' (command, datain, dataout, status, msgin, msgout)";
+            }
+            if (step_count == MAX_STEPS) {
+                return "Too many phases, the maximum is " + to_string(MAX_STEPS);
+            }
+
+            const uint32_t value = (1 << PIN_BSY) | (mci & 0x04 ? 1 << PIN_MSG : 0) | (mci & 0x02 ? 1 << PIN_CD : 0) |
+                    (mci & 0x01 ? 1 << PIN_IO : 0);
+            AddStep(PHASE_MASK, value);
+        }
+
+        return step_count ? "" : "Missing phases";
+    }
+
+    return "Invalid trigger condition '" + condition + "'";
+}
+
+void Trigger::AddStep(uint32_t mask, uint32_t value, bool negate)
+{
+    steps[step_count++] = { .mask = mask, .value = value, .negate = negate };
+}
+
+uint32_t Trigger::GetDataBits(uint8_t data)
+{
+    const array<int, 8> pins = { PIN_DT0, PIN_DT1, PIN_DT2, PIN_DT3, PIN_DT4, PIN_DT5, PIN_DT6, PIN_DT7 };
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 8; i++) {
+        if (data & (1 << i)) {
+            bits |= 1 << pins[i];
+        }
+    }
+
+    return bits;
+}
@@ -0,0 +1,174 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+// Trigger conditions evaluated on the raw GPIO words in the sampling loop. A condition is a sequence
+// of steps, each step is a mask/value pair precomputed when the condition is parsed. Only the samples
+// that match the gate of the condition (e.g. REQ asserted) are evaluated. The condition fires when the
+// steps have been matched in order, without a sample in between that matches neither the current nor
+// the previous step.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+
+#include "scsimon/sm_capture.h"
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Trigger
+{
+    static const size_t MAX_STEPS = 8;
+
+    struct trigger_step_t {
+        uint32_t mask;
+        uint32_t value;
+        // The step matches if the masked sample does not have the value
+        bool negate;
+    };
+
+  public:
+
+    Trigger() = default;
+    ~Trigger() = default;
+
+    // Supported conditions: "id:<target ID>", "opcode:<CDB opcode>", "rst", "phases:<phase>,<phase>,...".
+    // Returns an error message if the condition is invalid.
+    string Parse(const string&);
+
+    // Returns true if the condition has been met with this sample
+    bool Update(uint32_t data)
+    {
+        if ((data & gate_mask) != gate_value) {
+            return false;
+        }
+
+        if (Matches(step, data)) {
+            if (++step == step_count) {
+                step = 0;
+                return true;
+            }
+        }
+        else if (step && !Matches(step - 1, data)) {
+            step = Matches(0, data) ? 1 : 0;
+        }
+
+        return false;
+    }
+
+    const string& GetDescription() const { return description; }
+
+  private:
+
+    bool Matches(size_t s, uint32_t data) const
+    {
+        return ((data & steps[s].mask) == steps[s].value) != steps[s].negate;
+    }
+
+    void AddStep(uint32_t, uint32_t, bool = false);
+
+    static uint32_t GetDataBits(uint8_t);
+
+    array<trigger_step_t, MAX_STEPS> steps = {};
+    size_t step_count = 0;
+
+    uint32_t gate_mask = 0;
+    uint32_t gate_value = 0;
+
+    // The next step to be matched
+    size_t step = 0;
+
+    string description;
+};
+
+// Passes only the changes around the first trigger to the recorder. Before the trigger the most recent changes
+// are kept in a history ring, after the trigger the window is passed on until it is complete.
+template<typename S>
+class TriggerRecorder
+{
+  public:
+
+    // The history includes the change that fires the trigger, which is also the first change of the window.
+    // Without a window size recording continues until the recorder stops it.
+    TriggerRecorder(vector<Trigger>& t, size_t before, size_t after, S& r)
+        : triggers(t), history(bit_ceil(max<size_t>(before, 1))), history_size(max<size_t>(before, 1)),
+          window(after), recorder(r) {}
+    ~TriggerRecorder() = default;
+
+    bool operator()(uint32_t data, uint32_t delta)
+    {
+        if (fired < 0) {
+            history[history_count++ & (history.size() - 1)] = { .data = data, .delta = delta };
+
+            for (size_t i = 0; i < triggers.size(); i++) {
+                if (triggers[i].Update(data)) {
+                    fired = static_cast<int>(i);
+                    return Flush() && window != 1;
+                }
+            }
+
+            return true;
+        }
+
+        if (!recorder(data, delta)) {
+            return false;
+        }
+
+        return !window || ++window_count < window;
+    }
+
+    // If there was no trigger the history is passed to the recorder
+    void Finish()
+    {
+        if (fired < 0) {
+            Flush();
+        }
+    }
+
+    // The index of the trigger that has fired, -1 if none
+    int GetTrigger() const { return fired; }
+
+  private:
+
+    bool Flush()
+    {
+        const size_t count = min(history_count, history_size);
+
+        // The oldest record is the start of the capture
+        bool delta = false;
+        for (size_t i = history_count - count; i < history_count; i++) {
+            const capture_record_t& record = history[i & (history.size() - 1)];
+            if (!recorder(record.data, delta ? record.delta : 0)) {
+                return false;
+            }
+            delta = true;
+        }
+
+        // The sample that fired the trigger is the first one of the window
+        window_count = 1;
+
+        return true;
+    }
+
+    vector<Trigger>& triggers;
+
+    vector<capture_record_t> history;
+    size_t history_size;
+    size_t history_count = 0;
+
+    size_t window;
+    size_t window_count = 0;
+
+    int fired = -1;
+
+    S& recorder;
+};
@@ -12,7 +12,6 @@
 #include "hal/data_sample.h"
 #include "hal/gpiobus.h"
 #include "hal/log.h"
-#include "sm_core.h"
 #include "sm_reports.h"
 #include <fstream>
 #include <iostream>
@@ -75,7 +74,7 @@ static void vcd_output_if_changed_byte(ofstream &fp, uint8_t data, int pin, char
     }
 }
 
-void scsimon_generate_value_change_dump(const string &filename, const vector<shared_ptr<DataSample>> &data_capture_array)
+void scsimon_generate_value_change_dump(const string &filename, const CaptureView &data_capture_array)
 {
     spdlog::trace("Creating Value Change Dump file (" + filename + ")");
     ofstream vcd_ofstream;
@@ -129,19 +128,19 @@ void scsimon_generate_value_change_dump(const string &filename, const vector<sha
                  << "b00000000 " << SYMBOL_PIN_DAT << endl
                  << "$end" << endl;
 
-    for (shared_ptr<DataSample> cur_sample : data_capture_array) {
-        vcd_ofstream << "#" << (double)cur_sample->GetTimestamp() * ScsiMon::ns_per_loop << endl;
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetBSY(), PIN_BSY, SYMBOL_PIN_BSY);
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetSEL(), PIN_SEL, SYMBOL_PIN_SEL);
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetCD(), PIN_CD, SYMBOL_PIN_CD);
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetIO(), PIN_IO, SYMBOL_PIN_IO);
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetMSG(), PIN_MSG, SYMBOL_PIN_MSG);
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetREQ(), PIN_REQ, SYMBOL_PIN_REQ);
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetACK(), PIN_ACK, SYMBOL_PIN_ACK);
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetATN(), PIN_ATN, SYMBOL_PIN_ATN);
-        vcd_output_if_changed_bool(vcd_ofstream, cur_sample->GetRST(), PIN_RST, SYMBOL_PIN_RST);
-        vcd_output_if_changed_byte(vcd_ofstream, cur_sample->GetDAT(), PIN_DT0, SYMBOL_PIN_DAT);
-        vcd_output_if_changed_phase(vcd_ofstream, cur_sample->GetPhase(), PIN_PHASE, SYMBOL_PIN_PHASE);
+    for (const auto& cur_sample : data_capture_array) {
+        vcd_ofstream << "#" << cur_sample.GetTimestamp() << endl;
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetBSY(), PIN_BSY, SYMBOL_PIN_BSY);
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetSEL(), PIN_SEL, SYMBOL_PIN_SEL);
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetCD(), PIN_CD, SYMBOL_PIN_CD);
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetIO(), PIN_IO, SYMBOL_PIN_IO);
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetMSG(), PIN_MSG, SYMBOL_PIN_MSG);
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetREQ(), PIN_REQ, SYMBOL_PIN_REQ);
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetACK(), PIN_ACK, SYMBOL_PIN_ACK);
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetATN(), PIN_ATN, SYMBOL_PIN_ATN);
+        vcd_output_if_changed_bool(vcd_ofstream, cur_sample.GetRST(), PIN_RST, SYMBOL_PIN_RST);
+        vcd_output_if_changed_byte(vcd_ofstream, cur_sample.GetDAT(), PIN_DT0, SYMBOL_PIN_DAT);
+        vcd_output_if_changed_phase(vcd_ofstream, cur_sample.GetPhase(), PIN_PHASE, SYMBOL_PIN_PHASE);
     }
     vcd_ofstream.close();
 }
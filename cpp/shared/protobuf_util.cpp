@@ -10,6 +10,9 @@
 #include "shared/piscsi_exceptions.h"
 #include "piscsi_util.h"
 #include "protobuf_util.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <unistd.h>
 #include <sstream>
 #include <array>
@@ -176,16 +179,36 @@ string protobuf_util::ListDevices(const vector<PbDevice>& pb_devices)
 	return s.str();
 }
 
+//---------------------------------------------------------------------------
+//
+// Append pre-serialized message data as a length-delimited field. Concatenated fields form a valid
+// message, which makes it possible to splice cached data into a message without rebuilding it.
+//
+//---------------------------------------------------------------------------
+
+void protobuf_util::AppendSerializedField(string& data, int field_number, string_view field_data)
+{
+	using namespace google::protobuf::internal;
+
+	google::protobuf::io::StringOutputStream output(&data);
+	google::protobuf::io::CodedOutputStream coded_output(&output);
+	coded_output.WriteTag(WireFormatLite::MakeTag(field_number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+	coded_output.WriteVarint32(static_cast<uint32_t>(field_data.size()));
+	coded_output.WriteRaw(field_data.data(), static_cast<int>(field_data.size()));
+}
+
 //---------------------------------------------------------------------------
 //
 // Serialize/Deserialize protobuf message: Length followed by the actual data.
+// Optional pre-serialized fields are appended to the message data.
 // A little endian platform is assumed.
 //
 //---------------------------------------------------------------------------
 
-void protobuf_util::SerializeMessage(int fd, const google::protobuf::Message& message)
+void protobuf_util::SerializeMessage(int fd, const google::protobuf::Message& message, string_view fields)
 {
-	const string data = message.SerializeAsString();
+	string data = message.SerializeAsString();
+	data.append(fields);
 
 	// Write the size of the protobuf data as a header
 	const auto size = static_cast<int32_t>(data.length());
@@ -23,6 +23,9 @@ namespace protobuf_util
 {
 	static const char KEY_VALUE_SEPARATOR = '=';
 
+	// Bucket n of a PbStatistics latency histogram counts durations of less than 2^(n + HISTOGRAM_MIN_BUCKET_BITS) us
+	static const int HISTOGRAM_MIN_BUCKET_BITS = 4;
+
 	string GetParam(const auto& item, const string& key)
 	{
 		const auto& it = item.params().find(key);
@@ -44,7 +47,8 @@ namespace protobuf_util
 	string SetIdAndLun(PbDeviceDefinition&, const string&);
 	string ListDevices(const vector<PbDevice>&);
 
-	void SerializeMessage(int, const google::protobuf::Message&);
+	void AppendSerializedField(string&, int, string_view);
+	void SerializeMessage(int, const google::protobuf::Message&, string_view = "");
 	void DeserializeMessage(int, google::protobuf::Message&);
 	size_t ReadBytes(int, span<byte>);
 }
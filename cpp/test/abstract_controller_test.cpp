@@ -26,10 +26,13 @@ TEST(AbstractControllerTest, AllocateBuffer)
 {
 	MockAbstractController controller;
 
+	EXPECT_EQ(0, controller.GetBufferSize());
 	controller.AllocateBuffer(1);
 	EXPECT_LE(1, controller.GetBuffer().size());
+	EXPECT_EQ(controller.GetBuffer().capacity(), controller.GetBufferSize());
 	controller.AllocateBuffer(10000);
 	EXPECT_LE(10000, controller.GetBuffer().size());
+	EXPECT_EQ(controller.GetBuffer().capacity(), controller.GetBufferSize());
 }
 
 TEST(AbstractControllerTest, Reset)
@@ -47,6 +50,8 @@ TEST(AbstractControllerTest, Reset)
 	EXPECT_TRUE(controller->IsBusFree());
 	EXPECT_EQ(status::good, controller->GetStatus());
 	EXPECT_EQ(0, controller->GetLength());
+	EXPECT_LE(512, controller->GetBuffer().size()) << "Buffer must not be released";
+	EXPECT_EQ(controller->GetBuffer().capacity(), controller->GetBufferSize());
 }
 
 TEST(AbstractControllerTest, Next)
@@ -0,0 +1,55 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "controllers/buffer_pool.h"
+
+TEST(BufferPoolTest, AcquireAndRelease)
+{
+	BufferPool::Trim(0);
+	EXPECT_EQ(0, BufferPool::GetPooledBufferCount());
+	EXPECT_EQ(0, BufferPool::GetPooledByteCount());
+
+	auto small = BufferPool::Acquire(512);
+	EXPECT_EQ(512, small.size());
+	BufferPool::Release(std::move(small));
+	EXPECT_EQ(0, BufferPool::GetPooledBufferCount()) << "Small buffers must not be pooled";
+
+	auto large = BufferPool::Acquire(1024 * 1024);
+	EXPECT_EQ(1024 * 1024, large.size());
+	const auto *data = large.data();
+	BufferPool::Release(std::move(large));
+	EXPECT_EQ(1, BufferPool::GetPooledBufferCount());
+	EXPECT_LE(1024 * 1024, BufferPool::GetPooledByteCount());
+
+	auto reused = BufferPool::Acquire(512 * 1024);
+	EXPECT_EQ(512 * 1024, reused.size());
+	EXPECT_EQ(data, reused.data()) << "Pooled buffer must be re-used";
+	EXPECT_EQ(0, BufferPool::GetPooledBufferCount());
+
+	BufferPool::Release(std::move(reused));
+	BufferPool::Trim();
+	EXPECT_EQ(1, BufferPool::GetPooledBufferCount()) << "Recently released buffers must be kept";
+	BufferPool::Trim(0);
+	EXPECT_EQ(0, BufferPool::GetPooledBufferCount());
+	EXPECT_EQ(0, BufferPool::GetPooledByteCount());
+}
+
+TEST(BufferPoolTest, Limit)
+{
+	BufferPool::Trim(0);
+
+	for (int i = 0; i < 4; i++) {
+		BufferPool::Release(vector<uint8_t>(16 * 1024 * 1024));
+	}
+	EXPECT_EQ(2, BufferPool::GetPooledBufferCount()) << "Pool size must be limited";
+	EXPECT_EQ(32 * 1024 * 1024, BufferPool::GetPooledByteCount());
+
+	BufferPool::Trim(0);
+}
@@ -0,0 +1,519 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "mocks.h"
+#include "test_shared.h"
+#include "devices/cfilesystem.h"
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <sstream>
+#include <set>
+
+using namespace filesystem;
+
+static path CreateFolder(const vector<string>& filenames)
+{
+	const path folder = test_data_temp_path / "cfilesystem";
+	remove_all(folder);
+	create_directories(folder);
+
+	for (const auto& filename : filenames) {
+		ofstream(folder / filename) << filename;
+	}
+
+	return folder;
+}
+
+static void InitPath(CHostPath& host_path, const path& folder)
+{
+	host_path.SetHost((folder.string() + "/").c_str());
+	host_path.SetHuman((const uint8_t *)"/");
+	host_path.Refresh();
+}
+
+TEST(CFileSystemTest, FindFilename)
+{
+	const path folder = CreateFolder({ "FILE1.TXT", "file2.txt", "a_very_long_file_name_1.dat",
+		"a_very_long_file_name_2.dat" });
+
+	CHostPath host_path;
+	InitPath(host_path, folder);
+
+	const CHostFilename *f = host_path.FindFilename((const uint8_t *)"FILE1.TXT");
+	ASSERT_NE(nullptr, f);
+	EXPECT_STREQ("FILE1.TXT", f->GetHost());
+	f = host_path.FindFilename((const uint8_t *)"file1.txt");
+	ASSERT_NE(nullptr, f) << "Names must be compared case-insensitively";
+	EXPECT_STREQ("FILE1.TXT", f->GetHost());
+	f = host_path.FindFilename((const uint8_t *)"FILE2.TXT");
+	ASSERT_NE(nullptr, f);
+	EXPECT_STREQ("file2.txt", f->GetHost());
+	EXPECT_EQ(nullptr, host_path.FindFilename((const uint8_t *)"FILE3.TXT"));
+	EXPECT_EQ(nullptr, host_path.FindFilename((const uint8_t *)"FILE1.TXT", Human68k::AT_DIRECTORY));
+
+	// The long names are reduced to distinct Human68k names
+	int count = 0;
+	string previous;
+	CHostPath::find_t find = {};
+	while ((f = host_path.FindFilenameWildcard((const uint8_t *)"A_VERY_L????????????.???", Human68k::AT_ALL, &find))) {
+		EXPECT_NE(previous, (const char *)f->GetHuman());
+		EXPECT_EQ(f, host_path.FindFilename(f->GetHuman()));
+		previous = (const char *)f->GetHuman();
+		count++;
+	}
+	EXPECT_EQ(2, count);
+
+	find = {};
+	f = host_path.FindFilenameWildcard((const uint8_t *)"FILE2.TXT", Human68k::AT_ALL, &find);
+	ASSERT_NE(nullptr, f);
+	EXPECT_STREQ("file2.txt", f->GetHost());
+	EXPECT_EQ(nullptr, host_path.FindFilenameWildcard((const uint8_t *)"FILE2.TXT", Human68k::AT_ALL, &find));
+
+	// Entries are preserved across refreshes
+	ofstream(folder / "file3.txt") << "file3";
+	remove(folder / "FILE1.TXT");
+	host_path.Refresh();
+	EXPECT_EQ(nullptr, host_path.FindFilename((const uint8_t *)"FILE1.TXT"));
+	EXPECT_NE(nullptr, host_path.FindFilename((const uint8_t *)"FILE3.TXT"));
+	EXPECT_EQ(previous, (const char *)host_path.FindFilename((const uint8_t *)previous.c_str())->GetHuman());
+
+	remove_all(folder);
+}
+
+TEST(CFileSystemTest, FindFilenameShiftJis)
+{
+	// Katakana "a", the second byte of the Shift-JIS code is 'A'
+	const path folder = CreateFolder({ "\xe3\x82\xa2.TXT", "FILE1.TXT" });
+
+	CHostPath host_path;
+	InitPath(host_path, folder);
+
+	EXPECT_NE(nullptr, host_path.FindFilename((const uint8_t *)"\x83\x41.TXT"));
+	EXPECT_NE(nullptr, host_path.FindFilename((const uint8_t *)"\x83\x41.txt"));
+	EXPECT_EQ(nullptr, host_path.FindFilename((const uint8_t *)"\x83\x61.TXT")) << "Second bytes must not be folded";
+
+	CHostPath::find_t find = {};
+	const CHostFilename *f = host_path.FindFilenameWildcard((const uint8_t *)"\x83\x41??????.t??", Human68k::AT_ALL, &find);
+	ASSERT_NE(nullptr, f);
+	EXPECT_STREQ("\x83\x41.TXT", f->GetHost()) << "Host names are converted to Shift-JIS";
+	EXPECT_EQ(nullptr, host_path.FindFilenameWildcard((const uint8_t *)"\x83\x41??????.t??", Human68k::AT_ALL, &find));
+
+	find = {};
+	EXPECT_EQ(nullptr, host_path.FindFilenameWildcard((const uint8_t *)"\x83\x61??????.???", Human68k::AT_ALL, &find));
+
+	find = {};
+	f = host_path.FindFilenameWildcard((const uint8_t *)"file????.???", Human68k::AT_ALL, &find);
+	ASSERT_NE(nullptr, f) << "Wildcard searches must be case-insensitive";
+	EXPECT_STREQ("FILE1.TXT", f->GetHost());
+
+	remove_all(folder);
+}
+
+static bool Find(CHostDrv& drv, const string& name, const string& ext, const string& dir = "")
+{
+	Human68k::namests_t namests = {};
+	namests.path[0] = 0x09;
+	if (!dir.empty()) {
+		memcpy(&namests.path[1], dir.data(), dir.size());
+		namests.path[dir.size() + 1] = 0x09;
+	}
+	memset(namests.name, ' ', sizeof(namests.name));
+	memcpy(namests.name, name.data(), name.size());
+	memset(namests.ext, ' ', sizeof(namests.ext));
+	memcpy(namests.ext, ext.data(), ext.size());
+
+	CHostFiles files;
+	files.SetPath(&namests);
+	files.SetAttribute(Human68k::AT_ALL);
+
+	return drv.Find(&files);
+}
+
+TEST(CFileSystemTest, HostChangeNotification)
+{
+	const path folder = CreateFolder({ "FILE1.TXT" });
+
+	CHostDrv drv;
+	drv.Init(folder.string().c_str(), 0);
+
+	EXPECT_TRUE(Find(drv, "FILE1", "TXT"));
+	EXPECT_FALSE(Find(drv, "FILE2", "TXT"));
+	EXPECT_FALSE(drv.FindCache((const uint8_t *)"/")->isRefresh()) << "Unchanged directories must not be read again";
+
+	ofstream(folder / "FILE2.TXT") << "file2";
+	EXPECT_TRUE(Find(drv, "FILE2", "TXT")) << "Files created on the host must be found";
+
+	remove(folder / "FILE1.TXT");
+	EXPECT_FALSE(Find(drv, "FILE1", "TXT")) << "Files deleted on the host must not be found";
+
+	remove_all(folder);
+}
+
+TEST(CFileSystemTest, HostChangeNotificationSharedDirectory)
+{
+	const path folder = CreateFolder({});
+	create_directory(folder / "DIR");
+	ofstream(folder / "DIR" / "FILE1.TXT") << "file1";
+	create_directory_symlink("DIR", folder / "LINK");
+
+	CHostDrv drv;
+	drv.Init(folder.string().c_str(), 0);
+
+	// Both paths are cached and share the watch of the directory
+	EXPECT_TRUE(Find(drv, "FILE1", "TXT", "DIR"));
+	EXPECT_TRUE(Find(drv, "FILE1", "TXT", "LINK"));
+	const CHostPath *dir = drv.FindCache((const uint8_t *)"/DIR/");
+	ASSERT_NE(nullptr, dir);
+	const CHostPath *link = drv.FindCache((const uint8_t *)"/LINK/");
+	ASSERT_NE(nullptr, link);
+	EXPECT_NE(-1, dir->GetWatch());
+	EXPECT_EQ(dir->GetWatch(), link->GetWatch());
+
+	ofstream(folder / "DIR" / "FILE2.TXT") << "file2";
+	EXPECT_TRUE(Find(drv, "FILE2", "TXT", "DIR")) << "All paths of a directory must be notified";
+	EXPECT_TRUE(Find(drv, "FILE2", "TXT", "LINK")) << "All paths of a directory must be notified";
+
+	// The remaining path must still be watched
+	drv.DeleteCache((const uint8_t *)"/DIR/");
+	EXPECT_NE(-1, link->GetWatch());
+	ofstream(folder / "DIR" / "FILE3.TXT") << "file3";
+	EXPECT_TRUE(Find(drv, "FILE3", "TXT", "LINK")) << "Files created on the host must be found";
+
+	remove_all(folder);
+}
+
+static string GetName(const string& prefix, int i, const string& extension)
+{
+	ostringstream s;
+	s << prefix << i << extension;
+	return s.str();
+}
+
+TEST(CFileSystemTest, DISABLED_Benchmark)
+{
+	const int FILE_COUNT = 20000;
+
+	vector<string> filenames;
+	for (int i = 0; i < FILE_COUNT; i++) {
+		// Half of the names have to be reduced to a Human68k name
+		filenames.push_back(i % 2 ? GetName("F", i, ".DAT") : GetName("long_file_name_", i, ".data"));
+	}
+	const path folder = CreateFolder(filenames);
+
+	CHostPath host_path;
+	auto start = chrono::steady_clock::now();
+	InitPath(host_path, folder);
+	auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	cout << "Initial refresh of " << FILE_COUNT << " files: " << duration << " ms\n";
+
+	start = chrono::steady_clock::now();
+	host_path.Refresh();
+	duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	cout << "Refresh of " << FILE_COUNT << " unchanged files: " << duration << " ms\n";
+
+	start = chrono::steady_clock::now();
+	for (int i = 1; i < FILE_COUNT; i += 2) {
+		EXPECT_NE(nullptr, host_path.FindFilename((const uint8_t *)GetName("F", i, ".DAT").c_str()));
+	}
+	duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+	cout << "Lookup of " << FILE_COUNT / 2 << " files: " << duration << " ms\n";
+
+	// Each wildcard search compares all names
+	for (const char *pattern : { "????????.???", "F1??????.DAT", "LONG_FIL????????????.???" }) {
+		start = chrono::steady_clock::now();
+		int count = 0;
+		for (int i = 0; i < 10; i++) {
+			CHostPath::find_t find = {};
+			while (host_path.FindFilenameWildcard((const uint8_t *)pattern, Human68k::AT_ALL, &find)) {
+				count++;
+			}
+		}
+		duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+		cout << "10 wildcard searches for " << pattern << " (" << count / 10 << " matches): " << duration << " ms\n";
+	}
+
+	remove_all(folder);
+}
+
+TEST(CFileSystemTest, HostFcbReadWrite)
+{
+	const path folder = CreateFolder({});
+	const string filename = (folder / "file").string();
+
+	CHostFcb fcb;
+	fcb.SetFilename(filename.c_str());
+	EXPECT_TRUE(fcb.SetMode(Human68k::OP_FULL));
+	EXPECT_TRUE(fcb.Create(0, true));
+
+	// Small writes are collected, large writes are written directly
+	vector<uint8_t> data(200000);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = static_cast<uint8_t>(i * 7);
+	}
+	EXPECT_EQ(100U, fcb.Write(data.data(), 100));
+	EXPECT_EQ(900U, fcb.Write(data.data() + 100, 900));
+	EXPECT_EQ(199000U, fcb.Write(data.data() + 1000, 199000));
+	EXPECT_EQ(200000U, fcb.Seek(0, Human68k::seek_t::SK_END)) << "The size must include the collected data";
+	EXPECT_EQ(100U, fcb.Seek(100, Human68k::seek_t::SK_BEGIN));
+	EXPECT_EQ(10U, fcb.Write(data.data(), 10));
+	EXPECT_EQ(10U, fcb.Seek(-100, Human68k::seek_t::SK_CURRENT));
+
+	// Small reads are served from the read-ahead data
+	vector<uint8_t> buf(data.size());
+	EXPECT_EQ(0U, fcb.Seek(0, Human68k::seek_t::SK_BEGIN));
+	uint32_t offset = 0;
+	while (offset < buf.size()) {
+		const uint32_t count = fcb.Read(buf.data() + offset, offset < 100000 ? 1000 : 70000);
+		ASSERT_NE(static_cast<uint32_t>(-1), count);
+		if (!count) {
+			break;
+		}
+		offset += count;
+	}
+	EXPECT_EQ(data.size(), offset);
+	memcpy(data.data() + 100, data.data(), 10);
+	EXPECT_EQ(data, buf);
+
+	EXPECT_EQ(static_cast<uint32_t>(-1), fcb.Seek(-1, Human68k::seek_t::SK_BEGIN));
+	EXPECT_EQ(0U, fcb.Seek(0, Human68k::seek_t::SK_BEGIN));
+	EXPECT_EQ(static_cast<uint32_t>(-1), fcb.Seek(-1, Human68k::seek_t::SK_CURRENT));
+
+	EXPECT_EQ(1000U, fcb.Seek(1000, Human68k::seek_t::SK_BEGIN));
+	EXPECT_EQ(1U, fcb.Write(data.data(), 1));
+	EXPECT_TRUE(fcb.Truncate());
+	fcb.Close();
+	EXPECT_EQ(1001U, file_size(folder / "file"));
+
+	fcb.SetMode(Human68k::OP_READ);
+	EXPECT_TRUE(fcb.Open());
+	EXPECT_EQ(static_cast<uint32_t>(-1), fcb.Write(data.data(), 1)) << "Read-only files must not be written";
+	fcb.Close();
+
+	remove_all(folder);
+}
+
+TEST(CFileSystemTest, HostFcbManager)
+{
+	CHostFcbManager manager;
+	manager.Init();
+
+	// There is no fixed limit for the number of open files
+	for (uint32_t key = 1; key <= 1000; key++) {
+		CHostFcb *fcb = manager.Alloc(key);
+		ASSERT_NE(nullptr, fcb);
+		EXPECT_TRUE(fcb->isSameKey(key));
+	}
+	EXPECT_EQ(1000U, manager.GetCount());
+
+	for (uint32_t key = 1; key <= 1000; key += 2) {
+		CHostFcb *fcb = manager.Search(key);
+		ASSERT_NE(nullptr, fcb);
+		EXPECT_TRUE(fcb->isSameKey(key));
+		fcb->SetUpdate();
+		manager.Free(fcb);
+	}
+	EXPECT_EQ(500U, manager.GetCount());
+	EXPECT_EQ(nullptr, manager.Search(1));
+	EXPECT_NE(nullptr, manager.Search(2));
+
+	CHostFcb *fcb = manager.Alloc(1);
+	ASSERT_NE(nullptr, fcb);
+	EXPECT_FALSE(fcb->isUpdate()) << "Re-used FCBs must be reset";
+
+	manager.Clean();
+	EXPECT_EQ(0U, manager.GetCount());
+	EXPECT_EQ(nullptr, manager.Search(2));
+}
+
+TEST(CFileSystemTest, HostFilesManager)
+{
+	CHostFilesManager manager;
+	manager.Init();
+
+	for (uint32_t key = 1; key <= XM6_HOST_FILES_MAX; key++) {
+		EXPECT_NE(nullptr, manager.Alloc(key));
+	}
+	EXPECT_EQ(static_cast<size_t>(XM6_HOST_FILES_MAX), manager.GetCount());
+
+	// The least recently used search is re-used
+	EXPECT_NE(nullptr, manager.Search(1));
+	EXPECT_NE(nullptr, manager.Alloc(XM6_HOST_FILES_MAX + 1));
+	EXPECT_EQ(static_cast<size_t>(XM6_HOST_FILES_MAX), manager.GetCount());
+	EXPECT_NE(nullptr, manager.Search(1));
+	EXPECT_EQ(nullptr, manager.Search(2));
+	EXPECT_NE(nullptr, manager.Search(XM6_HOST_FILES_MAX + 1));
+
+	manager.Free(manager.Search(1));
+	EXPECT_EQ(nullptr, manager.Search(1));
+	EXPECT_EQ(static_cast<size_t>(XM6_HOST_FILES_MAX - 1), manager.GetCount());
+
+	manager.Clean();
+}
+
+TEST(CFileSystemTest, DISABLED_HostFcbBenchmark)
+{
+	const path folder = CreateFolder({});
+	const string filename = (folder / "file").string();
+	const uint32_t FILE_SIZE = 64 * 1024 * 1024;
+
+	vector<uint8_t> buf(1024 * 1024);
+
+	for (const uint32_t chunk_size : { 1024, 1024 * 1024 }) {
+		CHostFcb fcb;
+		fcb.SetFilename(filename.c_str());
+		fcb.SetMode(Human68k::OP_FULL);
+		fcb.Create(0, true);
+
+		auto start = chrono::steady_clock::now();
+		for (uint32_t offset = 0; offset < FILE_SIZE; offset += chunk_size) {
+			fcb.Write(buf.data(), chunk_size);
+		}
+		fcb.Close();
+		auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+		cout << "Writing " << FILE_SIZE / 1024 / 1024 << " MiB in chunks of " << chunk_size << " bytes: "
+				<< duration << " ms\n";
+
+		fcb.SetMode(Human68k::OP_READ);
+		fcb.Open();
+		start = chrono::steady_clock::now();
+		while (fcb.Read(buf.data(), chunk_size) == chunk_size) {
+			// Read until the end of the file
+		}
+		fcb.Close();
+		duration = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+		cout << "Reading " << FILE_SIZE / 1024 / 1024 << " MiB in chunks of " << chunk_size << " bytes: "
+				<< duration << " ms\n";
+	}
+
+	remove_all(folder);
+}
+
+static void InitFileSys(CFileSys& fs, const path& folder)
+{
+	Human68k::argument_t argument = {};
+	const string base = folder.string();
+	memcpy(&argument.buf[1], base.c_str(), base.size());
+	fs.InitDevice(&argument);
+}
+
+static Human68k::namests_t GetWildcard()
+{
+	Human68k::namests_t namests = {};
+	namests.path[0] = 0x09;
+	memset(namests.name, '?', sizeof(namests.name));
+	memset(namests.ext, '?', sizeof(namests.ext));
+	return namests;
+}
+
+static Human68k::files_t GetFiles()
+{
+	Human68k::files_t files = {};
+	files.fatr = Human68k::AT_ARCHIVE;
+	return files;
+}
+
+TEST(CFileSystemTest, NFilesBatch)
+{
+	const uint32_t KEY = 0x1000;
+
+	vector<string> filenames;
+	for (int i = 0; i < 10; i++) {
+		filenames.push_back(GetName("FILE", i, ".TXT"));
+	}
+	const path folder = CreateFolder(filenames);
+
+	CFileSys fs;
+	InitFileSys(fs, folder);
+	const Human68k::namests_t namests = GetWildcard();
+
+	set<string> classic;
+	Human68k::files_t files = GetFiles();
+	EXPECT_EQ(0, fs.Files(0, KEY, &namests, &files));
+	do {
+		classic.insert((const char *)files.full);
+	} while (!fs.NFiles(0, KEY, &files));
+	EXPECT_EQ(10U, classic.size());
+
+	set<string> batched;
+	files = GetFiles();
+	EXPECT_EQ(0, fs.Files(0, KEY, &namests, &files));
+	batched.insert((const char *)files.full);
+
+	array<Human68k::files_t, 4> results;
+	EXPECT_EQ(4, fs.NFilesBatch(0, KEY, 1, &files, results.data(), 4));
+	EXPECT_EQ(KEY, results[0].sector);
+	EXPECT_EQ(Human68k::AT_ARCHIVE, results[0].fatr);
+	const string first = (const char *)results[0].full;
+	EXPECT_EQ(4, fs.NFilesBatch(0, KEY, 1, &files, results.data(), 4)) << "The previous batch must be repeatable";
+	EXPECT_EQ(first, (const char *)results[0].full);
+	EXPECT_EQ(FS_INVALIDPRM, fs.NFilesBatch(0, KEY, 2, &files, results.data(), 4));
+	for (const auto& r : results) {
+		batched.insert((const char *)r.full);
+	}
+
+	EXPECT_EQ(4, fs.NFilesBatch(0, KEY, 5, &files, results.data(), 4));
+	for (const auto& r : results) {
+		batched.insert((const char *)r.full);
+	}
+	EXPECT_EQ(1, fs.NFilesBatch(0, KEY, 9, &files, results.data(), 4));
+	batched.insert((const char *)results[0].full);
+	EXPECT_EQ(FS_FILENOTFND, fs.NFilesBatch(0, KEY, 10, &files, results.data(), 4));
+	EXPECT_EQ(FS_INVALIDPTR, fs.NFilesBatch(0, KEY, 10, &files, results.data(), 4)) << "The search must have ended";
+
+	EXPECT_EQ(classic, batched);
+
+	fs.Reset();
+	remove_all(folder);
+}
+
+TEST(CFileSystemTest, DISABLED_NFilesBenchmark)
+{
+	const int FILE_COUNT = 5000;
+	const uint32_t KEY = 0x1000;
+
+	vector<string> filenames;
+	for (int i = 0; i < FILE_COUNT; i++) {
+		filenames.push_back(GetName("F", i, ".DAT"));
+	}
+	const path folder = CreateFolder(filenames);
+
+	CFileSys fs;
+	InitFileSys(fs, folder);
+	const Human68k::namests_t namests = GetWildcard();
+
+	// Only the host side is measured, each call is one command on the bus
+	Human68k::files_t files = GetFiles();
+	auto start = chrono::steady_clock::now();
+	int calls = 1;
+	EXPECT_EQ(0, fs.Files(0, KEY, &namests, &files));
+	while (!fs.NFiles(0, KEY, &files)) {
+		calls++;
+	}
+	auto duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+	cout << "Listing " << FILE_COUNT << " files with $47/$48: " << calls << " calls, " << duration << " us\n";
+
+	// 0x10000 bytes of option data per transfer
+	vector<Human68k::files_t> results(0x10000 / sizeof(Human68k::files_t));
+	files = GetFiles();
+	start = chrono::steady_clock::now();
+	calls = 1;
+	EXPECT_EQ(0, fs.Files(0, KEY, &namests, &files));
+	uint32_t cursor = 1;
+	int count;
+	while ((count = fs.NFilesBatch(0, KEY, cursor, &files, results.data(), static_cast<uint32_t>(results.size()))) > 0) {
+		cursor += count;
+		calls++;
+	}
+	duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+	cout << "Listing " << cursor << " files with $47/$59: " << calls << " calls, " << duration << " us\n";
+
+	fs.Reset();
+	remove_all(folder);
+}
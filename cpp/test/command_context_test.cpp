@@ -116,6 +116,28 @@ TEST(CommandContext, WriteSuccessResult)
 	EXPECT_TRUE(result.status());
 }
 
+TEST(CommandContext, WriteSuccessResultWithField)
+{
+	const string filename = CreateTempFile(0);
+	int fd = open(filename.c_str(), O_RDWR | O_APPEND);
+	PbMappingInfo mapping_info;
+	(*mapping_info.mutable_mapping())["hds"] = SCHD;
+	PbResult result;
+	CommandContext context(fd);
+	EXPECT_TRUE(context.WriteSuccessResult(result, PbResult::kMappingInfoFieldNumber,
+			mapping_info.SerializeAsString()));
+	close(fd);
+	EXPECT_TRUE(result.status());
+	EXPECT_FALSE(result.has_mapping_info());
+
+	fd = open(filename.c_str(), O_RDONLY);
+	PbResult written_result;
+	DeserializeMessage(fd, written_result);
+	close(fd);
+	EXPECT_TRUE(written_result.status());
+	EXPECT_EQ(SCHD, written_result.mapping_info().mapping().at("hds"));
+}
+
 TEST(CommandContext, ReturnLocalizedError)
 {
 	PbCommand command;
@@ -0,0 +1,93 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "devices/crc32.h"
+#include <vector>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+using namespace crc32_util;
+
+static const vector<crc32_implementation> IMPLEMENTATIONS = { crc32_implementation::bitwise,
+		crc32_implementation::slicing_by_8, crc32_implementation::arm, crc32_implementation::pclmul };
+
+TEST(Crc32Test, Crc32)
+{
+	const string data = "123456789";
+	for (const auto implementation : IMPLEMENTATIONS) {
+		if (IsSupported(implementation)) {
+			EXPECT_EQ(0xcbf43926, Crc32(span(reinterpret_cast<const uint8_t *>(data.data()), data.size()),
+					implementation)) << GetImplementationName(implementation);
+			EXPECT_EQ(0, Crc32(span<const uint8_t>(), implementation)) << GetImplementationName(implementation);
+		}
+	}
+}
+
+TEST(Crc32Test, CompareImplementations)
+{
+	vector<uint8_t> data(4096);
+	mt19937 generator(0);
+	ranges::generate(data, [&generator] { return static_cast<uint8_t>(generator()); });
+
+	for (size_t length = 0; length < data.size(); length += length < 200 ? 1 : 61) {
+		// Test both aligned and unaligned data, the 32-bit ARM implementation processes words
+		for (const size_t offset : { 0, 1, 2, 3 }) {
+			const auto d = span(data.data() + offset, min(length, data.size() - offset));
+			const uint32_t expected = Crc32(d, crc32_implementation::bitwise);
+			for (const auto implementation : IMPLEMENTATIONS) {
+				if (IsSupported(implementation)) {
+					EXPECT_EQ(expected, Crc32(d, implementation)) << GetImplementationName(implementation)
+							<< ", length " << d.size();
+				}
+			}
+		}
+	}
+}
+
+TEST(Crc32Test, GetImplementation)
+{
+	EXPECT_TRUE(IsSupported(GetImplementation()));
+	EXPECT_NE(crc32_implementation::bitwise, GetImplementation());
+
+#if defined(__aarch64__) || defined(__arm__)
+	// Also with the ARMv6 build of the 32-bit Raspberry Pi OS the CRC32 instructions are used if there are any
+	EXPECT_EQ(IsSupported(crc32_implementation::arm), GetImplementation() == crc32_implementation::arm);
+#endif
+}
+
+// Microbenchmark, run with --gtest_also_run_disabled_tests --gtest_filter=Crc32Test.*
+TEST(Crc32Test, DISABLED_Benchmark)
+{
+	const int FRAME_COUNT = 100'000;
+
+	// A full Ethernet frame
+	vector<uint8_t> frame(1514);
+	ranges::generate(frame, [n = 0] () mutable { return static_cast<uint8_t>(n++); });
+
+	for (const auto implementation : IMPLEMENTATIONS) {
+		if (!IsSupported(implementation)) {
+			continue;
+		}
+
+		uint32_t crc = 0;
+		const auto start = chrono::steady_clock::now();
+		for (int i = 0; i < FRAME_COUNT; i++) {
+			frame[0] = static_cast<uint8_t>(i);
+			crc ^= Crc32(frame, implementation);
+		}
+		const auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+		cout << GetImplementationName(implementation) << ": " << us * 1000 / FRAME_COUNT << " ns per frame, "
+				<< static_cast<double>(frame.size()) * FRAME_COUNT / static_cast<double>(max<int64_t>(us, 1)) << " MB/s (" << hex << crc << dec
+				<< ")\n";
+	}
+}
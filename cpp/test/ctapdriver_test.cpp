@@ -10,6 +10,9 @@
 #include "mocks.h"
 #include <net/ethernet.h>
 #include "devices/ctapdriver.h"
+#include "devices/loopback_backend.h"
+#include <chrono>
+#include <thread>
 
 TEST(CTapDriverTest, Crc32)
 {
@@ -40,3 +43,62 @@ TEST(CTapDriverTest, Crc32)
 	}
 	EXPECT_EQ(0xe7870705, CTapDriver::Crc32(span(buf.data(), ETH_FRAME_LEN)));
 }
+
+TEST(CTapDriverTest, IsAccepted)
+{
+	CTapDriver tap;
+
+	array<uint8_t, ETH_FRAME_LEN> frame = {};
+	EXPECT_TRUE(tap.IsAccepted(frame)) << "Without filter all frames must be accepted";
+	EXPECT_FALSE(tap.IsAccepted(span(frame.data(), 5))) << "Frames without destination address must be rejected";
+
+	tap.SetFilter({ { 0x00, 0x80, 0x19, 0x10, 0x98, 0xe3 }, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff } });
+	EXPECT_FALSE(tap.IsAccepted(frame));
+	frame = { 0x00, 0x80, 0x19, 0x10, 0x98, 0xe3 };
+	EXPECT_TRUE(tap.IsAccepted(frame));
+	frame = { 0x00, 0x80, 0x19, 0x10, 0x98, 0xe4 };
+	EXPECT_FALSE(tap.IsAccepted(frame));
+	frame = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	EXPECT_TRUE(tap.IsAccepted(frame));
+
+	tap.SetFilter({});
+	frame = { 0x00, 0x80, 0x19, 0x10, 0x98, 0xe4 };
+	EXPECT_TRUE(tap.IsAccepted(frame));
+}
+
+TEST(CTapDriverTest, Loopback)
+{
+	auto [backend, peer] = LoopbackBackend::CreatePair();
+
+	CTapDriver tap;
+	tap.SetBackend(move(backend));
+	EXPECT_TRUE(tap.Init({}));
+	EXPECT_FALSE(tap.HasPendingPackets());
+
+	const vector<uint8_t> frame = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 1, 2, 3, 4, 5, 6 };
+	peer->Write(frame);
+	for (int i = 0; i < 1000 && !tap.HasPendingPackets(); i++) {
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	EXPECT_TRUE(tap.HasPendingPackets());
+
+	array<uint8_t, ETH_FRAME_LEN + ETH_FCS_LEN> buf;
+	EXPECT_EQ(static_cast<int>(frame.size()) + 4, tap.Receive(buf.data())) << "The CRC must have been appended";
+	EXPECT_TRUE(equal(frame.begin(), frame.end(), buf.begin()));
+	const uint32_t crc = CTapDriver::Crc32(frame);
+	EXPECT_EQ(crc & 0xff, buf[frame.size()]);
+	EXPECT_EQ(crc >> 24, buf[frame.size() + 3]);
+	EXPECT_FALSE(tap.HasPendingPackets());
+
+	EXPECT_EQ(static_cast<int>(frame.size()), tap.Send(frame.data(), static_cast<int>(frame.size())));
+	EXPECT_EQ(static_cast<int>(frame.size()), peer->Read(buf, 1000));
+	EXPECT_TRUE(equal(frame.begin(), frame.end(), buf.begin()));
+
+	const vector<uint8_t> oversized_frame(2048);
+	EXPECT_EQ(-1, tap.Send(oversized_frame.data(), static_cast<int>(oversized_frame.size())));
+	EXPECT_EQ(1, tap.GetDroppedSendFrameCount());
+	EXPECT_EQ(static_cast<int>(frame.size()), tap.Send(frame.data(), static_cast<int>(frame.size())));
+	EXPECT_EQ(static_cast<int>(frame.size()), peer->Read(buf, 1000)) << "Oversized frames must not be sent";
+
+	tap.CleanUp();
+}
@@ -823,6 +823,9 @@ TEST(DiskTest, ConfiguredSectorSize)
 
 	EXPECT_FALSE(disk.SetConfiguredSectorSize(device_factory, 1234));
 	EXPECT_EQ(512, disk.GetConfiguredSectorSize());
+
+	EXPECT_TRUE(disk.SetConfiguredSectorSize(device_factory, 0));
+	EXPECT_EQ(0, disk.GetConfiguredSectorSize());
 }
 
 TEST(DiskTest, BlockCount)
@@ -18,6 +18,7 @@
 #include "devices/scsicd.h"
 #include "devices/scsimo.h"
 #include "devices/host_services.h"
+#include "devices/trace_log.h"
 #include "piscsi/piscsi_executor.h"
 #include <fcntl.h>
 
@@ -199,6 +200,7 @@ class MockScsiController : public ScsiController
 	FRIEND_TEST(ScsiControllerTest, DataOut);
 	FRIEND_TEST(ScsiControllerTest, Error);
 	FRIEND_TEST(ScsiControllerTest, RequestSense);
+	FRIEND_TEST(ScsiControllerTest, XferOutDaynaPort);
 	FRIEND_TEST(PrimaryDeviceTest, RequestSense);
 
 public:
@@ -414,3 +416,8 @@ public:
 
 	using PiscsiExecutor::PiscsiExecutor;
 };
+
+class MockTraceLog : public TraceLog
+{
+	FRIEND_TEST(TraceLogTest, Dropped);
+};
@@ -0,0 +1,108 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "mocks.h"
+#include "test_shared.h"
+#include "devices/loopback_backend.h"
+#include "devices/pcap_backend.h"
+#include "devices/tap_backend.h"
+#include <fstream>
+#include <unistd.h>
+
+TEST(PacketBackendTest, Loopback)
+{
+	auto [a, b] = LoopbackBackend::CreatePair();
+	EXPECT_EQ("loopback", a->GetName());
+
+	array<uint8_t, 64> buf = {};
+	EXPECT_EQ(0, b->Read(buf, 0)) << "No frame must be available";
+
+	const vector<uint8_t> frame = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	EXPECT_EQ(8, a->Write(frame));
+	EXPECT_EQ(0, a->Read(buf, 0)) << "A frame must not be returned to the sender";
+	EXPECT_EQ(8, b->Read(buf, 0));
+	EXPECT_TRUE(equal(frame.begin(), frame.end(), buf.begin()));
+
+	EXPECT_EQ(8, b->Write(frame));
+	EXPECT_EQ(8, a->Read(buf, 0));
+	EXPECT_EQ(0, b->Read(buf, 0));
+
+	// Truncated
+	EXPECT_EQ(8, a->Write(frame));
+	EXPECT_EQ(4, b->Read(span(buf.data(), 4), 0));
+}
+
+TEST(PacketBackendTest, Pcap)
+{
+	const path filename = CreateTempFile(0);
+
+	const vector<uint8_t> frame1 = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 1, 2, 3 };
+	const vector<uint8_t> frame2 = { 0x00, 0x80, 0x19, 0x10, 0x98, 0xe3, 4, 5, 6, 7 };
+
+	auto capture = make_unique<PcapBackend>();
+	EXPECT_TRUE(capture->Open("", filename));
+	EXPECT_EQ("pcap", capture->GetName());
+	EXPECT_TRUE(capture->IsReplayDone());
+	array<uint8_t, 64> buf;
+	EXPECT_EQ(0, capture->Read(buf, 0)) << "There must be nothing to replay";
+	EXPECT_EQ(static_cast<int>(frame1.size()), capture->Write(frame1));
+	EXPECT_EQ(static_cast<int>(frame2.size()), capture->Write(frame2));
+	capture.reset();
+
+	EXPECT_EQ(24 + 16 + frame1.size() + 16 + frame2.size(), file_size(filename));
+
+	PcapBackend replay;
+	EXPECT_TRUE(replay.Open(filename, ""));
+	EXPECT_FALSE(replay.IsReplayDone());
+	EXPECT_EQ(static_cast<int>(frame1.size()), replay.Read(buf, 0));
+	EXPECT_TRUE(equal(frame1.begin(), frame1.end(), buf.begin()));
+	EXPECT_EQ(static_cast<int>(frame2.size()), replay.Read(buf, 0));
+	EXPECT_TRUE(equal(frame2.begin(), frame2.end(), buf.begin()));
+	EXPECT_EQ(0, replay.Read(buf, 0));
+	EXPECT_TRUE(replay.IsReplayDone());
+	EXPECT_EQ(2, replay.GetReplayedFrameCount());
+
+	// A corrupt record length stops the replay
+	fstream corrupt(filename, ios::binary | ios::in | ios::out);
+	corrupt.seekp(24 + 16 + frame1.size() + 8);
+	const uint32_t length = 0x7fffffff;
+	corrupt.write((const char *)&length, sizeof(length));
+	corrupt.close();
+	PcapBackend corrupt_replay;
+	EXPECT_TRUE(corrupt_replay.Open(filename, ""));
+	EXPECT_EQ(static_cast<int>(frame1.size()), corrupt_replay.Read(buf, 0));
+	EXPECT_EQ(0, corrupt_replay.Read(buf, 0));
+	EXPECT_TRUE(corrupt_replay.IsReplayDone());
+	EXPECT_EQ(1, corrupt_replay.GetReplayedFrameCount());
+
+	ofstream out(filename, ios::binary | ios::trunc);
+	out << "not a pcap file";
+	out.close();
+	PcapBackend invalid;
+	EXPECT_FALSE(invalid.Open(filename, ""));
+
+	remove(filename);
+
+	PcapBackend missing;
+	EXPECT_FALSE(missing.Open(filename, ""));
+}
+
+TEST(PacketBackendTest, TapReadError)
+{
+	array<int, 2> fds;
+	ASSERT_EQ(0, pipe(fds.data()));
+	TapBackend backend(fds[0]);
+	array<uint8_t, 16> buf;
+
+	EXPECT_EQ(0, backend.Read(buf, 0)) << "No frame must be available";
+	close(fds[1]);
+	EXPECT_EQ(-1, backend.Read(buf, 0)) << "A hangup without data must be reported as an error";
+	close(fds[0]);
+	EXPECT_EQ(-1, backend.Read(buf, 0)) << "An invalid descriptor must be reported as an error";
+}
@@ -0,0 +1,137 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "mocks.h"
+#include "test_shared.h"
+#include "devices/packet_capture.h"
+#include <fstream>
+#include <cstring>
+
+struct pcapng_block
+{
+	uint32_t type;
+	vector<uint8_t> body;
+};
+
+static vector<pcapng_block> ReadBlocks(const path& filename)
+{
+	vector<pcapng_block> blocks;
+
+	ifstream in(filename, ios::binary);
+	uint32_t header[2];
+	while (in.read((char *)header, sizeof(header))) {
+		pcapng_block block = { .type = header[0], .body = vector<uint8_t>(header[1] - 12) };
+		in.read((char *)block.body.data(), block.body.size());
+		uint32_t trailer;
+		in.read((char *)&trailer, sizeof(trailer));
+		EXPECT_EQ(header[1], trailer);
+		blocks.push_back(block);
+	}
+
+	return blocks;
+}
+
+static uint32_t GetUInt32(const vector<uint8_t>& body, int offset)
+{
+	uint32_t value;
+	memcpy(&value, body.data() + offset, sizeof(value));
+	return value;
+}
+
+TEST(PacketCaptureTest, GetRotatedFilename)
+{
+	EXPECT_EQ("capture.pcapng", PacketCapture::GetRotatedFilename("capture.pcapng", 0));
+	EXPECT_EQ("capture.pcapng.2", PacketCapture::GetRotatedFilename("capture.pcapng", 2));
+}
+
+TEST(PacketCaptureTest, Start)
+{
+	EXPECT_FALSE(PacketCapture::Start("").empty());
+	EXPECT_FALSE(PacketCapture::Start("capture.pcapng", 0).empty());
+	EXPECT_FALSE(PacketCapture::Start("capture.pcapng", PacketCapture::DEFAULT_MAX_FILE_SIZE, 0).empty());
+	EXPECT_FALSE(PacketCapture::Start("/non_existing_folder/capture.pcapng").empty());
+	EXPECT_FALSE(PacketCapture::IsRunning());
+}
+
+TEST(PacketCaptureTest, Capture)
+{
+	const path filename = CreateTempFile(0);
+
+	const vector<uint8_t> frame1 = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 1, 2, 3 };
+	const vector<uint8_t> frame2 = { 0x00, 0x80, 0x19, 0x10, 0x98, 0xe3, 4, 5, 6, 7 };
+
+	PacketCapture::Capture(1, 0, PacketCapture::direction::inbound, frame1);
+
+	EXPECT_EQ("", PacketCapture::Start(filename));
+	EXPECT_TRUE(PacketCapture::IsRunning());
+	PacketCapture::Capture(1, 0, PacketCapture::direction::inbound, frame1);
+	PacketCapture::Capture(1, 0, PacketCapture::direction::outbound, frame2);
+	PacketCapture::Capture(2, 0, PacketCapture::direction::outbound, frame2);
+	PacketCapture::Stop();
+	EXPECT_FALSE(PacketCapture::IsRunning());
+
+	const auto& blocks = ReadBlocks(filename);
+	ASSERT_EQ(6, blocks.size());
+	EXPECT_EQ(0x0a0d0d0a, blocks[0].type);
+	EXPECT_EQ(0x1a2b3c4d, GetUInt32(blocks[0].body, 0));
+	EXPECT_EQ(1, blocks[1].type);
+	EXPECT_EQ(6, blocks[2].type);
+	EXPECT_EQ(0, GetUInt32(blocks[2].body, 0));
+	EXPECT_EQ(frame1.size(), GetUInt32(blocks[2].body, 12));
+	EXPECT_TRUE(equal(frame1.begin(), frame1.end(), blocks[2].body.begin() + 20));
+	EXPECT_EQ(6, blocks[3].type);
+	EXPECT_EQ(0, GetUInt32(blocks[3].body, 0));
+	EXPECT_EQ(frame2.size(), GetUInt32(blocks[3].body, 12));
+	EXPECT_TRUE(equal(frame2.begin(), frame2.end(), blocks[3].body.begin() + 20));
+	EXPECT_EQ(1, blocks[4].type) << "Each device must have its own interface";
+	EXPECT_EQ(6, blocks[5].type);
+	EXPECT_EQ(1, GetUInt32(blocks[5].body, 0));
+
+	remove(filename);
+}
+
+TEST(PacketCaptureTest, Rotate)
+{
+	const path filename = CreateTempFile(0);
+	const path rotated = PacketCapture::GetRotatedFilename(filename, 1);
+
+	const vector<uint8_t> frame(1500);
+
+	EXPECT_EQ("", PacketCapture::Start(filename, 8192, 2));
+	for (int i = 0; i < 16; i++) {
+		PacketCapture::Capture(0, 0, PacketCapture::direction::inbound, frame);
+	}
+	PacketCapture::Stop();
+
+	EXPECT_TRUE(exists(rotated));
+	EXPECT_FALSE(exists(PacketCapture::GetRotatedFilename(filename, 2))) << "Only 2 files must be kept";
+	EXPECT_GE(8192, file_size(filename));
+	EXPECT_GE(8192, file_size(rotated));
+
+	remove(filename);
+	remove(rotated);
+}
+
+TEST(PacketCaptureTest, TruncatedFrame)
+{
+	const path filename = CreateTempFile(0);
+
+	const vector<uint8_t> frame(4000);
+
+	EXPECT_EQ("", PacketCapture::Start(filename));
+	PacketCapture::Capture(0, 0, PacketCapture::direction::inbound, frame);
+	PacketCapture::Stop();
+
+	const auto& blocks = ReadBlocks(filename);
+	ASSERT_EQ(3, blocks.size());
+	EXPECT_EQ(2048, GetUInt32(blocks[2].body, 12)) << "Wrong captured length";
+	EXPECT_EQ(4000, GetUInt32(blocks[2].body, 16)) << "Wrong original length";
+
+	remove(filename);
+}
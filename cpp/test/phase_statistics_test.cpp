@@ -0,0 +1,71 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "controllers/phase_statistics.h"
+
+TEST(PhaseStatisticsTest, GetBucket)
+{
+	EXPECT_EQ(0, PhaseStatistics::GetBucket(0));
+	EXPECT_EQ(0, PhaseStatistics::GetBucket(15));
+	EXPECT_EQ(1, PhaseStatistics::GetBucket(16));
+	EXPECT_EQ(1, PhaseStatistics::GetBucket(31));
+	EXPECT_EQ(2, PhaseStatistics::GetBucket(32));
+	EXPECT_EQ(PhaseStatistics::BUCKET_COUNT - 1, PhaseStatistics::GetBucket(0xffffffff));
+}
+
+TEST(PhaseStatisticsTest, GetStatistics)
+{
+	const int ID = 2;
+	const int LUN = 1;
+
+	PhaseStatistics statistics;
+
+	EXPECT_TRUE(statistics.GetStatistics(ID, LUN).empty());
+
+	// Without a command nothing is recorded
+	statistics.EnterPhase(phase_t::selection, 1000);
+	statistics.EnterPhase(phase_t::busfree, 1010);
+	EXPECT_TRUE(statistics.GetStatistics(ID, LUN).empty());
+
+	statistics.EnterPhase(phase_t::selection, 1000);
+	statistics.EnterPhase(phase_t::command, 1010);
+	statistics.AddBytes(phase_t::command, 10);
+	statistics.SetCommand(LUN, static_cast<int>(scsi_command::eCmdRead10));
+	statistics.EnterPhase(phase_t::datain, 1020);
+	statistics.AddBytes(phase_t::datain, 512);
+	statistics.AddBytes(phase_t::datain, 512);
+	statistics.EnterPhase(phase_t::status, 1100);
+	statistics.EnterPhase(phase_t::msgin, 1105);
+	statistics.EnterPhase(phase_t::busfree, 1110);
+	EXPECT_TRUE(statistics.GetStatistics(ID, 0).empty()) << "Statistics must be separated by LUN";
+
+	const auto& s = statistics.GetStatistics(ID, LUN);
+	EXPECT_EQ(7, s.size());
+
+	const auto& datain = ranges::find_if(s, [] (const auto& e) { return e.key() == "latency_datain_Read10"; });
+	EXPECT_NE(s.end(), datain);
+	EXPECT_EQ(ID, datain->id());
+	EXPECT_EQ(LUN, datain->unit());
+	EXPECT_EQ(1, datain->value());
+	EXPECT_EQ(PhaseStatistics::BUCKET_COUNT, datain->histogram_size());
+	EXPECT_EQ(1, datain->histogram(PhaseStatistics::GetBucket(80)));
+
+	const auto& bytes = ranges::find_if(s, [] (const auto& e) { return e.key() == "datain_byte_count"; });
+	EXPECT_NE(s.end(), bytes);
+	EXPECT_EQ(1024, bytes->value());
+
+	statistics.EnterPhase(phase_t::selection, 2000);
+	statistics.SetCommand(LUN, static_cast<int>(scsi_command::eCmdRead10));
+	statistics.Reset();
+	statistics.EnterPhase(phase_t::busfree, 2010);
+	const auto& s_reset = statistics.GetStatistics(ID, LUN);
+	EXPECT_EQ(1, ranges::find_if(s_reset, [] (const auto& e) { return e.key() == "latency_selection_Read10"; })->value())
+			<< "A reset command must not be recorded";
+}
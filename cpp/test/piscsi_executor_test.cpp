@@ -166,6 +166,333 @@ TEST(PiscsiExecutorTest, ProcessCmd)
 	EXPECT_FALSE(executor->ProcessCmd(context_attach2)) << "LUN 0 is missing";
 }
 
+TEST(PiscsiExecutorTest, ProcessBatch)
+{
+	const int ID = 3;
+
+	auto bus = make_shared<MockBus>();
+	ControllerManager controller_manager;
+	auto executor = make_shared<MockPiscsiExecutor>(*bus, controller_manager);
+
+	PbCommand batch;
+	batch.set_operation(BATCH);
+	CommandContext context_empty(batch, "", "");
+	EXPECT_TRUE(executor->ProcessCmd(context_empty)) << "An empty batch must succeed";
+
+	auto command1 = batch.add_commands();
+	command1->set_operation(ATTACH);
+	auto device1 = command1->add_devices();
+	device1->set_type(SCHS);
+	device1->set_id(ID);
+	auto device2 = command1->add_devices();
+	device2->set_type(SCLP);
+	device2->set_id(ID);
+	device2->set_unit(1);
+	auto command2 = batch.add_commands();
+	command2->set_operation(LOG_LEVEL);
+	CommandContext context_invalid(batch, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_invalid)) << "Operation is not supported in a batch";
+	EXPECT_TRUE(controller_manager.GetAllDevices().empty());
+
+	command2->set_operation(ATTACH);
+	auto device3 = command2->add_devices();
+	device3->set_type(SCHS);
+	device3->set_id(ID);
+	CommandContext context_duplicate(batch, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_duplicate)) << "Duplicate ID and LUN must be rejected";
+	EXPECT_TRUE(controller_manager.GetAllDevices().empty());
+
+	device3->set_id(ID + 1);
+	device3->set_unit(1);
+	CommandContext context_lun0(batch, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_lun0)) << "LUN 0 is missing";
+	EXPECT_TRUE(controller_manager.GetAllDevices().empty()) << "No command must be executed if validation fails";
+
+	device3->set_unit(0);
+	CommandContext context_attach(batch, "", "");
+	EXPECT_TRUE(executor->ProcessCmd(context_attach));
+	EXPECT_EQ(3, controller_manager.GetAllDevices().size());
+
+	PbCommand batch_detach;
+	batch_detach.set_operation(BATCH);
+	auto command3 = batch_detach.add_commands();
+	command3->set_operation(DETACH);
+	auto device4 = command3->add_devices();
+	device4->set_id(ID);
+	device4->set_unit(1);
+	auto command4 = batch_detach.add_commands();
+	command4->set_operation(DETACH);
+	auto device5 = command4->add_devices();
+	device5->set_id(ID + 1);
+	CommandContext context_detach(batch_detach, "", "");
+	EXPECT_TRUE(executor->ProcessCmd(context_detach));
+	EXPECT_EQ(1, controller_manager.GetAllDevices().size());
+	EXPECT_TRUE(controller_manager.HasDeviceForIdAndLun(ID, 0));
+}
+
+TEST(PiscsiExecutorTest, ProcessBatchWithAttachedDevices)
+{
+	const int ID = 4;
+
+	auto bus = make_shared<MockBus>();
+	ControllerManager controller_manager;
+	auto executor = make_shared<MockPiscsiExecutor>(*bus, controller_manager);
+
+	const path filename1 = CreateTempFile(4096);
+	const path filename2 = CreateTempFile(4096);
+
+	PbCommand batch;
+	batch.set_operation(BATCH);
+	auto command1 = batch.add_commands();
+	command1->set_operation(ATTACH);
+	auto device1 = command1->add_devices();
+	device1->set_type(SCHD);
+	device1->set_id(ID);
+	SetParam(*device1, "file", filename1.string());
+	auto device2 = command1->add_devices();
+	device2->set_type(SCCD);
+	device2->set_id(ID);
+	device2->set_unit(1);
+	auto command2 = batch.add_commands();
+	command2->set_operation(PROTECT);
+	auto device3 = command2->add_devices();
+	device3->set_id(ID);
+	auto command3 = batch.add_commands();
+	command3->set_operation(INSERT);
+	auto device4 = command3->add_devices();
+	device4->set_id(ID);
+	device4->set_unit(1);
+	SetParam(*device4, "file", "nonexisting_file");
+	CommandContext context_undo(batch, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_undo)) << "Inserting a non-existing file must fail";
+	EXPECT_TRUE(controller_manager.GetAllDevices().empty()) << "Attached devices must be detached again";
+	EXPECT_EQ(-1, StorageDevice::GetIdsForReservedFile(filename1.string()).first);
+
+	SetParam(*device4, "file", filename2.string());
+	CommandContext context_batch(batch, "", "");
+	EXPECT_TRUE(executor->ProcessCmd(context_batch)) << "Commands must be able to refer to devices attached before";
+	EXPECT_EQ(2, controller_manager.GetAllDevices().size());
+	EXPECT_TRUE(controller_manager.GetDeviceForIdAndLun(ID, 0)->IsProtected());
+	EXPECT_FALSE(controller_manager.GetDeviceForIdAndLun(ID, 1)->IsRemoved());
+	EXPECT_EQ(1, StorageDevice::GetIdsForReservedFile(filename2.string()).second);
+
+	PbCommand batch_detach;
+	batch_detach.set_operation(BATCH);
+	auto command4 = batch_detach.add_commands();
+	command4->set_operation(DETACH);
+	auto device5 = command4->add_devices();
+	device5->set_id(ID);
+	auto command5 = batch_detach.add_commands();
+	command5->set_operation(DETACH);
+	auto device6 = command5->add_devices();
+	device6->set_id(ID);
+	device6->set_unit(1);
+	CommandContext context_lun0(batch_detach, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_lun0)) << "LUN 0 must be detached last";
+	EXPECT_EQ(2, controller_manager.GetAllDevices().size());
+
+	device5->set_unit(1);
+	device6->set_unit(0);
+	auto command6 = batch_detach.add_commands();
+	command6->set_operation(UNPROTECT);
+	auto device7 = command6->add_devices();
+	device7->set_id(ID);
+	CommandContext context_detached(batch_detach, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_detached)) << "Commands must not refer to devices detached before";
+	EXPECT_EQ(2, controller_manager.GetAllDevices().size());
+
+	batch_detach.mutable_commands()->RemoveLast();
+	CommandContext context_detach(batch_detach, "", "");
+	EXPECT_TRUE(executor->ProcessCmd(context_detach));
+	EXPECT_TRUE(controller_manager.GetAllDevices().empty());
+
+	StorageDevice::UnreserveAll();
+
+	remove(filename1);
+	remove(filename2);
+}
+
+TEST(PiscsiExecutorTest, ProcessBatchWithRemovedDevices)
+{
+	const int ID = 5;
+
+	auto bus = make_shared<MockBus>();
+	ControllerManager controller_manager;
+	auto executor = make_shared<MockPiscsiExecutor>(*bus, controller_manager);
+
+	const path filename1 = CreateTempFile(4096);
+	const path filename2 = CreateTempFile(4096);
+
+	PbCommand attach;
+	attach.set_operation(ATTACH);
+	auto device1 = attach.add_devices();
+	device1->set_type(SCRM);
+	device1->set_id(ID);
+	SetParam(*device1, "file", filename1.string());
+	auto device2 = attach.add_devices();
+	device2->set_type(SCRM);
+	device2->set_id(ID);
+	device2->set_unit(1);
+	CommandContext context_attach(attach, "", "");
+	EXPECT_TRUE(executor->ProcessCmd(context_attach));
+
+	PbCommand batch;
+	batch.set_operation(BATCH);
+	auto command1 = batch.add_commands();
+	command1->set_operation(INSERT);
+	auto device3 = command1->add_devices();
+	device3->set_id(ID);
+	SetParam(*device3, "file", filename2.string());
+	CommandContext context_inserted(batch, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_inserted)) << "A medium must not be inserted twice";
+
+	batch.mutable_commands()->Clear();
+	auto command2 = batch.add_commands();
+	command2->set_operation(EJECT);
+	auto device4 = command2->add_devices();
+	device4->set_id(ID);
+	auto command3 = batch.add_commands();
+	command3->set_operation(INSERT);
+	auto device5 = command3->add_devices();
+	device5->set_id(ID);
+	SetParam(*device5, "file", filename1.string());
+	CommandContext context_reinsert(batch, "", "");
+	EXPECT_TRUE(executor->ProcessCmd(context_reinsert)) << "A medium ejected before must be insertable";
+	EXPECT_EQ(0, StorageDevice::GetIdsForReservedFile(filename1.string()).second);
+
+	// The commands already executed are undone when inserting a non-existing file fails
+	batch.mutable_commands()->Clear();
+	auto command4 = batch.add_commands();
+	command4->set_operation(INSERT);
+	auto device6 = command4->add_devices();
+	device6->set_id(ID);
+	device6->set_unit(1);
+	device6->set_block_size(1024);
+	device6->set_protected_(true);
+	SetParam(*device6, "file", filename2.string());
+	auto command5 = batch.add_commands();
+	command5->set_operation(EJECT);
+	auto device7 = command5->add_devices();
+	device7->set_id(ID);
+	auto command6 = batch.add_commands();
+	command6->set_operation(INSERT);
+	auto device8 = command6->add_devices();
+	device8->set_id(ID);
+	SetParam(*device8, "file", "nonexisting_file");
+	CommandContext context_undo_insert(batch, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_undo_insert));
+	const auto disk = dynamic_pointer_cast<Disk>(controller_manager.GetDeviceForIdAndLun(ID, 1));
+	EXPECT_TRUE(disk->IsRemoved());
+	EXPECT_FALSE(disk->IsProtected());
+	EXPECT_EQ(0, disk->GetConfiguredSectorSize());
+	EXPECT_EQ(-1, StorageDevice::GetIdsForReservedFile(filename2.string()).first);
+	EXPECT_FALSE(controller_manager.GetDeviceForIdAndLun(ID, 0)->IsRemoved()) << "Ejected medium must be inserted again";
+	EXPECT_EQ(0, StorageDevice::GetIdsForReservedFile(filename1.string()).second);
+
+	batch.mutable_commands()->Clear();
+	auto command7 = batch.add_commands();
+	command7->set_operation(DETACH);
+	auto device9 = command7->add_devices();
+	device9->set_id(ID);
+	device9->set_unit(1);
+	auto command8 = batch.add_commands();
+	command8->set_operation(ATTACH);
+	auto device10 = command8->add_devices();
+	device10->set_type(SCHD);
+	device10->set_id(ID);
+	device10->set_unit(1);
+	SetParam(*device10, "file", filename2.string());
+	CommandContext context_reattach(batch, "", "");
+	EXPECT_TRUE(executor->ProcessCmd(context_reattach)) << "A device must be attachable where a device was detached before";
+	EXPECT_EQ(SCHD, controller_manager.GetDeviceForIdAndLun(ID, 1)->GetType());
+	EXPECT_EQ(1, StorageDevice::GetIdsForReservedFile(filename2.string()).second);
+
+	batch.mutable_commands()->Clear();
+	auto command9 = batch.add_commands();
+	command9->set_operation(DETACH);
+	auto device11 = command9->add_devices();
+	device11->set_id(ID);
+	device11->set_unit(1);
+	auto command10 = batch.add_commands();
+	command10->set_operation(EJECT);
+	auto device12 = command10->add_devices();
+	device12->set_id(ID);
+	auto command11 = batch.add_commands();
+	command11->set_operation(INSERT);
+	auto device13 = command11->add_devices();
+	device13->set_id(ID);
+	SetParam(*device13, "file", "nonexisting_file");
+	CommandContext context_undo_detach(batch, "", "");
+	EXPECT_FALSE(executor->ProcessCmd(context_undo_detach));
+	EXPECT_EQ(2, controller_manager.GetAllDevices().size()) << "Detached device must be attached again";
+	EXPECT_EQ(SCHD, controller_manager.GetDeviceForIdAndLun(ID, 1)->GetType());
+	EXPECT_EQ(1, StorageDevice::GetIdsForReservedFile(filename2.string()).second);
+	EXPECT_EQ(0, StorageDevice::GetIdsForReservedFile(filename1.string()).second);
+
+	executor->DetachAll();
+	StorageDevice::UnreserveAll();
+
+	remove(filename1);
+	remove(filename2);
+}
+
+TEST(PiscsiExecutorTest, ProcessAttachCmd)
+{
+	auto bus = make_shared<MockBus>();
+	ControllerManager controller_manager;
+	auto executor = make_shared<MockPiscsiExecutor>(*bus, controller_manager);
+
+	const path filename1 = CreateTempFile(4096);
+	const path filename2 = CreateTempFile(4096);
+	const path filename3 = CreateTempFile(1);
+
+	PbCommand command;
+	command.set_operation(ATTACH);
+	auto device1 = command.add_devices();
+	device1->set_type(SCHD);
+	device1->set_id(1);
+	SetParam(*device1, "file", filename1.string());
+	auto device2 = command.add_devices();
+	device2->set_type(SCHD);
+	device2->set_id(2);
+	SetParam(*device2, "file", filename1.string());
+	auto device3 = command.add_devices();
+	device3->set_type(SCHS);
+	device3->set_id(3);
+	CommandContext context_image_in_use(command, "", "");
+	EXPECT_FALSE(executor->ProcessAttachCmd(context_image_in_use)) << "Image file must not be used twice";
+	EXPECT_TRUE(controller_manager.GetAllDevices().empty());
+
+	SetParam(*device2, "file", filename3.string());
+	CommandContext context_invalid_file(command, "", "");
+	EXPECT_FALSE(executor->ProcessAttachCmd(context_invalid_file)) << "Invalid image file size";
+	EXPECT_TRUE(controller_manager.GetAllDevices().empty()) << "No device must be attached if opening a file fails";
+
+	SetParam(*device2, "file", filename2.string());
+	auto device4 = command.add_devices();
+	device4->set_type(SCLP);
+	device4->set_id(4);
+	SetParam(*device4, "cmd", "lp");
+	CommandContext context_init_error(command, "", "");
+	EXPECT_FALSE(executor->ProcessAttachCmd(context_init_error)) << "Printer command without %f";
+	EXPECT_TRUE(controller_manager.GetAllDevices().empty()) << "Devices attached before the error must be detached";
+	EXPECT_EQ(-1, StorageDevice::GetIdsForReservedFile(filename1.string()).first);
+
+	command.mutable_devices()->RemoveLast();
+	CommandContext context_attach(command, "", "");
+	EXPECT_TRUE(executor->ProcessAttachCmd(context_attach));
+	EXPECT_EQ(3, controller_manager.GetAllDevices().size());
+	EXPECT_EQ(1, StorageDevice::GetIdsForReservedFile(filename1.string()).first);
+	EXPECT_EQ(2, StorageDevice::GetIdsForReservedFile(filename2.string()).first);
+
+	executor->DetachAll();
+	StorageDevice::UnreserveAll();
+
+	remove(filename1);
+	remove(filename2);
+	remove(filename3);
+}
+
 TEST(PiscsiExecutorTest, Attach)
 {
 	const int ID = 3;
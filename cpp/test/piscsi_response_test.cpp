@@ -68,7 +68,7 @@ void TestNonDiskDevice(PbDeviceType type, int default_param_count)
 TEST(PiscsiResponseTest, GetDevices)
 {
 	TestNonDiskDevice(SCHS, 0);
-	TestNonDiskDevice(SCLP, 1);
+	TestNonDiskDevice(SCLP, 3);
 }
 
 TEST(PiscsiResponseTest, GetImageFile)
@@ -183,7 +183,7 @@ TEST(PiscsiResponseTest, GetServerInfo)
 
 	PbCommand command;
 	PbServerInfo info1;
-	response.GetServerInfo(info1, command, devices, ids, "default_folder", 1234);
+	EXPECT_TRUE(info1.ParseFromString(response.GetServerInfo(command, devices, ids, "default_folder", 1234)));
 	EXPECT_TRUE(info1.has_version_info());
 	EXPECT_TRUE(info1.has_log_level_info());
 	EXPECT_TRUE(info1.has_device_types_info());
@@ -205,7 +205,7 @@ TEST(PiscsiResponseTest, GetServerInfo)
 
 	SetParam(command, "operations", "log_level_info,mapping_info");
 	PbServerInfo info2;
-	response.GetServerInfo(info2, command, devices, ids, "default_folder", 1234);
+	EXPECT_TRUE(info2.ParseFromString(response.GetServerInfo(command, devices, ids, "default_folder", 1234)));
 	EXPECT_FALSE(info2.has_version_info());
 	EXPECT_TRUE(info2.has_log_level_info());
 	EXPECT_FALSE(info2.has_device_types_info());
@@ -218,6 +218,62 @@ TEST(PiscsiResponseTest, GetServerInfo)
 	EXPECT_FALSE(info2.has_operation_info());
 }
 
+TEST(PiscsiResponseTest, GetSerializedServerInfo)
+{
+	PiscsiResponse response;
+	const unordered_set<shared_ptr<PrimaryDevice>> devices;
+	const unordered_set<int> ids = { 1, 3 };
+
+	PbCommand command;
+	PbServerInfo info1;
+	EXPECT_TRUE(info1.ParseFromString(response.GetServerInfo(command, devices, ids, "default_folder", 1234)));
+	PbVersionInfo version_info;
+	response.GetVersionInfo(version_info);
+	EXPECT_EQ(version_info.SerializeAsString(), info1.version_info().SerializeAsString());
+	PbDeviceTypesInfo device_types_info;
+	response.GetDeviceTypesInfo(device_types_info);
+	EXPECT_EQ(device_types_info.properties_size(), info1.device_types_info().properties_size());
+	PbMappingInfo mapping_info;
+	response.GetMappingInfo(mapping_info);
+	EXPECT_EQ(mapping_info.mapping_size(), info1.mapping_info().mapping_size());
+	PbOperationInfo operation_info;
+	response.GetOperationInfo(operation_info, 1234);
+	EXPECT_EQ(operation_info.operations_size(), info1.operation_info().operations_size());
+	EXPECT_TRUE(info1.has_log_level_info());
+	EXPECT_TRUE(info1.has_image_files_info());
+	EXPECT_EQ("default_folder", info1.image_files_info().default_image_folder());
+	EXPECT_EQ(2, info1.reserved_ids_info().ids().size());
+
+	SetParam(command, "operations", "reserved_ids_info,version_info");
+	PbServerInfo info2;
+	EXPECT_TRUE(info2.ParseFromString(response.GetServerInfo(command, devices, ids, "default_folder", 1234)));
+	EXPECT_TRUE(info2.has_version_info());
+	EXPECT_TRUE(info2.has_reserved_ids_info());
+	EXPECT_FALSE(info2.has_device_types_info());
+	EXPECT_FALSE(info2.has_mapping_info());
+	EXPECT_FALSE(info2.has_operation_info());
+	EXPECT_FALSE(info2.has_log_level_info());
+	EXPECT_EQ(piscsi_major_version, info2.version_info().major_version());
+}
+
+TEST(PiscsiResponseTest, GetStaticInfo)
+{
+	PiscsiResponse response;
+
+	const string& data = response.GetStaticInfo(MAPPING_INFO, 0);
+	PbMappingInfo mapping_info;
+	EXPECT_TRUE(mapping_info.ParseFromString(data));
+	EXPECT_EQ(10, mapping_info.mapping().size());
+	EXPECT_EQ(&data, &response.GetStaticInfo(MAPPING_INFO, 1)) << "Cached data must be re-used";
+
+	PbOperationInfo operation_info1;
+	EXPECT_TRUE(operation_info1.ParseFromString(response.GetStaticInfo(OPERATION_INFO, 0)));
+	PbOperationInfo operation_info2;
+	EXPECT_TRUE(operation_info2.ParseFromString(response.GetStaticInfo(OPERATION_INFO, 1)));
+	EXPECT_NE(operation_info1.SerializeAsString(), operation_info2.SerializeAsString())
+		<< "Operation meta data depend on the scan depth";
+}
+
 TEST(PiscsiResponseTest, GetVersionInfo)
 {
 	PiscsiResponse response;
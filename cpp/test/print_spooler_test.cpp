@@ -0,0 +1,76 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "mocks.h"
+#include "test_shared.h"
+#include "devices/print_spooler.h"
+#include <chrono>
+
+TEST(PrintSpoolerTest, Execute)
+{
+	EXPECT_EQ(0, PrintSpooler::Execute("true"));
+	EXPECT_EQ(3, PrintSpooler::Execute("exit 3"));
+}
+
+TEST(PrintSpoolerTest, Submit)
+{
+	PrintSpooler spooler;
+	EXPECT_EQ(0, spooler.GetQueuedCount());
+	EXPECT_EQ(0, spooler.GetActiveCount());
+
+	const path file1 = CreateTempFile(1);
+	const path file2 = CreateTempFile(1);
+	EXPECT_TRUE(spooler.Submit("true", file1));
+	EXPECT_TRUE(spooler.Submit("false", file2));
+	spooler.Drain();
+
+	EXPECT_EQ(0, spooler.GetQueuedCount());
+	EXPECT_EQ(0, spooler.GetActiveCount());
+	EXPECT_EQ(1, spooler.GetCompletedCount());
+	EXPECT_EQ(1, spooler.GetFailedCount());
+	EXPECT_FALSE(exists(file1)) << "Print file must be removed after printing";
+	EXPECT_FALSE(exists(file2)) << "Print file must be removed after printing";
+}
+
+TEST(PrintSpoolerTest, QueueFull)
+{
+	PrintSpooler spooler;
+
+	vector<path> files;
+	bool rejected = false;
+	for (int i = 0; i < 32 && !rejected; i++) {
+		files.push_back(CreateTempFile(1));
+		rejected = !spooler.Submit("sleep 1", files.back());
+	}
+	EXPECT_TRUE(rejected) << "Queue size must be limited";
+
+	// The rejected file is still owned by the caller
+	EXPECT_TRUE(exists(files.back()));
+	remove(files.back());
+}
+
+TEST(PrintSpoolerTest, DiscardQueuedJobs)
+{
+	vector<path> files;
+
+	const auto start = chrono::steady_clock::now();
+	{
+		PrintSpooler spooler;
+		for (int i = 0; i < 8; i++) {
+			files.push_back(CreateTempFile(1));
+			EXPECT_TRUE(spooler.Submit("sleep 1", files.back()));
+		}
+	}
+
+	// Only the jobs already running are waited for
+	EXPECT_GT(3, chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - start).count());
+	for (const auto& file : files) {
+		EXPECT_FALSE(exists(file)) << "Spool files of discarded jobs must be removed";
+	}
+}
@@ -163,6 +163,27 @@ TEST(ProtobufUtil, SetIdAndLun)
 	EXPECT_EQ(0, device.unit());
 }
 
+TEST(ProtobufUtil, AppendSerializedField)
+{
+	PbVersionInfo version_info;
+	version_info.set_major_version(22);
+	version_info.set_minor_version(11);
+
+	PbResult result;
+	result.set_status(true);
+	string data = result.SerializeAsString();
+	AppendSerializedField(data, PbResult::kVersionInfoFieldNumber, version_info.SerializeAsString());
+
+	PbResult spliced_result;
+	EXPECT_TRUE(spliced_result.ParseFromString(data));
+	EXPECT_TRUE(spliced_result.status());
+	EXPECT_EQ(22, spliced_result.version_info().major_version());
+	EXPECT_EQ(11, spliced_result.version_info().minor_version());
+
+	result.mutable_version_info()->CopyFrom(version_info);
+	EXPECT_EQ(result.SerializeAsString(), data);
+}
+
 TEST(ProtobufUtil, SerializeMessage)
 {
 	PbResult result;
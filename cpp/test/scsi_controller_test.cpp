@@ -11,6 +11,10 @@
 #include "shared/scsi.h"
 #include "shared/piscsi_exceptions.h"
 #include "controllers/scsi_controller.h"
+#include "devices/scsi_daynaport.h"
+#include "devices/loopback_backend.h"
+#include <chrono>
+#include <thread>
 
 using namespace scsi_defs;
 
@@ -68,6 +72,18 @@ TEST(ScsiControllerTest, BusFree)
 	EXPECT_EQ(phase_t::busfree, controller.GetPhase());
 	EXPECT_EQ(status::good, controller.GetStatus());
 
+	const size_t resident_size = controller.GetBuffer().size();
+	controller.AllocateBuffer(1024 * 1024);
+	EXPECT_LE(1024 * 1024, controller.GetBufferSize());
+	controller.SetPhase(phase_t::reserved);
+	controller.BusFree();
+	EXPECT_EQ(resident_size, controller.GetBuffer().size()) << "Large buffer must be released after the command";
+	EXPECT_EQ(controller.GetBuffer().capacity(), controller.GetBufferSize());
+	const auto& statistics = controller.GetStatistics(0);
+	ASSERT_FALSE(statistics.empty());
+	EXPECT_EQ("transfer_buffer_byte_count", statistics.back().key());
+	EXPECT_EQ(controller.GetBuffer().capacity(), statistics.back().value());
+
 	controller.ScheduleShutdown(AbstractController::piscsi_shutdown_mode::NONE);
 	controller.SetPhase(phase_t::reserved);
 	controller.BusFree();
@@ -286,3 +302,58 @@ TEST(ScsiControllerTest, RequestSense)
 	device->Dispatch(scsi_command::eCmdRequestSense);
 	EXPECT_EQ(status::good, controller->GetStatus()) << "Wrong CHECK CONDITION for non-existing LUN";
 }
+
+TEST(ScsiControllerTest, XferOutDaynaPort)
+{
+	const array<uint8_t, 6> mac_address = { 0x02, 0x00, 0x00, 0x12, 0x34, 0x56 };
+	const array<uint8_t, 6> multicast_address = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x01 };
+	const array<uint8_t, 6> other_multicast_address = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x02 };
+
+	auto bus = make_shared<NiceMock<MockBus>>();
+	MockScsiController controller(bus, 0);
+	auto [backend, peer] = LoopbackBackend::CreatePair();
+	auto daynaport = make_shared<SCSIDaynaPort>(0);
+	daynaport->SetBackend(move(backend));
+	ASSERT_TRUE(daynaport->Init({}));
+	EXPECT_TRUE(controller.AddDevice(daynaport));
+	controller.SetPhase(phase_t::dataout);
+
+	// SET INTERFACE MODE/SET MAC ADDRESS
+	controller.SetCmdByte(0, static_cast<int>(scsi_command::eCmdSetIfaceMode));
+	ranges::copy(mac_address, controller.GetBuffer().begin());
+	controller.SetLength(static_cast<uint32_t>(mac_address.size()));
+	controller.UpdateOffsetAndLength();
+	controller.SetBlocks(1);
+	EXPECT_CALL(controller, Status);
+	controller.DataOut();
+	array<int, 6> cdb = {};
+	cdb[4] = 255;
+	vector<uint8_t> buf(ETH_FRAME_LEN + ETH_FCS_LEN + SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ);
+	daynaport->RetrieveStats(cdb, buf);
+	EXPECT_TRUE(equal(mac_address.begin(), mac_address.end(), buf.begin()));
+
+	// SET MCAST ADDR
+	controller.ResetOffset();
+	controller.SetCmdByte(0, static_cast<int>(scsi_command::eCmdSetMcastAddr));
+	ranges::copy(multicast_address, controller.GetBuffer().begin());
+	controller.SetLength(static_cast<uint32_t>(multicast_address.size()));
+	controller.UpdateOffsetAndLength();
+	controller.SetBlocks(1);
+	EXPECT_CALL(controller, Status);
+	controller.DataOut();
+	vector<uint8_t> frame(64);
+	ranges::copy(other_multicast_address, frame.begin());
+	peer->Write(frame);
+	ranges::copy(multicast_address, frame.begin());
+	peer->Write(frame);
+	int length = 0;
+	for (int i = 0; i < 1000 && length <= static_cast<int>(SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ); i++) {
+		this_thread::sleep_for(chrono::milliseconds(1));
+		length = daynaport->Read(cdb, buf, 0);
+	}
+	EXPECT_LT(static_cast<int>(SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ), length);
+	EXPECT_TRUE(equal(multicast_address.begin(), multicast_address.end(),
+			buf.begin() + SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ)) << "Only the configured multicast address must pass";
+
+	daynaport->CleanUp();
+}
@@ -10,6 +10,35 @@
 #include "mocks.h"
 #include "shared/piscsi_exceptions.h"
 #include "devices/scsi_daynaport.h"
+#include "devices/pcap_backend.h"
+#include "devices/loopback_backend.h"
+#include <chrono>
+#include <iostream>
+
+// Offers the frames to the DaynaPort and returns the destination address of the first frame that passes the filter
+static array<uint8_t, 6> ReceiveFrame(SCSIDaynaPort& daynaport, LoopbackBackend& peer,
+		const vector<array<uint8_t, 6>>& destinations)
+{
+	vector<uint8_t> frame(64);
+	for (const auto& destination : destinations) {
+		ranges::copy(destination, frame.begin());
+		peer.Write(frame);
+	}
+
+	array<int, 6> cdb = {};
+	cdb[4] = 0xff;
+	vector<uint8_t> buf(ETH_FRAME_LEN + ETH_FCS_LEN + SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ);
+	array<uint8_t, 6> address = {};
+	for (int i = 0; i < 1000; i++) {
+		if (daynaport.Read(cdb, buf, 0) > static_cast<int>(SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ)) {
+			copy_n(buf.begin() + SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ, address.size(), address.begin());
+			break;
+		}
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	return address;
+}
 
 TEST(ScsiDaynaportTest, GetDefaultParams)
 {
@@ -50,6 +79,15 @@ TEST(ScsiDaynaportTest, Write)
 	controller->SetCmdByte(5, 0xff);
 	vector<uint8_t> buf(0);
 	EXPECT_TRUE(dynamic_pointer_cast<SCSIDaynaPort>(daynaport)->Write(controller->GetCmd(), buf));
+
+	// 80 format, the packet length in the payload must fit into the transferred data
+	controller->SetCmdByte(4, 10);
+	controller->SetCmdByte(5, 0x80);
+	vector<uint8_t> packet(18);
+	packet[1] = 32;
+	EXPECT_FALSE(dynamic_pointer_cast<SCSIDaynaPort>(daynaport)->Write(controller->GetCmd(), packet));
+	packet[1] = 10;
+	EXPECT_TRUE(dynamic_pointer_cast<SCSIDaynaPort>(daynaport)->Write(controller->GetCmd(), packet));
 }
 
 TEST(ScsiDaynaportTest, Read6)
@@ -160,6 +198,64 @@ TEST(ScsiDaynaportTest, SetMcastAddr)
 	daynaport->Dispatch(scsi_command::eCmdSetMcastAddr);
 }
 
+TEST(ScsiDaynaportTest, SetMulticastAddresses)
+{
+	const array<uint8_t, 6> multicast_address = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x01 };
+	const array<uint8_t, 6> other_multicast_address = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x02 };
+	const array<uint8_t, 6> broadcast_address = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+	auto [backend, peer] = LoopbackBackend::CreatePair();
+	auto controller = make_shared<NiceMock<MockAbstractController>>(0);
+	auto daynaport = make_shared<SCSIDaynaPort>(0);
+	daynaport->SetBackend(move(backend));
+	ASSERT_TRUE(daynaport->Init({}));
+	EXPECT_TRUE(controller->AddDevice(daynaport));
+
+	EXPECT_EQ(broadcast_address, ReceiveFrame(*daynaport, *peer, { multicast_address, broadcast_address }))
+		<< "Without a multicast list all multicast frames must be rejected";
+
+	// The address list is followed by an incomplete address, which must be ignored
+	vector<uint8_t> buf(multicast_address.begin(), multicast_address.end());
+	buf.push_back(0x01);
+	daynaport->SetMulticastAddresses(buf);
+	EXPECT_EQ(multicast_address, ReceiveFrame(*daynaport, *peer, { other_multicast_address, multicast_address }));
+
+	daynaport->SetMulticastAddresses({});
+	EXPECT_EQ(broadcast_address, ReceiveFrame(*daynaport, *peer, { multicast_address, broadcast_address }));
+
+	daynaport->CleanUp();
+}
+
+TEST(ScsiDaynaportTest, SetMacAddress)
+{
+	const array<uint8_t, 6> built_in_mac_address = { 0x00, 0x80, 0x19, 0x10, 0x98, 0xe3 };
+	const array<uint8_t, 6> mac_address = { 0x02, 0x00, 0x00, 0x12, 0x34, 0x56 };
+
+	auto [backend, peer] = LoopbackBackend::CreatePair();
+	auto controller = make_shared<NiceMock<MockAbstractController>>(0);
+	auto daynaport = make_shared<SCSIDaynaPort>(0);
+	daynaport->SetBackend(move(backend));
+	ASSERT_TRUE(daynaport->Init({}));
+	EXPECT_TRUE(controller->AddDevice(daynaport));
+
+	EXPECT_EQ(built_in_mac_address, ReceiveFrame(*daynaport, *peer, { mac_address, built_in_mac_address }));
+
+	daynaport->SetMacAddress(mac_address);
+	EXPECT_EQ(mac_address, ReceiveFrame(*daynaport, *peer, { built_in_mac_address, mac_address }));
+
+	array<int, 6> cdb = {};
+	cdb[4] = 255;
+	vector<uint8_t> stats(255);
+	daynaport->RetrieveStats(cdb, stats);
+	EXPECT_TRUE(equal(mac_address.begin(), mac_address.end(), stats.begin())) << "The statistics must report the new address";
+
+	daynaport->SetMacAddress(span(built_in_mac_address.data(), 5));
+	EXPECT_EQ(mac_address, ReceiveFrame(*daynaport, *peer, { built_in_mac_address, mac_address }))
+		<< "An incomplete address must be ignored";
+
+	daynaport->CleanUp();
+}
+
 TEST(ScsiDaynaportTest, EnableInterface)
 {
 	auto [controller, daynaport] = CreateDevice(SCDP);
@@ -185,3 +281,94 @@ TEST(ScsiDaynaportTest, GetSendDelay)
 
 	EXPECT_EQ(6, daynaport.GetSendDelay());
 }
+
+TEST(ScsiDaynaportTest, GetStatistics)
+{
+	SCSIDaynaPort daynaport(0);
+
+	const auto& statistics = daynaport.GetStatistics();
+	EXPECT_EQ(9, statistics.size());
+	EXPECT_EQ("rx_frame_drop_count", statistics[7].key());
+	EXPECT_EQ(PbStatisticsCategory::CATEGORY_WARNING, statistics[7].category());
+	EXPECT_EQ(0, statistics[7].value());
+	EXPECT_EQ("tx_frame_drop_count", statistics[8].key());
+	EXPECT_EQ(PbStatisticsCategory::CATEGORY_WARNING, statistics[8].category());
+	EXPECT_EQ(0, statistics[8].value());
+}
+
+TEST(ScsiDaynaportTest, DISABLED_Benchmark)
+{
+	const int FRAME_COUNT = 100'000;
+	const array<int, 3> FRAME_SIZES = { 64, 590, ETH_FRAME_LEN };
+
+	// Record a trace of frames for the DaynaPort address with typical frame sizes
+	const path trace = CreateTempFile(0);
+	vector<uint8_t> frame(ETH_FRAME_LEN);
+	const array<uint8_t, 6> mac_address = { 0x00, 0x80, 0x19, 0x10, 0x98, 0xe3 };
+	ranges::copy(mac_address, frame.begin());
+	{
+		PcapBackend recorder;
+		ASSERT_TRUE(recorder.Open("", trace));
+		for (int i = 0; i < FRAME_COUNT; i++) {
+			recorder.Write(span(frame.data(), FRAME_SIZES[i % FRAME_SIZES.size()]));
+		}
+	}
+
+	// The receive thread replays the trace as fast as it can, frames the initiator does not fetch in time are dropped
+	auto backend = make_unique<PcapBackend>();
+	ASSERT_TRUE(backend->Open(trace, ""));
+	const PcapBackend& replay = *backend;
+	auto controller = make_shared<NiceMock<MockAbstractController>>(0);
+	auto daynaport = make_shared<SCSIDaynaPort>(0);
+	daynaport->SetBackend(move(backend));
+
+	array<int, 6> read_cdb = {};
+	read_cdb[4] = 0xff;
+	vector<uint8_t> buf(ETH_FRAME_LEN + ETH_FCS_LEN + SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ);
+	int received = 0;
+	uint64_t received_bytes = 0;
+	auto start = chrono::steady_clock::now();
+	ASSERT_TRUE(daynaport->Init({}));
+	EXPECT_TRUE(controller->AddDevice(daynaport));
+	while (chrono::steady_clock::now() - start < chrono::seconds(60)) {
+		// The replay is only done when the receive thread has queued or dropped the last frame
+		const bool done = replay.IsReplayDone();
+		if (const int length = daynaport->Read(read_cdb, buf, 0);
+				length > static_cast<int>(SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ)) {
+			received++;
+			received_bytes += length - SCSIDaynaPort::DAYNAPORT_READ_HEADER_SZ;
+		}
+		else if (done) {
+			break;
+		}
+	}
+	auto us = max<int64_t>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count(), 1);
+	uint64_t dropped = 0;
+	for (const auto& statistics : daynaport->GetStatistics()) {
+		if (statistics.key() == "rx_frame_drop_count") {
+			dropped = statistics.value();
+		}
+	}
+	EXPECT_EQ(static_cast<uint64_t>(FRAME_COUNT), replay.GetReplayedFrameCount());
+	EXPECT_EQ(static_cast<uint64_t>(FRAME_COUNT), received + dropped);
+	cout << "Read: " << received << " frames, " << received * 1'000'000LL / us << " frames/s, "
+			<< received_bytes / us << " MB/s (" << FRAME_COUNT * 1'000'000LL / us << " frames/s replayed, " << dropped
+			<< " dropped)\n";
+	remove(trace);
+
+	array<int, 6> write_cdb = {};
+	uint64_t sent_bytes = 0;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < FRAME_COUNT; i++) {
+		const int size = FRAME_SIZES[i % FRAME_SIZES.size()];
+		write_cdb[3] = size >> 8;
+		write_cdb[4] = size & 0xff;
+		daynaport->Write(write_cdb, span(frame.data(), size));
+		sent_bytes += size;
+	}
+	// Waits for the send thread
+	daynaport->CleanUp();
+	us = max<int64_t>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count(), 1);
+	cout << "Write: " << FRAME_COUNT << " frames, " << FRAME_COUNT * 1'000'000LL / us << " frames/s, "
+			<< sent_bytes / us << " MB/s\n";
+}
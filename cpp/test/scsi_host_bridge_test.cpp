@@ -8,15 +8,241 @@
 //---------------------------------------------------------------------------
 
 #include "mocks.h"
+#include "test_shared.h"
+#include "devices/scsi_host_bridge.h"
+#include "devices/loopback_backend.h"
+#include "devices/scsi_command_util.h"
+#include <netinet/in.h>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <thread>
+
+using namespace scsi_command_util;
+
+static int GetSize(const vector<uint8_t>& buf, int offset)
+{
+	return (buf[offset] << 8) | buf[offset + 1];
+}
+
+static void SetAllocationLength(array<int, 10>& cdb, int length)
+{
+	cdb[6] = length >> 16;
+	cdb[7] = (length >> 8) & 0xff;
+	cdb[8] = length & 0xff;
+}
+
+// Broadcast frames are not rejected by the bridge filter. The first payload byte identifies the frame.
+static void SendFrames(LoopbackBackend& peer, const vector<int>& sizes)
+{
+	for (size_t i = 0; i < sizes.size(); i++) {
+		vector<uint8_t> frame(sizes[i]);
+		fill_n(frame.begin(), 6, 0xff);
+		frame[6] = static_cast<uint8_t>(i + 1);
+		peer.Write(frame);
+	}
+
+	// Give the receive thread time to queue the frames
+	this_thread::sleep_for(chrono::milliseconds(100));
+}
+
+// Checks the size prefix and the identifying byte of a frame in a bundle, returns the offset of the next entry
+static int CheckFrame(const vector<uint8_t>& buf, int offset, int size, int id)
+{
+	EXPECT_EQ(size, GetSize(buf, offset));
+	// The TAP driver appends the frame check sequence
+	EXPECT_EQ(id, buf[offset + 2 + 6]);
+	return offset + 2 + size;
+}
 
 TEST(ScsiHostBridgeTest, GetDefaultParams)
 {
 	const auto [controller, bridge] = CreateDevice(SCBR);
 	const auto params = bridge->GetDefaultParams();
-	EXPECT_EQ(2, params.size());
+	EXPECT_EQ(3, params.size());
+	EXPECT_EQ(to_string(XM6_HOST_DIRENTRY_CACHE_MAX), params.at("dir_cache"));
 }
 
 TEST(ScsiHostBridgeTest, Inquiry)
 {
 	TestInquiry::Inquiry(SCBR, device_type::communications, scsi_level::scsi_2, "PiSCSI  RASCSI BRIDGE   ", 0x27, false);
 }
+
+TEST(ScsiHostBridgeTest, GetMessage10)
+{
+	auto bridge = make_shared<SCSIBR>(0);
+	vector<uint8_t> buf(16);
+
+	// Without TAP device no packets are available
+	array<int, 10> cdb = {};
+	cdb[2] = 1;
+	for (const int func : { 1, 2, 3, 4 }) {
+		cdb[3] = func;
+		EXPECT_EQ(0, bridge->GetMessage10(cdb, buf));
+	}
+}
+
+TEST(ScsiHostBridgeTest, GetMessage10Bundle)
+{
+	auto [backend, peer] = LoopbackBackend::CreatePair();
+	auto bridge = make_shared<SCSIBR>(0);
+	bridge->SetBackend(move(backend));
+	ASSERT_TRUE(bridge->Init({}));
+
+	vector<uint8_t> buf(0x2000);
+	array<int, 10> cdb = {};
+	cdb[2] = 1;
+	cdb[3] = 4;
+
+	// The frames are 4 bytes longer when received because of the frame check sequence
+	SendFrames(*peer, { 60, 60, 100 });
+
+	// Space for 2 frames and the terminator, the third frame does not fit
+	SetAllocationLength(cdb, 2 + 64 + 2 + 64 + 2);
+	EXPECT_EQ(2 + 64 + 2 + 64 + 2, bridge->GetMessage10(cdb, buf));
+	int offset = CheckFrame(buf, 0, 64, 1);
+	offset = CheckFrame(buf, offset, 64, 2);
+	EXPECT_EQ(0, GetSize(buf, offset)) << "Missing terminator";
+
+	// The frame that did not fit is returned by the next call
+	SetAllocationLength(cdb, 0x1000);
+	EXPECT_EQ(2 + 104 + 2, bridge->GetMessage10(cdb, buf));
+	offset = CheckFrame(buf, 0, 104, 3);
+	EXPECT_EQ(0, GetSize(buf, offset)) << "Missing terminator";
+
+	// Only the terminator
+	EXPECT_EQ(2, bridge->GetMessage10(cdb, buf));
+	EXPECT_EQ(0, GetSize(buf, 0));
+
+	// A frame that can never be returned is discarded
+	SendFrames(*peer, { 100, 60 });
+	SetAllocationLength(cdb, 64);
+	EXPECT_EQ(2, bridge->GetMessage10(cdb, buf));
+	EXPECT_EQ(0, GetSize(buf, 0));
+	SetAllocationLength(cdb, 0x1000);
+	EXPECT_EQ(2 + 64 + 2, bridge->GetMessage10(cdb, buf));
+	CheckFrame(buf, 0, 64, 2);
+
+	bridge->CleanUp();
+}
+
+TEST(ScsiHostBridgeTest, GetMessage10MultiplePackets)
+{
+	auto [backend, peer] = LoopbackBackend::CreatePair();
+	auto bridge = make_shared<SCSIBR>(0);
+	bridge->SetBackend(move(backend));
+	ASSERT_TRUE(bridge->Init({}));
+
+	vector<uint8_t> buf(0x2000);
+	array<int, 10> cdb = {};
+	cdb[2] = 1;
+	cdb[3] = 3;
+
+	// More frames than returned by a single call
+	SendFrames(*peer, vector<int>(12, 60));
+
+	// Without a terminator when the maximum number of frames is returned
+	EXPECT_EQ(10 * (2 + 64), bridge->GetMessage10(cdb, buf));
+	int offset = 0;
+	for (int i = 1; i <= 10; i++) {
+		offset = CheckFrame(buf, offset, 64, i);
+	}
+
+	EXPECT_EQ(2 * (2 + 64) + 2, bridge->GetMessage10(cdb, buf));
+	offset = CheckFrame(buf, 0, 64, 11);
+	offset = CheckFrame(buf, offset, 64, 12);
+	EXPECT_EQ(0, GetSize(buf, offset)) << "Missing terminator";
+
+	bridge->CleanUp();
+}
+
+TEST(ScsiHostBridgeTest, NFilesBatch)
+{
+	const uint32_t KEY = 0x1000;
+	const uint32_t BATCH_SIZE = 4;
+
+	const path folder = test_data_temp_path / "scsibr";
+	remove_all(folder);
+	create_directories(folder);
+	for (const string filename : { "FILE1.TXT", "FILE2.TXT", "FILE3.TXT" }) {
+		ofstream(folder / filename) << filename;
+	}
+
+	SCSIBR bridge(0);
+	array<int, 10> write_cdb = {};
+	write_cdb[2] = 2;
+	array<int, 10> read_cdb = {};
+	read_cdb[2] = 2;
+	vector<uint8_t> buf(0x1000);
+
+	// $40 - Device Boot
+	const string base = folder.string();
+	ranges::copy(base, buf.begin() + 1);
+	write_cdb[3] = 0x00;
+	EXPECT_TRUE(bridge.ReadWrite(write_cdb, buf));
+	read_cdb[9] = 0;
+	EXPECT_EQ(4, bridge.GetMessage10(read_cdb, buf));
+	EXPECT_EQ(1U, ntohl(*(const uint32_t *)buf.data())) << "There must be one unit";
+
+	// $47 - File search, all fields in the requests are big-endian
+	Human68k::namests_t namests = {};
+	namests.path[0] = 0x09;
+	memset(namests.name, '?', sizeof(namests.name));
+	memset(namests.ext, '?', sizeof(namests.ext));
+	Human68k::files_t files = {};
+	files.fatr = Human68k::AT_ARCHIVE;
+	ranges::fill(buf, 0);
+	SetInt32(buf, 0, 0);
+	SetInt32(buf, 4, KEY);
+	memcpy(&buf[8], &namests, sizeof(namests));
+	memcpy(&buf[8 + sizeof(namests)], &files, sizeof(files));
+	write_cdb[3] = 0x07;
+	EXPECT_TRUE(bridge.ReadWrite(write_cdb, buf));
+	EXPECT_EQ(4, bridge.GetMessage10(read_cdb, buf));
+	EXPECT_EQ(0U, ntohl(*(const uint32_t *)buf.data()));
+	read_cdb[9] = 1;
+	EXPECT_EQ(static_cast<int>(sizeof(files)), bridge.GetMessage10(read_cdb, buf));
+	memcpy(&files, buf.data(), sizeof(files));
+
+	// $59 - Find next files, the remaining 2 files are returned with one request
+	ranges::fill(buf, 0);
+	SetInt32(buf, 0, 0);
+	SetInt32(buf, 4, KEY);
+	// The cursor of the first result
+	SetInt32(buf, 8, 1);
+	memcpy(&buf[12], &files, sizeof(files));
+	SetInt32(buf, 12 + sizeof(files), BATCH_SIZE * sizeof(Human68k::files_t));
+	write_cdb[3] = 0x19;
+	EXPECT_TRUE(bridge.ReadWrite(write_cdb, buf));
+	read_cdb[9] = 0;
+	EXPECT_EQ(4, bridge.GetMessage10(read_cdb, buf));
+	EXPECT_EQ(2U, ntohl(*(const uint32_t *)buf.data())) << "The result code must be the number of files";
+	EXPECT_NE(0, bridge.GetStatistics().back().value()) << "The results must be in the file system buffer";
+
+	// The length of the option data is the size of the results
+	read_cdb[9] = 2;
+	EXPECT_EQ(static_cast<int>(2 * sizeof(Human68k::files_t)), bridge.GetMessage10(read_cdb, buf));
+	set<string> filenames = { (const char *)files.full };
+	for (int i = 0; i < 2; i++) {
+		Human68k::files_t result;
+		memcpy(&result, &buf[i * sizeof(Human68k::files_t)], sizeof(result));
+		EXPECT_EQ(Human68k::AT_ARCHIVE, result.fatr);
+		EXPECT_EQ(KEY, ntohl(result.sector)) << "The directory sector must be big-endian";
+		EXPECT_EQ(9U, ntohl(result.size)) << "The file size must be big-endian";
+		filenames.insert((const char *)result.full);
+	}
+	EXPECT_EQ(set<string>({ "FILE1.TXT", "FILE2.TXT", "FILE3.TXT" }), filenames);
+	EXPECT_EQ(0, bridge.GetStatistics().back().value()) << "The file system buffer must have been released";
+
+	remove_all(folder);
+}
+
+TEST(ScsiHostBridgeTest, GetStatistics)
+{
+	SCSIBR bridge(0);
+
+	const auto& statistics = bridge.GetStatistics();
+	ASSERT_EQ(1, statistics.size());
+	EXPECT_EQ("fs_buffer_byte_count", statistics[0].key());
+	EXPECT_EQ(0, statistics[0].value()) << "File system buffer must only be allocated when being used";
+}
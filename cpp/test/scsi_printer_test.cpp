@@ -9,7 +9,9 @@
 
 #include "mocks.h"
 #include "shared/piscsi_exceptions.h"
+#include "test_shared.h"
 #include "devices/scsi_printer.h"
+#include <fstream>
 
 using namespace std;
 
@@ -17,7 +19,7 @@ TEST(ScsiPrinterTest, GetDefaultParams)
 {
 	const auto [controller, printer] = CreateDevice(SCLP);
 	const auto params = printer->GetDefaultParams();
-	EXPECT_EQ(1, params.size());
+	EXPECT_EQ(3, params.size());
 }
 
 TEST(ScsiPrinterTest, Init)
@@ -31,6 +33,14 @@ TEST(ScsiPrinterTest, Init)
 
 	params["cmd"] = "%f";
 	EXPECT_TRUE(printer->Init(params));
+
+	params["buffer"] = "-1";
+	EXPECT_FALSE(printer->Init(params));
+
+	params["buffer"] = "0";
+	params["cmd"] = "missing_filename_specifier";
+	params["pipe"] = "true";
+	EXPECT_TRUE(printer->Init(params)) << "No filename specifier is required when piping";
 }
 
 TEST(ScsiPrinterTest, TestUnitReady)
@@ -111,7 +121,72 @@ TEST(ScsiPrinterTest, SynchronizeBuffer)
 			Property(&scsi_exception::get_asc, asc::no_additional_sense_information))))
 		<< "Nothing to print";
 
-	// Further testing would use the printing system
+	param_map params;
+	params["cmd"] = "true %f";
+	EXPECT_TRUE(printer->Init(params));
+	const vector<uint8_t> buf(16);
+	EXPECT_TRUE(printer->WriteByteSequence(buf));
+	EXPECT_CALL(*controller, Status());
+	printer->Dispatch(scsi_command::eCmdSynchronizeBuffer);
+	EXPECT_EQ(status::good, controller->GetStatus());
+
+	static_pointer_cast<SCSIPrinter>(printer)->DrainPrintQueue();
+	const auto& statistics = printer->GetStatistics();
+	const auto& it = ranges::find_if(statistics, [] (const auto& s) { return s.key() == "file_print_count"; });
+	ASSERT_NE(statistics.end(), it);
+	EXPECT_EQ(1, it->value());
+}
+
+void TestPrint(const param_map& params, int count, const path& result)
+{
+	auto [controller, printer] = CreateDevice(SCLP);
+	EXPECT_TRUE(printer->Init(params));
+
+	vector<uint8_t> buf(1000);
+	for (int i = 0; i < count; i++) {
+		ranges::fill(buf, static_cast<uint8_t>(i));
+		EXPECT_TRUE(printer->WriteByteSequence(buf));
+	}
+	EXPECT_CALL(*controller, Status());
+	printer->Dispatch(scsi_command::eCmdSynchronizeBuffer);
+	static_pointer_cast<SCSIPrinter>(printer)->DrainPrintQueue();
+
+	ASSERT_EQ(buf.size() * count, file_size(result));
+	ifstream in(result, ios::binary);
+	for (int i = 0; i < count; i++) {
+		in.read((char *)buf.data(), buf.size());
+		EXPECT_EQ(buf.size(), ranges::count(buf, static_cast<uint8_t>(i))) << "Print data are corrupted";
+	}
+	in.close();
+
+	remove(result);
+}
+
+TEST(ScsiPrinterTest, PrintFile)
+{
+	const path result = path(CreateTempFile(0)).string() + "_printed";
+
+	param_map params;
+	params["cmd"] = "cp %f " + result.string();
+	// Buffered in memory
+	TestPrint(params, 3, result);
+	// Written to a file in several steps
+	params["buffer"] = "4096";
+	TestPrint(params, 10, result);
+}
+
+TEST(ScsiPrinterTest, PrintPipe)
+{
+	const path result = path(CreateTempFile(0)).string() + "_printed";
+
+	param_map params;
+	params["cmd"] = "cat > " + result.string();
+	params["pipe"] = "true";
+	// Piped from memory
+	TestPrint(params, 3, result);
+	// Piped from a file
+	params["buffer"] = "4096";
+	TestPrint(params, 10, result);
 }
 
 TEST(ScsiPrinterTest, WriteByteSequence)
@@ -291,3 +291,27 @@ TEST(ScsictlDisplayTest, DisplayOperationInfo)
 	EXPECT_FALSE(s.empty());
 	EXPECT_NE(string::npos, s.find("server_side_name"));
 }
+
+TEST(ScsictlDisplayTest, DisplayStatisticsInfo)
+{
+	ScsictlDisplay display;
+	PbStatisticsInfo info;
+
+	EXPECT_FALSE(display.DisplayStatisticsInfo(info).empty());
+
+	auto statistics = info.add_statistics();
+	statistics->set_category(PbStatisticsCategory::CATEGORY_INFO);
+	statistics->set_key("latency_datain_Read10");
+	statistics->set_value(100);
+	statistics->add_histogram(0);
+	statistics->add_histogram(90);
+	statistics->add_histogram(10);
+	for (int i = 3; i < 16; i++) {
+		statistics->add_histogram(0);
+	}
+	const string s = display.DisplayStatisticsInfo(info);
+	EXPECT_NE(string::npos, s.find("latency_datain_Read10: 100 (p50 < 32 us, p90 < 32 us, p99 < 64 us)"));
+
+	statistics->set_histogram(15, 100);
+	EXPECT_NE(string::npos, display.DisplayStatisticsInfo(info).find("p99 >= 262144 us"));
+}
@@ -0,0 +1,150 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+
+#include "scsimon/sm_capture.h"
+#include "scsimon/sm_clock.h"
+#include "scsimon/sm_reports.h"
+#include "test/test_shared.h"
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+using namespace filesystem;
+
+// The frequency of the ARM generic timer on a Pi 4
+static const uint64_t PI4_FREQUENCY = 54'000'000;
+
+static vector<uint64_t> GetTimestamps(const CaptureView& view)
+{
+	vector<uint64_t> timestamps;
+	for (const auto& sample : view) {
+		timestamps.push_back(sample.GetTimestamp());
+	}
+
+	return timestamps;
+}
+
+TEST(ScsiMonCaptureTest, CaptureView)
+{
+	const vector<capture_record_t> records = { { .data = 1, .delta = 0 }, { .data = 2, .delta = 54 },
+			{ .data = 3, .delta = 27 }, { .data = 4, .delta = UINT32_MAX } };
+
+	const CaptureView view(records, PI4_FREQUENCY);
+	EXPECT_EQ(4U, view.size());
+	EXPECT_EQ(vector<uint64_t>({ 0, 1'000, 1'500, 79'536'432'889 }), GetTimestamps(view));
+	uint32_t data = 1;
+	for (const auto& sample : view) {
+		EXPECT_EQ(data++, sample.GetRawCapture());
+	}
+
+	// The timestamps are nanoseconds by default
+	EXPECT_EQ(vector<uint64_t>({ 0, 54, 81, 4'294'967'376 }), GetTimestamps(CaptureView(records)));
+
+	// SysTimer on a Pi Zero/1
+	EXPECT_EQ(vector<uint64_t>({ 0, 54'000, 81'000, 4'294'967'376'000 }),
+			GetTimestamps(CaptureView(records, 1'000'000)));
+}
+
+TEST(ScsiMonCaptureTest, RecordChange)
+{
+	vector<capture_record_t> records;
+	auto recorder = [&records] (uint32_t data, uint32_t delta) {
+		records.push_back({ .data = data, .delta = delta });
+		return true;
+	};
+
+	EXPECT_TRUE(RecordChange(recorder, 1, 2, 5));
+	ASSERT_EQ(1U, records.size());
+	EXPECT_EQ(2U, records[0].data);
+	EXPECT_EQ(5U, records[0].delta);
+
+	EXPECT_TRUE(RecordChange(recorder, 2, 3, UINT32_MAX));
+	ASSERT_EQ(2U, records.size());
+	EXPECT_EQ(UINT32_MAX, records[1].delta);
+
+	// The time without changes is filled with records of the previous data
+	records.clear();
+	EXPECT_TRUE(RecordChange(recorder, 3, 4, 2ULL * UINT32_MAX + 5));
+	ASSERT_EQ(3U, records.size());
+	EXPECT_EQ(3U, records[0].data);
+	EXPECT_EQ(UINT32_MAX, records[0].delta);
+	EXPECT_EQ(3U, records[1].data);
+	EXPECT_EQ(UINT32_MAX, records[1].delta);
+	EXPECT_EQ(4U, records[2].data);
+	EXPECT_EQ(5U, records[2].delta);
+
+	// The recorder can stop while the gap is being filled
+	records.clear();
+	auto stopping_recorder = [&records] (uint32_t data, uint32_t delta) {
+		records.push_back({ .data = data, .delta = delta });
+		return false;
+	};
+	EXPECT_FALSE(RecordChange(stopping_recorder, 4, 5, 3ULL * UINT32_MAX));
+	EXPECT_EQ(1U, records.size());
+}
+
+TEST(ScsiMonCaptureTest, AppendAt)
+{
+	CaptureBuffer buffer(4);
+
+	EXPECT_TRUE(buffer.AppendAt(1, 0));
+	EXPECT_TRUE(buffer.AppendAt(2, 5'000'000'000));
+	ASSERT_EQ(3U, buffer.GetCount());
+	EXPECT_EQ(1U, buffer.GetRecords()[1].data) << "The signals did not change during the gap";
+	EXPECT_EQ(vector<uint64_t>({ 0, UINT32_MAX, 5'000'000'000 }), GetTimestamps(CaptureView(buffer)));
+
+	EXPECT_TRUE(buffer.AppendAt(3, 5'000'000'000));
+	EXPECT_FALSE(buffer.AppendAt(4, 5'000'000'001)) << "The buffer must be full";
+}
+
+TEST(ScsiMonCaptureTest, SampleClock)
+{
+	SampleClock::Init();
+	EXPECT_FALSE(SampleClock::GetName().empty());
+	const uint64_t frequency = SampleClock::GetFrequency();
+	EXPECT_NE(0U, frequency);
+
+	const uint64_t start = SampleClock::Read();
+	this_thread::sleep_for(chrono::milliseconds(10));
+	EXPECT_LE(frequency / 100, SampleClock::Read() - start);
+}
+
+TEST(ScsiMonCaptureTest, Json)
+{
+	const path folder = test_data_temp_path / "scsimon";
+	create_directories(folder);
+	const string filename = (folder / "capture.json").string();
+
+	CaptureBuffer buffer(3);
+	buffer.SetFrequency(PI4_FREQUENCY);
+	buffer.Append(0x12345678, 0);
+	buffer.Append(0x00000001, 54);
+	buffer.Append(0x80000000, 54'000'000);
+	scsimon_generate_json(filename, CaptureView(buffer));
+
+	// The file contains nanoseconds
+	CaptureBuffer imported(3);
+	EXPECT_EQ(3U, scsimon_read_json(filename, imported));
+	ASSERT_EQ(3U, imported.GetCount());
+	EXPECT_EQ(vector<uint64_t>({ 0, 1'000, 1'000'001'000 }), GetTimestamps(CaptureView(imported)));
+	EXPECT_EQ(0x12345678U, imported.GetRecords()[0].data);
+	EXPECT_EQ(0x00000001U, imported.GetRecords()[1].data);
+	EXPECT_EQ(0x80000000U, imported.GetRecords()[2].data);
+
+	// Files of older versions contain loop counts
+	ofstream(filename) << "[\n{\"id\": \"0\", \"timestamp\":\"0x00000000000000\", \"data\":\"0x000001\"}\n]\n";
+	CaptureBuffer legacy(3);
+	EXPECT_EQ(0U, scsimon_read_json(filename, legacy));
+	EXPECT_EQ(0U, legacy.GetCount());
+
+	remove_all(folder);
+}
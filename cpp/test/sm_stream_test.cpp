@@ -0,0 +1,230 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+
+#include "scsimon/sm_stream.h"
+#include "test/test_shared.h"
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+using namespace filesystem;
+
+// More than a data block
+static const uint32_t RECORD_COUNT = 200'000;
+
+// Rotating at more than the file header size starts a new file after each block
+static const uint64_t FILE_HEADER_SIZE = 16;
+
+static path CreateCaptureFolder()
+{
+	const path folder = test_data_temp_path / "scsimon";
+	remove_all(folder);
+	create_directories(folder);
+
+	return folder;
+}
+
+// Like the bus signals, only few bits change from sample to sample
+static capture_record_t GetRecord(uint32_t i)
+{
+	return { .data = i ^ (i >> 1), .delta = i % 7 + 1 };
+}
+
+static void Push(CaptureStream& stream, uint32_t start, uint32_t count)
+{
+	for (uint32_t i = start; i < start + count; i++) {
+		const capture_record_t record = GetRecord(i);
+		ASSERT_TRUE(stream.Push(record.data, record.delta));
+	}
+}
+
+static void ExpectRecords(const CaptureBuffer& buffer, uint32_t count)
+{
+	ASSERT_EQ(count, buffer.GetCount());
+	const auto records = buffer.GetRecords();
+	for (uint32_t i = 0; i < count; i++) {
+		const capture_record_t record = GetRecord(i);
+		ASSERT_EQ(record.data, records[i].data) << "Record " << i;
+		ASSERT_EQ(record.delta, records[i].delta) << "Record " << i;
+	}
+}
+
+TEST(ScsiMonStreamTest, RecordRing)
+{
+	RecordRing ring(3);
+	array<capture_record_t, 8> buf;
+
+	EXPECT_EQ(0U, ring.Pop(buf.data(), buf.size()));
+
+	for (uint32_t i = 0; i < 4; i++) {
+		EXPECT_TRUE(ring.Push({ .data = i, .delta = i }));
+	}
+	EXPECT_FALSE(ring.Push({ .data = 4, .delta = 4 })) << "The capacity must have been rounded up to 4";
+
+	EXPECT_EQ(3U, ring.Pop(buf.data(), 3));
+	EXPECT_EQ(2U, buf[2].data);
+
+	// The records wrap around the end of the ring
+	for (uint32_t i = 4; i < 7; i++) {
+		EXPECT_TRUE(ring.Push({ .data = i, .delta = i }));
+	}
+	EXPECT_FALSE(ring.Push({ .data = 7, .delta = 7 }));
+	EXPECT_EQ(4U, ring.Pop(buf.data(), buf.size()));
+	for (uint32_t i = 0; i < 4; i++) {
+		EXPECT_EQ(i + 3, buf[i].data);
+		EXPECT_EQ(i + 3, buf[i].delta);
+	}
+	EXPECT_EQ(0U, ring.Pop(buf.data(), buf.size()));
+}
+
+TEST(ScsiMonStreamTest, ReadWrite)
+{
+	const path folder = CreateCaptureFolder();
+
+	CaptureStream stream((folder / "capture").string(), 1024, 1'000'000, 0, 0, 0);
+	ASSERT_TRUE(stream.Start(0));
+	Push(stream, 0, RECORD_COUNT);
+	stream.Stop();
+	EXPECT_EQ(RECORD_COUNT, stream.GetRecordCount());
+	ASSERT_EQ(1U, stream.GetFilenames().size());
+	EXPECT_EQ((folder / "capture.scm").string(), stream.GetFilenames()[0]);
+	EXPECT_LT(stream.GetByteCount(), RECORD_COUNT * 2ULL) << "The records must have been compressed";
+
+	CaptureBuffer buffer(RECORD_COUNT);
+	EXPECT_EQ(RECORD_COUNT, CaptureStream::Read(stream.GetFilenames()[0], buffer));
+	EXPECT_EQ(1'000'000U, buffer.GetFrequency());
+	ExpectRecords(buffer, RECORD_COUNT);
+
+	// The complete blocks of a truncated file can be read
+	resize_file(stream.GetFilenames()[0], file_size(stream.GetFilenames()[0]) - 1000);
+	CaptureBuffer truncated(RECORD_COUNT);
+	const uint32_t count = CaptureStream::Read(stream.GetFilenames()[0], truncated);
+	EXPECT_LT(0U, count);
+	EXPECT_GT(RECORD_COUNT, count);
+	ExpectRecords(truncated, count);
+
+	// Corrupt block sizes must not be trusted
+	fstream corrupt(stream.GetFilenames()[0], ios::binary | ios::in | ios::out);
+	corrupt.seekp(16 + 4);
+	const uint32_t size = 0xffffffff;
+	corrupt.write((const char *)&size, sizeof(size));
+	corrupt.close();
+	CaptureBuffer invalid(RECORD_COUNT);
+	EXPECT_EQ(0U, CaptureStream::Read(stream.GetFilenames()[0], invalid));
+
+	ofstream(folder / "invalid.scm") << "not a capture file";
+	EXPECT_EQ(0U, CaptureStream::Read((folder / "invalid.scm").string(), invalid));
+
+	remove_all(folder);
+}
+
+static void Write32(const string& filename, int offset, uint32_t value)
+{
+	fstream file(filename, ios::binary | ios::in | ios::out);
+	file.seekp(offset);
+	file.write((const char *)&value, sizeof(value));
+}
+
+TEST(ScsiMonStreamTest, FileHeader)
+{
+	const path folder = CreateCaptureFolder();
+
+	// The frequency of the ARM generic timer on a Pi 4
+	CaptureStream stream((folder / "capture").string(), 1024, 54'000'000, 0, 0, 0);
+	ASSERT_TRUE(stream.Start(0));
+	Push(stream, 0, 3);
+	stream.Stop();
+	const string filename = stream.GetFilenames()[0];
+
+	CaptureBuffer buffer(3);
+	EXPECT_EQ(3U, CaptureStream::Read(filename, buffer));
+	EXPECT_EQ(54'000'000U, buffer.GetFrequency());
+	vector<uint64_t> timestamps;
+	for (const auto& sample : CaptureView(buffer)) {
+		timestamps.push_back(sample.GetTimestamp());
+	}
+	EXPECT_EQ(vector<uint64_t>({ 19, 56, 111 }), timestamps) << "The ticks must have been converted to nanoseconds";
+
+	// Version 1 files contain loop counts
+	Write32(filename, 8, 1);
+	CaptureBuffer version1(3);
+	EXPECT_EQ(0U, CaptureStream::Read(filename, version1));
+
+	Write32(filename, 8, 2);
+	Write32(filename, 12, 0);
+	CaptureBuffer no_frequency(3);
+	EXPECT_EQ(0U, CaptureStream::Read(filename, no_frequency));
+
+	remove_all(folder);
+}
+
+TEST(ScsiMonStreamTest, Rotate)
+{
+	const path folder = CreateCaptureFolder();
+
+	CaptureStream stream((folder / "capture").string(), 1024, 1'000'000, FILE_HEADER_SIZE + 1, 0, 0);
+	ASSERT_TRUE(stream.Start(0));
+	Push(stream, 0, RECORD_COUNT);
+	stream.Stop();
+	EXPECT_EQ(RECORD_COUNT, stream.GetRecordCount());
+	const vector<string>& filenames = stream.GetFilenames();
+	ASSERT_LE(4U, filenames.size());
+	EXPECT_EQ((folder / "capture-000000.scm").string(), filenames[0]);
+	EXPECT_EQ((folder / "capture-000001.scm").string(), filenames[1]);
+
+	// The files can be concatenated
+	CaptureBuffer buffer(RECORD_COUNT);
+	uint32_t count = 0;
+	for (const auto& filename : filenames) {
+		count += CaptureStream::Read(filename, buffer);
+	}
+	EXPECT_EQ(RECORD_COUNT, count);
+	ExpectRecords(buffer, RECORD_COUNT);
+
+	remove_all(folder);
+}
+
+TEST(ScsiMonStreamTest, Keep)
+{
+	const path folder = CreateCaptureFolder();
+
+	CaptureStream stream((folder / "capture").string(), 1024, 1'000'000, FILE_HEADER_SIZE + 1, 0, 1);
+	ASSERT_TRUE(stream.Start(0));
+	Push(stream, 0, 2 * 65536);
+
+	// The files closed before are expired when the next file is closed
+	this_thread::sleep_for(chrono::milliseconds(1500));
+	Push(stream, 2 * 65536, 65536);
+	stream.Stop();
+
+	const vector<string>& filenames = stream.GetFilenames();
+	ASSERT_FALSE(filenames.empty());
+	EXPECT_NE((folder / "capture-000000.scm").string(), filenames[0]);
+	EXPECT_FALSE(exists(folder / "capture-000000.scm"));
+	EXPECT_FALSE(exists(folder / "capture-000001.scm"));
+	for (const auto& filename : filenames) {
+		EXPECT_TRUE(exists(filename));
+	}
+
+	// The remaining files contain the most recent records
+	CaptureBuffer buffer(RECORD_COUNT);
+	uint32_t count = 0;
+	for (const auto& filename : filenames) {
+		count += CaptureStream::Read(filename, buffer);
+	}
+	EXPECT_LE(65536U, count);
+	EXPECT_GT(2U * 65536, count);
+	ASSERT_EQ(count, buffer.GetCount());
+	EXPECT_EQ(GetRecord(3 * 65536 - 1).data, buffer.GetRecords()[count - 1].data);
+
+	remove_all(folder);
+}
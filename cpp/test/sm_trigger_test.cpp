@@ -0,0 +1,271 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+
+#include "scsimon/sm_trigger.h"
+#include "hal/bus.h"
+
+using namespace std;
+
+// Synthetic GPIO words, positive logic like the raw samples
+
+static uint32_t Data(uint8_t data)
+{
+	const array<int, 8> pins = { PIN_DT0, PIN_DT1, PIN_DT2, PIN_DT3, PIN_DT4, PIN_DT5, PIN_DT6, PIN_DT7 };
+
+	uint32_t bits = 0;
+	for (int i = 0; i < 8; i++) {
+		if (data & (1 << i)) {
+			bits |= 1 << pins[i];
+		}
+	}
+
+	return bits;
+}
+
+static uint32_t Phase(phase_t phase)
+{
+	switch (phase) {
+	case phase_t::command:
+		return (1 << PIN_BSY) | (1 << PIN_CD);
+	case phase_t::datain:
+		return (1 << PIN_BSY) | (1 << PIN_IO);
+	case phase_t::dataout:
+		return 1 << PIN_BSY;
+	case phase_t::status:
+		return (1 << PIN_BSY) | (1 << PIN_CD) | (1 << PIN_IO);
+	case phase_t::msgin:
+		return (1 << PIN_BSY) | (1 << PIN_MSG) | (1 << PIN_CD) | (1 << PIN_IO);
+	case phase_t::msgout:
+		return (1 << PIN_BSY) | (1 << PIN_MSG) | (1 << PIN_CD);
+	default:
+		return 0;
+	}
+}
+
+static uint32_t Req(phase_t phase)
+{
+	return Phase(phase) | (1 << PIN_REQ);
+}
+
+static uint32_t Handshake(phase_t phase, uint8_t data)
+{
+	return Phase(phase) | Data(data) | (1 << PIN_REQ) | (1 << PIN_ACK);
+}
+
+class TestRecorder
+{
+public:
+
+	bool operator()(uint32_t data, uint32_t delta)
+	{
+		records.push_back({ .data = data, .delta = delta });
+		return true;
+	}
+
+	vector<capture_record_t> records;
+};
+
+TEST(ScsiMonTriggerTest, Parse)
+{
+	for (const char *condition : { "rst", "id:0", "id:7", "opcode:18", "opcode:0x12", "opcode:255",
+			"phases:command", "phases:msgout,command,datain,dataout,status,msgin" }) {
+		Trigger trigger;
+		EXPECT_EQ("", trigger.Parse(condition)) << condition;
+		EXPECT_EQ(condition, trigger.GetDescription());
+	}
+
+	for (const char *condition : { "", "reset", "rst:1", "id", "id:", "id:8", "id:x", "opcode", "opcode:",
+			"opcode:256", "opcode:-1", "opcode:0x12x", "opcode:x", "phases", "phases:",
+			"phases:command,,status", "phases:selection", "phases:bus free",
+			"phases:command,command,command,command,command,command,command,command,command" }) {
+		Trigger trigger;
+		EXPECT_NE("", trigger.Parse(condition)) << condition;
+	}
+
+	Trigger trigger;
+	EXPECT_EQ("", trigger.Parse("phases:command,command,command,command,command,command,command,command"));
+}
+
+TEST(ScsiMonTriggerTest, UpdateRst)
+{
+	Trigger trigger;
+	trigger.Parse("rst");
+
+	EXPECT_FALSE(trigger.Update(0));
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::command, 0xff)));
+	EXPECT_TRUE(trigger.Update(1 << PIN_RST));
+	EXPECT_TRUE(trigger.Update(Phase(phase_t::datain) | (1 << PIN_RST)));
+}
+
+TEST(ScsiMonTriggerTest, UpdateId)
+{
+	Trigger trigger;
+	trigger.Parse("id:3");
+
+	// BSY must have been released
+	EXPECT_FALSE(trigger.Update((1 << PIN_SEL) | (1 << PIN_BSY) | Data(0x08)));
+	EXPECT_FALSE(trigger.Update((1 << PIN_SEL) | Data(0x04)));
+	EXPECT_FALSE(trigger.Update(Data(0x08)));
+	EXPECT_TRUE(trigger.Update((1 << PIN_SEL) | Data(0x08)));
+	// The initiator ID is also on the bus
+	EXPECT_TRUE(trigger.Update((1 << PIN_SEL) | Data(0x88)));
+}
+
+TEST(ScsiMonTriggerTest, UpdateOpcode)
+{
+	Trigger trigger;
+	trigger.Parse("opcode:0x12");
+
+	// Without a previous byte in a different phase this is not the first CDB byte
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::command, 0x12)));
+
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::msgout, 0x80)));
+	// Only the samples with REQ and ACK asserted are evaluated
+	EXPECT_FALSE(trigger.Update(Req(phase_t::command) | Data(0x00)));
+	EXPECT_FALSE(trigger.Update(Phase(phase_t::command) | Data(0x12) | (1 << PIN_ACK)));
+	EXPECT_TRUE(trigger.Update(Handshake(phase_t::command, 0x12)));
+
+	// The opcode value in another CDB byte does not fire
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::command, 0x12)));
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::msgout, 0x80)));
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::command, 0x00)));
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::command, 0x12)));
+
+	// Any number of bytes in other phases may precede the opcode
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::datain, 0x12)));
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::status, 0x00)));
+	EXPECT_FALSE(trigger.Update(Handshake(phase_t::msgin, 0x00)));
+	EXPECT_TRUE(trigger.Update(Handshake(phase_t::command, 0x12)));
+}
+
+TEST(ScsiMonTriggerTest, UpdatePhases)
+{
+	Trigger trigger;
+	trigger.Parse("phases:command,datain,status");
+
+	// Repeated samples of the current phase do not reset the sequence
+	EXPECT_FALSE(trigger.Update(Req(phase_t::command)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::command)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::datain)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::datain)));
+	EXPECT_TRUE(trigger.Update(Req(phase_t::status)));
+
+	// A phase that is not part of the sequence resets it
+	EXPECT_FALSE(trigger.Update(Req(phase_t::command)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::datain)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::msgin)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::status)));
+
+	// The first phase restarts the sequence
+	EXPECT_FALSE(trigger.Update(Req(phase_t::command)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::datain)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::command)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::datain)));
+	EXPECT_TRUE(trigger.Update(Req(phase_t::status)));
+
+	// Only the samples with REQ asserted are evaluated
+	EXPECT_FALSE(trigger.Update(Req(phase_t::command)));
+	EXPECT_FALSE(trigger.Update(Phase(phase_t::msgin)));
+	EXPECT_FALSE(trigger.Update(Req(phase_t::datain)));
+	EXPECT_FALSE(trigger.Update(Phase(phase_t::msgout)));
+	EXPECT_TRUE(trigger.Update(Req(phase_t::status)));
+}
+
+TEST(ScsiMonTriggerTest, TriggerRecorder)
+{
+	vector<Trigger> triggers(2);
+	triggers[0].Parse("id:7");
+	triggers[1].Parse("rst");
+	TestRecorder recorder;
+
+	// The history only keeps the most recent changes
+	TriggerRecorder trigger_recorder(triggers, 3, 3, recorder);
+	for (uint32_t i = 0; i < 10; i++) {
+		EXPECT_TRUE(trigger_recorder(Data(static_cast<uint8_t>(i)), i + 1));
+	}
+	EXPECT_TRUE(recorder.records.empty());
+	EXPECT_EQ(-1, trigger_recorder.GetTrigger());
+
+	EXPECT_TRUE(trigger_recorder(1 << PIN_RST, 11));
+	EXPECT_EQ(1, trigger_recorder.GetTrigger());
+	ASSERT_EQ(3U, recorder.records.size());
+	EXPECT_EQ(Data(8), recorder.records[0].data);
+	EXPECT_EQ(0U, recorder.records[0].delta) << "The first record is the start of the capture";
+	EXPECT_EQ(Data(9), recorder.records[1].data);
+	EXPECT_EQ(10U, recorder.records[1].delta);
+	EXPECT_EQ(1U << PIN_RST, recorder.records[2].data);
+	EXPECT_EQ(11U, recorder.records[2].delta);
+
+	// The window includes the sample that fired the trigger
+	EXPECT_TRUE(trigger_recorder(0, 12));
+	EXPECT_FALSE(trigger_recorder((1 << PIN_SEL) | Data(0x80), 13));
+	ASSERT_EQ(5U, recorder.records.size());
+	EXPECT_EQ(13U, recorder.records[4].delta);
+	EXPECT_EQ(1, trigger_recorder.GetTrigger()) << "Only the first trigger counts";
+
+	trigger_recorder.Finish();
+	EXPECT_EQ(5U, recorder.records.size());
+}
+
+TEST(ScsiMonTriggerTest, TriggerRecorderWindow)
+{
+	vector<Trigger> triggers(1);
+	triggers[0].Parse("rst");
+
+	// A window size of 1 only contains the sample that fired the trigger
+	TestRecorder recorder1;
+	TriggerRecorder trigger_recorder1(triggers, 2, 1, recorder1);
+	EXPECT_TRUE(trigger_recorder1(0, 1));
+	EXPECT_FALSE(trigger_recorder1(1 << PIN_RST, 2));
+	EXPECT_EQ(0, trigger_recorder1.GetTrigger());
+	ASSERT_EQ(2U, recorder1.records.size());
+	EXPECT_EQ(1U << PIN_RST, recorder1.records[1].data);
+
+	// Without a window size recording does not stop
+	TestRecorder recorder2;
+	TriggerRecorder trigger_recorder2(triggers, 0, 0, recorder2);
+	EXPECT_TRUE(trigger_recorder2(0, 1));
+	EXPECT_TRUE(trigger_recorder2(1 << PIN_RST, 2));
+	for (uint32_t i = 0; i < 100; i++) {
+		EXPECT_TRUE(trigger_recorder2(i, 1));
+	}
+	EXPECT_EQ(101U, recorder2.records.size());
+}
+
+TEST(ScsiMonTriggerTest, TriggerRecorderFinish)
+{
+	vector<Trigger> triggers(1);
+	triggers[0].Parse("rst");
+	TestRecorder recorder;
+
+	// Without a trigger the most recent changes are recorded
+	TriggerRecorder trigger_recorder(triggers, 4, 10, recorder);
+	for (uint32_t i = 0; i < 6; i++) {
+		EXPECT_TRUE(trigger_recorder(Data(static_cast<uint8_t>(i)), i + 1));
+	}
+	EXPECT_TRUE(recorder.records.empty());
+
+	trigger_recorder.Finish();
+	EXPECT_EQ(-1, trigger_recorder.GetTrigger());
+	ASSERT_EQ(4U, recorder.records.size());
+	EXPECT_EQ(Data(2), recorder.records[0].data);
+	EXPECT_EQ(0U, recorder.records[0].delta);
+	EXPECT_EQ(Data(5), recorder.records[3].data);
+	EXPECT_EQ(6U, recorder.records[3].delta);
+
+	// Less samples than the history size
+	TestRecorder recorder2;
+	TriggerRecorder trigger_recorder2(triggers, 4, 10, recorder2);
+	EXPECT_TRUE(trigger_recorder2(Data(1), 1));
+	trigger_recorder2.Finish();
+	ASSERT_EQ(1U, recorder2.records.size());
+	EXPECT_EQ(0U, recorder2.records[0].delta);
+}
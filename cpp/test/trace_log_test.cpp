@@ -0,0 +1,81 @@
+//---------------------------------------------------------------------------
+//
+// SCSI Target Emulator PiSCSI
+// for Raspberry Pi
+//
+// Copyright (C) 2023 Uwe Seimet
+//
+//---------------------------------------------------------------------------
+
+#include "mocks.h"
+#include "devices/trace_log.h"
+
+TEST(TraceLogTest, Format)
+{
+	TraceLog::trace_record record = { .value1 = 0x28, .timestamp = 1234, .value2 = 0, .id = 1, .lun = -1,
+			.event = TraceLog::trace_event::command, .length = 0, .data = {} };
+	EXPECT_EQ("(ID 1) - [1234 us] Command: $28", TraceLog::Format(record));
+
+	record.lun = 0;
+	record.event = TraceLog::trace_event::cdb;
+	record.length = 6;
+	record.data = { 0x08, 0x00, 0x00, 0x01, 0x0a, 0x00 };
+	EXPECT_EQ("(ID:LUN 1:0) - [1234 us] CDB=$080000010a00", TraceLog::Format(record));
+
+	record.event = TraceLog::trace_event::send;
+	record.value1 = 512;
+	record.value2 = 1024;
+	EXPECT_EQ("(ID:LUN 1:0) - [1234 us] Sending data, offset: 512, length: 1024", TraceLog::Format(record));
+
+	record.event = TraceLog::trace_event::receive;
+	EXPECT_EQ("(ID:LUN 1:0) - [1234 us] Receiving data, transfer length: 512 byte(s)", TraceLog::Format(record));
+
+	record.event = TraceLog::trace_event::status;
+	record.value1 = 0x02;
+	EXPECT_EQ("(ID:LUN 1:0) - [1234 us] Status phase, status is $02", TraceLog::Format(record));
+
+	record.event = TraceLog::trace_event::block;
+	record.value1 = 0x123456789;
+	record.value2 = 16;
+	EXPECT_EQ("(ID:LUN 1:0) - [1234 us] READ/WRITE/VERIFY/SEEK, start block: $123456789, blocks: 16",
+			TraceLog::Format(record));
+}
+
+TEST(TraceLogTest, StartStop)
+{
+	EXPECT_FALSE(TraceLog::IsRunning());
+
+	TraceLog::Start();
+	EXPECT_TRUE(TraceLog::IsRunning());
+
+	const array<uint8_t, 6> cdb = {};
+	for (int i = 0; i < 100; i++) {
+		TraceLog::Record(TraceLog::trace_event::cdb, 0, 0, 0, 0, cdb);
+	}
+
+	TraceLog::Stop();
+	EXPECT_FALSE(TraceLog::IsRunning());
+	EXPECT_EQ(0, TraceLog::GetDropped());
+}
+
+TEST(TraceLogTest, Dropped)
+{
+	// Nothing is consumed before the background thread is stopped, the ring is guaranteed to overflow
+	MockTraceLog::SetConsuming(false);
+	TraceLog::Start();
+
+	const array<uint8_t, 6> cdb = {};
+	for (int i = 0; i < 10000; i++) {
+		TraceLog::Record(TraceLog::trace_event::cdb, 0, 0, 0, 0, cdb);
+	}
+	EXPECT_EQ(10000 - 4096, TraceLog::GetDropped());
+
+	TraceLog::Stop();
+	MockTraceLog::SetConsuming(true);
+	EXPECT_EQ(10000 - 4096, TraceLog::GetDropped());
+
+	// Dropped records are only counted for the current session
+	TraceLog::Start();
+	TraceLog::Stop();
+	EXPECT_EQ(0, TraceLog::GetDropped());
+}